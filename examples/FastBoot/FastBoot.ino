@@ -0,0 +1,116 @@
+/****************************************************************************************************************************
+  FastBoot.ino - Fast boot with the DHCP lease and SPI clock cached in NVS, per-phase boot timing over Serial
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// The first power-up is a normal one: the SPI clock is auto-tuned and DHCP runs, both get cached in NVS. From the
+// next power-up on the tuned clock is taken as is and, as soon as the link is up, DHCP asks the server to confirm the
+// cached lease (one REQUEST / ACK) instead of discovering one. One JSON object per boot shows where the time went,
+// compare the first boot with the following ones. Set FAST_BOOT to false for the plain begin() timing.
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       1
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+#define FAST_BOOT           true
+
+// > SPI_CLOCK_MHZ => auto-tune on the first boot, cached afterwards
+#define SPI_CLOCK_MAX_MHZ   40
+
+// how long to wait for DHCP to confirm the lease before printing
+#define DHCP_WAIT_MS        10000
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart FastBoot on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  ESP32_W5500_Config config;
+
+  config.misoGpio       = MISO_GPIO;
+  config.mosiGpio       = MOSI_GPIO;
+  config.sclkGpio       = SCK_GPIO;
+  config.csGpio         = CS_GPIO;
+  config.intGpio        = INT_GPIO;
+  config.spiClockMHz    = SPI_CLOCK_MHZ;
+  config.spiClockMaxMHz = SPI_CLOCK_MAX_MHZ;
+  config.spiHost        = ETH_SPI_HOST;
+  config.fastBoot       = FAST_BOOT;
+
+  ETH.begin(config);
+
+  ESP32_W5500_waitForConnect();
+
+  Serial.print(F("IP address: "));
+  Serial.println(ETH.localIP());
+
+  ///////////////////////////////////
+
+  uint32_t startMs = millis();
+
+  while (!ETH.getBootTiming().dhcpUs && (millis() - startMs < DHCP_WAIT_MS))
+  {
+    delay(10);
+  }
+
+  ESP32_W5500_BootTiming timing = ETH.getBootTiming();
+
+  Serial.printf("{\"fast_boot\":%s,\"spi_clock_reused\":%s,\"lease_reused\":%s,\"spi_clock_hz\":%u,",
+                FAST_BOOT ? "true" : "false", timing.spiClockReused ? "true" : "false",
+                timing.leaseReused ? "true" : "false", ETH.getSPIClockHz());
+  Serial.printf("\"tcpip_init_us\":%u,\"spi_init_us\":%u,\"driver_install_us\":%u,\"start_us\":%u,",
+                timing.tcpipInitUs, timing.spiInitUs, timing.driverInstallUs, timing.startUs);
+  Serial.printf("\"chip_reset_us\":%u,\"chip_setup_us\":%u,\"begin_us\":%u,",
+                timing.chipResetUs, timing.chipSetupUs, timing.beginUs);
+  Serial.printf("\"link_up_us\":%u,\"ip_us\":%u,\"dhcp_us\":%u}\n", timing.linkUpUs, timing.ipUs, timing.dhcpUs);
+}
+
+void loop()
+{
+  delay(1000);
+}
@@ -0,0 +1,240 @@
+/****************************************************************************************************************************
+  MACBenchmark.ino - W5500 MAC driver hot path microbenchmark for ESP32_W5500, JSON results over Serial
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Transmits synthetic raw Ethernet frames (EtherType 0x88B5, local experimental) straight through the MAC driver,
+// then listens for RX_DURATION_MS. Run it on an isolated bench network: the frames are flooded by the switch.
+// For the RX case, point a traffic source at the board, e.g. a second board running this sketch, or `ping -f`.
+// Every case prints one JSON object per line, compare them between library versions to catch regressions.
+// extras/host_sim runs the same cases on Linux against a simulated W5500: `make bench` there.
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       1
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+#define TX_DURATION_MS      3000
+#define RX_DURATION_MS      5000
+#define BURST_FRAMES        32
+#define BURST_PAUSE_MS      10
+
+#define ETH_TYPE_BENCH      0x88B5
+
+uint8_t frame[1514];
+
+//////////////////////////////////////////////////////////
+
+// Frame size of the n-th frame of a mix
+typedef uint16_t (*FrameMix)(uint32_t n);
+
+uint16_t mix64(uint32_t n)
+{
+  return 64;
+}
+
+uint16_t mix1514(uint32_t n)
+{
+  return 1514;
+}
+
+// Simple IMIX, 7 : 4 : 1 of 64, 594 and 1514 byte frames
+uint16_t mixIMIX(uint32_t n)
+{
+  n %= 12;
+
+  return (n < 7) ? 64 : ((n < 11) ? 594 : 1514);
+}
+
+// Odd size, so successive frames straddle the end of the 16KB TX ring at ever changing offsets
+uint16_t mixWrap(uint32_t n)
+{
+  return 997;
+}
+
+//////////////////////////////////////////////////////////
+
+void printResult(const char *name, uint32_t elapsedMs, uint32_t attempts, const ESP32_W5500_Stats &stats)
+{
+  uint32_t frames = stats.tx_frames + stats.rx_frames;
+  float    perFrame = frames ? 1.0f / frames : 0.0f;
+
+  Serial.printf("{\"case\":\"%s\",\"version\":\"%s\",\"spi_clock_mhz\":%d,\"duration_ms\":%u,", name,
+                WEBSERVER_ESP32_W5500_VERSION, SPI_CLOCK_MHZ, elapsedMs);
+  Serial.printf("\"tx_attempts\":%u,\"tx_frames\":%u,\"tx_drops\":%u,\"rx_frames\":%u,\"rx_drops\":%u,",
+                attempts, stats.tx_frames, stats.tx_drops_no_mem, stats.rx_frames, stats.rx_drops_no_mem);
+  Serial.printf("\"frames_per_s\":%.1f,\"bytes_per_s\":%.1f,", elapsedMs ? frames * 1000.0f / elapsedMs : 0.0f,
+                elapsedMs ? (stats.tx_bytes + stats.rx_bytes) * 1000.0f / elapsedMs : 0.0f);
+  Serial.printf("\"spi_bytes_per_frame\":%.1f,\"spi_transactions_per_frame\":%.2f,\"spi_queued_per_frame\":%.2f,",
+                stats.spi_bytes * perFrame, stats.spi_transactions * perFrame, stats.spi_queued_transactions * perFrame);
+  Serial.printf("\"lock_acquisitions_per_frame\":%.2f,\"lock_hold_max_us\":%u,\"heap_allocs_per_frame\":%.3f,",
+                stats.spi_lock_acquisitions * perFrame, stats.spi_lock_hold_max_us, stats.rx_pool_misses * perFrame);
+  Serial.printf("\"send_max_us\":%u,\"recv_max_us\":%u,\"rx_wakeups\":%u,\"rx_poll_rounds\":%u,",
+                stats.cmd_latency[ETH_W5500_CMD_SEND].max_us, stats.cmd_latency[ETH_W5500_CMD_RECV].max_us,
+                stats.rx_wakeups, stats.rx_poll_rounds);
+  // frames sent from segments skipped the flattening copy
+  Serial.printf("\"tx_segmented_frames\":%u,\"tx_copied_frames\":%u,", stats.tx_segmented_frames,
+                stats.tx_frames - stats.tx_segmented_frames);
+  Serial.printf("\"rx_copied_per_byte\":%.3f,",
+                stats.rx_bytes ? (float) stats.rx_bytes_copied / stats.rx_bytes : 0.0f);
+  // TX priority classes: frames and worst transmit-to-SEND_OK latency per class
+  Serial.printf("\"tx_strict\":[%u,%u],\"tx_normal\":[%u,%u],\"tx_bulk\":[%u,%u],",
+                stats.tx_class[ETH_W5500_TX_STRICT].frames, stats.tx_class[ETH_W5500_TX_STRICT].max_us,
+                stats.tx_class[ETH_W5500_TX_NORMAL].frames, stats.tx_class[ETH_W5500_TX_NORMAL].max_us,
+                stats.tx_class[ETH_W5500_TX_BULK].frames, stats.tx_class[ETH_W5500_TX_BULK].max_us);
+  // with pipelined RX, frames whose payload read also fetched the next header
+  Serial.printf("\"rx_pipelined_frames\":%u}\n", stats.rx_pipelined_frames);
+}
+
+//////////////////////////////////////////////////////////
+
+void runTx(const char *name, FrameMix mix, bool burst)
+{
+  esp_eth_handle_t handle = ETH.getEthHandle();
+  uint32_t attempts = 0;
+
+  ETH.resetStats();
+
+  uint32_t startMs = millis();
+
+  while (millis() - startMs < TX_DURATION_MS)
+  {
+    esp_eth_transmit(handle, frame, mix(attempts++));
+
+    if (burst && (attempts % BURST_FRAMES == 0))
+    {
+      delay(BURST_PAUSE_MS);
+    }
+  }
+
+  uint32_t elapsedMs = millis() - startMs;
+
+  printResult(name, elapsedMs, attempts, ETH.getStats());
+}
+
+//////////////////////////////////////////////////////////
+
+// Same frame as tx_1514, but handed over as header + two payload pieces the way lwIP passes a pbuf chain
+void runTxSegmented()
+{
+  esp_eth_mac_t *mac = ETH.getEthMac();
+  eth_w5500_tx_segment_t segments[3] =
+  {
+    { frame, 14 },
+    { frame + 14, 500 },
+    { frame + 514, 1000 }
+  };
+  uint32_t attempts = 0;
+
+  ETH.resetStats();
+
+  uint32_t startMs = millis();
+
+  while (millis() - startMs < TX_DURATION_MS)
+  {
+    esp_eth_mac_w5500_transmit_segments(mac, segments, 3);
+    attempts++;
+  }
+
+  uint32_t elapsedMs = millis() - startMs;
+
+  printResult("tx_sg_1514", elapsedMs, attempts, ETH.getStats());
+}
+
+//////////////////////////////////////////////////////////
+
+// Same RX window with the configured RX mode, then with pipelined RX, to show what the chained reads save
+void runRx(const char *name, bool pipeline)
+{
+  esp_eth_mac_w5500_set_rx_pipeline(ETH.getEthMac(), pipeline);
+  ETH.resetStats();
+
+  uint32_t startMs = millis();
+
+  delay(RX_DURATION_MS);
+
+  printResult(name, millis() - startMs, 0, ETH.getStats());
+
+  esp_eth_mac_w5500_set_rx_pipeline(ETH.getEthMac(), ETH_W5500_RX_PIPELINE);
+}
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart MACBenchmark on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  ETH.begin( MISO_GPIO, MOSI_GPIO, SCK_GPIO, CS_GPIO, INT_GPIO, SPI_CLOCK_MHZ, ETH_SPI_HOST );
+
+  ESP32_W5500_waitForConnect();
+
+  ///////////////////////////////////
+
+  // broadcast destination, our own source address, then a counting payload
+  memset(frame, 0xFF, 6);
+  ETH.macAddress(frame + 6);
+  frame[12] = ETH_TYPE_BENCH >> 8;
+  frame[13] = ETH_TYPE_BENCH & 0xFF;
+
+  for (int i = 14; i < (int) sizeof(frame); i++)
+  {
+    frame[i] = i & 0xFF;
+  }
+}
+
+void loop()
+{
+  runTx("tx_64", mix64, false);
+  runTx("tx_imix", mixIMIX, false);
+  runTx("tx_1514", mix1514, false);
+  runTx("tx_wrap", mixWrap, false);
+  runTx("tx_burst_1514", mix1514, true);
+  runTxSegmented();
+  runRx("rx", false);
+  runRx("rx_pipelined", true);
+
+  delay(5000);
+}
@@ -0,0 +1,215 @@
+/****************************************************************************************************************************
+  MultiW5500Benchmark.ino - Two W5500 chips as two independent netifs, raw TX throughput alone and side by side
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// The first W5500 is the usual ETH instance, the second one ETH2 sits on its own SPI host (HSPI pins below), or on
+// the same host with its own CS pin: set ETH2_SPI_HOST to ETH_SPI_HOST, the bus pins of ETH2 are then ignored.
+// Each chip floods 1514 byte raw frames (EtherType 0x88B5, local experimental) for TX_DURATION_MS, first alone, then
+// both at once from one task per chip. Run it on isolated bench segments, every case prints one JSON object per line.
+// On separate SPI hosts the "both" aggregate should come close to the sum of the two "alone" cases.
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       1
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+// Second W5500
+#define ETH2_SPI_HOST       SPI2_HOST
+#define ETH2_INT_GPIO       27
+#define ETH2_MISO_GPIO      12
+#define ETH2_MOSI_GPIO      13
+#define ETH2_SCK_GPIO       14
+#define ETH2_CS_GPIO        15
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+#define TX_DURATION_MS      3000
+#define FRAME_SIZE          1514
+
+#define ETH_TYPE_BENCH      0x88B5
+
+ESP32_W5500 ETH2;
+
+struct Lane
+{
+  ESP32_W5500 *eth;
+  uint8_t frame[FRAME_SIZE];
+  uint32_t attempts;
+  uint32_t elapsedMs;
+  ESP32_W5500_Stats stats;
+  TaskHandle_t waiter;
+};
+
+Lane lanes[2];
+float aloneFramesPerSec[2];
+
+//////////////////////////////////////////////////////////
+
+void prepareLane(Lane &lane, ESP32_W5500 &eth)
+{
+  lane.eth = &eth;
+
+  // broadcast destination, the chip's own source address, then a counting payload
+  memset(lane.frame, 0xFF, 6);
+  eth.macAddress(lane.frame + 6);
+  lane.frame[12] = ETH_TYPE_BENCH >> 8;
+  lane.frame[13] = ETH_TYPE_BENCH & 0xFF;
+
+  for (int i = 14; i < FRAME_SIZE; i++)
+  {
+    lane.frame[i] = i & 0xFF;
+  }
+}
+
+//////////////////////////////////////////////////////////
+
+void floodLane(Lane &lane)
+{
+  esp_eth_handle_t handle = lane.eth->getEthHandle();
+
+  lane.attempts = 0;
+  lane.eth->resetStats();
+
+  uint32_t startMs = millis();
+
+  while (millis() - startMs < TX_DURATION_MS)
+  {
+    esp_eth_transmit(handle, lane.frame, FRAME_SIZE);
+    lane.attempts++;
+  }
+
+  lane.elapsedMs = millis() - startMs;
+  lane.stats = lane.eth->getStats();
+}
+
+//////////////////////////////////////////////////////////
+
+void floodTask(void *arg)
+{
+  Lane *lane = (Lane *) arg;
+
+  floodLane(*lane);
+  xTaskNotifyGive(lane->waiter);
+  vTaskDelete(NULL);
+}
+
+//////////////////////////////////////////////////////////
+
+float framesPerSec(const Lane &lane)
+{
+  return lane.elapsedMs ? lane.stats.tx_frames * 1000.0f / lane.elapsedMs : 0.0f;
+}
+
+void printLane(const char *name, int index, const Lane &lane)
+{
+  Serial.printf("{\"case\":\"%s\",\"chip\":%d,\"spi_clock_hz\":%u,\"duration_ms\":%u,\"tx_attempts\":%u,", name, index,
+                lane.eth->getSPIClockHz(), lane.elapsedMs, lane.attempts);
+  Serial.printf("\"tx_frames\":%u,\"tx_drops\":%u,\"frames_per_s\":%.1f,\"bytes_per_s\":%.1f,",
+                lane.stats.tx_frames, lane.stats.tx_drops_no_mem, framesPerSec(lane),
+                lane.elapsedMs ? lane.stats.tx_bytes * 1000.0f / lane.elapsedMs : 0.0f);
+  Serial.printf("\"lock_hold_max_us\":%u}\n", lane.stats.spi_lock_hold_max_us);
+}
+
+//////////////////////////////////////////////////////////
+
+void runAlone(int index)
+{
+  floodLane(lanes[index]);
+  aloneFramesPerSec[index] = framesPerSec(lanes[index]);
+  printLane("alone", index, lanes[index]);
+}
+
+void runBoth()
+{
+  // one task per chip, on different cores, so neither waits for the other's SPI transfers
+  for (int i = 0; i < 2; i++)
+  {
+    lanes[i].waiter = xTaskGetCurrentTaskHandle();
+    xTaskCreatePinnedToCore(floodTask, "flood", 4096, &lanes[i], 1, NULL, i);
+  }
+
+  ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+  ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+  printLane("both", 0, lanes[0]);
+  printLane("both", 1, lanes[1]);
+
+  Serial.printf("{\"case\":\"aggregate\",\"alone_sum_frames_per_s\":%.1f,\"both_frames_per_s\":%.1f}\n",
+                aloneFramesPerSec[0] + aloneFramesPerSec[1], framesPerSec(lanes[0]) + framesPerSec(lanes[1]));
+}
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart MultiW5500Benchmark on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  ETH.begin( MISO_GPIO, MOSI_GPIO, SCK_GPIO, CS_GPIO, INT_GPIO, SPI_CLOCK_MHZ, ETH_SPI_HOST );
+
+  // its own netif (eth1), a MAC derived from the built-in one and its own RX task / SPI lock
+  ETH2.begin( ETH2_MISO_GPIO, ETH2_MOSI_GPIO, ETH2_SCK_GPIO, ETH2_CS_GPIO, ETH2_INT_GPIO, SPI_CLOCK_MHZ,
+              ETH2_SPI_HOST );
+
+  ESP32_W5500_waitForConnect();
+
+  ///////////////////////////////////
+
+  prepareLane(lanes[0], ETH);
+  prepareLane(lanes[1], ETH2);
+
+  Serial.print(F("ETH  MAC: "));
+  Serial.println(ETH.macAddress());
+  Serial.print(F("ETH2 MAC: "));
+  Serial.println(ETH2.macAddress());
+}
+
+void loop()
+{
+  runAlone(0);
+  runAlone(1);
+  runBoth();
+
+  delay(5000);
+}
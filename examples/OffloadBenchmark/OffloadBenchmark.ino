@@ -0,0 +1,197 @@
+/****************************************************************************************************************************
+  OffloadBenchmark.ino - CPU cost per MB of a TCP upload through lwIP vs. a W5500 hardware socket (hybrid mode)
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Start a TCP sink on the host first, e.g. `iperf -s -p 5001` or `nc -lk 5001 > /dev/null`
+// The same upload runs twice: with WiFiClient (lwIP on the ESP32, MACRAW frames over SPI), then with
+// ESP32_W5500_HwClient (the W5500's own TCP engine, only payload over SPI). Every case prints one JSON object per line,
+// cpu_ms_per_mb is the busy CPU time both cores spent per MB sent.
+// Hybrid mode leaves 8 KB TX / RX to MACRAW, the rest is split between OFFLOAD_SOCKETS hardware sockets.
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       1
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+// Select the IP address of the TCP sink according to your local network
+IPAddress sinkIP(192, 168, 2, 30);
+uint16_t  sinkPort          = 5001;
+
+#define TEST_DURATION_MS    10000
+#define CHUNK_SIZE          2048
+#define OFFLOAD_SOCKETS     1         // one hardware socket gets all 8 KB left over
+
+uint8_t chunk[CHUNK_SIZE];
+
+//////////////////////////////////////////////////////////
+
+// One lowest priority task per core counts while the core has nothing better to do
+volatile uint32_t idleCount[2] = { 0, 0 };
+
+void idleCounter(void *arg)
+{
+  volatile uint32_t *counter = (volatile uint32_t *) arg;
+
+  while (true)
+  {
+    (*counter)++;
+  }
+}
+
+uint32_t idleTotal()
+{
+  return idleCount[0] + idleCount[1];
+}
+
+uint32_t idleCalibration = 0;
+
+void calibrateIdle()
+{
+  uint32_t start = idleTotal();
+
+  delay(1000);
+
+  idleCalibration = idleTotal() - start;
+}
+
+//////////////////////////////////////////////////////////
+
+void runUpload(const char *name, Client &client)
+{
+  if (!client.connect(sinkIP, sinkPort))
+  {
+    Serial.printf("{\"case\":\"%s\",\"error\":\"connect failed\"}\n", name);
+    return;
+  }
+
+  ETH.resetStats();
+
+  uint64_t sent       = 0;
+  uint32_t idleStart  = idleTotal();
+  uint32_t startMs    = millis();
+
+  while ( client.connected() && (millis() - startMs < TEST_DURATION_MS) )
+  {
+    size_t written = client.write(chunk, CHUNK_SIZE);
+
+    if (written == 0)
+    {
+      delay(1);
+    }
+
+    sent += written;
+  }
+
+  uint32_t elapsedMs  = millis() - startMs;
+  uint32_t idleDelta  = idleTotal() - idleStart;
+  ESP32_W5500_Stats stats = ETH.getStats();
+
+  client.stop();
+
+  float cpuLoad = 100.0f;
+
+  if (idleCalibration)
+  {
+    cpuLoad = 100.0f * (1.0f - ((float) idleDelta * 1000.0f / elapsedMs) / idleCalibration);
+  }
+
+  // two cores: a fully busy second equals 2000 ms of CPU time
+  float mb       = sent / (1024.0f * 1024.0f);
+  float cpuMs    = cpuLoad / 100.0f * 2.0f * elapsedMs;
+
+  Serial.printf("{\"case\":\"%s\",\"duration_ms\":%u,\"bytes\":%llu,\"kbit_per_s\":%.1f,\"cpu_load\":%.1f,",
+                name, elapsedMs, sent, elapsedMs ? (sent * 8.0f) / elapsedMs : 0.0f, cpuLoad);
+  Serial.printf("\"cpu_ms_per_mb\":%.1f,\"macraw_tx_frames\":%u,\"offload_tx_bytes\":%u}\n",
+                (mb > 0) ? cpuMs / mb : 0.0f, stats.tx_frames, stats.offload_tx_bytes);
+}
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart OffloadBenchmark on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  for (int i = 0; i < CHUNK_SIZE; i++)
+  {
+    chunk[i] = i & 0xFF;
+  }
+
+  xTaskCreatePinnedToCore(idleCounter, "idle0", 1024, (void *) &idleCount[0], 0, NULL, 0);
+  xTaskCreatePinnedToCore(idleCounter, "idle1", 1024, (void *) &idleCount[1], 0, NULL, 1);
+
+  // Baseline before the network is up
+  calibrateIdle();
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  ESP32_W5500_Config config;
+
+  config.misoGpio       = MISO_GPIO;
+  config.mosiGpio       = MOSI_GPIO;
+  config.sclkGpio       = SCK_GPIO;
+  config.csGpio         = CS_GPIO;
+  config.intGpio        = INT_GPIO;
+  config.spiClockMHz    = SPI_CLOCK_MHZ;
+  config.spiHost        = ETH_SPI_HOST;
+  config.offloadSockets = OFFLOAD_SOCKETS;
+
+  ETH.begin(config);
+
+  ESP32_W5500_waitForConnect();
+
+  ///////////////////////////////////
+}
+
+void loop()
+{
+  WiFiClient lwipClient;
+  ESP32_W5500_HwClient hwClient;
+
+  runUpload("lwip", lwipClient);
+  delay(2000);
+  runUpload("offload", hwClient);
+
+  delay(5000);
+}
@@ -0,0 +1,141 @@
+/****************************************************************************************************************************
+  RawEtherTypeBenchmark.ino - Wire to callback latency of raw EtherType frames, delivered by the driver without lwIP
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Frames of EtherType 0x88B5 (local experimental) go straight from the driver's receive buffer to onRawFrame(), which
+// echoes them back with sendRaw(). Send some from a Linux host on the same segment, as root, e.g. with Python:
+//
+//   import socket, time
+//   s = socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(0x88B5)); s.bind(("eth0", 0x88B5))
+//   frame = bytes.fromhex("<ESP32 MAC>") + s.getsockname()[4] + b"\x88\xb5" + bytes(46)
+//   t = time.perf_counter(); s.send(frame); s.recv(1514); print((time.perf_counter() - t) * 1e6, "us")
+//
+// Every REPORT_MS one JSON object per line: frames seen, and the latency from the W5500 RX interrupt to the callback
+// (average and max over the report period). The host's round trip adds both wires, its own stack and the echo's TX.
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       1
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+#define BENCH_ETHERTYPE     0x88B5
+#define REPORT_MS           5000
+#define ECHO_FRAMES         true
+
+uint8_t ownMac[6];
+volatile uint32_t echoFailures = 0;
+
+//////////////////////////////////////////////////////////
+
+// Runs in the w5500 task and must not block: the frame is only valid until we return, so the reply is built in place.
+// sendRaw() doesn't wait for TX space from here, an echo which finds the TX queue full is counted as a failure
+void onRawFrame(uint8_t *frame, uint32_t length, void *arg)
+{
+  if (!ECHO_FRAMES)
+  {
+    return;
+  }
+
+  // back to the sender, from us
+  memcpy(frame, frame + 6, 6);
+  memcpy(frame + 6, ownMac, 6);
+
+  if (!ETH.sendRaw(frame, length))
+  {
+    echoFailures++;
+  }
+}
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart RawEtherTypeBenchmark on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  ESP32_W5500_Config config;
+
+  config.misoGpio    = MISO_GPIO;
+  config.mosiGpio    = MOSI_GPIO;
+  config.sclkGpio    = SCK_GPIO;
+  config.csGpio      = CS_GPIO;
+  config.intGpio     = INT_GPIO;
+  config.spiClockMHz = SPI_CLOCK_MHZ;
+  config.spiHost     = ETH_SPI_HOST;
+
+  ETH.begin(config);
+
+  ESP32_W5500_waitForConnect();
+
+  ///////////////////////////////////
+
+  ETH.macAddress(ownMac);
+
+  if (!ETH.registerEtherType(BENCH_ETHERTYPE, onRawFrame))
+  {
+    Serial.println(F("Register EtherType failed"));
+  }
+
+  Serial.print(F("Send EtherType 0x88B5 frames to "));
+  Serial.println(ETH.macAddress());
+
+  ETH.resetStats();
+}
+
+void loop()
+{
+  delay(REPORT_MS);
+
+  ESP32_W5500_Stats stats = ETH.getStats();
+
+  ETH.resetStats();
+
+  uint32_t avgUs = stats.raw_rx_frames ? (uint32_t) (stats.raw_rx_latency_total_us / stats.raw_rx_frames) : 0;
+
+  Serial.printf("{\"raw_rx_frames\":%u,\"raw_rx_bytes\":%u,\"latency_avg_us\":%u,\"latency_max_us\":%u,",
+                stats.raw_rx_frames, stats.raw_rx_bytes, avgUs, stats.raw_rx_latency_max_us);
+  Serial.printf("\"stack_rx_frames\":%u,\"echo_failures\":%u}\n", stats.rx_frames, echoFailures);
+}
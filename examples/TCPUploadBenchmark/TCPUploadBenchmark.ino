@@ -0,0 +1,199 @@
+/****************************************************************************************************************************
+  TCPUploadBenchmark.ino - Sustained TCP upload throughput and CPU load for ESP32_W5500
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Start a TCP sink on the host first, e.g. `iperf -s -p 5001` or `nc -l 5001 > /dev/null`
+// To compare with the blocking transmit path, rebuild the library with -D ETH_W5500_TX_QUEUE_DEPTH=0
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       3
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+// Select the IP address of the TCP sink according to your local network
+IPAddress sinkIP(192, 168, 2, 30);
+uint16_t  sinkPort          = 5001;
+
+#define TEST_DURATION_MS    10000
+#define CHUNK_SIZE          1460
+
+uint8_t chunk[CHUNK_SIZE];
+
+WiFiClient client;
+
+//////////////////////////////////////////////////////////
+
+// One lowest priority task per core counts while the core has nothing better to do
+volatile uint32_t idleCount[2] = { 0, 0 };
+
+void idleCounter(void *arg)
+{
+  volatile uint32_t *counter = (volatile uint32_t *) arg;
+
+  while (true)
+  {
+    (*counter)++;
+  }
+}
+
+uint32_t idleTotal()
+{
+  return idleCount[0] + idleCount[1];
+}
+
+uint32_t idleCalibration = 0;
+
+void calibrateIdle()
+{
+  uint32_t start = idleTotal();
+
+  delay(1000);
+
+  idleCalibration = idleTotal() - start;
+}
+
+//////////////////////////////////////////////////////////
+
+void runUpload()
+{
+  Serial.print(F("Connecting to "));
+  Serial.print(sinkIP);
+  Serial.print(F(":"));
+  Serial.println(sinkPort);
+
+  if (!client.connect(sinkIP, sinkPort))
+  {
+    Serial.println(F("Connection failed"));
+    return;
+  }
+
+  client.setNoDelay(true);
+
+  uint64_t sent       = 0;
+  uint32_t idleStart  = idleTotal();
+  uint32_t startMs    = millis();
+
+  while ( client.connected() && (millis() - startMs < TEST_DURATION_MS) )
+  {
+    size_t written = client.write(chunk, CHUNK_SIZE);
+
+    if (written == 0)
+    {
+      delay(1);
+    }
+
+    sent += written;
+  }
+
+  uint32_t elapsedMs  = millis() - startMs;
+  uint32_t idleDelta  = idleTotal() - idleStart;
+
+  client.stop();
+
+  float kbps    = (sent * 8.0f) / elapsedMs;
+  float cpuLoad = 100.0f;
+
+  if (idleCalibration)
+  {
+    cpuLoad = 100.0f * (1.0f - ((float) idleDelta * 1000.0f / elapsedMs) / idleCalibration);
+  }
+
+  Serial.print(F("Sent "));
+  Serial.print((uint32_t) sent);
+  Serial.print(F(" bytes in "));
+  Serial.print(elapsedMs);
+  Serial.print(F(" ms => "));
+  Serial.print(kbps, 1);
+  Serial.print(F(" kbit/s, CPU load "));
+  Serial.print(cpuLoad, 1);
+  Serial.println(F(" %"));
+}
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart TCPUploadBenchmark on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  ET_LOGWARN(F("Default SPI pinout:"));
+  ET_LOGWARN1(F("SPI_HOST:"), ETH_SPI_HOST);
+  ET_LOGWARN1(F("MOSI:"), MOSI_GPIO);
+  ET_LOGWARN1(F("MISO:"), MISO_GPIO);
+  ET_LOGWARN1(F("SCK:"),  SCK_GPIO);
+  ET_LOGWARN1(F("CS:"),   CS_GPIO);
+  ET_LOGWARN1(F("INT:"),  INT_GPIO);
+  ET_LOGWARN1(F("SPI Clock (MHz):"), SPI_CLOCK_MHZ);
+  ET_LOGWARN(F("========================="));
+
+  for (int i = 0; i < CHUNK_SIZE; i++)
+  {
+    chunk[i] = i & 0xFF;
+  }
+
+  xTaskCreatePinnedToCore(idleCounter, "idle0", 1024, (void *) &idleCount[0], 0, NULL, 0);
+  xTaskCreatePinnedToCore(idleCounter, "idle1", 1024, (void *) &idleCount[1], 0, NULL, 1);
+
+  // Baseline before the network is up
+  calibrateIdle();
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  // start the ethernet connection and the server:
+  // Use DHCP dynamic IP and random mac
+  //bool begin(int MISO_GPIO, int MOSI_GPIO, int SCLK_GPIO, int CS_GPIO, int INT_GPIO, int SPI_CLOCK_MHZ,
+  //           int SPI_HOST, uint8_t *W6100_Mac = W6100_Default_Mac);
+  ETH.begin( MISO_GPIO, MOSI_GPIO, SCK_GPIO, CS_GPIO, INT_GPIO, SPI_CLOCK_MHZ, ETH_SPI_HOST );
+
+  ESP32_W5500_waitForConnect();
+
+  ///////////////////////////////////
+}
+
+void loop()
+{
+  runUpload();
+
+  delay(5000);
+}
@@ -0,0 +1,141 @@
+/****************************************************************************************************************************
+  WiFiFailover.ino - W5500 as primary link, WiFi STA in hot standby, switchover latency over Serial
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Pull the Ethernet cable: the default route and DNS move to WiFi within about LINK_POLL_MS plus the reported
+// switchover time. Plug it back: traffic returns to Ethernet once the link has been up for FAILBACK_HOLD_MS.
+// A request to HOST is made every few seconds to show which interface carries it.
+
+#if !( defined(ESP32) )
+  #error This code is designed for (ESP32 + W5500) to run on ESP32 platform! Please check your Tools->Board setting.
+#endif
+
+#define DEBUG_ETHERNET_WEBSERVER_PORT       Serial
+
+// Debug Level from 0 to 4
+#define _ETHERNET_WEBSERVER_LOGLEVEL_       2
+
+//////////////////////////////////////////////////////////
+
+// Optional values to override default settings
+// Don't change unless you know what you're doing
+//#define ETH_SPI_HOST        SPI3_HOST
+//#define SPI_CLOCK_MHZ       25
+
+// Must connect INT to GPIOxx or not working
+//#define INT_GPIO            4
+
+//#define MISO_GPIO           19
+//#define MOSI_GPIO           23
+//#define SCK_GPIO            18
+//#define CS_GPIO             5
+
+//////////////////////////////////////////////////////////
+
+#include <WebServer_ESP32_W5500.h>
+
+#define WIFI_SSID           "your_ssid"
+#define WIFI_PASS           "your_pass"
+
+#define LINK_POLL_MS        100
+#define FAILBACK_HOLD_MS    2000
+
+#define HOST                "example.com"
+
+ESP32_W5500_Failover failover;
+
+//////////////////////////////////////////////////////////
+
+const char *routeName(ESP32_W5500_Route route)
+{
+  return (route == ESP32_W5500_ROUTE_ETH) ? "ETH" : ((route == ESP32_W5500_ROUTE_WIFI) ? "WiFi" : "none");
+}
+
+//////////////////////////////////////////////////////////
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial && (millis() < 5000));
+
+  Serial.print(F("\nStart WiFiFailover on "));
+  Serial.print(ARDUINO_BOARD);
+  Serial.print(F(" with "));
+  Serial.println(SHIELD_TYPE);
+  Serial.println(WEBSERVER_ESP32_W5500_VERSION);
+
+  ///////////////////////////////////
+
+  // To be called before ETH.begin()
+  ESP32_W5500_onEvent();
+
+  ESP32_W5500_Config config;
+
+  config.misoGpio    = MISO_GPIO;
+  config.mosiGpio    = MOSI_GPIO;
+  config.sclkGpio    = SCK_GPIO;
+  config.csGpio      = CS_GPIO;
+  config.intGpio     = INT_GPIO;
+  config.spiClockMHz = SPI_CLOCK_MHZ;
+  config.spiHost     = ETH_SPI_HOST;
+
+  // the failover polls the PHY itself, a faster esp_eth check also takes the netif down sooner
+  config.linkCheckPeriodMs = 250;
+
+  ETH.begin(config);
+
+  ESP32_W5500_waitForConnect();
+
+  ///////////////////////////////////
+
+  ESP32_W5500_FailoverConfig failoverConfig;
+
+  failoverConfig.linkPollMs     = LINK_POLL_MS;
+  failoverConfig.failbackHoldMs = FAILBACK_HOLD_MS;
+
+  if (!failover.begin(ETH, WIFI_SSID, WIFI_PASS, failoverConfig))
+  {
+    Serial.println(F("Failover start failed"));
+  }
+}
+
+void loop()
+{
+  static ESP32_W5500_Route lastRoute = ESP32_W5500_ROUTE_NONE;
+  static uint32_t lastRequestMs = 0;
+
+  ESP32_W5500_Route route = failover.activeRoute();
+
+  if (route != lastRoute)
+  {
+    ESP32_W5500_FailoverStats stats = failover.getStats();
+
+    Serial.printf("{\"route\":\"%s\",\"switchovers\":%u,\"last_switchover_us\":%u,\"max_switchover_us\":%u,",
+                  routeName(route), stats.switchovers, stats.lastSwitchoverUs, stats.maxSwitchoverUs);
+    Serial.printf("\"failbacks\":%u,\"last_failback_us\":%u,\"max_failback_us\":%u,\"detect_bound_ms\":%u}\n",
+                  stats.failbacks, stats.lastFailbackUs, stats.maxFailbackUs, LINK_POLL_MS);
+
+    lastRoute = route;
+  }
+
+  if (millis() - lastRequestMs > 5000)
+  {
+    WiFiClient client;
+
+    lastRequestMs = millis();
+
+    Serial.printf("Connect to %s over %s: %s\n", HOST, routeName(route), client.connect(HOST, 80) ? "OK" : "failed");
+    client.stop();
+  }
+
+  delay(10);
+}
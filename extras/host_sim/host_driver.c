@@ -0,0 +1,835 @@
+/****************************************************************************************************************************
+  host_driver.c - GPIO and SPI master drivers on the host, wired to the simulated chips
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Checks the same arguments as IDF 4.4 does and fails the same way, so a misuse shows up on the host too. Queued SPI
+// transactions run at once in the queueing thread, the result queue keeps the order IDF guarantees
+
+#include <stdlib.h>
+#include <string.h>
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "host_sim.h"
+
+#define SIM_SPI_TARGETS_MAX       (8)
+#define SIM_SPI_DEVICES_MAX       (6)
+
+static const char *TAG = "sim.driver";
+
+typedef struct
+{
+  int level;                // pulled up until a chip drives it low
+  gpio_mode_t mode;
+  gpio_int_type_t intr_type;
+  bool intr_enabled;
+  gpio_isr_t isr;
+  void *isr_arg;
+} sim_gpio_pin_t;
+
+typedef struct
+{
+  int cs_gpio;
+  sim_spi_transfer_t transfer;
+  void *ctx;
+} sim_spi_target_t;
+
+typedef struct
+{
+  bool initialized;
+  bool dma;
+  int max_transfer_sz;
+  pthread_mutex_t lock;     // held by one transaction, or from acquire to release
+  spi_device_handle_t acquired_by;  // atomic, compared against their own device by the users of the bus
+  spi_device_handle_t devices[SIM_SPI_DEVICES_MAX];
+} sim_spi_bus_t;
+
+struct spi_device_t
+{
+  spi_host_device_t host;
+  spi_device_interface_config_t cfg;
+  spi_transaction_t **results;  // ring of queue_size finished transactions, not yet collected
+  int result_head;
+  int result_count;
+};
+
+static pthread_mutex_t gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_gpio_pin_t gpio_pins[SIM_GPIO_PIN_COUNT];
+static bool gpio_isr_service;
+
+static pthread_mutex_t spi_target_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_spi_target_t spi_targets[SIM_SPI_TARGETS_MAX];
+static sim_spi_bus_t spi_buses[SPI_HOST_MAX];
+
+////////////////////////////////////////
+
+__attribute__((constructor)) static void host_driver_init(void)
+{
+  for (int i = 0; i < SIM_GPIO_PIN_COUNT; i++)
+  {
+    gpio_pins[i].level = 1;
+  }
+
+  for (int i = 0; i < SPI_HOST_MAX; i++)
+  {
+    pthread_mutex_init(&spi_buses[i].lock, NULL);
+  }
+}
+
+////////////////////////////////////////
+
+static bool gpio_valid(gpio_num_t gpio_num)
+{
+  return (gpio_num >= 0) && (gpio_num < SIM_GPIO_PIN_COUNT);
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+  esp_err_t ret = ESP_OK;
+
+  (void)intr_alloc_flags;
+
+  pthread_mutex_lock(&gpio_lock);
+
+  if (gpio_isr_service)
+  {
+    ret = ESP_ERR_INVALID_STATE;
+  }
+
+  gpio_isr_service = true;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+void gpio_uninstall_isr_service(void)
+{
+  pthread_mutex_lock(&gpio_lock);
+  gpio_isr_service = false;
+
+  for (int i = 0; i < SIM_GPIO_PIN_COUNT; i++)
+  {
+    gpio_pins[i].isr = NULL;
+  }
+
+  pthread_mutex_unlock(&gpio_lock);
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+  esp_err_t ret = ESP_OK;
+
+  if (!gpio_valid(gpio_num))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+
+  if (!gpio_isr_service)
+  {
+    ESP_LOGE(TAG, "GPIO isr service is not installed, call gpio_install_isr_service() first");
+    ret = ESP_ERR_INVALID_STATE;
+  }
+  else
+  {
+    gpio_pins[gpio_num].isr = isr_handler;
+    gpio_pins[gpio_num].isr_arg = args;
+  }
+
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+  if (!gpio_valid(gpio_num))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  gpio_pins[gpio_num].isr = NULL;
+  gpio_pins[gpio_num].isr_arg = NULL;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+  if (!gpio_valid(gpio_num))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  gpio_pins[gpio_num].mode = GPIO_MODE_DISABLE;
+  gpio_pins[gpio_num].intr_type = GPIO_INTR_DISABLE;
+  gpio_pins[gpio_num].intr_enabled = false;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+  if (!gpio_valid(gpio_num))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  gpio_pins[gpio_num].mode = mode;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+  (void)pull;
+
+  return gpio_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+  if (!gpio_valid(gpio_num) || (intr_type > GPIO_INTR_HIGH_LEVEL))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  gpio_pins[gpio_num].intr_type = intr_type;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+static esp_err_t gpio_intr_set(gpio_num_t gpio_num, bool enable)
+{
+  if (!gpio_valid(gpio_num))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  gpio_pins[gpio_num].intr_enabled = enable;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+  return gpio_intr_set(gpio_num, true);
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+  return gpio_intr_set(gpio_num, false);
+}
+
+////////////////////////////////////////
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+  if (!gpio_valid(gpio_num))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // an output pin reads back what it drives, nothing is wired to the chips' reset inputs
+  pthread_mutex_lock(&gpio_lock);
+
+  if (gpio_pins[gpio_num].mode & GPIO_MODE_OUTPUT)
+  {
+    gpio_pins[gpio_num].level = level ? 1 : 0;
+  }
+
+  pthread_mutex_unlock(&gpio_lock);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+  int level;
+
+  if (!gpio_valid(gpio_num))
+  {
+    return 0;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  level = gpio_pins[gpio_num].level;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return level;
+}
+
+////////////////////////////////////////
+
+void sim_gpio_drive(int gpio_num, int level)
+{
+  gpio_isr_t isr = NULL;
+  void *isr_arg = NULL;
+
+  if (!gpio_valid(gpio_num))
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+
+  sim_gpio_pin_t *pin = &gpio_pins[gpio_num];
+  int old_level = pin->level;
+
+  pin->level = level ? 1 : 0;
+
+  // the GPIO peripheral latches nothing while the interrupt is disabled, level types fire on entering the level
+  if (gpio_isr_service && pin->isr && pin->intr_enabled && (old_level != pin->level))
+  {
+    bool fire = false;
+
+    switch (pin->intr_type)
+    {
+      case GPIO_INTR_POSEDGE:
+      case GPIO_INTR_HIGH_LEVEL:
+        fire = pin->level;
+        break;
+
+      case GPIO_INTR_NEGEDGE:
+      case GPIO_INTR_LOW_LEVEL:
+        fire = !pin->level;
+        break;
+
+      case GPIO_INTR_ANYEDGE:
+        fire = true;
+        break;
+
+      default:
+        break;
+    }
+
+    if (fire)
+    {
+      isr = pin->isr;
+      isr_arg = pin->isr_arg;
+    }
+  }
+
+  pthread_mutex_unlock(&gpio_lock);
+
+  if (isr)
+  {
+    SIM_COUNT(gpio_isr_calls, 1);
+    isr(isr_arg);
+  }
+}
+
+////////////////////////////////////////
+
+esp_err_t sim_spi_attach(int cs_gpio, sim_spi_transfer_t transfer, void *ctx)
+{
+  esp_err_t ret = ESP_ERR_NO_MEM;
+
+  pthread_mutex_lock(&spi_target_lock);
+
+  for (int i = 0; i < SIM_SPI_TARGETS_MAX; i++)
+  {
+    if (!spi_targets[i].transfer)
+    {
+      spi_targets[i] = (sim_spi_target_t)
+      {
+        .cs_gpio = cs_gpio, .transfer = transfer, .ctx = ctx
+      };
+      ret = ESP_OK;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&spi_target_lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+void sim_spi_detach(int cs_gpio)
+{
+  pthread_mutex_lock(&spi_target_lock);
+
+  for (int i = 0; i < SIM_SPI_TARGETS_MAX; i++)
+  {
+    if (spi_targets[i].transfer && (spi_targets[i].cs_gpio == cs_gpio))
+    {
+      memset(&spi_targets[i], 0, sizeof(sim_spi_target_t));
+    }
+  }
+
+  pthread_mutex_unlock(&spi_target_lock);
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t *bus_config, spi_dma_chan_t dma_chan)
+{
+  if ((host_id <= SPI1_HOST) || (host_id >= SPI_HOST_MAX) || !bus_config || (dma_chan > SPI_DMA_CH_AUTO))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  sim_spi_bus_t *bus = &spi_buses[host_id];
+
+  if (bus->initialized)
+  {
+    ESP_LOGE(TAG, "SPI bus already initialized.");
+
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  bus->initialized = true;
+  bus->dma = (dma_chan != SPI_DMA_DISABLED);
+
+  // as IDF: 0 => the DMA limit, or 64 bytes of FIFO without DMA
+  if (bus_config->max_transfer_sz > 0)
+  {
+    bus->max_transfer_sz = bus_config->max_transfer_sz;
+  }
+  else
+  {
+    bus->max_transfer_sz = bus->dma ? SPI_MAX_DMA_LEN : 64;
+  }
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_bus_free(spi_host_device_t host_id)
+{
+  if ((host_id <= SPI1_HOST) || (host_id >= SPI_HOST_MAX))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  sim_spi_bus_t *bus = &spi_buses[host_id];
+
+  for (int i = 0; i < SIM_SPI_DEVICES_MAX; i++)
+  {
+    if (bus->devices[i])
+    {
+      ESP_LOGE(TAG, "not all CSses freed");
+
+      return ESP_ERR_INVALID_STATE;
+    }
+  }
+
+  bus->initialized = false;
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_bus_add_device(spi_host_device_t host_id, const spi_device_interface_config_t *dev_config,
+                             spi_device_handle_t *handle)
+{
+  if ((host_id <= SPI1_HOST) || (host_id >= SPI_HOST_MAX) || !dev_config || !handle)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  sim_spi_bus_t *bus = &spi_buses[host_id];
+
+  if (!bus->initialized)
+  {
+    ESP_LOGE(TAG, "SPI bus not initialized");
+
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if ((dev_config->clock_speed_hz <= 0) || (dev_config->queue_size <= 0) || (dev_config->command_bits > 16) ||
+      (dev_config->address_bits > 64) || (dev_config->cs_ena_posttrans > 16) || (dev_config->mode > 3))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  for (int i = 0; i < SIM_SPI_DEVICES_MAX; i++)
+  {
+    if (!bus->devices[i])
+    {
+      spi_device_handle_t dev = calloc(1, sizeof(struct spi_device_t));
+
+      if (!dev || !(dev->results = calloc(dev_config->queue_size, sizeof(spi_transaction_t *))))
+      {
+        free(dev);
+
+        return ESP_ERR_NO_MEM;
+      }
+
+      dev->host = host_id;
+      dev->cfg = *dev_config;
+      bus->devices[i] = dev;
+      *handle = dev;
+
+      return ESP_OK;
+    }
+  }
+
+  ESP_LOGE(TAG, "no free cs pins for the host");
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+  if (!handle)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  sim_spi_bus_t *bus = &spi_buses[handle->host];
+
+  if (handle->result_count || (__atomic_load_n(&bus->acquired_by, __ATOMIC_ACQUIRE) == handle))
+  {
+    ESP_LOGE(TAG, "Have unfinished transactions or the bus acquired");
+
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  for (int i = 0; i < SIM_SPI_DEVICES_MAX; i++)
+  {
+    if (bus->devices[i] == handle)
+    {
+      bus->devices[i] = NULL;
+    }
+  }
+
+  free(handle->results);
+  free(handle);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+// One transaction on the wire, the caller owns the bus
+static esp_err_t spi_run(spi_device_handle_t dev, spi_transaction_t *trans)
+{
+  sim_spi_bus_t *bus = &spi_buses[dev->host];
+  size_t rxlength = trans->rxlength ? trans->rxlength : trans->length;
+  uint32_t len = trans->length / 8;
+  const uint8_t *tx;
+  uint8_t *rx;
+  uint8_t *tx_bounce = NULL;
+  uint8_t *rx_bounce = NULL;
+  sim_spi_transfer_t transfer = NULL;
+  void *ctx = NULL;
+
+  if ((trans->length % 8) || (rxlength > trans->length) ||
+      ((trans->flags & SPI_TRANS_USE_TXDATA) && (trans->length > 32)) ||
+      ((trans->flags & SPI_TRANS_USE_RXDATA) && (rxlength > 32)))
+  {
+    ESP_LOGE(TAG, "invalid transaction: length %u bits, rxlength %u bits, flags 0x%x",
+             (unsigned)trans->length, (unsigned)rxlength, (unsigned)trans->flags);
+
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (len > (uint32_t)bus->max_transfer_sz)
+  {
+    ESP_LOGE(TAG, "txdata transfer > host maximum");
+
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  tx = (trans->flags & SPI_TRANS_USE_TXDATA) ? trans->tx_data : trans->tx_buffer;
+  rx = (trans->flags & SPI_TRANS_USE_RXDATA) ? trans->rx_data : trans->rx_buffer;
+
+  // DMA needs word aligned buffers, IDF copies through a temporary one otherwise (and so does a receive length
+  // which isn't a multiple of 4, see W5500_RX_ALIGN)
+  if (bus->dma && tx && !(trans->flags & SPI_TRANS_USE_TXDATA) && ((uintptr_t)tx % 4))
+  {
+    tx_bounce = heap_caps_malloc(len, MALLOC_CAP_DMA);
+
+    if (!tx_bounce)
+    {
+      return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(tx_bounce, tx, len);
+    SIM_COUNT(spi_dma_bounces, 1);
+  }
+
+  if (bus->dma && rx && !(trans->flags & SPI_TRANS_USE_RXDATA) && (((uintptr_t)rx % 4) || (len % 4)))
+  {
+    rx_bounce = heap_caps_malloc((len + 3) & ~3, MALLOC_CAP_DMA);
+
+    if (!rx_bounce)
+    {
+      heap_caps_free(tx_bounce);
+
+      return ESP_ERR_NO_MEM;
+    }
+
+    SIM_COUNT(spi_dma_bounces, 1);
+  }
+
+  if (dev->cfg.pre_cb)
+  {
+    dev->cfg.pre_cb(trans);
+  }
+
+  pthread_mutex_lock(&spi_target_lock);
+
+  for (int i = 0; i < SIM_SPI_TARGETS_MAX; i++)
+  {
+    if (spi_targets[i].transfer && (spi_targets[i].cs_gpio == dev->cfg.spics_io_num))
+    {
+      transfer = spi_targets[i].transfer;
+      ctx = spi_targets[i].ctx;
+    }
+  }
+
+  pthread_mutex_unlock(&spi_target_lock);
+
+  if (transfer)
+  {
+    transfer(ctx, trans->cmd, dev->cfg.command_bits, trans->addr, dev->cfg.address_bits,
+             tx_bounce ? tx_bounce : tx, rx_bounce ? rx_bounce : rx, len, (uint32_t)dev->cfg.clock_speed_hz);
+  }
+  else if (rx_bounce || rx)
+  {
+    // nobody answers, MISO floats high
+    memset(rx_bounce ? rx_bounce : rx, 0xFF, len);
+  }
+
+  if (rx_bounce)
+  {
+    memcpy(rx, rx_bounce, rxlength / 8);
+    heap_caps_free(rx_bounce);
+  }
+
+  heap_caps_free(tx_bounce);
+
+  if (dev->cfg.post_cb)
+  {
+    dev->cfg.post_cb(trans);
+  }
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+static void spi_bus_enter(spi_device_handle_t dev)
+{
+  if (__atomic_load_n(&spi_buses[dev->host].acquired_by, __ATOMIC_ACQUIRE) != dev)
+  {
+    pthread_mutex_lock(&spi_buses[dev->host].lock);
+  }
+}
+
+////////////////////////////////////////
+
+static void spi_bus_leave(spi_device_handle_t dev)
+{
+  if (__atomic_load_n(&spi_buses[dev->host].acquired_by, __ATOMIC_ACQUIRE) != dev)
+  {
+    pthread_mutex_unlock(&spi_buses[dev->host].lock);
+  }
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc, TickType_t ticks_to_wait)
+{
+  esp_err_t ret;
+
+  if (!handle || !trans_desc)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // finished transactions are held until collected, a full queue would block the sender for good
+  if (handle->result_count >= handle->cfg.queue_size)
+  {
+    ESP_LOGE(TAG, "queue of %d transactions full, results not collected", handle->cfg.queue_size);
+
+    return ESP_ERR_TIMEOUT;
+  }
+
+  spi_bus_enter(handle);
+  ret = spi_run(handle, trans_desc);
+  spi_bus_leave(handle);
+
+  if (ret == ESP_OK)
+  {
+    handle->results[(handle->result_head + handle->result_count) % handle->cfg.queue_size] = trans_desc;
+    handle->result_count++;
+    SIM_COUNT(spi_queued, 1);
+  }
+
+  (void)ticks_to_wait;
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans_desc,
+                                      TickType_t ticks_to_wait)
+{
+  if (!handle || !trans_desc)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (handle->result_count == 0)
+  {
+    // on the chip this waits ticks_to_wait for a transaction which was never queued
+    if (ticks_to_wait)
+    {
+      ESP_LOGE(TAG, "waiting for the result of a transaction which was not queued");
+    }
+
+    return ESP_ERR_TIMEOUT;
+  }
+
+  *trans_desc = handle->results[handle->result_head];
+  handle->result_head = (handle->result_head + 1) % handle->cfg.queue_size;
+  handle->result_count--;
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc)
+{
+  spi_transaction_t *done;
+  esp_err_t ret = spi_device_queue_trans(handle, trans_desc, portMAX_DELAY);
+
+  if (ret != ESP_OK)
+  {
+    return ret;
+  }
+
+  return spi_device_get_trans_result(handle, &done, portMAX_DELAY);
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc)
+{
+  esp_err_t ret;
+
+  if (!handle || !trans_desc)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (handle->result_count)
+  {
+    ESP_LOGE(TAG, "Cannot send polling transaction while the previous interrupt transaction is not terminated.");
+
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  spi_bus_enter(handle);
+  ret = spi_run(handle, trans_desc);
+  spi_bus_leave(handle);
+
+  if (ret == ESP_OK)
+  {
+    SIM_COUNT(spi_polled, 1);
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait)
+{
+  if (!device)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // IDF 4.4 only supports waiting forever here
+  if (wait != portMAX_DELAY)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  sim_spi_bus_t *bus = &spi_buses[device->host];
+
+  if (__atomic_load_n(&bus->acquired_by, __ATOMIC_ACQUIRE) == device)
+  {
+    ESP_LOGE(TAG, "bus already acquired by this device");
+
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  pthread_mutex_lock(&bus->lock);
+  __atomic_store_n(&bus->acquired_by, device, __ATOMIC_RELEASE);
+  SIM_COUNT(spi_bus_acquisitions, 1);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+void spi_device_release_bus(spi_device_handle_t dev)
+{
+  sim_spi_bus_t *bus = &spi_buses[dev->host];
+
+  if (__atomic_load_n(&bus->acquired_by, __ATOMIC_ACQUIRE) != dev)
+  {
+    ESP_LOGE(TAG, "releasing a bus not acquired by this device");
+
+    return;
+  }
+
+  __atomic_store_n(&bus->acquired_by, NULL, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&bus->lock);
+}
@@ -0,0 +1,233 @@
+/****************************************************************************************************************************
+  host_esp.c - ESP-IDF system services on the host: log, error names, esp_timer, ROM delay and the counted heap
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_rom_gpio.h"
+#include "esp_rom_sys.h"
+#include "hal/cpu_hal.h"
+#include "host_sim.h"
+
+sim_counters_t sim_counters;
+
+static int64_t start_ns;
+static int log_level = -1;
+
+////////////////////////////////////////
+
+static int64_t host_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+////////////////////////////////////////
+
+__attribute__((constructor)) static void host_esp_init(void)
+{
+  const char *level = getenv("SIM_LOG_LEVEL");
+
+  start_ns = host_now_ns();
+  log_level = level ? atoi(level) : ESP_LOG_WARN;
+}
+
+////////////////////////////////////////
+
+void sim_counters_get(sim_counters_t *counters)
+{
+  uint64_t *dst = (uint64_t *)counters;
+  uint64_t *src = (uint64_t *)&sim_counters;
+
+  for (size_t i = 0; i < sizeof(sim_counters_t) / sizeof(uint64_t); i++)
+  {
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  }
+}
+
+////////////////////////////////////////
+
+const char *esp_err_to_name(esp_err_t code)
+{
+  switch (code)
+  {
+    case ESP_OK:
+      return "ESP_OK";
+
+    case ESP_FAIL:
+      return "ESP_FAIL";
+
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+
+    case ESP_ERR_INVALID_SIZE:
+      return "ESP_ERR_INVALID_SIZE";
+
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+
+    case ESP_ERR_NOT_SUPPORTED:
+      return "ESP_ERR_NOT_SUPPORTED";
+
+    case ESP_ERR_TIMEOUT:
+      return "ESP_ERR_TIMEOUT";
+
+    default:
+      return "UNKNOWN ERROR";
+  }
+}
+
+////////////////////////////////////////
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+  (void)tag;
+  log_level = level;
+}
+
+////////////////////////////////////////
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+  va_list args;
+
+  if ((int)level > log_level)
+  {
+    return;
+  }
+
+  // same line format as IDF: "E (1234) tag: message"
+  flockfile(stderr);
+  fprintf(stderr, "%c (%lld) %s: ", "NEWIDV"[level], (long long)((host_now_ns() - start_ns) / 1000000), tag);
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+  funlockfile(stderr);
+}
+
+////////////////////////////////////////
+
+int64_t esp_timer_get_time(void)
+{
+  return (host_now_ns() - start_ns) / 1000;
+}
+
+////////////////////////////////////////
+
+void esp_rom_delay_us(uint32_t us)
+{
+  int64_t until = host_now_ns() + (int64_t)us * 1000;
+
+  while (host_now_ns() < until);
+}
+
+////////////////////////////////////////
+
+void esp_rom_gpio_pad_select_gpio(uint32_t iopad_num)
+{
+  (void)iopad_num;
+}
+
+////////////////////////////////////////
+
+uint32_t cpu_hal_get_core_id(void)
+{
+  return 0;
+}
+
+////////////////////////////////////////
+
+// Every allocation of the program is counted: the linker redirects malloc & co. here (-Wl,--wrap, see the Makefile)
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+  SIM_COUNT(heap_allocs, 1);
+
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  SIM_COUNT(heap_allocs, 1);
+
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  SIM_COUNT(heap_allocs, 1);
+
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+  if (ptr)
+  {
+    SIM_COUNT(heap_frees, 1);
+  }
+
+  __real_free(ptr);
+}
+
+////////////////////////////////////////
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+  (void)caps;
+
+  return malloc(size);
+}
+
+////////////////////////////////////////
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+  (void)caps;
+
+  return calloc(n, size);
+}
+
+////////////////////////////////////////
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+  (void)caps;
+
+  return realloc(ptr, size);
+}
+
+////////////////////////////////////////
+
+void heap_caps_free(void *ptr)
+{
+  free(ptr);
+}
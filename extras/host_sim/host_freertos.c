@@ -0,0 +1,485 @@
+/****************************************************************************************************************************
+  host_freertos.c - The FreeRTOS subset used by the driver on top of pthreads
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// One kernel lock guards all task and semaphore state, every change is broadcast on one condition variable and the
+// waiters re-check their own condition. Plenty for the handful of tasks of a driver test, and no lost wake-ups
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "host_sim.h"
+
+#define SIM_TICK_NS               (1000000000LL / configTICK_RATE_HZ)
+
+struct sim_task
+{
+  pthread_t thread;
+  TaskFunction_t code;
+  void *arg;
+  char name[16];
+  uint32_t notify;
+  bool deleted;   // vTaskDelete() by another task, it exits at its next blocking call
+};
+
+struct sim_semaphore
+{
+  bool mutex;
+  UBaseType_t count;
+  UBaseType_t max_count;
+  TaskHandle_t holder;
+};
+
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kernel_cond;
+static int64_t kernel_start_ns;
+static __thread TaskHandle_t current_task;
+
+////////////////////////////////////////
+
+static int64_t kernel_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+////////////////////////////////////////
+
+__attribute__((constructor)) static void kernel_init(void)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&kernel_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  kernel_start_ns = kernel_now_ns();
+}
+
+////////////////////////////////////////
+
+static int64_t kernel_deadline(TickType_t ticks)
+{
+  return (ticks == portMAX_DELAY) ? -1 : kernel_now_ns() + (int64_t)ticks * SIM_TICK_NS;
+}
+
+////////////////////////////////////////
+
+// Called with the kernel lock held: a task deleted by another one goes away here, without the lock
+static void kernel_check_deleted(TaskHandle_t self)
+{
+  if (self->deleted)
+  {
+    pthread_mutex_unlock(&kernel_lock);
+    pthread_exit(NULL);
+  }
+}
+
+////////////////////////////////////////
+
+// Sleep until the next kernel state change or the deadline (-1 forever), false once the deadline has passed
+static bool kernel_wait(TaskHandle_t self, int64_t deadline_ns)
+{
+  kernel_check_deleted(self);
+
+  if (deadline_ns < 0)
+  {
+    pthread_cond_wait(&kernel_cond, &kernel_lock);
+  }
+  else
+  {
+    struct timespec ts = { .tv_sec = deadline_ns / 1000000000LL, .tv_nsec = deadline_ns % 1000000000LL };
+
+    if (pthread_cond_timedwait(&kernel_cond, &kernel_lock, &ts) == ETIMEDOUT)
+    {
+      kernel_check_deleted(self);
+
+      return false;
+    }
+  }
+
+  kernel_check_deleted(self);
+
+  return (deadline_ns < 0) || (kernel_now_ns() < deadline_ns);
+}
+
+////////////////////////////////////////
+
+static void *sim_task_entry(void *arg)
+{
+  TaskHandle_t task = arg;
+
+  current_task = task;
+  task->code(task->arg);
+
+  // a FreeRTOS task must not return, treat it as deleting itself
+  vTaskDelete(NULL);
+
+  return NULL;
+}
+
+////////////////////////////////////////
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+  (void)stack_depth;
+  (void)priority;
+  (void)core_id;
+
+  TaskHandle_t task = calloc(1, sizeof(struct sim_task));
+
+  if (!task)
+  {
+    return pdFAIL;
+  }
+
+  task->code = task_code;
+  task->arg = arg;
+  strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+
+  // the new task may use its handle right away, as the creator's copy
+  if (created_task)
+  {
+    *created_task = task;
+  }
+
+  if (pthread_create(&task->thread, NULL, sim_task_entry, task) != 0)
+  {
+    if (created_task)
+    {
+      *created_task = NULL;
+    }
+
+    free(task);
+
+    return pdFAIL;
+  }
+
+  pthread_setname_np(task->thread, task->name);
+
+  return pdPASS;
+}
+
+////////////////////////////////////////
+
+void vTaskDelete(TaskHandle_t task)
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+  if (!task || (task == self))
+  {
+    // as the idle task would free the TCB, nobody may use the handle any more
+    current_task = NULL;
+    free(self);
+    pthread_detach(pthread_self());
+    pthread_exit(NULL);
+  }
+
+  pthread_mutex_lock(&kernel_lock);
+  task->deleted = true;
+  pthread_cond_broadcast(&kernel_cond);
+  pthread_mutex_unlock(&kernel_lock);
+
+  pthread_join(task->thread, NULL);
+  free(task);
+}
+
+////////////////////////////////////////
+
+void vTaskDelay(TickType_t ticks)
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int64_t deadline = kernel_deadline(ticks);
+
+  pthread_mutex_lock(&kernel_lock);
+
+  if (ticks == 0)
+  {
+    kernel_check_deleted(self);
+  }
+
+  while (ticks && kernel_wait(self, deadline));
+
+  pthread_mutex_unlock(&kernel_lock);
+
+  if (ticks == 0)
+  {
+    sched_yield();
+  }
+}
+
+////////////////////////////////////////
+
+TickType_t xTaskGetTickCount(void)
+{
+  return (TickType_t)((kernel_now_ns() - kernel_start_ns) / SIM_TICK_NS);
+}
+
+////////////////////////////////////////
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  if (!current_task)
+  {
+    // adopt a thread started outside the kernel, it's never deleted through its handle
+    current_task = calloc(1, sizeof(struct sim_task));
+
+    if (!current_task)
+    {
+      abort();
+    }
+
+    current_task->thread = pthread_self();
+    strcpy(current_task->name, "main");
+  }
+
+  return current_task;
+}
+
+////////////////////////////////////////
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int64_t deadline = kernel_deadline(ticks_to_wait);
+  uint32_t value;
+
+  pthread_mutex_lock(&kernel_lock);
+  kernel_check_deleted(self);
+
+  while ((self->notify == 0) && ticks_to_wait && kernel_wait(self, deadline));
+
+  value = self->notify;
+
+  if (value)
+  {
+    self->notify = clear_on_exit ? 0 : value - 1;
+  }
+
+  pthread_mutex_unlock(&kernel_lock);
+
+  return value;
+}
+
+////////////////////////////////////////
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  SIM_COUNT(task_notifications, 1);
+
+  pthread_mutex_lock(&kernel_lock);
+  task->notify++;
+  pthread_cond_broadcast(&kernel_cond);
+  pthread_mutex_unlock(&kernel_lock);
+
+  return pdPASS;
+}
+
+////////////////////////////////////////
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+  xTaskNotifyGive(task);
+
+  if (higher_priority_task_woken)
+  {
+    *higher_priority_task_woken = pdTRUE;
+  }
+}
+
+////////////////////////////////////////
+
+// Not a deletion point: the driver yields while it polls a command register inside an SPI session
+void sim_task_yield(void)
+{
+  sched_yield();
+}
+
+////////////////////////////////////////
+
+static SemaphoreHandle_t semaphore_new(bool mutex, UBaseType_t max_count, UBaseType_t initial_count)
+{
+  SemaphoreHandle_t semaphore = calloc(1, sizeof(struct sim_semaphore));
+
+  if (semaphore)
+  {
+    semaphore->mutex = mutex;
+    semaphore->max_count = max_count;
+    semaphore->count = initial_count;
+  }
+
+  return semaphore;
+}
+
+////////////////////////////////////////
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  return semaphore_new(true, 1, 1);
+}
+
+////////////////////////////////////////
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  return semaphore_new(false, 1, 0);
+}
+
+////////////////////////////////////////
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+  if ((max_count == 0) || (initial_count > max_count))
+  {
+    return NULL;
+  }
+
+  return semaphore_new(false, max_count, initial_count);
+}
+
+////////////////////////////////////////
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+  free(semaphore);
+}
+
+////////////////////////////////////////
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int64_t deadline = kernel_deadline(ticks_to_wait);
+  BaseType_t ret = pdFALSE;
+
+  pthread_mutex_lock(&kernel_lock);
+  kernel_check_deleted(self);
+
+  while ((semaphore->count == 0) && ticks_to_wait && kernel_wait(self, deadline));
+
+  if (semaphore->count)
+  {
+    semaphore->count--;
+
+    if (semaphore->mutex)
+    {
+      semaphore->holder = self;
+    }
+
+    ret = pdTRUE;
+  }
+
+  pthread_mutex_unlock(&kernel_lock);
+
+  if (ret == pdTRUE)
+  {
+    SIM_COUNT(semaphore_takes, 1);
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  BaseType_t ret = pdFALSE;
+
+  pthread_mutex_lock(&kernel_lock);
+
+  // a mutex is only given back by its holder, a full semaphore stays full
+  if ((!semaphore->mutex || (semaphore->holder == xTaskGetCurrentTaskHandle()))
+      && (semaphore->count < semaphore->max_count))
+  {
+    semaphore->count++;
+    semaphore->holder = NULL;
+    pthread_cond_broadcast(&kernel_cond);
+    ret = pdTRUE;
+  }
+
+  pthread_mutex_unlock(&kernel_lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken)
+{
+  BaseType_t ret = pdFALSE;
+
+  pthread_mutex_lock(&kernel_lock);
+
+  if (semaphore->count < semaphore->max_count)
+  {
+    semaphore->count++;
+    pthread_cond_broadcast(&kernel_cond);
+    ret = pdTRUE;
+  }
+
+  pthread_mutex_unlock(&kernel_lock);
+
+  if ((ret == pdTRUE) && higher_priority_task_woken)
+  {
+    *higher_priority_task_woken = pdTRUE;
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore)
+{
+  UBaseType_t count;
+
+  pthread_mutex_lock(&kernel_lock);
+  count = semaphore->count;
+  pthread_mutex_unlock(&kernel_lock);
+
+  return count;
+}
+
+////////////////////////////////////////
+
+void sim_mux_init(portMUX_TYPE *mux)
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&mux->mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+////////////////////////////////////////
+
+void sim_mux_enter(portMUX_TYPE *mux)
+{
+  pthread_mutex_lock(&mux->mutex);
+  SIM_COUNT(critical_sections, 1);
+}
+
+////////////////////////////////////////
+
+void sim_mux_exit(portMUX_TYPE *mux)
+{
+  pthread_mutex_unlock(&mux->mutex);
+}
@@ -0,0 +1,76 @@
+/****************************************************************************************************************************
+  host_sim.h - Host side of the ESP-IDF shim: SPI targets, GPIO inputs and process wide counters
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////
+
+/**
+   @brief One SPI transaction as it reaches the chip behind a CS pin: command / address phase as configured on the
+          device, then len data bytes, full duplex. tx or rx is NULL when the transaction doesn't send / receive
+
+*/
+typedef void (*sim_spi_transfer_t)(void *ctx, uint16_t cmd, uint8_t command_bits, uint64_t addr, uint8_t address_bits,
+                                   const uint8_t *tx, uint8_t *rx, uint32_t len, uint32_t clock_hz);
+
+/**
+   @brief Put a simulated chip on every SPI bus at the given CS pin, devices added with that spics_io_num talk to it.
+          Without a chip MISO floats high, reads return 0xFF
+
+*/
+esp_err_t sim_spi_attach(int cs_gpio, sim_spi_transfer_t transfer, void *ctx);
+void sim_spi_detach(int cs_gpio);
+
+/**
+   @brief Drive a GPIO input from a simulated chip. An edge matching the pin's interrupt type calls its ISR handler
+          on the calling thread, when the ISR service is installed and the pin's interrupt enabled
+
+*/
+void sim_gpio_drive(int gpio_num, int level);
+
+////////////////////////////////////////
+
+/**
+   @brief Process wide counters of the shim, monotonic. Take a snapshot before and after a run and subtract
+
+*/
+typedef struct
+{
+  uint64_t heap_allocs;         /*!< malloc / calloc / realloc / heap_caps_*alloc calls of the whole program */
+  uint64_t heap_frees;
+  uint64_t semaphore_takes;     /*!< Successful xSemaphoreTake(), mutexes and semaphores alike */
+  uint64_t critical_sections;   /*!< portENTER_CRITICAL() of any portMUX */
+  uint64_t task_notifications;  /*!< xTaskNotifyGive() / vTaskNotifyGiveFromISR() */
+  uint64_t gpio_isr_calls;      /*!< GPIO ISR handlers run */
+  uint64_t spi_polled;          /*!< spi_device_polling_transmit() transactions */
+  uint64_t spi_queued;          /*!< spi_device_queue_trans() transactions */
+  uint64_t spi_bus_acquisitions;/*!< spi_device_acquire_bus() */
+  uint64_t spi_dma_bounces;     /*!< DMA transfers copied through a temporary buffer (address / length not aligned) */
+} sim_counters_t;
+
+void sim_counters_get(sim_counters_t *counters);
+
+// Shim internals bump the counters through this
+#define SIM_COUNT(counter, n) __atomic_fetch_add(&sim_counters.counter, (n), __ATOMIC_RELAXED)
+
+extern sim_counters_t sim_counters;
+
+#ifdef __cplusplus
+}
+#endif
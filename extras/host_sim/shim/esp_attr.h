@@ -0,0 +1,8 @@
+// Host stand-in for ESP-IDF's esp_attr.h, placement attributes mean nothing on the host
+
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,9 @@
+// Host stand-in for ESP-IDF 4.4's esp_eth.h. The driver install / start of esp_eth is replaced by sim_eth.h
+
+#pragma once
+
+#include "esp_eth_com.h"
+#include "esp_eth_mac.h"
+#include "esp_eth_phy.h"
+
+typedef void *esp_eth_handle_t;
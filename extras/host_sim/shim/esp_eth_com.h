@@ -0,0 +1,61 @@
+// Host stand-in for ESP-IDF 4.4's esp_eth_com.h: frame sizes, link types and the driver mediator
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+////////////////////////////////////////
+
+#define ETH_MAX_PAYLOAD_LEN       (1500)
+#define ETH_MIN_PAYLOAD_LEN       (46)
+#define ETH_HEADER_LEN            (14)
+#define ETH_VLAN_TAG_LEN          (4)
+#define ETH_CRC_LEN               (4)
+#define ETH_ADDR_LEN              (6)
+#define ETH_MAX_PACKET_SIZE       (ETH_HEADER_LEN + ETH_VLAN_TAG_LEN + ETH_MAX_PAYLOAD_LEN + ETH_CRC_LEN)
+#define ETH_MIN_PACKET_SIZE       (ETH_HEADER_LEN + ETH_MIN_PAYLOAD_LEN + ETH_CRC_LEN)
+
+////////////////////////////////////////
+
+typedef enum
+{
+  ETH_STATE_LLINIT,
+  ETH_STATE_DEINIT,
+  ETH_STATE_LINK,
+  ETH_STATE_SPEED,
+  ETH_STATE_DUPLEX,
+  ETH_STATE_PAUSE,
+} esp_eth_state_t;
+
+typedef enum
+{
+  ETH_LINK_UP,
+  ETH_LINK_DOWN,
+} eth_link_t;
+
+typedef enum
+{
+  ETH_SPEED_10M,
+  ETH_SPEED_100M,
+  ETH_SPEED_MAX,
+} eth_speed_t;
+
+typedef enum
+{
+  ETH_DUPLEX_HALF,
+  ETH_DUPLEX_FULL,
+} eth_duplex_t;
+
+////////////////////////////////////////
+
+typedef struct esp_eth_mediator_s esp_eth_mediator_t;
+
+struct esp_eth_mediator_s
+{
+  esp_err_t (*phy_reg_read)(esp_eth_mediator_t *eth, uint32_t phy_addr, uint32_t phy_reg, uint32_t *reg_value);
+  esp_err_t (*phy_reg_write)(esp_eth_mediator_t *eth, uint32_t phy_addr, uint32_t phy_reg, uint32_t reg_value);
+  esp_err_t (*stack_input)(esp_eth_mediator_t *eth, uint8_t *buffer, uint32_t length);
+  esp_err_t (*on_state_changed)(esp_eth_mediator_t *eth, esp_eth_state_t state, void *args);
+};
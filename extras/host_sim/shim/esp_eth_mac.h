@@ -0,0 +1,70 @@
+// Host stand-in for ESP-IDF 4.4's esp_eth_mac.h, the MAC interface and the W5500 part of its configuration
+
+#pragma once
+
+#include "esp_eth_com.h"
+
+////////////////////////////////////////
+
+typedef struct esp_eth_mac_s esp_eth_mac_t;
+
+struct esp_eth_mac_s
+{
+  esp_err_t (*set_mediator)(esp_eth_mac_t *mac, esp_eth_mediator_t *eth);
+  esp_err_t (*init)(esp_eth_mac_t *mac);
+  esp_err_t (*deinit)(esp_eth_mac_t *mac);
+  esp_err_t (*start)(esp_eth_mac_t *mac);
+  esp_err_t (*stop)(esp_eth_mac_t *mac);
+  esp_err_t (*transmit)(esp_eth_mac_t *mac, uint8_t *buf, uint32_t length);
+  esp_err_t (*receive)(esp_eth_mac_t *mac, uint8_t *buf, uint32_t *length);
+  esp_err_t (*read_phy_reg)(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t *reg_value);
+  esp_err_t (*write_phy_reg)(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t reg_value);
+  esp_err_t (*set_addr)(esp_eth_mac_t *mac, uint8_t *addr);
+  esp_err_t (*get_addr)(esp_eth_mac_t *mac, uint8_t *addr);
+  esp_err_t (*set_speed)(esp_eth_mac_t *mac, eth_speed_t speed);
+  esp_err_t (*set_duplex)(esp_eth_mac_t *mac, eth_duplex_t duplex);
+  esp_err_t (*set_link)(esp_eth_mac_t *mac, eth_link_t link);
+  esp_err_t (*set_promiscuous)(esp_eth_mac_t *mac, bool enable);
+  esp_err_t (*enable_flow_ctrl)(esp_eth_mac_t *mac, bool enable);
+  esp_err_t (*set_peer_pause_ability)(esp_eth_mac_t *mac, uint32_t ability);
+  esp_err_t (*del)(esp_eth_mac_t *mac);
+};
+
+////////////////////////////////////////
+
+typedef struct
+{
+  uint32_t sw_reset_timeout_ms;
+  uint32_t rx_task_stack_size;
+  uint32_t rx_task_prio;
+  int smi_mdc_gpio_num;
+  int smi_mdio_gpio_num;
+  uint32_t flags;
+} eth_mac_config_t;
+
+#define ETH_MAC_FLAG_WORK_WITH_CACHE_DISABLE (1 << 0)
+#define ETH_MAC_FLAG_PIN_TO_CORE             (1 << 1)
+
+#define ETH_MAC_DEFAULT_CONFIG()  \
+  {                               \
+    .sw_reset_timeout_ms = 100,   \
+    .rx_task_stack_size = 2048,   \
+    .rx_task_prio = 15,           \
+    .smi_mdc_gpio_num = 23,       \
+    .smi_mdio_gpio_num = 18,      \
+    .flags = 0,                   \
+  }
+
+////////////////////////////////////////
+
+typedef struct
+{
+  void *spi_hdl;
+  int int_gpio_num;
+} eth_w5500_config_t;
+
+#define ETH_W5500_DEFAULT_CONFIG(spi_device)  \
+  {                                           \
+    .spi_hdl = spi_device,                    \
+    .int_gpio_num = 4,                        \
+  }
@@ -0,0 +1,46 @@
+// Host stand-in for ESP-IDF 4.4's esp_eth_phy.h, the PHY interface
+
+#pragma once
+
+#include "esp_eth_com.h"
+
+////////////////////////////////////////
+
+#define ESP_ETH_PHY_ADDR_AUTO     (-1)
+
+typedef struct esp_eth_phy_s esp_eth_phy_t;
+
+struct esp_eth_phy_s
+{
+  esp_err_t (*set_mediator)(esp_eth_phy_t *phy, esp_eth_mediator_t *mediator);
+  esp_err_t (*reset)(esp_eth_phy_t *phy);
+  esp_err_t (*reset_hw)(esp_eth_phy_t *phy);
+  esp_err_t (*init)(esp_eth_phy_t *phy);
+  esp_err_t (*deinit)(esp_eth_phy_t *phy);
+  esp_err_t (*negotiate)(esp_eth_phy_t *phy);
+  esp_err_t (*get_link)(esp_eth_phy_t *phy);
+  esp_err_t (*pwrctl)(esp_eth_phy_t *phy, bool enable);
+  esp_err_t (*set_addr)(esp_eth_phy_t *phy, uint32_t addr);
+  esp_err_t (*get_addr)(esp_eth_phy_t *phy, uint32_t *addr);
+  esp_err_t (*advertise_pause_ability)(esp_eth_phy_t *phy, uint32_t ability);
+  esp_err_t (*loopback)(esp_eth_phy_t *phy, bool enable);
+  esp_err_t (*del)(esp_eth_phy_t *phy);
+};
+
+////////////////////////////////////////
+
+typedef struct
+{
+  int32_t phy_addr;
+  uint32_t reset_timeout_ms;
+  uint32_t autonego_timeout_ms;
+  int reset_gpio_num;
+} eth_phy_config_t;
+
+#define ETH_PHY_DEFAULT_CONFIG()            \
+  {                                         \
+    .phy_addr = ESP_ETH_PHY_ADDR_AUTO,      \
+    .reset_timeout_ms = 100,                \
+    .autonego_timeout_ms = 4000,            \
+    .reset_gpio_num = 5,                    \
+  }
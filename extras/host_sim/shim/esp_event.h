@@ -0,0 +1,5 @@
+// Host stand-in for ESP-IDF's esp_event.h. Included by esp_eth_spi_w5500.c, which uses nothing of it
+
+#pragma once
+
+#include "esp_err.h"
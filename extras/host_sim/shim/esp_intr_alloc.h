@@ -0,0 +1,10 @@
+// Host stand-in for ESP-IDF's esp_intr_alloc.h, the flags are accepted and ignored
+
+#pragma once
+
+#define ESP_INTR_FLAG_LEVEL1      (1 << 1)
+#define ESP_INTR_FLAG_LEVEL2      (1 << 2)
+#define ESP_INTR_FLAG_LEVEL3      (1 << 3)
+#define ESP_INTR_FLAG_SHARED      (1 << 8)
+#define ESP_INTR_FLAG_EDGE        (1 << 9)
+#define ESP_INTR_FLAG_IRAM        (1 << 10)
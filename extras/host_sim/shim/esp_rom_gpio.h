@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF's esp_rom_gpio.h
+
+#pragma once
+
+#include <stdint.h>
+
+void esp_rom_gpio_pad_select_gpio(uint32_t iopad_num);
@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF's esp_rom_sys.h, esp_rom_delay_us() busy-waits like the ROM function
+
+#pragma once
+
+#include <stdint.h>
+
+void esp_rom_delay_us(uint32_t us);
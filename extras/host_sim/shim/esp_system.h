@@ -0,0 +1,5 @@
+// Host stand-in for ESP-IDF's esp_system.h, nothing of it is used by the simulated sources beyond esp_err.h
+
+#pragma once
+
+#include "esp_err.h"
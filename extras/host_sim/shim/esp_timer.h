@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF's esp_timer.h, microseconds of CLOCK_MONOTONIC since the program started
+
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
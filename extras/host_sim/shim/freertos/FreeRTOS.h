@@ -0,0 +1,58 @@
+// Host stand-in for FreeRTOS.h / portmacro.h of ESP-IDF 4.4: tasks are pthreads, see host_freertos.c.
+// Build with _GNU_SOURCE (recursive mutex initializer), the Makefile does
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+////////////////////////////////////////
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE                   ((BaseType_t) 0)
+#define pdTRUE                    ((BaseType_t) 1)
+#define pdPASS                    (pdTRUE)
+#define pdFAIL                    (pdFALSE)
+#define errQUEUE_EMPTY            ((BaseType_t) 0)
+#define errQUEUE_FULL             ((BaseType_t) 0)
+
+#define configTICK_RATE_HZ        (CONFIG_FREERTOS_HZ)
+#define configMAX_PRIORITIES      (25)
+#define portTICK_PERIOD_MS        ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY             ((TickType_t) 0xffffffffUL)
+#define portNUM_PROCESSORS        (2)
+#define tskNO_AFFINITY            (0x7FFFFFFF)
+
+#define pdMS_TO_TICKS(xTimeInMs)  ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+////////////////////////////////////////
+
+// Critical sections are a recursive mutex per portMUX, they don't mask the simulated GPIO interrupt
+typedef struct
+{
+  pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  { .mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+
+void sim_mux_init(portMUX_TYPE *mux);
+void sim_mux_enter(portMUX_TYPE *mux);
+void sim_mux_exit(portMUX_TYPE *mux);
+
+#define portMUX_INITIALIZE(mux)       sim_mux_init(mux)
+#define portENTER_CRITICAL(mux)       sim_mux_enter(mux)
+#define portEXIT_CRITICAL(mux)        sim_mux_exit(mux)
+#define portENTER_CRITICAL_ISR(mux)   sim_mux_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux)    sim_mux_exit(mux)
+#define portENTER_CRITICAL_SAFE(mux)  sim_mux_enter(mux)
+#define portEXIT_CRITICAL_SAFE(mux)   sim_mux_exit(mux)
+
+// The simulated ISR runs on the thread raising the GPIO edge, the notified task is woken by its condition variable
+#define portYIELD_FROM_ISR(...)       do { } while (0)
@@ -0,0 +1,33 @@
+// Host stand-in for FreeRTOS task.h: tasks, delays, ticks (1ms) and direct-to-task notifications
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+////////////////////////////////////////
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+// Stack size, priority and core are accepted and ignored, every task is a plain pthread
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+
+#define xTaskCreate(task_code, name, stack_depth, arg, priority, created_task) \
+  xTaskCreatePinnedToCore(task_code, name, stack_depth, arg, priority, created_task, tskNO_AFFINITY)
+
+// Another task is stopped at its next blocking call (semaphore, notification, delay) and joined
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+// Threads not created through xTaskCreatePinnedToCore() (main, the model) get a handle on first use
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+
+void sim_task_yield(void);
+
+#define taskYIELD()               sim_task_yield()
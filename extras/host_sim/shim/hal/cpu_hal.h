@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF's hal/cpu_hal.h, every thread claims to run on core 0
+
+#pragma once
+
+#include <stdint.h>
+
+uint32_t cpu_hal_get_core_id(void);
@@ -0,0 +1,10 @@
+// Host stand-in for the Arduino-ESP32 2.x sdkconfig.h, only what the simulated sources and shim look at
+
+#pragma once
+
+#define CONFIG_IDF_TARGET_ESP32         1
+#define CONFIG_FREERTOS_HZ              1000
+#define CONFIG_FREERTOS_UNICORE         0
+#define CONFIG_ETH_SPI_ETHERNET_W5500   1
+#define CONFIG_ETH_USE_SPI_ETHERNET     1
+#define CONFIG_LOG_DEFAULT_LEVEL        2
@@ -0,0 +1,10 @@
+// The host's sys/cdefs.h plus __containerof(), which ESP-IDF gets from newlib's
+
+#pragma once
+
+#include_next <sys/cdefs.h>
+#include <stddef.h>
+
+#ifndef __containerof
+  #define __containerof(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
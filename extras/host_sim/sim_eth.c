@@ -0,0 +1,243 @@
+/****************************************************************************************************************************
+  sim_eth.c - Just enough of esp_eth to run the w5500 MAC and PHY drivers on the host: mediator, link check, RX sink
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Follows esp_eth.c of IDF 4.4, with the link check timer as a task and stack_input handing frames to a callback
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include "esp_log.h"
+#include "sim_eth.h"
+
+static const char *TAG = "sim.eth";
+
+////////////////////////////////////////
+
+static esp_err_t sim_eth_phy_reg_read(esp_eth_mediator_t *mediator, uint32_t phy_addr, uint32_t phy_reg,
+                                      uint32_t *reg_value)
+{
+  sim_eth_t *eth = __containerof(mediator, sim_eth_t, mediator);
+
+  return eth->mac->read_phy_reg(eth->mac, phy_addr, phy_reg, reg_value);
+}
+
+////////////////////////////////////////
+
+static esp_err_t sim_eth_phy_reg_write(esp_eth_mediator_t *mediator, uint32_t phy_addr, uint32_t phy_reg,
+                                       uint32_t reg_value)
+{
+  sim_eth_t *eth = __containerof(mediator, sim_eth_t, mediator);
+
+  return eth->mac->write_phy_reg(eth->mac, phy_addr, phy_reg, reg_value);
+}
+
+////////////////////////////////////////
+
+static esp_err_t sim_eth_stack_input(esp_eth_mediator_t *mediator, uint8_t *buffer, uint32_t length)
+{
+  sim_eth_t *eth = __containerof(mediator, sim_eth_t, mediator);
+
+  if (eth->input)
+  {
+    eth->input(eth->mac, buffer, length, eth->input_arg);
+  }
+  else
+  {
+    esp_eth_mac_w5500_free_rx_buffer(eth->mac, buffer);
+  }
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+static esp_err_t sim_eth_on_state_changed(esp_eth_mediator_t *mediator, esp_eth_state_t state, void *args)
+{
+  sim_eth_t *eth = __containerof(mediator, sim_eth_t, mediator);
+  esp_err_t ret = ESP_OK;
+
+  switch (state)
+  {
+    case ETH_STATE_LINK:
+      ret = eth->mac->set_link(eth->mac, (eth_link_t)(uintptr_t)args);
+
+      if (ret == ESP_OK)
+      {
+        __atomic_store_n(&eth->link, (eth_link_t)(uintptr_t)args, __ATOMIC_RELEASE);
+      }
+
+      break;
+
+    case ETH_STATE_SPEED:
+      eth->speed = (eth_speed_t)(uintptr_t)args;
+      ret = eth->mac->set_speed(eth->mac, eth->speed);
+      break;
+
+    case ETH_STATE_DUPLEX:
+      eth->duplex = (eth_duplex_t)(uintptr_t)args;
+      ret = eth->mac->set_duplex(eth->mac, eth->duplex);
+      break;
+
+    default:
+      break;
+  }
+
+  if (ret != ESP_OK)
+  {
+    ESP_LOGE(TAG, "state %d change failed: %s", state, esp_err_to_name(ret));
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+static void sim_eth_link_task(void *arg)
+{
+  sim_eth_t *eth = arg;
+
+  while (!__atomic_load_n(&eth->link_task_stop, __ATOMIC_ACQUIRE))
+  {
+    eth->phy->get_link(eth->phy);
+    vTaskDelay(pdMS_TO_TICKS(eth->check_link_period_ms));
+  }
+
+  xSemaphoreGive(eth->link_task_done);
+  vTaskDelete(NULL);
+}
+
+////////////////////////////////////////
+
+esp_err_t sim_eth_install(sim_eth_t *eth, esp_eth_mac_t *mac, esp_eth_phy_t *phy, uint32_t check_link_period_ms,
+                          sim_eth_input_t input, void *input_arg)
+{
+  esp_err_t ret;
+
+  *eth = (sim_eth_t)
+  {
+    .mediator =
+    {
+      .phy_reg_read = sim_eth_phy_reg_read,
+      .phy_reg_write = sim_eth_phy_reg_write,
+      .stack_input = sim_eth_stack_input,
+      .on_state_changed = sim_eth_on_state_changed,
+    },
+    .mac = mac,
+    .phy = phy,
+    .input = input,
+    .input_arg = input_arg,
+    .check_link_period_ms = check_link_period_ms ? check_link_period_ms : 2000,
+    .link = ETH_LINK_DOWN,
+  };
+
+  eth->link_task_done = xSemaphoreCreateBinary();
+
+  if (!eth->link_task_done)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+
+  mac->set_mediator(mac, &eth->mediator);
+  phy->set_mediator(phy, &eth->mediator);
+
+  if ((ret = mac->init(mac)) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "init mac failed: %s", esp_err_to_name(ret));
+
+    goto err;
+  }
+
+  if ((ret = phy->init(phy)) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "init phy failed: %s", esp_err_to_name(ret));
+    mac->deinit(mac);
+
+    goto err;
+  }
+
+  return ESP_OK;
+
+err:
+  vSemaphoreDelete(eth->link_task_done);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+esp_err_t sim_eth_start(sim_eth_t *eth)
+{
+  esp_err_t ret = eth->phy->reset(eth->phy);
+
+  if (ret != ESP_OK)
+  {
+    ESP_LOGE(TAG, "reset phy failed: %s", esp_err_to_name(ret));
+
+    return ret;
+  }
+
+  eth->link_task_stop = false;
+
+  if (xTaskCreate(sim_eth_link_task, "eth_link", 4096, eth, 5, &eth->link_task) != pdPASS)
+  {
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_err_t sim_eth_stop(sim_eth_t *eth)
+{
+  // the link check finishes its round, it may be in the middle of bringing the MAC up
+  __atomic_store_n(&eth->link_task_stop, true, __ATOMIC_RELEASE);
+  xSemaphoreTake(eth->link_task_done, portMAX_DELAY);
+  eth->link_task = NULL;
+
+  return eth->mac->stop(eth->mac);
+}
+
+////////////////////////////////////////
+
+esp_err_t sim_eth_uninstall(sim_eth_t *eth)
+{
+  esp_err_t ret = eth->phy->deinit(eth->phy);
+
+  if (ret == ESP_OK)
+  {
+    ret = eth->mac->deinit(eth->mac);
+  }
+
+  eth->phy->del(eth->phy);
+  eth->mac->del(eth->mac);
+  vSemaphoreDelete(eth->link_task_done);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+bool sim_eth_wait_link(sim_eth_t *eth, eth_link_t link, uint32_t timeout_ms)
+{
+  TickType_t start = xTaskGetTickCount();
+
+  while (__atomic_load_n(&eth->link, __ATOMIC_ACQUIRE) != link)
+  {
+    if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms))
+    {
+      return false;
+    }
+
+    vTaskDelay(1);
+  }
+
+  return true;
+}
@@ -0,0 +1,82 @@
+/****************************************************************************************************************************
+  sim_eth.h - Just enough of esp_eth to run the w5500 MAC and PHY drivers on the host: mediator, link check, RX sink
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#pragma once
+
+#include "esp_eth.h"
+#include "esp_eth_w5500.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////
+
+// Defined in esp_eth_spi_w5500.c without a header, esp32_w5500.cpp declares it the same way
+esp_eth_mac_t *w5500_begin(int MISO_GPIO, int MOSI_GPIO, int SCLK_GPIO, int CS_GPIO, int INT_GPIO, int SPICLOCK_MHZ,
+                           int SPIHOST, int SPI_QUEUE_SIZE, int DMA_CHANNEL, int SPICLOCK_MAX_MHZ,
+                           uint32_t *SPICLOCK_HZ, const eth_mac_config_t *MAC_CONFIG,
+                           const eth_w5500_ext_config_t *EXT_CONFIG);
+
+/**
+   @brief What the stack would get: a received frame, to be released with esp_eth_mac_w5500_free_rx_buffer()
+
+*/
+typedef void (*sim_eth_input_t)(esp_eth_mac_t *mac, uint8_t *buffer, uint32_t length, void *arg);
+
+typedef struct
+{
+  esp_eth_mediator_t mediator;
+  esp_eth_mac_t *mac;
+  esp_eth_phy_t *phy;
+  sim_eth_input_t input;
+  void *input_arg;
+  uint32_t check_link_period_ms;
+  TaskHandle_t link_task;
+  SemaphoreHandle_t link_task_done;
+  bool link_task_stop;          // atomic
+  eth_link_t link;              // atomic, as last reported by the link check
+  eth_speed_t speed;
+  eth_duplex_t duplex;
+} sim_eth_t;
+
+/**
+   @brief esp_eth_driver_install(): mediator wired to both drivers, MAC init, PHY init. A NULL input frees the frames
+
+*/
+esp_err_t sim_eth_install(sim_eth_t *eth, esp_eth_mac_t *mac, esp_eth_phy_t *phy, uint32_t check_link_period_ms,
+                          sim_eth_input_t input, void *input_arg);
+
+/**
+   @brief esp_eth_start() / esp_eth_stop(): PHY reset and the periodic link check, which brings the MAC up and down
+
+*/
+esp_err_t sim_eth_start(sim_eth_t *eth);
+esp_err_t sim_eth_stop(sim_eth_t *eth);
+
+/**
+   @brief esp_eth_driver_uninstall() and the drivers' del()
+
+*/
+esp_err_t sim_eth_uninstall(sim_eth_t *eth);
+
+/**
+   @brief Wait until the link check has reported the link state, false on timeout
+
+*/
+bool sim_eth_wait_link(sim_eth_t *eth, eth_link_t link, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,477 @@
+/****************************************************************************************************************************
+  w5500_bench.c - Host microbenchmark of the w5500 MAC driver hot paths against the simulated chip, JSON results
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// The cases of examples/MACBenchmark, driven the same way: TX straight through the MAC driver, RX through its task
+// loop from frames the chip receives, with the library's default driver configuration.
+// Prints one JSON object per line and case. The per frame counts (SPI, locks, allocations) only vary with the tasks'
+// interleaving, compare them between library versions. frames_per_s is the host CPU's, comparable on one machine only.
+// Every case runs with each driver configuration, in its own process: the defaults, without the RX pool, with per
+// frame and with batched RX, and with synchronous TX, for the before / after of those options.
+// Usage: w5500_bench [milliseconds per case, default 500]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "sim_eth.h"
+#include "w5500_model.h"
+
+#ifndef W5500_BENCH_VERSION
+  #define W5500_BENCH_VERSION     "unknown"
+#endif
+
+#define BENCH_CS_GPIO             5
+#define BENCH_INT_GPIO            4
+#define BENCH_SPI_MHZ             25
+#define BENCH_SPI_QUEUE_SIZE      20
+#define BENCH_DURATION_MS         500
+#define BENCH_BURST_FRAMES        32
+#define BENCH_ETHERTYPE           0x88B5
+#define BENCH_TIMEOUT_US          (5 * 1000 * 1000)
+
+// Frame size of the n-th frame of a mix
+typedef uint32_t (*bench_mix_t)(uint32_t n);
+
+typedef struct
+{
+  const char *name;
+  bench_mix_t mix;
+  bool rx;                      // frames arrive from the wire, else they're sent
+  uint32_t burst;               // frames back to back from idle, 0 => continuous
+  bool segmented;               // TX as header + two payload pieces, the way lwIP passes a pbuf chain
+  bool pipeline;                // RX with esp_eth_mac_w5500_set_rx_pipeline()
+} bench_case_t;
+
+static const uint8_t own_mac[6] = { 0x02, 0x00, 0x00, 0x55, 0x00, 0x01 };
+static const uint8_t peer_mac[6] = { 0x02, 0x00, 0x00, 0x77, 0x00, 0x02 };
+
+static uint8_t tx_frame[ETH_MAX_PACKET_SIZE];
+static uint8_t rx_frame[ETH_MAX_PACKET_SIZE];
+
+// atomic, frames on the wire and frames the stack got
+static uint64_t wire_frames;
+static uint64_t stack_frames;
+static uint64_t stack_bytes;
+
+////////////////////////////////////////
+
+static uint32_t mix_64(uint32_t n)
+{
+  return 64;
+}
+
+static uint32_t mix_1514(uint32_t n)
+{
+  return 1514;
+}
+
+// Simple IMIX, 7 : 4 : 1 of 64, 594 and 1514 byte frames
+static uint32_t mix_imix(uint32_t n)
+{
+  n %= 12;
+
+  return (n < 7) ? 64 : ((n < 11) ? 594 : 1514);
+}
+
+// Odd size, so successive frames straddle the end of the 16KB rings at ever changing offsets
+static uint32_t mix_wrap(uint32_t n)
+{
+  return 997;
+}
+
+static const bench_case_t bench_cases[] =
+{
+  { "tx_64",             mix_64,   false, 0,                  false, false },
+  { "tx_imix",           mix_imix, false, 0,                  false, false },
+  { "tx_1514",           mix_1514, false, 0,                  false, false },
+  { "tx_wrap",           mix_wrap, false, 0,                  false, false },
+  { "tx_burst_1514",     mix_1514, false, BENCH_BURST_FRAMES, false, false },
+  { "tx_sg_1514",        mix_1514, false, 0,                  true,  false },
+  { "rx_64",             mix_64,   true,  0,                  false, false },
+  { "rx_imix",           mix_imix, true,  0,                  false, false },
+  { "rx_1514",           mix_1514, true,  0,                  false, false },
+  { "rx_wrap",           mix_wrap, true,  0,                  false, false },
+  { "rx_burst_64",       mix_64,   true,  BENCH_BURST_FRAMES, false, false },
+  { "rx_burst_imix",     mix_imix, true,  BENCH_BURST_FRAMES, false, false },
+  { "rx_pipelined_imix", mix_imix, true,  0,                  false, true  },
+};
+
+////////////////////////////////////////
+
+static void bench_on_wire(uint8_t sock, const uint8_t *data, uint32_t length, void *arg)
+{
+  if (sock == 0)
+  {
+    __atomic_fetch_add(&wire_frames, 1, __ATOMIC_RELEASE);
+  }
+}
+
+////////////////////////////////////////
+
+static void bench_input(esp_eth_mac_t *mac, uint8_t *buffer, uint32_t length, void *arg)
+{
+  __atomic_fetch_add(&stack_bytes, length, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stack_frames, 1, __ATOMIC_RELEASE);
+  esp_eth_mac_w5500_free_rx_buffer(mac, buffer);
+}
+
+////////////////////////////////////////
+
+// Spin (yielding) until the counter reaches target, false on timeout. A tick wait would cap the rates at 1 per ms
+static bool bench_wait(uint64_t *value, uint64_t target)
+{
+  int64_t start = esp_timer_get_time();
+
+  while (__atomic_load_n(value, __ATOMIC_ACQUIRE) < target)
+  {
+    if (esp_timer_get_time() - start > BENCH_TIMEOUT_US)
+    {
+      return false;
+    }
+
+    taskYIELD();
+  }
+
+  return true;
+}
+
+////////////////////////////////////////
+
+// Send frames for duration_ms, wait for the last one to leave. Returns the frames sent, the refused attempts
+// (full TX queue / ring, retried as lwIP's sender would be throttled) are counted in tx_drops_no_mem
+static uint64_t bench_tx(esp_eth_mac_t *mac, const bench_case_t *bench, uint32_t duration_ms, uint32_t *attempts,
+                         bool *timeout)
+{
+  uint64_t first = __atomic_load_n(&wire_frames, __ATOMIC_ACQUIRE);
+  uint64_t sent = 0;
+  int64_t start = esp_timer_get_time();
+
+  while (esp_timer_get_time() - start < (int64_t)duration_ms * 1000)
+  {
+    uint32_t len = bench->mix(sent);
+    esp_err_t ret;
+
+    if (bench->segmented)
+    {
+      eth_w5500_tx_segment_t segments[3] =
+      {
+        { tx_frame, ETH_HEADER_LEN }, { tx_frame + ETH_HEADER_LEN, len / 2 - ETH_HEADER_LEN },
+        { tx_frame + len / 2, len - len / 2 }
+      };
+
+      ret = esp_eth_mac_w5500_transmit_segments(mac, segments, 3);
+    }
+    else
+    {
+      ret = mac->transmit(mac, tx_frame, len);
+    }
+
+    (*attempts)++;
+
+    if (ret == ESP_ERR_NO_MEM)
+    {
+      taskYIELD();
+
+      continue;
+    }
+
+    if (ret != ESP_OK)
+    {
+      fprintf(stderr, "%s: transmit of %u bytes: %s\n", bench->name, len, esp_err_to_name(ret));
+      *timeout = true;
+
+      break;
+    }
+
+    sent++;
+
+    // the next burst starts with the TX queue and ring empty
+    if (bench->burst && (sent % bench->burst == 0) && !bench_wait(&wire_frames, first + sent))
+    {
+      *timeout = true;
+
+      break;
+    }
+  }
+
+  if (!bench_wait(&wire_frames, first + sent))
+  {
+    *timeout = true;
+  }
+
+  return sent;
+}
+
+////////////////////////////////////////
+
+// Let frames arrive for duration_ms, as fast as the RX ring takes them, and wait until the stack got the last one.
+// Returns the frames received
+static uint64_t bench_rx(w5500_model_t *model, const bench_case_t *bench, uint32_t duration_ms, bool *timeout)
+{
+  uint64_t first = __atomic_load_n(&stack_frames, __ATOMIC_ACQUIRE);
+  uint64_t injected = 0;
+  int64_t start = esp_timer_get_time();
+
+  while (esp_timer_get_time() - start < (int64_t)duration_ms * 1000)
+  {
+    uint32_t len = bench->mix(injected);
+    int64_t wait_start = esp_timer_get_time();
+
+    // the wire is faster than the driver: wait for the ring to have room, as the sender's flow would
+    while (w5500_model_rx_free(model) < len + 2)
+    {
+      if (esp_timer_get_time() - wait_start > BENCH_TIMEOUT_US)
+      {
+        *timeout = true;
+
+        return injected;
+      }
+
+      taskYIELD();
+    }
+
+    if (!w5500_model_receive(model, rx_frame, len))
+    {
+      fprintf(stderr, "%s: the chip dropped a frame of %u bytes\n", bench->name, len);
+      *timeout = true;
+
+      break;
+    }
+
+    injected++;
+
+    // the next burst arrives with the driver idle again
+    if (bench->burst && (injected % bench->burst == 0) && !bench_wait(&stack_frames, first + injected))
+    {
+      *timeout = true;
+
+      break;
+    }
+  }
+
+  if (!bench_wait(&stack_frames, first + injected))
+  {
+    *timeout = true;
+  }
+
+  return injected;
+}
+
+////////////////////////////////////////
+
+static bool bench_run(const char *config, const bench_case_t *bench, esp_eth_mac_t *mac, w5500_model_t *model,
+                      uint32_t duration_ms)
+{
+  w5500_model_counters_t chip;
+  sim_counters_t before, after;
+  eth_w5500_stats_t stats;
+  uint32_t attempts = 0;
+  bool timeout = false;
+  uint64_t frames, bytes;
+
+  esp_eth_mac_w5500_set_rx_pipeline(mac, bench->pipeline);
+  esp_eth_mac_w5500_reset_stats(mac);
+  w5500_model_reset_counters(model);
+  sim_counters_get(&before);
+
+  uint64_t rx_bytes_first = __atomic_load_n(&stack_bytes, __ATOMIC_ACQUIRE);
+  int64_t start = esp_timer_get_time();
+
+  if (bench->rx)
+  {
+    frames = bench_rx(model, bench, duration_ms, &timeout);
+  }
+  else
+  {
+    frames = bench_tx(mac, bench, duration_ms, &attempts, &timeout);
+  }
+
+  int64_t elapsed_us = esp_timer_get_time() - start;
+
+  sim_counters_get(&after);
+  w5500_model_get_counters(model, &chip);
+  esp_eth_mac_w5500_get_stats(mac, &stats);
+  esp_eth_mac_w5500_set_rx_pipeline(mac, ETH_W5500_RX_PIPELINE);
+
+  bytes = bench->rx ? __atomic_load_n(&stack_bytes, __ATOMIC_ACQUIRE) - rx_bytes_first : chip.tx_bytes;
+
+  double per_frame = frames ? 1.0 / frames : 0.0;
+  double seconds = elapsed_us / 1e6;
+
+  printf("{\"case\":\"%s\",\"config\":\"%s\",\"version\":\"%s\",\"target\":\"host\",\"spi_clock_mhz\":%d,",
+         bench->name, config, W5500_BENCH_VERSION, BENCH_SPI_MHZ);
+  printf("\"duration_ms\":%u,", (uint32_t)(elapsed_us / 1000));
+  printf("\"tx_attempts\":%u,\"tx_frames\":%u,\"tx_drops\":%u,\"rx_frames\":%u,\"rx_drops\":%u,", attempts,
+         stats.tx_frames, stats.tx_drops_no_mem, stats.rx_frames, stats.rx_drops_no_mem);
+  printf("\"frames_per_s\":%.1f,\"bytes_per_s\":%.1f,", frames / seconds, bytes / seconds);
+  // what the chip saw on its SPI pins, and how long that takes at the SPI clock
+  printf("\"spi_bytes_per_frame\":%.1f,\"spi_transactions_per_frame\":%.2f,\"spi_queued_per_frame\":%.2f,",
+         chip.spi_bytes * per_frame, chip.spi_transactions * per_frame,
+         (after.spi_queued - before.spi_queued) * per_frame);
+  printf("\"spi_bus_us_per_frame\":%.2f,\"spi_dma_bounces_per_frame\":%.2f,", chip.spi_bus_ns / 1000.0 * per_frame,
+         (after.spi_dma_bounces - before.spi_dma_bounces) * per_frame);
+  // SPI sessions of the driver, then every FreeRTOS lock of the process, link check included
+  printf("\"lock_acquisitions_per_frame\":%.2f,\"semaphore_takes_per_frame\":%.2f,"
+         "\"critical_sections_per_frame\":%.2f,\"task_notifications_per_frame\":%.2f,",
+         stats.spi_lock_acquisitions * per_frame, (after.semaphore_takes - before.semaphore_takes) * per_frame,
+         (after.critical_sections - before.critical_sections) * per_frame,
+         (after.task_notifications - before.task_notifications) * per_frame);
+  printf("\"heap_allocs_per_frame\":%.3f,\"rx_pool_misses\":%u,",
+         (after.heap_allocs - before.heap_allocs) * per_frame, stats.rx_pool_misses);
+  printf("\"rx_wakeups\":%u,\"rx_poll_rounds\":%u,\"rx_pipelined_frames\":%u,\"rx_copied_per_byte\":%.3f,",
+         stats.rx_wakeups, stats.rx_poll_rounds, stats.rx_pipelined_frames,
+         stats.rx_bytes ? (double)stats.rx_bytes_copied / stats.rx_bytes : 0.0);
+  printf("\"violations\":%llu,\"timeout\":%s}\n", (unsigned long long)chip.violations, timeout ? "true" : "false");
+  fflush(stdout);
+
+  return !timeout && !chip.violations;
+}
+
+////////////////////////////////////////
+
+// All cases with one driver configuration. Returns the cases failed
+static int bench_config(const char *config, const eth_w5500_ext_config_t *ext, uint32_t duration_ms)
+{
+  uint32_t clock_hz = 0;
+  sim_eth_t eth;
+  w5500_model_config_t chip = W5500_MODEL_DEFAULT_CONFIG();
+  eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+  eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+  int failed = 0;
+
+  // SEND_OK with the command: the frames/s measure the driver, not the simulated 100Mbit/s wire
+  chip.cs_gpio = BENCH_CS_GPIO;
+  chip.int_gpio = BENCH_INT_GPIO;
+  chip.wire_timing = false;
+  chip.on_transmit = bench_on_wire;
+
+  w5500_model_t *model = w5500_model_new(&chip);
+
+  if (!model)
+  {
+    fprintf(stderr, "no chip model\n");
+
+    return 1;
+  }
+
+  w5500_model_set_link(model, true, true, true);
+
+  esp_eth_mac_t *mac = w5500_begin(19, 23, 18, BENCH_CS_GPIO, BENCH_INT_GPIO, BENCH_SPI_MHZ, SPI2_HOST,
+                                   BENCH_SPI_QUEUE_SIZE, SPI_DMA_CH_AUTO, 0, &clock_hz, &mac_config, ext);
+
+  phy_config.reset_gpio_num = -1;
+  esp_eth_phy_t *phy = esp_eth_phy_new_w5500(&phy_config);
+
+  // the link check's PHYCFGR reads stay out of the way with esp_eth's default period
+  if (!mac || !phy || (sim_eth_install(&eth, mac, phy, 2000, bench_input, NULL) != ESP_OK))
+  {
+    fprintf(stderr, "%s: driver install failed\n", config);
+    w5500_model_del(model);
+
+    return 1;
+  }
+
+  mac->set_addr(mac, (uint8_t *)own_mac);
+
+  if ((sim_eth_start(&eth) != ESP_OK) || !sim_eth_wait_link(&eth, ETH_LINK_UP, 1000))
+  {
+    fprintf(stderr, "%s: no link up\n", config);
+
+    return 1;
+  }
+
+  for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+  {
+    if (!bench_run(config, &bench_cases[i], mac, model, duration_ms))
+    {
+      fprintf(stderr, "%s: %s failed\n", config, bench_cases[i].name);
+      failed++;
+    }
+  }
+
+  sim_eth_stop(&eth);
+  sim_eth_uninstall(&eth);
+  w5500_model_del(model);
+
+  return failed;
+}
+
+////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+  uint32_t duration_ms = (argc > 1) ? strtoul(argv[1], NULL, 0) : BENCH_DURATION_MS;
+  static eth_w5500_ext_config_t configs[5];
+  static const char *config_names[5] = { "default", "no_pool", "per_frame_rx", "batch_rx", "sync_tx" };
+  int failed = 0;
+
+  if (!duration_ms)
+  {
+    fprintf(stderr, "usage: %s [milliseconds per case]\n", argv[0]);
+
+    return 2;
+  }
+
+  for (int i = 0; i < 5; i++)
+  {
+    configs[i] = (eth_w5500_ext_config_t)ETH_W5500_EXT_DEFAULT_CONFIG();
+  }
+
+  // heap buffer per received frame, as before the RX pool
+  configs[1].rx_pool_depth = 0;
+
+  // one SPI read sequence per frame against the batched RX drain, whichever of them is the default
+  configs[2].rx_batch_size = 0;
+  configs[3].rx_batch_size = 4096;
+
+  // transmit waits for SEND_OK, no TX queue
+  configs[4].tx_queue_depth = 0;
+
+  // broadcast from us / to us from the peer, then a counting payload
+  memset(tx_frame, 0xFF, 6);
+  memcpy(tx_frame + 6, own_mac, 6);
+  memcpy(rx_frame, own_mac, 6);
+  memcpy(rx_frame + 6, peer_mac, 6);
+
+  for (int i = 12; i < ETH_MAX_PACKET_SIZE; i++)
+  {
+    tx_frame[i] = rx_frame[i] = i & 0xFF;
+  }
+
+  tx_frame[12] = rx_frame[12] = BENCH_ETHERTYPE >> 8;
+  tx_frame[13] = rx_frame[13] = BENCH_ETHERTYPE & 0xFF;
+
+  // one process per configuration, w5500_begin() adds an SPI device and the GPIO ISR service for good
+  for (int i = 0; i < 5; i++)
+  {
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+      exit(bench_config(config_names[i], &configs[i], duration_ms) ? 1 : 0);
+    }
+
+    int status = 0;
+
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+      fprintf(stderr, "%s: failed (status 0x%x)\n", config_names[i], status);
+      failed++;
+    }
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,1178 @@
+/****************************************************************************************************************************
+  w5500_model.c - Register level software model of the WIZnet W5500, behind the host SPI / GPIO shim
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// Register offsets and bits come from the datasheet, not from the driver's w5500.h, so a wrong define there shows up.
+// One lock per chip serialises SPI transactions, frames from the wire and the timer thread. INTn is driven with the
+// lock held, the driver's ISR only notifies its task and doesn't come back into the model
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "host_sim.h"
+#include "w5500_model.h"
+
+static const char *TAG = "w5500.model";
+
+// Common registers
+#define COM_MR              (0x00)
+#define COM_SHAR            (0x09)
+#define COM_INTLEVEL        (0x13)
+#define COM_IR              (0x15)
+#define COM_IMR             (0x16)
+#define COM_SIR             (0x17)
+#define COM_SIMR            (0x18)
+#define COM_RTR             (0x19)
+#define COM_RCR             (0x1B)
+#define COM_PTIMER          (0x1C)
+#define COM_PMAGIC          (0x1D)
+#define COM_PMRU            (0x26)
+#define COM_PHYCFGR         (0x2E)
+#define COM_VERSIONR        (0x39)
+#define COM_SIZE            (0x3A)
+
+#define MR_RST              (0x80)
+
+#define PHYCFGR_RST         (0x80)  // active low, 0 holds the PHY in reset
+#define PHYCFGR_WRITABLE    (0xF8)  // RST, OPMD, OPMDC, the status bits below are read only
+#define PHYCFGR_DPX         (0x04)
+#define PHYCFGR_SPD         (0x02)
+#define PHYCFGR_LNK         (0x01)
+
+#define VERSIONR_W5500      (0x04)
+
+// Socket registers
+#define SN_MR               (0x00)
+#define SN_CR               (0x01)
+#define SN_IR               (0x02)
+#define SN_SR               (0x03)
+#define SN_PORT             (0x04)
+#define SN_DHAR             (0x06)
+#define SN_DIPR             (0x0C)
+#define SN_DPORT            (0x10)
+#define SN_TTL              (0x16)
+#define SN_RXBUF_SIZE       (0x1E)
+#define SN_TXBUF_SIZE       (0x1F)
+#define SN_TX_FSR           (0x20)
+#define SN_TX_RD            (0x22)
+#define SN_TX_WR            (0x24)
+#define SN_RX_RSR           (0x26)
+#define SN_RX_RD            (0x28)
+#define SN_RX_WR            (0x2A)
+#define SN_IMR              (0x2C)
+#define SN_FRAG             (0x2D)
+#define SN_SIZE             (0x30)
+
+#define SN_MR_PROTO         (0x0F)
+#define SN_MR_TCP           (0x01)
+#define SN_MR_UDP           (0x02)
+#define SN_MR_MACRAW        (0x04)
+#define SN_MR_MFEN          (0x80)
+#define SN_MR_BCASTB        (0x40)
+#define SN_MR_MMB           (0x20)
+#define SN_MR_MIP6B         (0x10)
+
+#define SN_CR_OPEN          (0x01)
+#define SN_CR_LISTEN        (0x02)
+#define SN_CR_CONNECT       (0x04)
+#define SN_CR_DISCON        (0x08)
+#define SN_CR_CLOSE         (0x10)
+#define SN_CR_SEND          (0x20)
+#define SN_CR_RECV          (0x40)
+
+#define SN_IR_CON           (0x01)
+#define SN_IR_DISCON        (0x02)
+#define SN_IR_RECV          (0x04)
+#define SN_IR_TIMEOUT       (0x08)
+#define SN_IR_SENDOK        (0x10)
+
+#define SN_SR_CLOSED        (0x00)
+#define SN_SR_INIT          (0x13)
+#define SN_SR_LISTEN        (0x14)
+#define SN_SR_ESTABLISHED   (0x17)
+#define SN_SR_CLOSE_WAIT    (0x1C)
+#define SN_SR_UDP           (0x22)
+#define SN_SR_MACRAW        (0x42)
+
+// SPI frame: 16 bit offset, control byte BSB[4:0] RWB OM[1:0]
+#define CTRL_BSB(ctrl)      ((ctrl) >> 3)
+#define CTRL_WRITE          (0x04)
+#define CTRL_OM             (0x03)
+
+#define MACRAW_HEADER_LEN   (2)
+#define ETH_FRAME_MIN       (14)
+#define ETH_FRAME_MAX       (1514)
+
+typedef struct
+{
+  uint8_t regs[SN_SIZE];    // plain registers, the ones below are kept apart
+  uint8_t cr;               // command in progress, reads back until cr_done_ns
+  int64_t cr_done_ns;
+  uint8_t ir;
+  uint8_t sr;
+  uint16_t tx_rd;
+  uint16_t tx_wr;
+  uint16_t rx_rd;
+  uint16_t rx_wr;
+  uint16_t rx_rd_done;      // RX_RD as of the last RECV, what the chip considers read
+  uint32_t tx_base;
+  uint32_t tx_size;         // 0 => the socket got no memory
+  uint32_t rx_base;
+  uint32_t rx_size;
+  int64_t send_done_ns;     // SEND in flight until then, 0 => none
+  uint16_t send_end;        // TX_RD once it's done
+} model_sock_t;
+
+struct w5500_model_s
+{
+  w5500_model_config_t config;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;      // wakes the timer thread for a new deadline
+  pthread_t timer;
+  bool stop;
+
+  uint8_t com[COM_SIZE];
+  int64_t reset_done_ns;    // MR.RST reads back set until then
+  model_sock_t sock[W5500_MODEL_SOCKETS];
+  uint8_t tx_mem[W5500_MODEL_MEM_SIZE];
+  uint8_t rx_mem[W5500_MODEL_MEM_SIZE];
+
+  bool link_up;
+  bool speed_100m;
+  bool full_duplex;
+  int64_t wire_free_ns;     // the PHY is sending until then
+
+  bool int_asserted;
+  int64_t int_released_ns;  // last deassertion, INTLEVEL counts from there
+  int64_t int_assert_ns;    // deferred assertion, 0 => none
+
+  // frame handed to on_transmit once the SPI transaction has released the lock
+  uint8_t tx_frame[W5500_MODEL_MEM_SIZE];
+  uint32_t tx_frame_len;
+  int tx_frame_sock;
+
+  w5500_model_counters_t counters;
+};
+
+////////////////////////////////////////
+
+static int64_t model_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+////////////////////////////////////////
+
+static uint16_t model_get16(const uint8_t *reg)
+{
+  return (reg[0] << 8) | reg[1];
+}
+
+////////////////////////////////////////
+
+static void model_put16(uint8_t *reg, uint16_t value)
+{
+  reg[0] = value >> 8;
+  reg[1] = value & 0xFF;
+}
+
+////////////////////////////////////////
+
+// Byte of a big endian 16 bit register, and its update, by the offset parity (all of them start on an even offset)
+static uint8_t model_byte16(uint16_t value, uint16_t offset)
+{
+  return (offset & 1) ? (value & 0xFF) : (value >> 8);
+}
+
+static void model_set_byte16(uint16_t *value, uint16_t offset, uint8_t byte)
+{
+  *value = (offset & 1) ? ((*value & 0xFF00) | byte) : ((*value & 0x00FF) | (byte << 8));
+}
+
+////////////////////////////////////////
+
+static void model_violation(w5500_model_t *model, const char *what, int sock, uint32_t value)
+{
+  model->counters.violations++;
+  ESP_LOGW(TAG, "violation: %s (socket %d, 0x%x)", what, sock, (unsigned)value);
+}
+
+////////////////////////////////////////
+
+// Sn_TXBUF_SIZE / Sn_RXBUF_SIZE in KB, sockets are laid out in order, what doesn't fit in the 16KB gets nothing
+static void model_layout(w5500_model_t *model)
+{
+  uint32_t tx_base = 0;
+  uint32_t rx_base = 0;
+
+  for (int s = 0; s < W5500_MODEL_SOCKETS; s++)
+  {
+    model_sock_t *sock = &model->sock[s];
+    uint32_t tx_size = sock->regs[SN_TXBUF_SIZE] * 1024;
+    uint32_t rx_size = sock->regs[SN_RXBUF_SIZE] * 1024;
+
+    sock->tx_base = tx_base;
+    sock->tx_size = (tx_base + tx_size <= W5500_MODEL_MEM_SIZE) ? tx_size : 0;
+    tx_base += sock->tx_size;
+    sock->rx_base = rx_base;
+    sock->rx_size = (rx_base + rx_size <= W5500_MODEL_MEM_SIZE) ? rx_size : 0;
+    rx_base += sock->rx_size;
+  }
+}
+
+////////////////////////////////////////
+
+static void model_reset(w5500_model_t *model, int64_t now)
+{
+  static const uint8_t sock_defaults[SN_SIZE] =
+  {
+    [SN_DHAR] = 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    [SN_TTL] = 0x80,
+    [SN_RXBUF_SIZE] = 2, [SN_TXBUF_SIZE] = 2,
+    [SN_IMR] = 0xFF, [SN_FRAG] = 0x40,
+  };
+
+  memset(model->com, 0, sizeof(model->com));
+  model_put16(&model->com[COM_RTR], 0x07D0);
+  model->com[COM_RCR] = 0x08;
+  model->com[COM_PTIMER] = 0x28;
+  model_put16(&model->com[COM_PMRU], 0xFFFF);
+  model->com[COM_PHYCFGR] = 0xB8;   // PHY running, all capable auto-negotiation
+  model->com[COM_VERSIONR] = VERSIONR_W5500;
+
+  for (int s = 0; s < W5500_MODEL_SOCKETS; s++)
+  {
+    memset(&model->sock[s], 0, sizeof(model_sock_t));
+    memcpy(model->sock[s].regs, sock_defaults, SN_SIZE);
+  }
+
+  model_layout(model);
+
+  model->reset_done_ns = now + (int64_t)model->config.cmd_latency_us * 1000;
+  model->int_assert_ns = 0;
+}
+
+////////////////////////////////////////
+
+static bool model_phy_link(w5500_model_t *model)
+{
+  return model->link_up && (model->com[COM_PHYCFGR] & PHYCFGR_RST);
+}
+
+////////////////////////////////////////
+
+static uint8_t model_sir(w5500_model_t *model)
+{
+  uint8_t sir = 0;
+
+  for (int s = 0; s < W5500_MODEL_SOCKETS; s++)
+  {
+    if (model->sock[s].ir & model->sock[s].regs[SN_IMR])
+    {
+      sir |= 1 << s;
+    }
+  }
+
+  return sir;
+}
+
+////////////////////////////////////////
+
+// Drive INTn from the interrupt registers: low while an unmasked interrupt is pending, but not before the INTLEVEL
+// wait (INTLEVEL + 1) * 4 / 150MHz after it was last released
+static void model_update_int(w5500_model_t *model, int64_t now)
+{
+  bool pending = (model_sir(model) & model->com[COM_SIMR]) || (model->com[COM_IR] & model->com[COM_IMR]);
+
+  if (!pending)
+  {
+    model->int_assert_ns = 0;
+
+    if (model->int_asserted)
+    {
+      model->int_asserted = false;
+      model->int_released_ns = now;
+
+      if (model->config.int_gpio >= 0)
+      {
+        sim_gpio_drive(model->config.int_gpio, 1);
+      }
+    }
+
+    return;
+  }
+
+  if (model->int_asserted)
+  {
+    return;
+  }
+
+  int64_t assert_ns = model->int_released_ns + ((int64_t)model_get16(&model->com[COM_INTLEVEL]) + 1) * 80 / 3;
+
+  if (now >= assert_ns)
+  {
+    model->int_asserted = true;
+    model->int_assert_ns = 0;
+    model->counters.int_asserts++;
+
+    if (model->config.int_gpio >= 0)
+    {
+      sim_gpio_drive(model->config.int_gpio, 0);
+    }
+  }
+  else if (!model->int_assert_ns)
+  {
+    model->int_assert_ns = assert_ns;
+    pthread_cond_signal(&model->cond);
+  }
+}
+
+////////////////////////////////////////
+
+// Time a frame spends on the wire: padding, FCS, preamble and inter frame gap included
+static int64_t model_wire_ns(w5500_model_t *model, uint32_t len)
+{
+  uint32_t octets = ((len < 60) ? 60 : len) + 4 + 8 + 12;
+
+  return (int64_t)octets * 8 * (model->speed_100m ? 10 : 100);
+}
+
+////////////////////////////////////////
+
+static void model_send_done(model_sock_t *sock)
+{
+  sock->tx_rd = sock->send_end;
+  sock->ir |= SN_IR_SENDOK;
+  sock->send_done_ns = 0;
+}
+
+////////////////////////////////////////
+
+// Completes what's due, returns the next deadline, -1 => none
+static int64_t model_run_deadlines(w5500_model_t *model, int64_t now)
+{
+  int64_t next = -1;
+
+  for (int s = 0; s < W5500_MODEL_SOCKETS; s++)
+  {
+    model_sock_t *sock = &model->sock[s];
+
+    if (sock->send_done_ns && (now >= sock->send_done_ns))
+    {
+      model_send_done(sock);
+    }
+
+    if (sock->send_done_ns && ((next < 0) || (sock->send_done_ns < next)))
+    {
+      next = sock->send_done_ns;
+    }
+  }
+
+  model_update_int(model, now);
+
+  if (model->int_assert_ns && ((next < 0) || (model->int_assert_ns < next)))
+  {
+    next = model->int_assert_ns;
+  }
+
+  return next;
+}
+
+////////////////////////////////////////
+
+static void *model_timer_task(void *arg)
+{
+  w5500_model_t *model = arg;
+
+  pthread_mutex_lock(&model->lock);
+
+  while (!model->stop)
+  {
+    int64_t next = model_run_deadlines(model, model_now_ns());
+
+    if (next < 0)
+    {
+      pthread_cond_wait(&model->cond, &model->lock);
+    }
+    else
+    {
+      struct timespec ts = { .tv_sec = next / 1000000000LL, .tv_nsec = next % 1000000000LL };
+
+      pthread_cond_timedwait(&model->cond, &model->lock, &ts);
+    }
+  }
+
+  pthread_mutex_unlock(&model->lock);
+
+  return NULL;
+}
+
+////////////////////////////////////////
+
+static void model_send(w5500_model_t *model, int s, int64_t now)
+{
+  model_sock_t *sock = &model->sock[s];
+  uint16_t len = sock->tx_wr - sock->tx_rd;
+  bool datagram = (sock->sr == SN_SR_UDP) || (sock->sr == SN_SR_MACRAW);
+
+  if (sock->send_done_ns)
+  {
+    model_violation(model, "SEND while the previous one is in flight", s, len);
+
+    return;
+  }
+
+  if ((sock->sr != SN_SR_MACRAW) && (sock->sr != SN_SR_UDP) && (sock->sr != SN_SR_ESTABLISHED) &&
+      (sock->sr != SN_SR_CLOSE_WAIT))
+  {
+    model_violation(model, "SEND on a socket not open", s, sock->sr);
+
+    return;
+  }
+
+  if (!sock->tx_size || (len > sock->tx_size) || (len == 0) ||
+      ((sock->sr == SN_SR_MACRAW) && ((len < ETH_FRAME_MIN) || (len > ETH_FRAME_MAX))))
+  {
+    model_violation(model, "SEND of a bad length", s, len);
+
+    return;
+  }
+
+  sock->send_end = sock->tx_wr;
+
+  if (model_phy_link(model))
+  {
+    for (uint32_t i = 0; i < len; i++)
+    {
+      model->tx_frame[i] = model->tx_mem[sock->tx_base + ((uint16_t)(sock->tx_rd + i) & (sock->tx_size - 1))];
+    }
+
+    model->tx_frame_len = len;
+    model->tx_frame_sock = s;
+
+    if (sock->sr == SN_SR_MACRAW)
+    {
+      model->counters.tx_frames++;
+      model->counters.tx_bytes += len;
+    }
+  }
+
+  // a TCP stream goes out as segments back to back, timed like one frame per datagram is close enough here
+  if (model->config.wire_timing && model_phy_link(model))
+  {
+    int64_t start = (model->wire_free_ns > now) ? model->wire_free_ns : now;
+
+    model->wire_free_ns = start + model_wire_ns(model, datagram ? len : ETH_FRAME_MAX);
+    sock->send_done_ns = model->wire_free_ns;
+    pthread_cond_signal(&model->cond);
+  }
+  else
+  {
+    model_send_done(sock);
+  }
+}
+
+////////////////////////////////////////
+
+static void model_command(w5500_model_t *model, int s, uint8_t command, int64_t now)
+{
+  model_sock_t *sock = &model->sock[s];
+  uint8_t proto = sock->regs[SN_MR] & SN_MR_PROTO;
+
+  model->counters.commands++;
+
+  switch (command)
+  {
+    case SN_CR_OPEN:
+      if ((proto == SN_MR_MACRAW) && (s == 0))
+      {
+        sock->sr = SN_SR_MACRAW;
+      }
+      else if (proto == SN_MR_TCP)
+      {
+        sock->sr = SN_SR_INIT;
+      }
+      else if (proto == SN_MR_UDP)
+      {
+        sock->sr = SN_SR_UDP;
+      }
+      else
+      {
+        sock->sr = SN_SR_CLOSED;
+        model_violation(model, "OPEN of an unsupported protocol", s, sock->regs[SN_MR]);
+
+        break;
+      }
+
+      sock->tx_rd = sock->tx_wr = model->config.ptr_origin;
+      sock->rx_rd = sock->rx_wr = sock->rx_rd_done = model->config.ptr_origin;
+      sock->send_done_ns = 0;
+      break;
+
+    case SN_CR_LISTEN:
+      if (sock->sr != SN_SR_INIT)
+      {
+        model_violation(model, "LISTEN on a socket not in INIT", s, sock->sr);
+        break;
+      }
+
+      sock->sr = SN_SR_LISTEN;
+      break;
+
+    case SN_CR_CONNECT:
+      if (sock->sr != SN_SR_INIT)
+      {
+        model_violation(model, "CONNECT on a socket not in INIT", s, sock->sr);
+        break;
+      }
+
+      // the simulated peer accepts at once
+      sock->sr = SN_SR_ESTABLISHED;
+      sock->ir |= SN_IR_CON;
+      break;
+
+    case SN_CR_DISCON:
+      if ((sock->sr == SN_SR_ESTABLISHED) || (sock->sr == SN_SR_CLOSE_WAIT))
+      {
+        sock->sr = SN_SR_CLOSED;
+        sock->ir |= SN_IR_DISCON;
+      }
+
+      break;
+
+    case SN_CR_CLOSE:
+      sock->sr = SN_SR_CLOSED;
+      sock->send_done_ns = 0;
+      break;
+
+    case SN_CR_SEND:
+      model->counters.send_commands++;
+      model_send(model, s, now);
+      break;
+
+    case SN_CR_RECV:
+      model->counters.recv_commands++;
+
+      // the new read pointer must lie between the last one and the write pointer
+      if ((uint16_t)(sock->rx_rd - sock->rx_rd_done) > (uint16_t)(sock->rx_wr - sock->rx_rd_done))
+      {
+        model_violation(model, "RECV past the received data", s, sock->rx_rd);
+        break;
+      }
+
+      sock->rx_rd_done = sock->rx_rd;
+      break;
+
+    default:
+      model_violation(model, "unknown command", s, command);
+      return;
+  }
+
+  sock->cr = command;
+  sock->cr_done_ns = now + (int64_t)model->config.cmd_latency_us * 1000;
+}
+
+////////////////////////////////////////
+
+static uint8_t model_read_common(w5500_model_t *model, uint16_t offset, int64_t now)
+{
+  if (offset >= COM_SIZE)
+  {
+    return 0;
+  }
+
+  switch (offset)
+  {
+    case COM_MR:
+      return model->com[COM_MR] | ((now < model->reset_done_ns) ? MR_RST : 0);
+
+    case COM_SIR:
+      return model_sir(model);
+
+    case COM_PHYCFGR:
+      if (model_phy_link(model))
+      {
+        return (model->com[COM_PHYCFGR] & PHYCFGR_WRITABLE) | PHYCFGR_LNK |
+               (model->speed_100m ? PHYCFGR_SPD : 0) | (model->full_duplex ? PHYCFGR_DPX : 0);
+      }
+
+      return model->com[COM_PHYCFGR] & PHYCFGR_WRITABLE;
+
+    default:
+      return model->com[offset];
+  }
+}
+
+////////////////////////////////////////
+
+static void model_write_common(w5500_model_t *model, uint16_t offset, uint8_t value, int64_t now)
+{
+  if ((offset >= COM_SIZE) || (offset == COM_SIR) || (offset == COM_VERSIONR))
+  {
+    return;
+  }
+
+  switch (offset)
+  {
+    case COM_MR:
+      if (value & MR_RST)
+      {
+        model_reset(model, now);
+      }
+      else
+      {
+        model->com[COM_MR] = value;
+      }
+
+      break;
+
+    case COM_IR:
+      model->com[COM_IR] &= ~value;
+      break;
+
+    case COM_PHYCFGR:
+      model->com[COM_PHYCFGR] = value & PHYCFGR_WRITABLE;
+      break;
+
+    default:
+      model->com[offset] = value;
+      break;
+  }
+}
+
+////////////////////////////////////////
+
+static uint8_t model_read_sock(w5500_model_t *model, int s, uint16_t offset, int64_t now)
+{
+  model_sock_t *sock = &model->sock[s];
+
+  if (offset >= SN_SIZE)
+  {
+    return 0;
+  }
+
+  switch (offset)
+  {
+    case SN_CR:
+      return (now < sock->cr_done_ns) ? sock->cr : 0;
+
+    case SN_IR:
+      return sock->ir;
+
+    case SN_SR:
+      return sock->sr;
+
+    case SN_TX_FSR:
+    case SN_TX_FSR + 1:
+      return model_byte16(sock->tx_size - (uint16_t)(sock->tx_wr - sock->tx_rd), offset);
+
+    case SN_TX_RD:
+    case SN_TX_RD + 1:
+      return model_byte16(sock->tx_rd, offset);
+
+    case SN_TX_WR:
+    case SN_TX_WR + 1:
+      return model_byte16(sock->tx_wr, offset);
+
+    case SN_RX_RSR:
+    case SN_RX_RSR + 1:
+      return model_byte16(sock->rx_wr - sock->rx_rd_done, offset);
+
+    case SN_RX_RD:
+    case SN_RX_RD + 1:
+      return model_byte16(sock->rx_rd, offset);
+
+    case SN_RX_WR:
+    case SN_RX_WR + 1:
+      return model_byte16(sock->rx_wr, offset);
+
+    default:
+      return sock->regs[offset];
+  }
+}
+
+////////////////////////////////////////
+
+static void model_write_sock(w5500_model_t *model, int s, uint16_t offset, uint8_t value, int64_t now)
+{
+  model_sock_t *sock = &model->sock[s];
+
+  if (offset >= SN_SIZE)
+  {
+    return;
+  }
+
+  switch (offset)
+  {
+    case SN_CR:
+      if (now < sock->cr_done_ns)
+      {
+        model_violation(model, "command while the previous one is busy", s, value);
+      }
+      else if (value)
+      {
+        model_command(model, s, value, now);
+      }
+
+      break;
+
+    case SN_IR:
+      sock->ir &= ~value;
+      break;
+
+    case SN_RXBUF_SIZE:
+    case SN_TXBUF_SIZE:
+      if ((value > 16) || (value & (value - 1)))
+      {
+        model_violation(model, "buffer size not 0, 1, 2, 4, 8 or 16KB", s, value);
+      }
+
+      sock->regs[offset] = value;
+      model_layout(model);
+      break;
+
+    case SN_TX_WR:
+    case SN_TX_WR + 1:
+      model_set_byte16(&sock->tx_wr, offset, value);
+      break;
+
+    case SN_RX_RD:
+    case SN_RX_RD + 1:
+      model_set_byte16(&sock->rx_rd, offset, value);
+      break;
+
+    // read only
+    case SN_SR:
+    case SN_TX_FSR:
+    case SN_TX_FSR + 1:
+    case SN_TX_RD:
+    case SN_TX_RD + 1:
+    case SN_RX_RSR:
+    case SN_RX_RSR + 1:
+    case SN_RX_WR:
+    case SN_RX_WR + 1:
+      break;
+
+    default:
+      sock->regs[offset] = value;
+      break;
+  }
+}
+
+////////////////////////////////////////
+
+static void model_spi_transfer(void *ctx, uint16_t cmd, uint8_t command_bits, uint64_t addr, uint8_t address_bits,
+                               const uint8_t *tx, uint8_t *rx, uint32_t len, uint32_t clock_hz)
+{
+  w5500_model_t *model = ctx;
+  uint8_t ctrl = (uint8_t)addr;
+  uint8_t bsb = CTRL_BSB(ctrl);
+  bool write = ctrl & CTRL_WRITE;
+  int s = (bsb - 1) / 4;
+  w5500_model_block_t block = (bsb == 0) ? W5500_MODEL_BLOCK_COMMON : (w5500_model_block_t)((bsb - 1) % 4 + 1);
+  w5500_model_tx_cb_t on_transmit = NULL;
+  uint32_t tx_len = 0;
+  int tx_sock = 0;
+
+  pthread_mutex_lock(&model->lock);
+
+  int64_t now = model_now_ns();
+
+  model_run_deadlines(model, now);
+
+  model->counters.spi_transactions++;
+  model->counters.spi_bytes += 3 + len;
+  model->counters.spi_bus_ns += clock_hz ? (uint64_t)(3 + len) * 8 * 1000000000ULL / clock_hz : 0;
+
+  if ((command_bits != 16) || (address_bits != 8))
+  {
+    model_violation(model, "SPI frame not 16 bit offset + 8 bit control", command_bits, address_bits);
+  }
+  else if ((bsb != 0) && ((bsb > 4 * W5500_MODEL_SOCKETS) || (block == W5500_MODEL_BLOCK_MAX)))
+  {
+    model_violation(model, "reserved block select", -1, bsb);
+  }
+  else if ((ctrl & CTRL_OM) && (len != ((ctrl & CTRL_OM) == 3 ? 4U : (ctrl & CTRL_OM))))
+  {
+    model_violation(model, "fixed length mode with another length", -1, len);
+  }
+  else if (write ? !tx : !rx)
+  {
+    model_violation(model, "transaction without a data buffer", -1, ctrl);
+  }
+  else
+  {
+    model->counters.block_transactions[block]++;
+    model->counters.block_bytes[block] += len;
+
+    if (!write)
+    {
+      model->counters.spi_reads++;
+    }
+
+    if ((block == W5500_MODEL_BLOCK_TX_BUF) || (block == W5500_MODEL_BLOCK_RX_BUF))
+    {
+      model_sock_t *sock = &model->sock[s];
+      uint8_t *mem = (block == W5500_MODEL_BLOCK_TX_BUF) ? &model->tx_mem[sock->tx_base] : &model->rx_mem[sock->rx_base];
+      uint32_t size = (block == W5500_MODEL_BLOCK_TX_BUF) ? sock->tx_size : sock->rx_size;
+
+      if (!size)
+      {
+        model_violation(model, "buffer access of a socket without memory", s, cmd);
+      }
+      else
+      {
+        // the offset wraps inside the socket's buffer, whatever the access length
+        for (uint32_t i = 0; i < len; i++)
+        {
+          if (write)
+          {
+            mem[(cmd + i) & (size - 1)] = tx[i];
+          }
+          else
+          {
+            rx[i] = mem[(cmd + i) & (size - 1)];
+          }
+        }
+      }
+    }
+    else
+    {
+      for (uint32_t i = 0; i < len; i++)
+      {
+        uint16_t offset = cmd + i;
+
+        if (block == W5500_MODEL_BLOCK_COMMON)
+        {
+          write ? model_write_common(model, offset, tx[i], now) : (void)(rx[i] = model_read_common(model, offset, now));
+        }
+        else
+        {
+          write ? model_write_sock(model, s, offset, tx[i], now) : (void)(rx[i] = model_read_sock(model, s, offset, now));
+        }
+      }
+    }
+
+    // too fast for the board's wiring: MISO samples late, one bit flips
+    if (!write && len && model->config.max_sclk_hz && (clock_hz > model->config.max_sclk_hz))
+    {
+      rx[len / 2] ^= 0x10;
+      model->counters.spi_corrupted++;
+    }
+  }
+
+  model_update_int(model, now);
+
+  if (model->tx_frame_len)
+  {
+    on_transmit = model->config.on_transmit;
+    tx_len = model->tx_frame_len;
+    tx_sock = model->tx_frame_sock;
+    model->tx_frame_len = 0;
+  }
+
+  pthread_mutex_unlock(&model->lock);
+
+  // tx_frame stays put: the next SEND needs another transaction, which waits for this one's SPI bus to be released
+  if (on_transmit)
+  {
+    on_transmit(tx_sock, model->tx_frame, tx_len, model->config.arg);
+  }
+}
+
+////////////////////////////////////////
+
+w5500_model_t *w5500_model_new(const w5500_model_config_t *config)
+{
+  w5500_model_t *model = calloc(1, sizeof(w5500_model_t));
+  pthread_condattr_t attr;
+
+  if (!model)
+  {
+    return NULL;
+  }
+
+  model->config = *config;
+  pthread_mutex_init(&model->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&model->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  model_reset(model, model_now_ns());
+  model->reset_done_ns = 0;
+
+  if (config->int_gpio >= 0)
+  {
+    sim_gpio_drive(config->int_gpio, 1);
+  }
+
+  if (pthread_create(&model->timer, NULL, model_timer_task, model) != 0)
+  {
+    free(model);
+
+    return NULL;
+  }
+
+  pthread_setname_np(model->timer, "w5500_model");
+
+  if (sim_spi_attach(config->cs_gpio, model_spi_transfer, model) != ESP_OK)
+  {
+    w5500_model_del(model);
+
+    return NULL;
+  }
+
+  return model;
+}
+
+////////////////////////////////////////
+
+void w5500_model_del(w5500_model_t *model)
+{
+  sim_spi_detach(model->config.cs_gpio);
+
+  pthread_mutex_lock(&model->lock);
+  model->stop = true;
+  pthread_cond_signal(&model->cond);
+  pthread_mutex_unlock(&model->lock);
+
+  pthread_join(model->timer, NULL);
+  pthread_cond_destroy(&model->cond);
+  pthread_mutex_destroy(&model->lock);
+  free(model);
+}
+
+////////////////////////////////////////
+
+void w5500_model_set_link(w5500_model_t *model, bool up, bool speed_100m, bool full_duplex)
+{
+  pthread_mutex_lock(&model->lock);
+  model->link_up = up;
+  model->speed_100m = speed_100m;
+  model->full_duplex = full_duplex;
+  pthread_mutex_unlock(&model->lock);
+}
+
+////////////////////////////////////////
+
+static bool model_rx_accept(w5500_model_t *model, const uint8_t *frame)
+{
+  static const uint8_t broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+  uint8_t mr = model->sock[0].regs[SN_MR];
+  bool bcast = !memcmp(frame, broadcast, 6);
+  bool mcast = !bcast && (frame[0] & 0x01);
+
+  if (((mr & SN_MR_BCASTB) && bcast) || ((mr & SN_MR_MMB) && mcast) ||
+      ((mr & SN_MR_MIP6B) && (frame[12] == 0x86) && (frame[13] == 0xDD)))
+  {
+    return false;
+  }
+
+  // MFEN: unicast only for our own address
+  return !(mr & SN_MR_MFEN) || bcast || mcast || !memcmp(frame, &model->com[COM_SHAR], 6);
+}
+
+////////////////////////////////////////
+
+// Append to a socket's RX ring, false if it doesn't fit
+static bool model_rx_store(w5500_model_t *model, model_sock_t *sock, const uint8_t *data, uint32_t len)
+{
+  if (!sock->rx_size || (len > sock->rx_size - (uint16_t)(sock->rx_wr - sock->rx_rd_done)))
+  {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < len; i++)
+  {
+    model->rx_mem[sock->rx_base + ((uint16_t)(sock->rx_wr + i) & (sock->rx_size - 1))] = data[i];
+  }
+
+  sock->rx_wr += len;
+
+  return true;
+}
+
+////////////////////////////////////////
+
+bool w5500_model_receive(w5500_model_t *model, const uint8_t *frame, uint32_t length)
+{
+  model_sock_t *sock = &model->sock[0];
+  uint8_t header[MACRAW_HEADER_LEN] = { (length + MACRAW_HEADER_LEN) >> 8, (length + MACRAW_HEADER_LEN) & 0xFF };
+  bool ret = false;
+
+  if ((length < ETH_FRAME_MIN) || (length > ETH_FRAME_MAX))
+  {
+    return false;
+  }
+
+  pthread_mutex_lock(&model->lock);
+
+  if (!model_phy_link(model) || (sock->sr != SN_SR_MACRAW) ||
+      (sock->rx_size - (uint16_t)(sock->rx_wr - sock->rx_rd_done) < length + MACRAW_HEADER_LEN))
+  {
+    model->counters.rx_dropped++;
+  }
+  else if (!model_rx_accept(model, frame))
+  {
+    model->counters.rx_filtered++;
+  }
+  else
+  {
+    model_rx_store(model, sock, header, sizeof(header));
+    model_rx_store(model, sock, frame, length);
+    sock->ir |= SN_IR_RECV;
+    model->counters.rx_frames++;
+    model->counters.rx_bytes += length;
+    model_update_int(model, model_now_ns());
+    ret = true;
+  }
+
+  pthread_mutex_unlock(&model->lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+uint32_t w5500_model_rx_free(w5500_model_t *model)
+{
+  uint32_t free_size;
+
+  pthread_mutex_lock(&model->lock);
+  free_size = model->sock[0].rx_size - (uint16_t)(model->sock[0].rx_wr - model->sock[0].rx_rd_done);
+  pthread_mutex_unlock(&model->lock);
+
+  return free_size;
+}
+
+////////////////////////////////////////
+
+bool w5500_model_sock_receive(w5500_model_t *model, uint8_t s, const uint8_t *data, uint32_t length,
+                              const uint8_t ip[4], uint16_t port)
+{
+  bool ret = false;
+
+  if (s >= W5500_MODEL_SOCKETS)
+  {
+    return false;
+  }
+
+  model_sock_t *sock = &model->sock[s];
+
+  pthread_mutex_lock(&model->lock);
+
+  if (sock->sr == SN_SR_UDP)
+  {
+    // each datagram with its header: sender IP, sender port, payload length
+    uint8_t header[8] = { ip[0], ip[1], ip[2], ip[3], port >> 8, port & 0xFF, length >> 8, length & 0xFF };
+
+    if (sizeof(header) + length <= sock->rx_size - (uint16_t)(sock->rx_wr - sock->rx_rd_done))
+    {
+      ret = model_rx_store(model, sock, header, sizeof(header)) && model_rx_store(model, sock, data, length);
+    }
+  }
+  else if (sock->sr == SN_SR_ESTABLISHED)
+  {
+    ret = model_rx_store(model, sock, data, length);
+  }
+
+  if (ret)
+  {
+    sock->ir |= SN_IR_RECV;
+    model_update_int(model, model_now_ns());
+  }
+
+  pthread_mutex_unlock(&model->lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+bool w5500_model_sock_accept(w5500_model_t *model, uint8_t s, const uint8_t ip[4], uint16_t port)
+{
+  bool ret = false;
+
+  if (s >= W5500_MODEL_SOCKETS)
+  {
+    return false;
+  }
+
+  model_sock_t *sock = &model->sock[s];
+
+  pthread_mutex_lock(&model->lock);
+
+  if (sock->sr == SN_SR_LISTEN)
+  {
+    memcpy(&sock->regs[SN_DIPR], ip, 4);
+    model_put16(&sock->regs[SN_DPORT], port);
+    sock->sr = SN_SR_ESTABLISHED;
+    sock->ir |= SN_IR_CON;
+    model_update_int(model, model_now_ns());
+    ret = true;
+  }
+
+  pthread_mutex_unlock(&model->lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+bool w5500_model_sock_peer_close(w5500_model_t *model, uint8_t s)
+{
+  bool ret = false;
+
+  if (s >= W5500_MODEL_SOCKETS)
+  {
+    return false;
+  }
+
+  model_sock_t *sock = &model->sock[s];
+
+  pthread_mutex_lock(&model->lock);
+
+  if (sock->sr == SN_SR_ESTABLISHED)
+  {
+    sock->sr = SN_SR_CLOSE_WAIT;
+    sock->ir |= SN_IR_DISCON;
+    model_update_int(model, model_now_ns());
+    ret = true;
+  }
+
+  pthread_mutex_unlock(&model->lock);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+void w5500_model_get_counters(w5500_model_t *model, w5500_model_counters_t *counters)
+{
+  pthread_mutex_lock(&model->lock);
+  *counters = model->counters;
+  pthread_mutex_unlock(&model->lock);
+}
+
+////////////////////////////////////////
+
+void w5500_model_reset_counters(w5500_model_t *model)
+{
+  pthread_mutex_lock(&model->lock);
+  memset(&model->counters, 0, sizeof(model->counters));
+  pthread_mutex_unlock(&model->lock);
+}
@@ -0,0 +1,152 @@
+/****************************************************************************************************************************
+  w5500_model.h - Register level software model of the WIZnet W5500, behind the host SPI / GPIO shim
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+// What the chip does, as far as the driver can see it over SPI (W5500 datasheet v1.1.0):
+// - common and socket register blocks, reset values, read-only and write-1-to-clear bits, VERSIONR 0x04
+// - 16KB TX and 16KB RX buffer memory split by Sn_TXBUF_SIZE / Sn_RXBUF_SIZE, offsets wrap inside each socket
+// - Sn_CR commands, busy for cmd_latency_us: MACRAW SEND sends TX_RD .. TX_WR as one frame and raises SEND_OK once
+//   it left the wire, RECV frees RX_RD. TCP / UDP sockets open, connect, listen and exchange data with the test
+// - MACRAW receive with the MAC filter (Sn_MR MFEN / BCASTB / MMB / MIP6B) and the 2 byte length header
+// - INTn: asserted while (SIR & SIMR) or (IR & IMR), asserted again only INTLEVEL after the last deassertion
+// - PHYCFGR: link, speed and duplex as set by the test, the PHY reset bit takes the link down
+// Accesses a real chip would get wrong (command while busy, SEND of a frame still in flight, undefined block, ...)
+// are logged and counted as violations, a correct driver makes none
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////
+
+#define W5500_MODEL_SOCKETS       (8)
+#define W5500_MODEL_MEM_SIZE      (16 * 1024)
+
+typedef struct w5500_model_s w5500_model_t;
+
+/**
+   @brief A frame (MACRAW) or payload (TCP / UDP) the chip puts on the wire, called without the model locked.
+          data is only valid during the call
+
+*/
+typedef void (*w5500_model_tx_cb_t)(uint8_t sock, const uint8_t *data, uint32_t length, void *arg);
+
+typedef struct
+{
+  int cs_gpio;                /*!< The chip answers the SPI devices with this CS pin */
+  int int_gpio;               /*!< INTn drives this GPIO, -1 => not wired */
+  uint32_t max_sclk_hz;       /*!< Reads clocked faster come back corrupted, 0 => no limit */
+  uint32_t cmd_latency_us;    /*!< Sn_CR and MR.RST read back as busy this long */
+  bool wire_timing;           /*!< SEND_OK once the frame left the wire (link speed), else with the SEND command */
+  uint16_t ptr_origin;        /*!< Socket pointers after OPEN, e.g. 0xFFF0 to cross the 16 bit wrap early */
+  w5500_model_tx_cb_t on_transmit;
+  void *arg;
+} w5500_model_config_t;
+
+#define W5500_MODEL_DEFAULT_CONFIG()  \
+  {                                   \
+    .cs_gpio = 5,                     \
+    .int_gpio = 4,                    \
+    .max_sclk_hz = 0,                 \
+    .cmd_latency_us = 0,              \
+    .wire_timing = true,              \
+    .ptr_origin = 0,                  \
+    .on_transmit = NULL,              \
+    .arg = NULL,                      \
+  }
+
+typedef enum
+{
+  W5500_MODEL_BLOCK_COMMON,
+  W5500_MODEL_BLOCK_SOCK_REG,
+  W5500_MODEL_BLOCK_TX_BUF,
+  W5500_MODEL_BLOCK_RX_BUF,
+  W5500_MODEL_BLOCK_MAX,
+} w5500_model_block_t;
+
+/**
+   @brief What went over SPI and over the wire, see w5500_model_get_counters()
+
+*/
+typedef struct
+{
+  uint64_t spi_transactions;
+  uint64_t spi_bytes;         /*!< Clocked bytes, 3 byte address / control phase included */
+  uint64_t spi_reads;         /*!< Read transactions, the rest are writes */
+  uint64_t block_transactions[W5500_MODEL_BLOCK_MAX];
+  uint64_t block_bytes[W5500_MODEL_BLOCK_MAX];  /*!< Data bytes by block */
+  uint64_t spi_bus_ns;        /*!< Time on the wire at the devices' SCLK */
+  uint64_t spi_corrupted;     /*!< Reads corrupted by an SCLK above max_sclk_hz */
+  uint64_t commands;          /*!< Sn_CR commands, the SEND and RECV ones below included */
+  uint64_t send_commands;
+  uint64_t recv_commands;
+  uint64_t tx_frames;         /*!< MACRAW frames sent */
+  uint64_t tx_bytes;
+  uint64_t rx_frames;         /*!< MACRAW frames stored in the RX ring */
+  uint64_t rx_bytes;
+  uint64_t rx_filtered;       /*!< Frames dropped by the MAC filter */
+  uint64_t rx_dropped;        /*!< Frames dropped: RX ring full, socket 0 not in MACRAW or link down */
+  uint64_t int_asserts;       /*!< INTn falling edges */
+  uint64_t violations;        /*!< Accesses a real chip would misbehave on, logged */
+} w5500_model_counters_t;
+
+////////////////////////////////////////
+
+/**
+   @brief Power the chip up (reset values, link down) and attach it to the SPI CS pin and INT GPIO of the config
+
+*/
+w5500_model_t *w5500_model_new(const w5500_model_config_t *config);
+void w5500_model_del(w5500_model_t *model);
+
+/**
+   @brief The cable: link state the PHY reports in PHYCFGR, frames are only exchanged while it's up
+
+*/
+void w5500_model_set_link(w5500_model_t *model, bool up, bool speed_100m, bool full_duplex);
+
+/**
+   @brief A frame arriving from the wire, without FCS (14 - 1514 bytes). False if the chip dropped it, see counters
+
+*/
+bool w5500_model_receive(w5500_model_t *model, const uint8_t *frame, uint32_t length);
+
+/**
+   @brief Bytes free in socket 0's RX ring, room for a frame of length n when n + 2 fit
+
+*/
+uint32_t w5500_model_rx_free(w5500_model_t *model);
+
+/**
+   @brief Data from the peer of a hardware socket: TCP once established, UDP as a datagram from ip:port (ip in
+          network order as it appears on the wire). False if it doesn't fit or the socket isn't open
+
+*/
+bool w5500_model_sock_receive(w5500_model_t *model, uint8_t sock, const uint8_t *data, uint32_t length,
+                              const uint8_t ip[4], uint16_t port);
+
+/**
+   @brief A peer connects to a TCP socket in LISTEN, or closes an established connection
+
+*/
+bool w5500_model_sock_accept(w5500_model_t *model, uint8_t sock, const uint8_t ip[4], uint16_t port);
+bool w5500_model_sock_peer_close(w5500_model_t *model, uint8_t sock);
+
+void w5500_model_get_counters(w5500_model_t *model, w5500_model_counters_t *counters);
+void w5500_model_reset_counters(w5500_model_t *model);
+
+#ifdef __cplusplus
+}
+#endif
@@ -86,6 +86,8 @@
 //////////////////////////////////////////////////////////////
 
 #include "w5500/esp32_w5500.h"
+#include "w5500/esp32_w5500_failover.h"
+#include "w5500/esp32_w5500_offload.h"
 
 #include "WebServer_ESP32_W5500.hpp"
 #include "WebServer_ESP32_W5500_Impl.h"
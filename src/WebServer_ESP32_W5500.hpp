@@ -79,6 +79,8 @@ extern void ESP32_W5500_onEvent();
 
 extern void ESP32_W5500_waitForConnect();
 
+extern bool ESP32_W5500_waitForConnect(uint32_t timeoutMs);
+
 extern bool ESP32_W5500_isConnected();
 
 extern void ESP32_W5500_event(WiFiEvent_t event);
@@ -38,8 +38,14 @@ void ESP32_W5500_onEvent()
 
 void ESP32_W5500_waitForConnect()
 {
-  while (!ESP32_W5500_eth_connected)
-    delay(100);
+  ETH.waitFor(ESP32_W5500_GOT_IP);
+}
+
+//////////////////////////////////////////////////////////////
+
+bool ESP32_W5500_waitForConnect(uint32_t timeoutMs)
+{
+  return ETH.waitFor(ESP32_W5500_GOT_IP, timeoutMs);
 }
 
 //////////////////////////////////////////////////////////////
@@ -24,7 +24,9 @@
 extern "C"
 {
   esp_eth_mac_t* w5500_begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICLOCK_MHZ,
-                             int SPIHOST);
+                             int SPIHOST, int SPI_QUEUE_SIZE, int DMA_CHANNEL, int SPICLOCK_MAX_MHZ,
+                             uint32_t *SPICLOCK_HZ, const eth_mac_config_t *MAC_CONFIG,
+                             const eth_w5500_ext_config_t *EXT_CONFIG);
 #include "esp_eth/esp_eth_w5500.h"
 }
 
@@ -38,37 +40,193 @@ extern "C"
   #include "soc/rtc.h"
 #endif
 
+#include "esp_timer.h"
+#include "nvs.h"
+
 #include "lwip/err.h"
 #include "lwip/dns.h"
+#include "lwip/dhcp.h"
+#include "lwip/netif.h"
+#include "lwip/tcpip.h"
+#include "lwip/igmp.h"
+#include "lwip/mld6.h"
 
 extern void tcpipInit();
 
+// fast boot records, one lease<n> / spi<n> pair per instance
+#define W5500_BOOT_NVS_NAMESPACE      "w5500_boot"
+
+////////////////////////////////////////
+
+// SPI clock found by the auto-tune, only reused for the same wiring and clock limits
+typedef struct
+{
+  int spiHost;
+  int csGpio;
+  int sclkGpio;
+  int spiClockMHz;
+  int spiClockMaxMHz;
+  uint32_t clockHz;
+} w5500_spi_clock_record_t;
+
 ////////////////////////////////////////
 
 ESP32_W5500::ESP32_W5500()
   : initialized(false)
   , staticIP(false)
   , eth_handle(NULL)
+  , eth_mac(NULL)
+  , eth_netif(NULL)
+  , instance(0)
+  , spi_clock_hz(0)
+  , offload_sockets(0)
+  , fast_boot(false)
+  , lease_cached(false)
+  , lease_requested(false)
+  , begin_start_us(0)
+  , boot_eth_handler(NULL)
+  , boot_ip_handler(NULL)
+  , state_group(NULL)
+  , state_lock(NULL)
+  , state_eth_handler(NULL)
+  , state_ip_handler(NULL)
+  , link_speed(0)
+  , ip_addr(0)
+  , ip_netmask(0)
+  , ip_gw(0)
+  , mcast_filter(false)
+  , next_instance(first_instance)
   , started(false)
   , eth_link(ETH_LINK_DOWN)
 {
+  portMUX_INITIALIZE(&callbacks_lock);
+  memset(callbacks, 0, sizeof(callbacks));
+  memset(callback_args, 0, sizeof(callback_args));
+
+  first_instance = this;
 }
 
 ////////////////////////////////////////
 
 ESP32_W5500::~ESP32_W5500()
-{}
+{
+  // the handlers get this instance as their argument: unregistering waits for a call in progress, so they go
+  // before the event group and the lock they use
+  if (state_eth_handler)
+  {
+    esp_event_handler_instance_unregister(ETH_EVENT, ESP_EVENT_ANY_ID, state_eth_handler);
+  }
+
+  if (state_ip_handler)
+  {
+    esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, state_ip_handler);
+  }
+
+  if (boot_eth_handler)
+  {
+    esp_event_handler_instance_unregister(ETH_EVENT, ETHERNET_EVENT_CONNECTED, boot_eth_handler);
+  }
+
+  if (boot_ip_handler)
+  {
+    esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_ETH_GOT_IP, boot_ip_handler);
+  }
+
+  if (state_group)
+  {
+    vEventGroupDelete(state_group);
+  }
+
+  if (state_lock)
+  {
+    vSemaphoreDelete(state_lock);
+  }
+
+  for (ESP32_W5500 **link = &first_instance; *link; link = &(*link)->next_instance)
+  {
+    if (*link == this)
+    {
+      *link = next_instance;
+      break;
+    }
+  }
+}
+
+////////////////////////////////////////
+
+uint8_t ESP32_W5500::instance_count = 0;
+ESP32_W5500 *ESP32_W5500::first_instance = NULL;
 
 ////////////////////////////////////////
 
 bool ESP32_W5500::begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICLOCK_MHZ, int SPIHOST,
                         uint8_t *W5500_Mac)
 {
+  ESP32_W5500_Config config;
+
+  config.misoGpio    = MISO;
+  config.mosiGpio    = MOSI;
+  config.sclkGpio    = SCLK;
+  config.csGpio      = CS;
+  config.intGpio     = INT;
+  config.spiClockMHz = SPICLOCK_MHZ;
+  config.spiHost     = SPIHOST;
+  config.mac         = W5500_Mac;
+
+  return begin(config);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::begin(const ESP32_W5500_Config& config)
+{
+  int64_t phase_start = esp_timer_get_time();
+
+  // checked before anything is installed. spiClockMHz is the clock every W5500 board is run at first, only the
+  // auto-tune goes faster, each step verified, up to spiClockMaxMHz
+  if ( (config.spiClockMHz < 14) || (config.spiClockMHz > 25) || (config.spiClockMaxMHz > ETH_W5500_SPI_CLOCK_MAX_MHZ) )
+  {
+    ET_LOGERROR("SPI Clock must be >= 14 and <= 25 MHz for W5500, spiClockMaxMHz <= 80 MHz");
+
+    return false;
+  }
+
+  begin_start_us = phase_start;
+  fast_boot = config.fastBoot;
+  offload_sockets = config.offloadSockets;
+  mcast_filter = config.mcastFilter;
+  memset(&boot_timing, 0, sizeof(boot_timing));
+
   tcpipInit();
 
+  boot_timing.tcpipInitUs = (uint32_t) (esp_timer_get_time() - phase_start);
+
+  // the first instance is the default Ethernet netif, every further one gets its own netif
+  if (eth_netif == NULL)
+  {
+    instance = instance_count++;
+  }
+
   //esp_base_mac_addr_set( W5500_Mac );
   
-  if ( esp_read_mac(mac_eth, ESP_MAC_ETH) == ESP_OK )
+  if (instance > 0)
+  {
+    uint8_t base_mac[6];
+
+    // must differ from the first instance and must not move the base MAC of WiFi / BT
+    if ( (config.mac == W5500_Default_Mac) && (esp_read_mac(base_mac, ESP_MAC_ETH) == ESP_OK) )
+    {
+      esp_derive_local_mac(mac_eth, base_mac);
+      mac_eth[5] += instance;
+    }
+    else
+    {
+      memcpy(mac_eth, config.mac, sizeof(mac_eth));
+    }
+
+    ET_LOGINFO1("Using mac_eth of instance", instance);
+  }
+  else if ( esp_read_mac(mac_eth, ESP_MAC_ETH) == ESP_OK )
   {
     char macStr[18] = { 0 };
 
@@ -82,17 +240,65 @@ bool ESP32_W5500::begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICL
   else
   {
     ET_LOGINFO("Using user mac_eth");
-    memcpy(mac_eth, W5500_Mac, sizeof(mac_eth));
+    memcpy(mac_eth, config.mac, sizeof(mac_eth));
 
-    esp_base_mac_addr_set( W5500_Mac );
+    esp_base_mac_addr_set( config.mac );
   }
 
-  tcpip_adapter_set_default_eth_handlers();
-
+  // no default Ethernet handlers, the w5500 glue drives its own netif only
   esp_netif_config_t cfg = ESP_NETIF_DEFAULT_ETH();
-  esp_netif_t *eth_netif = esp_netif_new(&cfg);
+  esp_netif_inherent_config_t base_cfg = ESP_NETIF_INHERENT_DEFAULT_ETH();
 
-  esp_eth_mac_t *eth_mac = w5500_begin(MISO, MOSI, SCLK, CS, INT, SPICLOCK_MHZ, SPIHOST);
+  if (instance > 0)
+  {
+    // the default route stays with the first instance
+    snprintf(netif_key, sizeof(netif_key), "ETH_W5500_%u", instance);
+    snprintf(netif_desc, sizeof(netif_desc), "eth%u", instance);
+    base_cfg.if_key = netif_key;
+    base_cfg.if_desc = netif_desc;
+    base_cfg.route_prio -= instance;
+    cfg.base = &base_cfg;
+  }
+
+  if (eth_netif == NULL)
+  {
+    eth_netif = esp_netif_new(&cfg);
+  }
+
+  eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+  mac_config.rx_task_prio       = config.rxTaskPrio;
+  mac_config.rx_task_stack_size = config.rxTaskStackSize;
+
+  eth_w5500_ext_config_t ext_config = ETH_W5500_EXT_DEFAULT_CONFIG();
+  ext_config.rx_pool_depth = config.rxPoolDepth;
+  ext_config.rx_batch_size = config.rxBatchSize;
+  ext_config.int_level     = config.intLevel;
+  ext_config.rx_pipeline   = config.rxPipeline;
+  ext_config.rx_task_core  = config.rxTaskCore;
+  ext_config.offload_sockets = config.offloadSockets;
+  ext_config.mcast_filter  = config.mcastFilter;
+  memcpy(ext_config.storm_limits, config.stormLimits, sizeof(ext_config.storm_limits));
+  ext_config.tx_bulk_share = config.txBulkShare;
+
+  // 0 => w5500_begin() runs the auto-tune (if asked for), else it checks the cached clock and tunes again if it fails
+  spi_clock_hz = 0;
+  boot_timing.spiClockReused = fast_boot && load_spi_clock(config);
+
+  uint32_t cached_clock_hz = spi_clock_hz;
+
+  phase_start = esp_timer_get_time();
+
+  eth_mac = w5500_begin(config.misoGpio, config.mosiGpio, config.sclkGpio, config.csGpio, config.intGpio,
+                        config.spiClockMHz, config.spiHost, config.spiQueueSize, config.dmaChannel,
+                        config.spiClockMaxMHz, &spi_clock_hz, &mac_config, &ext_config);
+
+  boot_timing.spiInitUs = (uint32_t) (esp_timer_get_time() - phase_start);
+
+  // a cached clock which failed its check was replaced by a freshly tuned one, cached below
+  if (boot_timing.spiClockReused && (spi_clock_hz != cached_clock_hz))
+  {
+    boot_timing.spiClockReused = false;
+  }
 
   if (eth_mac == NULL)
   {
@@ -104,6 +310,7 @@ bool ESP32_W5500::begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICL
   eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
   phy_config.autonego_timeout_ms = 0;       // W5500 doesn't support auto-negotiation
   phy_config.reset_gpio_num = -1;           // W5500 doesn't have a pin to reset internal PHY
+  phy_config.reset_timeout_ms = config.phyResetTimeoutMs;
   esp_eth_phy_t *eth_phy = esp_eth_phy_new_w5500(&phy_config);
 
   if (eth_phy == NULL)
@@ -115,6 +322,9 @@ bool ESP32_W5500::begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICL
 
   eth_handle = NULL;
   esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(eth_mac, eth_phy);
+  eth_config.check_link_period_ms = config.linkCheckPeriodMs;
+
+  phase_start = esp_timer_get_time();
 
   if (esp_eth_driver_install(&eth_config, &eth_handle) != ESP_OK || eth_handle == NULL)
   {
@@ -123,26 +333,73 @@ bool ESP32_W5500::begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICL
     return false;
   }
 
+  boot_timing.driverInstallUs = (uint32_t) (esp_timer_get_time() - phase_start);
+  esp_eth_mac_w5500_get_init_timing(eth_mac, &boot_timing.chipResetUs, &boot_timing.chipSetupUs);
+
   eth_mac->set_addr(eth_mac, mac_eth);
 
 #if 1
 
-  if ( (SPICLOCK_MHZ < 14) || (SPICLOCK_MHZ > 25) )
+  if (boot_timing.spiClockReused)
   {
-    ET_LOGERROR("SPI Clock must be >= 8 and <= 25 MHz for W5500");
-    ESP_ERROR_CHECK(ESP_FAIL);
+    ET_LOGWARN1("SPI Clock from fast boot cache (Hz)", spi_clock_hz);
+  }
+  else if (config.spiClockMaxMHz > config.spiClockMHz)
+  {
+    ET_LOGWARN1("SPI Clock auto-tuned to (Hz)", spi_clock_hz);
+
+    if (fast_boot)
+    {
+      save_spi_clock(config);
+    }
   }
 
 #endif
 
-  /* attach Ethernet driver to TCP/IP stack */
-  if (esp_netif_attach(eth_netif, esp_eth_new_netif_glue(eth_handle)) != ESP_OK)
+  /* attach Ethernet driver to TCP/IP stack, RX buffers are returned to the w5500 RX pool */
+  if (esp_netif_attach(eth_netif, esp_eth_w5500_new_netif_glue(eth_handle, eth_mac)) != ESP_OK)
   {
     ET_LOGERROR("esp_netif_attach failed");
 
     return false;
   }
 
+  lease_cached = fast_boot && load_lease();
+
+  if (state_group == NULL)
+  {
+    state_group = xEventGroupCreate();
+  }
+
+  if (state_lock == NULL)
+  {
+    state_lock = xSemaphoreCreateMutex();
+  }
+
+  // ETH_EVENT_START is posted by esp_eth_start(), so the state handlers go in first
+  if ( !state_group || !state_lock ||
+       (!state_eth_handler && esp_event_handler_instance_register(ETH_EVENT, ESP_EVENT_ANY_ID, eth_event_handler,
+                                                                  this, &state_eth_handler) != ESP_OK) ||
+       (!state_ip_handler && esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, ip_event_handler,
+                                                                 this, &state_ip_handler) != ESP_OK) )
+  {
+    ET_LOGERROR("State event handler register failed");
+
+    return false;
+  }
+
+  // the glue's ESP_EVENT_ANY_ID handler runs before these, the netif is up (and DHCP started) when ours sees CONNECTED
+  if ( (!boot_eth_handler && esp_event_handler_instance_register(ETH_EVENT, ETHERNET_EVENT_CONNECTED,
+                                                                 boot_event_handler, this,
+                                                                 &boot_eth_handler) != ESP_OK) ||
+       (!boot_ip_handler && esp_event_handler_instance_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, boot_event_handler,
+                                                                this, &boot_ip_handler) != ESP_OK) )
+  {
+    ET_LOGWARN("Boot event handler register failed, no link / IP timing");
+  }
+
+  phase_start = esp_timer_get_time();
+
   if (esp_eth_start(eth_handle) != ESP_OK)
   {
     ET_LOG("esp_eth_start failed");
@@ -150,19 +407,279 @@ bool ESP32_W5500::begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICL
     return false;
   }
 
+  boot_timing.startUs = (uint32_t) (esp_timer_get_time() - phase_start);
+
   // holds a few microseconds to let DHCP start and enter into a good state
   // FIX ME -- addresses issue https://github.com/espressif/arduino-esp32/issues/5733
-  delay(50);
+  // Fast boot skips it: DHCP only starts at link up, from the glue's event handler, long after begin() returned
+  if (!fast_boot)
+  {
+    delay(50);
+  }
+
+  boot_timing.beginUs = (uint32_t) (esp_timer_get_time() - begin_start_us);
 
   return true;
 }
 
 ////////////////////////////////////////
 
+bool ESP32_W5500::load_lease()
+{
+  nvs_handle_t nvs;
+  char key[8];
+  size_t size = sizeof(lease);
+  bool valid = false;
+
+  snprintf(key, sizeof(key), "lease%u", instance);
+
+  if (nvs_open(W5500_BOOT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+  {
+    return false;
+  }
+
+  // a lease belongs to the MAC address it was granted to
+  if ( (nvs_get_blob(nvs, key, &lease, &size) == ESP_OK) && (size == sizeof(lease)) &&
+       !memcmp(lease.mac, mac_eth, sizeof(lease.mac)) && lease.ip.ip.addr )
+  {
+    valid = lease_usable();
+  }
+
+  nvs_close(nvs);
+
+  return valid;
+}
+
+////////////////////////////////////////
+
+// A cached lease is only asked for again while it hasn't run out. The system time carries on over resets and deep
+// sleep but not over a power loss: then, or with the clock behind the save time, the lease's age is unknown and the
+// server's ACK or NAK decides
+bool ESP32_W5500::lease_usable()
+{
+  int64_t now = (int64_t) time(NULL);
+  esp_reset_reason_t reason = esp_reset_reason();
+
+  if ( (lease.leaseTime == UINT32_MAX) || (reason == ESP_RST_POWERON) || (reason == ESP_RST_BROWNOUT) ||
+       (now < lease.boundAt) )
+  {
+    return true;
+  }
+
+  return (now - lease.boundAt) < (int64_t) lease.leaseTime;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500::save_lease(const esp_netif_ip_info_t *ip)
+{
+  ESP32_W5500_Lease current;
+  struct netif *netif = (struct netif *) esp_netif_get_netif_impl(eth_netif);
+  struct dhcp *dhcp = netif ? netif_dhcp_data(netif) : NULL;
+  nvs_handle_t nvs;
+  char key[8];
+
+  if (!dhcp)
+  {
+    return;
+  }
+
+  memset(&current, 0, sizeof(current));
+  memcpy(current.mac, mac_eth, sizeof(current.mac));
+  current.ip = *ip;
+  current.boundAt = (int64_t) time(NULL);
+  // set by lwIP before it binds, the GOT_IP event comes after
+  current.leaseTime = dhcp->offered_t0_lease;
+
+  // renewals mostly hand out the same lease: spare the flash, the saved expiry is only moved on once half of it
+  // has passed
+  if ( lease_cached && !memcmp(&current.ip, &lease.ip, sizeof(lease.ip)) && (current.leaseTime == lease.leaseTime) &&
+       (current.boundAt >= lease.boundAt) && (current.boundAt - lease.boundAt < lease.leaseTime / 2) )
+  {
+    return;
+  }
+
+  snprintf(key, sizeof(key), "lease%u", instance);
+
+  if (nvs_open(W5500_BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+  {
+    ET_LOGWARN("Fast boot: NVS open failed, lease not cached");
+
+    return;
+  }
+
+  if ( (nvs_set_blob(nvs, key, &current, sizeof(current)) == ESP_OK) && (nvs_commit(nvs) == ESP_OK) )
+  {
+    lease = current;
+    lease_cached = true;
+  }
+
+  nvs_close(nvs);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::load_spi_clock(const ESP32_W5500_Config& config)
+{
+  w5500_spi_clock_record_t record;
+  nvs_handle_t nvs;
+  char key[8];
+  size_t size = sizeof(record);
+  bool valid = false;
+
+  if (config.spiClockMaxMHz <= config.spiClockMHz)
+  {
+    return false;
+  }
+
+  snprintf(key, sizeof(key), "spi%u", instance);
+
+  if (nvs_open(W5500_BOOT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+  {
+    return false;
+  }
+
+  if ( (nvs_get_blob(nvs, key, &record, &size) == ESP_OK) && (size == sizeof(record)) &&
+       (record.spiHost == config.spiHost) && (record.csGpio == config.csGpio) &&
+       (record.sclkGpio == config.sclkGpio) && (record.spiClockMHz == config.spiClockMHz) &&
+       (record.spiClockMaxMHz == config.spiClockMaxMHz) && record.clockHz )
+  {
+    spi_clock_hz = record.clockHz;
+    valid = true;
+  }
+
+  nvs_close(nvs);
+
+  return valid;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500::save_spi_clock(const ESP32_W5500_Config& config)
+{
+  w5500_spi_clock_record_t record;
+  nvs_handle_t nvs;
+  char key[8];
+
+  memset(&record, 0, sizeof(record));
+  record.spiHost        = config.spiHost;
+  record.csGpio         = config.csGpio;
+  record.sclkGpio       = config.sclkGpio;
+  record.spiClockMHz    = config.spiClockMHz;
+  record.spiClockMaxMHz = config.spiClockMaxMHz;
+  record.clockHz        = spi_clock_hz;
+
+  snprintf(key, sizeof(key), "spi%u", instance);
+
+  if (nvs_open(W5500_BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+  {
+    ET_LOGWARN("Fast boot: NVS open failed, SPI clock not cached");
+
+    return;
+  }
+
+  nvs_set_blob(nvs, key, &record, sizeof(record));
+  nvs_commit(nvs);
+  nvs_close(nvs);
+}
+
+////////////////////////////////////////
+
+// Runs in the tcpip thread, DHCP state may only be touched there. Turns the DISCOVER DHCP has just started into an
+// INIT-REBOOT for the cached address (RFC 2131 4.3.2): one REQUEST / ACK instead of the whole exchange. The address
+// is only used once the server ACKs it, lwIP binds it then and esp-netif posts GOT_IP as for any lease. A NAK, or no
+// answer after lwIP's reboot retries, sends DHCP back to DISCOVER without the cached address ever being set
+void ESP32_W5500::request_lease_callback(void *arg)
+{
+  ESP32_W5500 *self = (ESP32_W5500 *) arg;
+  struct netif *netif = (struct netif *) esp_netif_get_netif_impl(self->eth_netif);
+  struct dhcp *dhcp = netif ? netif_dhcp_data(netif) : NULL;
+
+  // DHCP may have been quicker after all, or already be gone again with the link
+  if (!dhcp || dhcp_supplied_address(netif) || (dhcp->state == DHCP_STATE_OFF))
+  {
+    return;
+  }
+
+  ip4_addr_set_u32(&dhcp->offered_ip_addr, self->lease.ip.ip.addr);
+
+  // from REBOOTING dhcp_network_changed() sends the REQUEST right away, an OFFER still coming is ignored
+  dhcp->state = DHCP_STATE_REBOOTING;
+  self->lease_requested = true;
+  dhcp_network_changed(netif);
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500::boot_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+  ESP32_W5500 *self = (ESP32_W5500 *) arg;
+  uint32_t elapsedUs = (uint32_t) (esp_timer_get_time() - self->begin_start_us);
+
+  if (event_base == ETH_EVENT)
+  {
+    if (*(esp_eth_handle_t *) event_data != self->eth_handle)
+    {
+      return;
+    }
+
+    if (!self->boot_timing.linkUpUs)
+    {
+      self->boot_timing.linkUpUs = elapsedUs;
+    }
+
+    // the glue has just brought the netif up and started DHCP, ask for the cached lease instead
+    if (self->fast_boot && self->lease_cached && !self->staticIP && self->lease_usable())
+    {
+      tcpip_callback(request_lease_callback, self);
+    }
+
+    return;
+  }
+
+  ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+  esp_netif_dhcp_status_t dhcp_status = ESP_NETIF_DHCP_INIT;
+
+  if (event->esp_netif != self->eth_netif)
+  {
+    return;
+  }
+
+  if (!self->boot_timing.ipUs)
+  {
+    self->boot_timing.ipUs = elapsedUs;
+  }
+
+  if ( (esp_netif_dhcpc_get_status(self->eth_netif, &dhcp_status) != ESP_OK) ||
+       (dhcp_status != ESP_NETIF_DHCP_STARTED) )
+  {
+    return;
+  }
+
+  if (!self->boot_timing.dhcpUs)
+  {
+    self->boot_timing.dhcpUs = elapsedUs;
+  }
+
+  // the INIT-REBOOT was ACKed, a NAK would have ended in another address
+  if (self->lease_requested)
+  {
+    self->boot_timing.leaseReused = (event->ip_info.ip.addr == self->lease.ip.ip.addr);
+    self->lease_requested = false;
+  }
+
+  if (self->fast_boot)
+  {
+    self->save_lease(&event->ip_info);
+  }
+}
+
+////////////////////////////////////////
+
 bool ESP32_W5500::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
 {
   esp_err_t err = ESP_OK;
-  tcpip_adapter_ip_info_t info;
+  esp_netif_ip_info_t info;
 
   if (static_cast<uint32_t>(local_ip) != 0)
   {
@@ -177,15 +694,15 @@ bool ESP32_W5500::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet
     info.netmask.addr = 0;
   }
 
-  err = tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_ETH);
+  err = esp_netif_dhcpc_stop(eth_netif);
 
-  if (err != ESP_OK && err != ESP_ERR_TCPIP_ADAPTER_DHCP_ALREADY_STOPPED)
+  if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED)
   {
     ET_LOGERROR1("DHCP could not be stopped! Error =", err);
     return false;
   }
 
-  err = tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_ETH, &info);
+  err = esp_netif_set_ip_info(eth_netif, &info);
 
   if (err != ERR_OK)
   {
@@ -193,15 +710,24 @@ bool ESP32_W5500::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet
     return false;
   }
 
+  // a static address is announced by an IP event too, but the getters shouldn't lag behind config()
+  cache_ip_info(&info);
+  sync_offload_ip(&info);
+
+  if (!info.ip.addr && state_group)
+  {
+    set_state(0, ESP32_W5500_GOT_IP);
+  }
+
   if (info.ip.addr)
   {
     staticIP = true;
   }
   else
   {
-    err = tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_ETH);
+    err = esp_netif_dhcpc_start(eth_netif);
 
-    if (err != ESP_OK && err != ESP_ERR_TCPIP_ADAPTER_DHCP_ALREADY_STARTED)
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED)
     {
       ET_LOGWARN1("DHCP could not be started! Error =", err);
       return false;
@@ -232,99 +758,412 @@ bool ESP32_W5500::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet
 
 ////////////////////////////////////////
 
-IPAddress ESP32_W5500::localIP()
+void ESP32_W5500::set_state(uint32_t set, uint32_t clear)
 {
-  tcpip_adapter_ip_info_t ip;
+  ESP32_W5500_StateCallback snapshot[ESP32_W5500_MAX_STATE_CALLBACKS];
+  void *args[ESP32_W5500_MAX_STATE_CALLBACKS];
 
-  if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip))
+  // the event group can't clear and set in one call, readers take the lock to never see the state in between
+  xSemaphoreTake(state_lock, portMAX_DELAY);
+
+  EventBits_t before = xEventGroupGetBits(state_group);
+
+  xEventGroupClearBits(state_group, clear & ~set);
+  EventBits_t after = xEventGroupSetBits(state_group, set);
+
+  xSemaphoreGive(state_lock);
+
+  // a repeated event, e.g. a DHCP renewal, isn't a state change
+  if (before == after)
   {
-    ET_LOGDEBUG("localIP NULL");
+    return;
+  }
+
+  portENTER_CRITICAL(&callbacks_lock);
+  memcpy(snapshot, callbacks, sizeof(snapshot));
+  memcpy(args, callback_args, sizeof(args));
+  portEXIT_CRITICAL(&callbacks_lock);
 
-    return IPAddress();
+  for (int i = 0; i < ESP32_W5500_MAX_STATE_CALLBACKS; i++)
+  {
+    if (snapshot[i])
+    {
+      snapshot[i](this, (uint32_t) after, args[i]);
+    }
   }
+}
 
-  ET_LOGDEBUG1("localIP =", IPAddress(ip.ip.addr));
+////////////////////////////////////////
 
-  return IPAddress(ip.ip.addr);
+void ESP32_W5500::cache_ip_info(const esp_netif_ip_info_t *ip)
+{
+  ip_addr.store(ip->ip.addr, std::memory_order_relaxed);
+  ip_netmask.store(ip->netmask.addr, std::memory_order_relaxed);
+  ip_gw.store(ip->gw.addr, std::memory_order_relaxed);
 }
 
 ////////////////////////////////////////
 
-IPAddress ESP32_W5500::subnetMask()
+// Runs in the esp_event task, after the glue has moved the netif for the same event
+void ESP32_W5500::eth_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-  tcpip_adapter_ip_info_t ip;
+  ESP32_W5500 *self = (ESP32_W5500 *) arg;
 
-  if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip))
+  // ETH_EVENT is shared by every Ethernet driver, only this instance's handle counts
+  if (*(esp_eth_handle_t *) event_data != self->eth_handle)
   {
-    return IPAddress();
+    return;
   }
 
-  return IPAddress(ip.netmask.addr);
+  switch (event_id)
+  {
+    case ETHERNET_EVENT_START:
+      // the glue has just added the lwIP netif, the hooks must be set in the tcpip thread
+      if (self->mcast_filter && tcpip_callback(install_mcast_hooks, self) != ERR_OK)
+      {
+        ET_LOGERROR("Multicast filter: installing the IGMP / MLD hooks failed");
+      }
+
+      self->started = true;
+      self->set_state(ESP32_W5500_STARTED, 0);
+      break;
+
+    case ETHERNET_EVENT_CONNECTED:
+    {
+      eth_speed_t speed = ETH_SPEED_100M;
+
+      esp_eth_ioctl(self->eth_handle, ETH_CMD_G_SPEED, &speed);
+      self->link_speed.store((speed == ETH_SPEED_10M) ? 10 : 100, std::memory_order_relaxed);
+      self->eth_link.store(ETH_LINK_UP, std::memory_order_relaxed);
+      self->set_state(ESP32_W5500_LINK_UP, 0);
+      break;
+    }
+
+    case ETHERNET_EVENT_DISCONNECTED:
+    case ETHERNET_EVENT_STOP:
+    {
+      esp_netif_ip_info_t none;
+
+      self->eth_link.store(ETH_LINK_DOWN, std::memory_order_relaxed);
+      self->link_speed.store(0, std::memory_order_relaxed);
+
+      // taking the netif down drops a DHCP address, a static one stays
+      if (!self->staticIP)
+      {
+        memset(&none, 0, sizeof(none));
+        self->cache_ip_info(&none);
+      }
+
+      if (event_id == ETHERNET_EVENT_STOP)
+      {
+        self->started = false;
+        self->set_state(0, ESP32_W5500_STARTED | ESP32_W5500_LINK_UP | ESP32_W5500_GOT_IP | ESP32_W5500_GOT_IP6);
+      }
+      else
+      {
+        self->set_state(0, ESP32_W5500_LINK_UP | ESP32_W5500_GOT_IP | ESP32_W5500_GOT_IP6);
+      }
+
+      break;
+    }
+
+    default:
+      break;
+  }
 }
 
 ////////////////////////////////////////
 
-IPAddress ESP32_W5500::gatewayIP()
+ESP32_W5500 *ESP32_W5500::from_lwip_netif(struct netif *netif)
 {
-  tcpip_adapter_ip_info_t ip;
+  for (ESP32_W5500 *eth = first_instance; eth; eth = eth->next_instance)
+  {
+    if (eth->eth_netif && esp_netif_get_netif_impl(eth->eth_netif) == netif)
+    {
+      return eth;
+    }
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////
 
-  if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip))
+// Runs in the tcpip thread, lwIP calls the hooks from there too
+void ESP32_W5500::install_mcast_hooks(void *arg)
+{
+  ESP32_W5500 *self = (ESP32_W5500 *) arg;
+  struct netif *netif = (struct netif *) esp_netif_get_netif_impl(self->eth_netif);
+
+  if (!netif || !self->eth_mac)
+  {
+    return;
+  }
+
+  // a restarted netif joins its groups anew, start from an empty table
+  esp_eth_mac_w5500_mcast_filter_clear(self->eth_mac);
+
+#if LWIP_IGMP
+  netif->igmp_mac_filter = igmp_mac_filter;
+
+  // groups joined before the hook was in place, 224.0.0.1 from netif_add() among them
+  for (struct igmp_group *group = netif_igmp_data(netif); group; group = group->next)
   {
-    return IPAddress();
+    igmp_mac_filter(netif, &group->group_address, NETIF_ADD_MAC_FILTER);
   }
+#endif
 
-  return IPAddress(ip.gw.addr);
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+  ip6_addr_t all_nodes;
+
+  netif->mld_mac_filter = mld_mac_filter;
+
+  // lwIP never joins ff02::1 through MLD, every node listens to it
+  ip6_addr_set_allnodes_linklocal(&all_nodes);
+  mld_mac_filter(netif, &all_nodes, NETIF_ADD_MAC_FILTER);
+
+  for (struct mld_group *group = netif_mld6_data(netif); group; group = group->next)
+  {
+    mld_mac_filter(netif, &group->group_address, NETIF_ADD_MAC_FILTER);
+  }
+#endif
 }
 
 ////////////////////////////////////////
 
-IPAddress ESP32_W5500::dnsIP(uint8_t dns_no)
+// 01:00:5e + the low 23 bits of the IPv4 group
+err_t ESP32_W5500::igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action)
 {
-  const ip_addr_t * dns_ip = dns_getserver(dns_no);
+  ESP32_W5500 *self = from_lwip_netif(netif);
+  uint8_t mac[6] = { 0x01, 0x00, 0x5e, (uint8_t) (ip4_addr2(group) & 0x7f), ip4_addr3(group), ip4_addr4(group) };
 
-  return IPAddress(dns_ip->u_addr.ip4.addr);
+  if (!self || esp_eth_mac_w5500_mcast_filter(self->eth_mac, mac, action == NETIF_ADD_MAC_FILTER) != ESP_OK)
+  {
+    return ERR_IF;
+  }
+
+  return ERR_OK;
 }
 
 ////////////////////////////////////////
 
-IPAddress ESP32_W5500::broadcastIP()
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+
+// 33:33 + the low 32 bits of the IPv6 group
+err_t ESP32_W5500::mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action)
 {
-  tcpip_adapter_ip_info_t ip;
+  ESP32_W5500 *self = from_lwip_netif(netif);
+  uint8_t mac[6] = { 0x33, 0x33 };
+
+  memcpy(mac + 2, &group->addr[3], 4);
 
-  if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip))
+  if (!self || esp_eth_mac_w5500_mcast_filter(self->eth_mac, mac, action == NETIF_ADD_MAC_FILTER) != ESP_OK)
   {
-    return IPAddress();
+    return ERR_IF;
   }
 
-  return WiFiGenericClass::calculateBroadcast(IPAddress(ip.gw.addr), IPAddress(ip.netmask.addr));
+  return ERR_OK;
 }
 
+#endif
+
 ////////////////////////////////////////
 
-IPAddress ESP32_W5500::networkID()
+// the hardware sockets source their traffic from the chip's own address registers, keep them in step with lwIP.
+// Left at 0.0.0.0 without offloading, the chip then has no address to answer ARP / ping for on its own
+void ESP32_W5500::sync_offload_ip(const esp_netif_ip_info_t *ip)
+{
+  if (!offload_sockets || !eth_mac)
+  {
+    return;
+  }
+
+  if (esp_eth_mac_w5500_set_ip(eth_mac, ip->ip.addr, ip->netmask.addr, ip->gw.addr) != ESP_OK)
+  {
+    ET_LOGERROR("Offload: setting the W5500 IP address failed");
+  }
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500::ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-  tcpip_adapter_ip_info_t ip;
+  ESP32_W5500 *self = (ESP32_W5500 *) arg;
 
-  if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip))
+  if (event_id == IP_EVENT_ETH_GOT_IP)
   {
-    return IPAddress();
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+
+    if (event->esp_netif == self->eth_netif)
+    {
+      self->cache_ip_info(&event->ip_info);
+      self->sync_offload_ip(&event->ip_info);
+      self->set_state(ESP32_W5500_GOT_IP, 0);
+    }
   }
+  else if (event_id == IP_EVENT_ETH_LOST_IP)
+  {
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+
+    // the DHCP lease ran out without a renewal: localIP() and so the failover's ethUsable() must see it gone
+    if (event->esp_netif == self->eth_netif)
+    {
+      esp_netif_ip_info_t none;
 
-  return WiFiGenericClass::calculateNetworkID(IPAddress(ip.gw.addr), IPAddress(ip.netmask.addr));
+      memset(&none, 0, sizeof(none));
+      self->cache_ip_info(&none);
+      self->sync_offload_ip(&none);
+      self->set_state(0, ESP32_W5500_GOT_IP);
+    }
+  }
+  else if (event_id == IP_EVENT_GOT_IP6)
+  {
+    ip_event_got_ip6_t *event = (ip_event_got_ip6_t *) event_data;
+
+    if (event->esp_netif == self->eth_netif)
+    {
+      self->set_state(ESP32_W5500_GOT_IP6, 0);
+    }
+  }
 }
 
 ////////////////////////////////////////
 
-uint8_t ESP32_W5500::subnetCIDR()
+uint32_t ESP32_W5500::state()
+{
+  if (!state_group)
+  {
+    return 0;
+  }
+
+  xSemaphoreTake(state_lock, portMAX_DELAY);
+  EventBits_t bits = xEventGroupGetBits(state_group);
+  xSemaphoreGive(state_lock);
+
+  return (uint32_t) bits;
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::waitFor(uint32_t state, uint32_t timeoutMs)
+{
+  if (!state_group)
+  {
+    return false;
+  }
+
+  TickType_t ticks = (timeoutMs == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+
+  // all requested bits, left set for the next waiter
+  EventBits_t bits = xEventGroupWaitBits(state_group, state, pdFALSE, pdTRUE, ticks);
+
+  if ((bits & state) != state)
+  {
+    return false;
+  }
+
+  // woken by the set half of a set_state(), check again once it has completed
+  xSemaphoreTake(state_lock, portMAX_DELAY);
+  bits = xEventGroupGetBits(state_group);
+  xSemaphoreGive(state_lock);
+
+  return (bits & state) == state;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500::onStateChange(ESP32_W5500_StateCallback callback, void *arg)
 {
-  tcpip_adapter_ip_info_t ip;
+  int id = -1;
 
-  if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_ETH, &ip))
+  portENTER_CRITICAL(&callbacks_lock);
+
+  for (int i = 0; i < ESP32_W5500_MAX_STATE_CALLBACKS; i++)
+  {
+    if (!callbacks[i])
+    {
+      callbacks[i] = callback;
+      callback_args[i] = arg;
+      id = i;
+      break;
+    }
+  }
+
+  portEXIT_CRITICAL(&callbacks_lock);
+
+  if (id < 0)
+  {
+    ET_LOGERROR("No free state callback slot");
+  }
+
+  return id;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500::removeStateCallback(int id)
+{
+  if (id < 0 || id >= ESP32_W5500_MAX_STATE_CALLBACKS)
   {
-    return (uint8_t)0;
+    return;
   }
 
-  return WiFiGenericClass::calculateSubnetCIDR(IPAddress(ip.netmask.addr));
+  portENTER_CRITICAL(&callbacks_lock);
+  callbacks[id] = NULL;
+  callback_args[id] = NULL;
+  portEXIT_CRITICAL(&callbacks_lock);
+}
+
+////////////////////////////////////////
+
+// the address getters read what the last IP / link event left, no esp-netif call (and no tcpip thread lock)
+IPAddress ESP32_W5500::localIP()
+{
+  return IPAddress(ip_addr.load(std::memory_order_relaxed));
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500::subnetMask()
+{
+  return IPAddress(ip_netmask.load(std::memory_order_relaxed));
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500::gatewayIP()
+{
+  return IPAddress(ip_gw.load(std::memory_order_relaxed));
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500::dnsIP(uint8_t dns_no)
+{
+  const ip_addr_t * dns_ip = dns_getserver(dns_no);
+
+  return IPAddress(dns_ip->u_addr.ip4.addr);
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500::broadcastIP()
+{
+  return WiFiGenericClass::calculateBroadcast(gatewayIP(), subnetMask());
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500::networkID()
+{
+  return WiFiGenericClass::calculateNetworkID(gatewayIP(), subnetMask());
+}
+
+////////////////////////////////////////
+
+uint8_t ESP32_W5500::subnetCIDR()
+{
+  return WiFiGenericClass::calculateSubnetCIDR(subnetMask());
 }
 
 ////////////////////////////////////////
@@ -333,7 +1172,7 @@ const char * ESP32_W5500::getHostname()
 {
   const char * hostname;
 
-  if (tcpip_adapter_get_hostname(TCPIP_ADAPTER_IF_ETH, &hostname))
+  if (esp_netif_get_hostname(eth_netif, &hostname))
   {
     return NULL;
   }
@@ -345,7 +1184,7 @@ const char * ESP32_W5500::getHostname()
 
 bool ESP32_W5500::setHostname(const char * hostname)
 {
-  return tcpip_adapter_set_hostname(TCPIP_ADAPTER_IF_ETH, hostname) == 0;
+  return esp_netif_set_hostname(eth_netif, hostname) == 0;
 }
 
 ////////////////////////////////////////
@@ -364,7 +1203,7 @@ bool ESP32_W5500::fullDuplex()
 bool ESP32_W5500::linkUp()
 {
 #ifdef ESP_IDF_VERSION_MAJOR
-  return eth_link == ETH_LINK_UP;
+  return eth_link.load(std::memory_order_relaxed) == ETH_LINK_UP;
 #else
   return eth_config.phy_check_link();
 #endif
@@ -375,9 +1214,8 @@ bool ESP32_W5500::linkUp()
 uint8_t ESP32_W5500::linkSpeed()
 {
 #ifdef ESP_IDF_VERSION_MAJOR
-  eth_speed_t link_speed;
-  esp_eth_ioctl(eth_handle, ETH_CMD_G_SPEED, &link_speed);
-  return (link_speed == ETH_SPEED_10M) ? 10 : 100;
+  // taken at link up, 0 while the link is down
+  return link_speed.load(std::memory_order_relaxed);
 #else
   return eth_config.phy_get_speed_mode() ? 100 : 10;
 #endif
@@ -387,16 +1225,16 @@ uint8_t ESP32_W5500::linkSpeed()
 
 bool ESP32_W5500::enableIpV6()
 {
-  return tcpip_adapter_create_ip6_linklocal(TCPIP_ADAPTER_IF_ETH) == 0;
+  return esp_netif_create_ip6_linklocal(eth_netif) == 0;
 }
 
 ////////////////////////////////////////
 
 IPv6Address ESP32_W5500::localIPv6()
 {
-  static ip6_addr_t addr;
+  static esp_ip6_addr_t addr;
 
-  if (tcpip_adapter_get_ip6_linklocal(TCPIP_ADAPTER_IF_ETH, &addr))
+  if (esp_netif_get_ip6_linklocal(eth_netif, &addr))
   {
     return IPv6Address();
   }
@@ -436,4 +1274,136 @@ String ESP32_W5500::macAddress()
 
 ////////////////////////////////////////
 
+ESP32_W5500_Stats ESP32_W5500::getStats()
+{
+  ESP32_W5500_Stats stats;
+
+  if (!eth_mac || esp_eth_mac_w5500_get_stats(eth_mac, &stats) != ESP_OK)
+  {
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  return stats;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500::resetStats()
+{
+  if (eth_mac)
+  {
+    esp_eth_mac_w5500_reset_stats(eth_mac);
+  }
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::stormActive()
+{
+  return stormClasses() != 0;
+}
+
+////////////////////////////////////////
+
+uint32_t ESP32_W5500::stormClasses()
+{
+  uint32_t classes = 0;
+
+  if (eth_mac)
+  {
+    esp_eth_mac_w5500_get_storm(eth_mac, &classes);
+  }
+
+  return classes;
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::setStormLimit(eth_w5500_rx_class_t rxClass, uint32_t rate, uint32_t burst)
+{
+  eth_w5500_storm_limit_t limit = { rate, burst };
+
+  return eth_mac && (esp_eth_mac_w5500_set_storm_limit(eth_mac, rxClass, &limit) == ESP_OK);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::registerEtherType(uint16_t type, ESP32_W5500_EtherTypeCallback callback, void *arg)
+{
+  return eth_mac && callback && (esp_eth_mac_w5500_register_ethertype(eth_mac, type, callback, arg) == ESP_OK);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::unregisterEtherType(uint16_t type)
+{
+  return eth_mac && (esp_eth_mac_w5500_register_ethertype(eth_mac, type, NULL, NULL) == ESP_OK);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::sendRaw(const uint8_t *frame, size_t len)
+{
+  if (!eth_handle || !frame || (len < ETH_HEADER_LEN) || (len > ETH_MAX_PACKET_SIZE))
+  {
+    return false;
+  }
+
+  // the w5500 sends MACRAW frames as given, short ones need their padding here (the chip appends the CRC)
+  if (len < ETH_HEADER_LEN + ETH_MIN_PAYLOAD_LEN)
+  {
+    uint8_t padded[ETH_HEADER_LEN + ETH_MIN_PAYLOAD_LEN] = { 0 };
+
+    memcpy(padded, frame, len);
+
+    return esp_eth_transmit(eth_handle, padded, sizeof(padded)) == ESP_OK;
+  }
+
+  return esp_eth_transmit(eth_handle, (void *) frame, len) == ESP_OK;
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500::setTxClassifier(ESP32_W5500_TxClassifier classifier, void *arg)
+{
+  return eth_mac && (esp_eth_mac_w5500_set_tx_classifier(eth_mac, classifier, arg) == ESP_OK);
+}
+
+////////////////////////////////////////
+
+esp_eth_handle_t ESP32_W5500::getEthHandle()
+{
+  return eth_handle;
+}
+
+////////////////////////////////////////
+
+esp_eth_mac_t *ESP32_W5500::getEthMac()
+{
+  return eth_mac;
+}
+
+////////////////////////////////////////
+
+esp_netif_t *ESP32_W5500::getNetif()
+{
+  return eth_netif;
+}
+
+////////////////////////////////////////
+
+uint32_t ESP32_W5500::getSPIClockHz()
+{
+  return spi_clock_hz;
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_BootTiming ESP32_W5500::getBootTiming()
+{
+  return boot_timing;
+}
+
+////////////////////////////////////////
+
 ESP32_W5500 ETH;
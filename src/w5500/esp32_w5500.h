@@ -26,6 +26,13 @@
 #include "esp_eth.h"
 
 #include <hal/spi_types.h>
+#include <atomic>
+
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "lwip/netif.h"
+
+#include "esp_eth/esp_eth_w5500.h"
 
 ////////////////////////////////////////
 
@@ -39,6 +46,122 @@ static uint8_t W5500_Default_Mac[] = { 0xFE, 0xED, 0xDE, 0xAD, 0xBE, 0xEF };
 
 ////////////////////////////////////////
 
+// Everything ESP32_W5500::begin() sets up, start from the defaults and change what's needed
+struct ESP32_W5500_Config
+{
+  // SPI wiring
+  int misoGpio              = -1;
+  int mosiGpio              = -1;
+  int sclkGpio              = -1;
+  int csGpio                = -1;
+  int intGpio               = -1;
+  int spiClockMHz           = 25;
+  int spiClockMaxMHz        = 0;                        // > spiClockMHz => auto-tune SCLK, at most this
+  int spiHost               = SPI3_HOST;
+  int spiQueueSize          = 20;                       // SPI transactions in flight, queued DMA sequences included
+  int dmaChannel            = SPI_DMA_CH_AUTO;
+  uint8_t *mac              = W5500_Default_Mac;        // used when there's no built-in Ethernet MAC in eFuse
+
+  // RX task, e.g. put it on the core not running loop() (ARDUINO_RUNNING_CORE)
+  uint32_t rxTaskPrio       = 1;
+  uint32_t rxTaskStackSize  = 2048;
+  int rxTaskCore            = -1;                       // -1 => no core affinity
+
+  // driver tuning
+  uint16_t intLevel         = ETH_W5500_INT_LEVEL;      // interrupt re-assert delay, INTLEVEL register
+  uint32_t rxPoolDepth      = ETH_W5500_RX_POOL_DEPTH;  // preallocated RX buffers, 0 => heap per frame
+  uint32_t rxBatchSize      = ETH_W5500_RX_BATCH_SIZE;  // batched RX staging buffer, 0 => zero-copy read per frame
+  bool     rxPipeline       = ETH_W5500_RX_PIPELINE;    // one SPI chain per frame: its payload and the next header
+  uint32_t linkCheckPeriodMs = 2000;                    // PHY link status polling period
+  uint32_t phyResetTimeoutMs = 100;
+
+  // hybrid mode: W5500 hardware TCP/UDP sockets 1..n next to MACRAW, see ESP32_W5500_HwClient / HwServer / HwUDP
+  uint32_t offloadSockets   = ETH_W5500_OFFLOAD_SOCKETS;
+
+  // opt-in: pass multicast to lwIP only for the groups it joined (IGMP / MLD), others are dropped before their payload
+  // is read. Multicast wanted without a join (raw EtherType callbacks, all-multicast protocols) is lost then
+  bool     mcastFilter      = ETH_W5500_MCAST_FILTER;
+
+  // RX storm protection, frames per second and burst per eth_w5500_rx_class_t (unicast, multicast, broadcast, ARP),
+  // rate 0 => not limited, which all classes are by default
+  eth_w5500_storm_limit_t stormLimits[ETH_W5500_RX_CLASS_MAX] = ETH_W5500_STORM_DEFAULT_LIMITS;
+
+  // TX priority classes (strict, normal, bulk by DSCP / VLAN PCP or setTxClassifier()): percent of the TX ring
+  // bulk frames may fill, the rest stays free for the others
+  uint32_t txBulkShare      = ETH_W5500_TX_BULK_SHARE;
+
+  // fast boot: keep the DHCP lease and the auto-tuned SPI clock in NVS. On the next power-up the clock is taken as
+  // is and DHCP asks the server to confirm the cached address (INIT-REBOOT) instead of discovering, unless it ran out
+  bool     fastBoot         = false;
+};
+
+////////////////////////////////////////
+
+// Where ESP32_W5500::begin() and the first address spent their time, in microseconds. The first fields are the
+// durations of the begin() phases, the milestones after beginUs count from the start of begin(), 0 => not reached
+struct ESP32_W5500_BootTiming
+{
+  uint32_t tcpipInitUs;
+  uint32_t spiInitUs;                                   // SPI bus and device, SPI clock auto-tune included
+  uint32_t driverInstallUs;                             // esp_eth_driver_install(): MAC init and PHY reset
+  uint32_t chipResetUs;                                 // parts of driverInstallUs: W5500 software reset
+  uint32_t chipSetupUs;                                 //                           default register setup
+  uint32_t startUs;                                     // esp_eth_start()
+  uint32_t beginUs;                                     // begin() as a whole
+
+  uint32_t linkUpUs;
+  uint32_t ipUs;                                        // first usable address, DHCP or static
+  uint32_t dhcpUs;                                      // DHCP lease bound
+
+  bool     spiClockReused;                              // fast boot took the cached SPI clock after one check
+  bool     leaseReused;                                 // the server confirmed fast boot's cached lease
+};
+
+////////////////////////////////////////
+
+// Connection state, bits of the ESP32_W5500 event group driven by the esp_event ETH / IP events
+typedef enum
+{
+  ESP32_W5500_STARTED       = BIT0,     // esp_eth_start() done, cleared by esp_eth_stop()
+  ESP32_W5500_LINK_UP       = BIT1,
+  ESP32_W5500_GOT_IP        = BIT2,     // IPv4 address, static or DHCP (the fast boot lease once ACKed)
+  ESP32_W5500_GOT_IP6       = BIT3,
+} ESP32_W5500_State;
+
+#define ESP32_W5500_MAX_STATE_CALLBACKS     4
+
+class ESP32_W5500;
+
+// Called from the esp_event task on every state change with the new ESP32_W5500_State bits, keep it short
+typedef void (*ESP32_W5500_StateCallback)(ESP32_W5500 *eth, uint32_t state, void *arg);
+
+////////////////////////////////////////
+
+// DHCP lease as cached in NVS by fast boot
+struct ESP32_W5500_Lease
+{
+  uint8_t mac[6];
+  esp_netif_ip_info_t ip;
+  int64_t boundAt;                      // time() of the ACK, seconds
+  uint32_t leaseTime;                   // seconds from boundAt, UINT32_MAX => infinite
+};
+
+////////////////////////////////////////
+
+// Driver counters, per command latency histograms and sliding window rates, see eth_w5500_stats_t
+typedef eth_w5500_stats_t ESP32_W5500_Stats;
+
+// Raw EtherType receive callback, runs in the w5500 task with the frame in the driver's buffer, see
+// eth_w5500_ethertype_cb_t: don't block, don't keep the pointer. sendRaw() from it fails rather than waits when the
+// TX queue is full
+typedef eth_w5500_ethertype_cb_t ESP32_W5500_EtherTypeCallback;
+
+// TX classifier hook, runs for every frame sent: return an eth_w5500_tx_class_t, or ETH_W5500_TX_CLASS_MAX to leave
+// the frame to the DSCP / VLAN PCP classification
+typedef eth_w5500_tx_classifier_t ESP32_W5500_TxClassifier;
+
+////////////////////////////////////////
+
 class ESP32_W5500
 {
   private:
@@ -49,10 +172,67 @@ class ESP32_W5500
 
 #if ESP_IDF_VERSION_MAJOR > 3
     esp_eth_handle_t eth_handle;
+    esp_eth_mac_t *eth_mac;
+    esp_netif_t *eth_netif;
+    uint8_t instance;                 // 0 => default Ethernet netif, > 0 => additional w5500
+    char netif_key[16];
+    char netif_desc[8];
+    uint32_t spi_clock_hz;
+    uint32_t offload_sockets;
+
+    static uint8_t instance_count;
+
+    // fast boot and boot timing
+    bool fast_boot;
+    bool lease_cached;
+    volatile bool lease_requested;        // DHCP asked for the cached lease, the next GOT_IP may confirm it
+    ESP32_W5500_Lease lease;
+    int64_t begin_start_us;
+    ESP32_W5500_BootTiming boot_timing;
+    esp_event_handler_instance_t boot_eth_handler;
+    esp_event_handler_instance_t boot_ip_handler;
+
+    static void boot_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+    static void request_lease_callback(void *arg);
+    bool load_lease();
+    bool lease_usable();
+    void save_lease(const esp_netif_ip_info_t *ip);
+    bool load_spi_clock(const ESP32_W5500_Config& config);
+    void save_spi_clock(const ESP32_W5500_Config& config);
+
+    // connection state machine, the cached values are read lock-free by linkUp(), linkSpeed(), localIP() ...
+    EventGroupHandle_t state_group;
+    SemaphoreHandle_t state_lock;         // makes set_state()'s clear + set one step for state() and waitFor()
+    esp_event_handler_instance_t state_eth_handler;
+    esp_event_handler_instance_t state_ip_handler;
+    std::atomic<uint8_t> link_speed;
+    std::atomic<uint32_t> ip_addr;
+    std::atomic<uint32_t> ip_netmask;
+    std::atomic<uint32_t> ip_gw;
+    portMUX_TYPE callbacks_lock;
+    ESP32_W5500_StateCallback callbacks[ESP32_W5500_MAX_STATE_CALLBACKS];
+    void *callback_args[ESP32_W5500_MAX_STATE_CALLBACKS];
+
+    static void ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+    void set_state(uint32_t set, uint32_t clear);
+    void cache_ip_info(const esp_netif_ip_info_t *ip);
+    void sync_offload_ip(const esp_netif_ip_info_t *ip);
+
+    // multicast filter fed by lwIP's IGMP / MLD hooks, which only get the netif: instances are found through a list
+    bool mcast_filter;
+    ESP32_W5500 *next_instance;
+    static ESP32_W5500 *first_instance;
+
+    static ESP32_W5500 *from_lwip_netif(struct netif *netif);
+    static void install_mcast_hooks(void *arg);
+    static err_t igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action);
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+    static err_t mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action);
+#endif
 
   protected:
     bool started;
-    eth_link_t eth_link;
+    std::atomic<eth_link_t> eth_link;
     static void eth_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 #else
     bool started;
@@ -65,6 +245,7 @@ class ESP32_W5500
 
     bool begin(int MISO, int MOSI, int SCLK, int CS, int INT, int SPICLOCK_MHZ = 25, int SPIHOST = SPI3_HOST,
                uint8_t *W5500_Mac = W5500_Default_Mac);
+    bool begin(const ESP32_W5500_Config& config);
 
     bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0x00000000,
                 IPAddress dns2 = (uint32_t)0x00000000);
@@ -72,6 +253,11 @@ class ESP32_W5500
     const char * getHostname();
     bool setHostname(const char * hostname);
 
+    uint32_t state();
+    bool waitFor(uint32_t state, uint32_t timeoutMs = portMAX_DELAY);
+    int onStateChange(ESP32_W5500_StateCallback callback, void *arg = NULL);
+    void removeStateCallback(int id);
+
     bool fullDuplex();
     bool linkUp();
     uint8_t linkSpeed();
@@ -91,6 +277,29 @@ class ESP32_W5500
     uint8_t * macAddress(uint8_t* mac);
     String macAddress();
 
+    ESP32_W5500_Stats getStats();
+    void resetStats();
+
+    // RX storm protection: classes dropping frames over their limit right now, e.g. to shed optional work meanwhile
+    bool stormActive();
+    uint32_t stormClasses();          // bit (1 << eth_w5500_rx_class_t) per class being limited
+    bool setStormLimit(eth_w5500_rx_class_t rxClass, uint32_t rate, uint32_t burst);
+
+    // Raw frames: a registered EtherType goes to its callback instead of lwIP, sendRaw() takes a complete frame
+    // (destination, source, EtherType, payload) and pads it to the Ethernet minimum
+    bool registerEtherType(uint16_t type, ESP32_W5500_EtherTypeCallback callback, void *arg = NULL);
+    bool unregisterEtherType(uint16_t type);
+    bool sendRaw(const uint8_t *frame, size_t len);
+
+    // TX priority classes, per class counters and latency histograms in getStats().tx_class[]
+    bool setTxClassifier(ESP32_W5500_TxClassifier classifier, void *arg = NULL);
+
+    esp_eth_handle_t getEthHandle();
+    esp_eth_mac_t *getEthMac();
+    esp_netif_t *getNetif();
+    uint32_t getSPIClockHz();
+    ESP32_W5500_BootTiming getBootTiming();
+
     friend class WiFiClient;
     friend class WiFiServer;
 };
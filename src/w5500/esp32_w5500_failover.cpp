@@ -0,0 +1,327 @@
+/****************************************************************************************************************************
+  esp32_w5500_failover.cpp
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#include "WebServer_ESP32_W5500_Debug.h"
+#include "esp32_w5500_failover.h"
+
+#include "esp_timer.h"
+#include "lwip/tcpip.h"
+#include "lwip/netif.h"
+#include "lwip/dns.h"
+
+// time the tcpip thread gets to apply a route change
+#define FAILOVER_ROUTE_TIMEOUT_MS     100
+
+////////////////////////////////////////
+
+ESP32_W5500_Failover::ESP32_W5500_Failover()
+  : eth(NULL)
+  , wifi_netif(NULL)
+  , active(ESP32_W5500_ROUTE_NONE)
+  , task_hdl(NULL)
+  , route_done(NULL)
+  , ip_event_handler(NULL)
+  , running(false)
+  , route_netif(NULL)
+{
+  portMUX_INITIALIZE(&stats_lock);
+  memset(&stats, 0, sizeof(stats));
+  ip_addr_set_zero(&eth_dns);
+  ip_addr_set_zero(&wifi_dns);
+  ip_addr_set_zero(&route_dns);
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_Failover::~ESP32_W5500_Failover()
+{
+  end();
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500_Failover::begin(ESP32_W5500& eth, const char *ssid, const char *passphrase,
+                                 const ESP32_W5500_FailoverConfig& config)
+{
+  if (running || !eth.getEthMac() || !eth.getNetif())
+  {
+    ET_LOGERROR("Failover: call ETH.begin() first");
+
+    return false;
+  }
+
+  this->eth = &eth;
+  this->config = config;
+
+  // standby link: associated and awake, so taking over only needs a route change
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(false);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(ssid, passphrase);
+
+  wifi_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+
+  route_done = xSemaphoreCreateBinary();
+
+  if (!wifi_netif || !route_done)
+  {
+    ET_LOGERROR("Failover: no WiFi STA netif / no mem");
+
+    return false;
+  }
+
+  if (esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, ipEventHandler, this,
+                                          &ip_event_handler) != ESP_OK)
+  {
+    ET_LOGERROR("Failover: register IP event handler failed");
+
+    return false;
+  }
+
+  running = true;
+
+  if (xTaskCreatePinnedToCore(task, "w5500_failover", config.taskStackSize, this, config.taskPrio, &task_hdl,
+                              (config.taskCore < 0) ? tskNO_AFFINITY : config.taskCore) != pdPASS)
+  {
+    ET_LOGERROR("Failover: create task failed");
+    running = false;
+
+    return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_Failover::end()
+{
+  // the IP event handler notifies the task, so it goes first: unregistering waits for a call in progress
+  if (ip_event_handler)
+  {
+    esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, ip_event_handler);
+    ip_event_handler = NULL;
+  }
+
+  if (running)
+  {
+    running = false;
+
+    // the task deletes itself after its current poll
+    while (task_hdl)
+    {
+      delay(config.linkPollMs);
+    }
+  }
+
+  if (route_done)
+  {
+    vSemaphoreDelete(route_done);
+    route_done = NULL;
+  }
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_Route ESP32_W5500_Failover::activeRoute()
+{
+  return active;
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_FailoverStats ESP32_W5500_Failover::getStats()
+{
+  ESP32_W5500_FailoverStats snapshot;
+
+  portENTER_CRITICAL(&stats_lock);
+  snapshot = stats;
+  portEXIT_CRITICAL(&stats_lock);
+
+  return snapshot;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_Failover::resetStats()
+{
+  portENTER_CRITICAL(&stats_lock);
+  memset(&stats, 0, sizeof(stats));
+  portEXIT_CRITICAL(&stats_lock);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500_Failover::ethUsable()
+{
+  eth_link_t link = ETH_LINK_DOWN;
+
+  // straight from the PHY, the esp_eth link check only runs every linkCheckPeriodMs
+  if (esp_eth_mac_w5500_get_link(eth->getEthMac(), &link) != ESP_OK || link != ETH_LINK_UP)
+  {
+    return false;
+  }
+
+  return (uint32_t) eth->localIP() != 0;
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500_Failover::wifiUsable()
+{
+  esp_netif_ip_info_t ip;
+
+  return WiFi.isConnected() && (esp_netif_get_ip_info(wifi_netif, &ip) == ESP_OK) && (ip.ip.addr != 0);
+}
+
+////////////////////////////////////////
+
+// runs in the tcpip thread, the only place lwIP's default netif and DNS servers may be changed
+void ESP32_W5500_Failover::applyRouteCallback(void *arg)
+{
+  ESP32_W5500_Failover *self = (ESP32_W5500_Failover *) arg;
+
+  netif_set_default(self->route_netif);
+
+  if (!ip_addr_isany(&self->route_dns))
+  {
+    dns_setserver(0, &self->route_dns);
+  }
+
+  xSemaphoreGive(self->route_done);
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500_Failover::moveRoute(ESP32_W5500_Route route)
+{
+  bool toEth = (route == ESP32_W5500_ROUTE_ETH);
+
+  route_netif = (struct netif *) esp_netif_get_netif_impl(toEth ? eth->getNetif() : wifi_netif);
+  route_dns = toEth ? eth_dns : wifi_dns;
+
+  if (!route_netif || tcpip_callback(applyRouteCallback, this) != ERR_OK)
+  {
+    return false;
+  }
+
+  return xSemaphoreTake(route_done, pdMS_TO_TICKS(FAILOVER_ROUTE_TIMEOUT_MS)) == pdTRUE;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_Failover::ipEventHandler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+  ESP32_W5500_Failover *self = (ESP32_W5500_Failover *) arg;
+
+  if (event_id == IP_EVENT_ETH_GOT_IP || event_id == IP_EVENT_STA_GOT_IP)
+  {
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+    const ip_addr_t *dns = dns_getserver(0);
+
+    // DHCP has just set the global DNS servers from this interface's lease
+    if (event->esp_netif == self->eth->getNetif())
+    {
+      ip_addr_copy(self->eth_dns, *dns);
+    }
+    else if (event->esp_netif == self->wifi_netif)
+    {
+      ip_addr_copy(self->wifi_dns, *dns);
+    }
+  }
+
+  // esp-netif may have picked another default netif (by route priority WiFi STA beats Ethernet), re-apply ours
+  if (self->task_hdl)
+  {
+    xTaskNotifyGive(self->task_hdl);
+  }
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_Failover::task(void *arg)
+{
+  ESP32_W5500_Failover *self = (ESP32_W5500_Failover *) arg;
+  int64_t ethUpSince = 0;
+
+  while (self->running)
+  {
+    bool reapply = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(self->config.linkPollMs)) != 0;
+    int64_t now = esp_timer_get_time();
+    ESP32_W5500_Route route = self->active;
+
+    if (self->ethUsable())
+    {
+      if (!ethUpSince)
+      {
+        ethUpSince = now;
+      }
+
+      // first route at startup, or Ethernet back and stable for long enough
+      if ((self->active != ESP32_W5500_ROUTE_WIFI) ||
+          (now - ethUpSince >= (int64_t) self->config.failbackHoldMs * 1000))
+      {
+        route = ESP32_W5500_ROUTE_ETH;
+      }
+    }
+    else
+    {
+      ethUpSince = 0;
+
+      if (self->wifiUsable())
+      {
+        route = ESP32_W5500_ROUTE_WIFI;
+      }
+    }
+
+    if (route == ESP32_W5500_ROUTE_NONE || (route == self->active && !reapply))
+    {
+      continue;
+    }
+
+    if (!self->moveRoute(route))
+    {
+      ET_LOGERROR("Failover: moving the default route failed");
+      continue;
+    }
+
+    if (route != self->active)
+    {
+      uint32_t elapsedUs = (uint32_t) (esp_timer_get_time() - now);
+
+      portENTER_CRITICAL(&self->stats_lock);
+
+      if (route == ESP32_W5500_ROUTE_WIFI && self->active == ESP32_W5500_ROUTE_ETH)
+      {
+        self->stats.switchovers++;
+        self->stats.lastSwitchoverUs = elapsedUs;
+        self->stats.maxSwitchoverUs = max(self->stats.maxSwitchoverUs, elapsedUs);
+      }
+      else if (route == ESP32_W5500_ROUTE_ETH && self->active == ESP32_W5500_ROUTE_WIFI)
+      {
+        self->stats.failbacks++;
+        self->stats.lastFailbackUs = elapsedUs;
+        self->stats.maxFailbackUs = max(self->stats.maxFailbackUs, elapsedUs);
+      }
+
+      portEXIT_CRITICAL(&self->stats_lock);
+
+      ET_LOGWARN1("Failover: default route now", (route == ESP32_W5500_ROUTE_ETH) ? "ETH" : "WiFi");
+      self->active = route;
+    }
+  }
+
+  self->task_hdl = NULL;
+  vTaskDelete(NULL);
+}
+
+////////////////////////////////////////
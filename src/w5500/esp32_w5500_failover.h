@@ -0,0 +1,102 @@
+/****************************************************************************************************************************
+  esp32_w5500_failover.h
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#ifndef _ESP32_W5500_FAILOVER_H_
+#define _ESP32_W5500_FAILOVER_H_
+
+#include "esp32_w5500.h"
+
+#include "freertos/semphr.h"
+#include "lwip/ip_addr.h"
+
+////////////////////////////////////////
+
+struct ESP32_W5500_FailoverConfig
+{
+  uint32_t linkPollMs       = 100;    // W5500 PHY link poll period, bounds the detection time of a cable pull
+  uint32_t failbackHoldMs   = 1000;   // Ethernet must stay up this long before traffic moves back to it
+  uint32_t taskPrio         = 2;
+  uint32_t taskStackSize    = 3072;
+  int taskCore              = -1;     // -1 => no core affinity
+};
+
+////////////////////////////////////////
+
+typedef enum
+{
+  ESP32_W5500_ROUTE_NONE,
+  ESP32_W5500_ROUTE_ETH,
+  ESP32_W5500_ROUTE_WIFI,
+} ESP32_W5500_Route;
+
+// Switchover latency is measured from the poll which saw the change to the default route / DNS being moved,
+// add up to linkPollMs for the detection itself
+struct ESP32_W5500_FailoverStats
+{
+  uint32_t switchovers;             // Ethernet => WiFi
+  uint32_t failbacks;               // WiFi => Ethernet
+  uint32_t lastSwitchoverUs;
+  uint32_t maxSwitchoverUs;
+  uint32_t lastFailbackUs;
+  uint32_t maxFailbackUs;
+};
+
+////////////////////////////////////////
+
+// Hot standby: WiFi STA stays associated while the W5500 carries the traffic. When the W5500 link drops, the default
+// route and DNS move to WiFi, and back once Ethernet has been up again for failbackHoldMs
+class ESP32_W5500_Failover
+{
+  public:
+    ESP32_W5500_Failover();
+    ~ESP32_W5500_Failover();
+
+    bool begin(ESP32_W5500& eth, const char *ssid, const char *passphrase,
+               const ESP32_W5500_FailoverConfig& config = ESP32_W5500_FailoverConfig());
+    void end();
+
+    ESP32_W5500_Route activeRoute();
+    ESP32_W5500_FailoverStats getStats();
+    void resetStats();
+
+  private:
+    ESP32_W5500 *eth;
+    esp_netif_t *wifi_netif;
+    ESP32_W5500_FailoverConfig config;
+    ESP32_W5500_FailoverStats stats;
+    portMUX_TYPE stats_lock;              // stats are updated by the failover task, read and reset by the application
+    volatile ESP32_W5500_Route active;
+    TaskHandle_t task_hdl;
+    SemaphoreHandle_t route_done;
+    esp_event_handler_instance_t ip_event_handler;
+    volatile bool running;
+
+    // DNS servers learnt by DHCP on each side, lwIP only keeps one global set
+    ip_addr_t eth_dns;
+    ip_addr_t wifi_dns;
+
+    // request handed to the tcpip thread
+    struct netif *route_netif;
+    ip_addr_t route_dns;
+
+    static void task(void *arg);
+    static void ipEventHandler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+    static void applyRouteCallback(void *arg);
+
+    bool ethUsable();
+    bool wifiUsable();
+    bool moveRoute(ESP32_W5500_Route route);
+};
+
+////////////////////////////////////////
+
+#endif /* _ESP32_W5500_FAILOVER_H_ */
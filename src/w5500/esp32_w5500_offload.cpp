@@ -0,0 +1,652 @@
+/****************************************************************************************************************************
+  esp32_w5500_offload.cpp
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#include "WebServer_ESP32_W5500_Debug.h"
+#include "esp32_w5500_offload.h"
+
+// poll period while waiting for the chip, a connect / a full TX buffer take at least a network round trip
+#define OFFLOAD_POLL_MS     1
+
+////////////////////////////////////////
+
+ESP32_W5500_HwClient::ESP32_W5500_HwClient(ESP32_W5500& eth)
+  : eth(&eth)
+  , sock(0)
+  , peeked(-1)
+{
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_HwClient::ESP32_W5500_HwClient(ESP32_W5500& eth, uint8_t sock)
+  : eth(&eth)
+  , sock(sock)
+  , peeked(-1)
+{
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwClient::connect(IPAddress ip, uint16_t port)
+{
+  esp_eth_mac_t *mac = eth->getEthMac();
+  eth_w5500_sock_info_t info;
+
+  stop();
+
+  if (!mac || esp_eth_mac_w5500_sock_open(mac, ETH_W5500_SOCK_TCP, 0, &sock) != ESP_OK)
+  {
+    ET_LOGERROR("Offload: no hardware socket, check ESP32_W5500_Config::offloadSockets");
+    sock = 0;
+
+    return 0;
+  }
+
+  if (esp_eth_mac_w5500_sock_connect(mac, sock, (uint32_t) ip, port) != ESP_OK)
+  {
+    stop();
+
+    return 0;
+  }
+
+  uint32_t startMs = millis();
+
+  // the chip goes SYNSENT => ESTABLISHED, or back to CLOSED on RST / after its retransmissions
+  while (esp_eth_mac_w5500_sock_info(mac, sock, &info) == ESP_OK)
+  {
+    if (info.state == ETH_W5500_SOCK_ESTABLISHED)
+    {
+      return 1;
+    }
+
+    if (info.state == ETH_W5500_SOCK_CLOSED || millis() - startMs >= ESP32_W5500_HW_CONNECT_TIMEOUT_MS)
+    {
+      break;
+    }
+
+    delay(OFFLOAD_POLL_MS);
+  }
+
+  stop();
+
+  return 0;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwClient::connect(const char *host, uint16_t port)
+{
+  IPAddress ip;
+
+  if (!WiFi.hostByName(host, ip))
+  {
+    return 0;
+  }
+
+  return connect(ip, port);
+}
+
+////////////////////////////////////////
+
+size_t ESP32_W5500_HwClient::write(uint8_t data)
+{
+  return write(&data, 1);
+}
+
+////////////////////////////////////////
+
+size_t ESP32_W5500_HwClient::write(const uint8_t *buf, size_t size)
+{
+  esp_eth_mac_t *mac = eth->getEthMac();
+  size_t written = 0;
+  uint32_t startMs = millis();
+
+  if (!sock)
+  {
+    return 0;
+  }
+
+  while (written < size)
+  {
+    uint32_t sent = 0;
+
+    if (esp_eth_mac_w5500_sock_send(mac, sock, buf + written, size - written, &sent) != ESP_OK)
+    {
+      break;
+    }
+
+    if (sent)
+    {
+      written += sent;
+      startMs = millis();
+    }
+    else if (millis() - startMs >= ESP32_W5500_HW_WRITE_TIMEOUT_MS)
+    {
+      break;
+    }
+    else
+    {
+      // TX buffer full, wait for the peer's ACKs
+      delay(OFFLOAD_POLL_MS);
+    }
+  }
+
+  return written;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwClient::available()
+{
+  eth_w5500_sock_info_t info;
+
+  if (!sock || esp_eth_mac_w5500_sock_info(eth->getEthMac(), sock, &info) != ESP_OK)
+  {
+    return (peeked >= 0) ? 1 : 0;
+  }
+
+  return info.rx_size + ((peeked >= 0) ? 1 : 0);
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwClient::read()
+{
+  uint8_t data;
+
+  return (read(&data, 1) == 1) ? data : -1;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwClient::read(uint8_t *buf, size_t size)
+{
+  uint32_t received = 0;
+  int count = 0;
+
+  if (!size)
+  {
+    return 0;
+  }
+
+  if (peeked >= 0)
+  {
+    *buf++ = peeked;
+    size--;
+    count++;
+    peeked = -1;
+  }
+
+  if (size && sock && esp_eth_mac_w5500_sock_recv(eth->getEthMac(), sock, buf, size, &received) == ESP_OK)
+  {
+    count += received;
+  }
+
+  return count ? count : -1;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwClient::peek()
+{
+  uint8_t data;
+  uint32_t received = 0;
+
+  if (peeked < 0 && sock && esp_eth_mac_w5500_sock_recv(eth->getEthMac(), sock, &data, 1, &received) == ESP_OK &&
+      received)
+  {
+    peeked = data;
+  }
+
+  return peeked;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_HwClient::flush()
+{
+  uint8_t buf[64];
+
+  // like WiFiClient: drop what has been received so far
+  while (available() > 0 && read(buf, sizeof(buf)) > 0);
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_HwClient::stop()
+{
+  esp_eth_mac_t *mac = eth->getEthMac();
+  eth_w5500_sock_info_t info;
+
+  if (!sock)
+  {
+    return;
+  }
+
+  // FIN first, the chip closes by itself once the peer has answered, otherwise close it after a while
+  if (esp_eth_mac_w5500_sock_disconnect(mac, sock) == ESP_OK)
+  {
+    uint32_t startMs = millis();
+
+    while (esp_eth_mac_w5500_sock_info(mac, sock, &info) == ESP_OK && info.state != ETH_W5500_SOCK_CLOSED &&
+           millis() - startMs < ESP32_W5500_HW_CONNECT_TIMEOUT_MS)
+    {
+      delay(OFFLOAD_POLL_MS);
+    }
+  }
+
+  esp_eth_mac_w5500_sock_close(mac, sock);
+  sock = 0;
+  peeked = -1;
+}
+
+////////////////////////////////////////
+
+uint8_t ESP32_W5500_HwClient::connected()
+{
+  eth_w5500_sock_info_t info;
+
+  if (peeked >= 0)
+  {
+    return 1;
+  }
+
+  if (!sock || esp_eth_mac_w5500_sock_info(eth->getEthMac(), sock, &info) != ESP_OK)
+  {
+    return 0;
+  }
+
+  // the peer's FIN still leaves unread data behind
+  return (info.state == ETH_W5500_SOCK_ESTABLISHED) || (info.rx_size > 0);
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_HwClient::operator bool()
+{
+  return connected();
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500_HwClient::remoteIP()
+{
+  uint32_t ip = 0;
+  uint16_t port = 0;
+
+  if (sock)
+  {
+    esp_eth_mac_w5500_sock_remote(eth->getEthMac(), sock, &ip, &port);
+  }
+
+  return IPAddress(ip);
+}
+
+////////////////////////////////////////
+
+uint16_t ESP32_W5500_HwClient::remotePort()
+{
+  uint32_t ip = 0;
+  uint16_t port = 0;
+
+  if (sock)
+  {
+    esp_eth_mac_w5500_sock_remote(eth->getEthMac(), sock, &ip, &port);
+  }
+
+  return port;
+}
+
+////////////////////////////////////////
+////////////////////////////////////////
+
+ESP32_W5500_HwServer::ESP32_W5500_HwServer(uint16_t port, ESP32_W5500& eth)
+  : eth(&eth)
+  , port(port)
+  , sock(0)
+{
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_HwServer::~ESP32_W5500_HwServer()
+{
+  end();
+}
+
+////////////////////////////////////////
+
+bool ESP32_W5500_HwServer::listen()
+{
+  esp_eth_mac_t *mac = eth->getEthMac();
+
+  if (!mac || esp_eth_mac_w5500_sock_open(mac, ETH_W5500_SOCK_TCP, port, &sock) != ESP_OK)
+  {
+    sock = 0;
+
+    return false;
+  }
+
+  if (esp_eth_mac_w5500_sock_listen(mac, sock) != ESP_OK)
+  {
+    esp_eth_mac_w5500_sock_close(mac, sock);
+    sock = 0;
+
+    return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_HwServer::begin(uint16_t port)
+{
+  if (port)
+  {
+    this->port = port;
+  }
+
+  end();
+
+  if (!listen())
+  {
+    ET_LOGERROR1("Offload: listen failed on port", this->port);
+  }
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_HwServer::end()
+{
+  if (sock)
+  {
+    esp_eth_mac_w5500_sock_close(eth->getEthMac(), sock);
+    sock = 0;
+  }
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_HwClient ESP32_W5500_HwServer::available()
+{
+  esp_eth_mac_t *mac = eth->getEthMac();
+  eth_w5500_sock_info_t info;
+
+  // no socket was free at the last try, every closed client gives one back
+  if (!sock)
+  {
+    listen();
+
+    return ESP32_W5500_HwClient(*eth);
+  }
+
+  if (esp_eth_mac_w5500_sock_info(mac, sock, &info) != ESP_OK)
+  {
+    return ESP32_W5500_HwClient(*eth);
+  }
+
+  if (info.state == ETH_W5500_SOCK_ESTABLISHED || info.state == ETH_W5500_SOCK_CLOSE_WAIT)
+  {
+    ESP32_W5500_HwClient client(*eth, sock);
+
+    sock = 0;
+    listen();
+
+    return client;
+  }
+
+  // a connection attempt reset by the peer
+  if (info.state == ETH_W5500_SOCK_CLOSED)
+  {
+    esp_eth_mac_w5500_sock_close(mac, sock);
+    sock = 0;
+    listen();
+  }
+
+  return ESP32_W5500_HwClient(*eth);
+}
+
+////////////////////////////////////////
+
+size_t ESP32_W5500_HwServer::write(uint8_t data)
+{
+  return 0;
+}
+
+////////////////////////////////////////
+
+size_t ESP32_W5500_HwServer::write(const uint8_t *buf, size_t size)
+{
+  return 0;
+}
+
+////////////////////////////////////////
+////////////////////////////////////////
+
+ESP32_W5500_HwUDP::ESP32_W5500_HwUDP(ESP32_W5500& eth)
+  : eth(&eth)
+  , sock(0)
+  , tx_buf(NULL)
+  , rx_buf(NULL)
+  , tx_len(0)
+  , rx_len(0)
+  , rx_pos(0)
+  , tx_ip(0)
+  , tx_port(0)
+  , rx_ip(0)
+  , rx_port(0)
+{
+}
+
+////////////////////////////////////////
+
+ESP32_W5500_HwUDP::~ESP32_W5500_HwUDP()
+{
+  stop();
+}
+
+////////////////////////////////////////
+
+uint8_t ESP32_W5500_HwUDP::begin(uint16_t port)
+{
+  esp_eth_mac_t *mac = eth->getEthMac();
+
+  stop();
+
+  tx_buf = (uint8_t *) malloc(ESP32_W5500_HW_UDP_MAX_PAYLOAD);
+  rx_buf = (uint8_t *) malloc(ESP32_W5500_HW_UDP_MAX_PAYLOAD);
+
+  if (!tx_buf || !rx_buf || !mac || esp_eth_mac_w5500_sock_open(mac, ETH_W5500_SOCK_UDP, port, &sock) != ESP_OK)
+  {
+    ET_LOGERROR1("Offload: UDP open failed on port", port);
+    sock = 0;
+    stop();
+
+    return 0;
+  }
+
+  return 1;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_HwUDP::stop()
+{
+  if (sock)
+  {
+    esp_eth_mac_w5500_sock_close(eth->getEthMac(), sock);
+    sock = 0;
+  }
+
+  free(tx_buf);
+  free(rx_buf);
+  tx_buf = NULL;
+  rx_buf = NULL;
+  tx_len = 0;
+  rx_len = 0;
+  rx_pos = 0;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  // like WiFiUDP, sending is possible without begin(), from an automatically chosen local port
+  if (!sock && !begin(0))
+  {
+    return 0;
+  }
+
+  tx_ip = (uint32_t) ip;
+  tx_port = port;
+  tx_len = 0;
+
+  return 1;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::beginPacket(const char *host, uint16_t port)
+{
+  IPAddress ip;
+
+  if (!WiFi.hostByName(host, ip))
+  {
+    return 0;
+  }
+
+  return beginPacket(ip, port);
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::endPacket()
+{
+  if (!sock || !tx_len)
+  {
+    return 0;
+  }
+
+  esp_err_t err = esp_eth_mac_w5500_sock_sendto(eth->getEthMac(), sock, tx_buf, tx_len, tx_ip, tx_port);
+
+  tx_len = 0;
+
+  return (err == ESP_OK) ? 1 : 0;
+}
+
+////////////////////////////////////////
+
+size_t ESP32_W5500_HwUDP::write(uint8_t data)
+{
+  return write(&data, 1);
+}
+
+////////////////////////////////////////
+
+size_t ESP32_W5500_HwUDP::write(const uint8_t *buf, size_t size)
+{
+  if (!tx_buf)
+  {
+    return 0;
+  }
+
+  size = min(size, (size_t) (ESP32_W5500_HW_UDP_MAX_PAYLOAD - tx_len));
+  memcpy(tx_buf + tx_len, buf, size);
+  tx_len += size;
+
+  return size;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::parsePacket()
+{
+  uint32_t received = 0;
+  uint32_t size = 0;
+
+  rx_len = 0;
+  rx_pos = 0;
+
+  if (!sock || esp_eth_mac_w5500_sock_recvfrom(eth->getEthMac(), sock, rx_buf, ESP32_W5500_HW_UDP_MAX_PAYLOAD,
+                                               &received, &size, &rx_ip, &rx_port) != ESP_OK)
+  {
+    return 0;
+  }
+
+  // a longer datagram is truncated, like lwIP does with a too small pbuf
+  rx_len = received;
+
+  return rx_len;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::available()
+{
+  return rx_len - rx_pos;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::read()
+{
+  return (rx_pos < rx_len) ? rx_buf[rx_pos++] : -1;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::read(unsigned char *buf, size_t len)
+{
+  len = min(len, rx_len - rx_pos);
+  memcpy(buf, rx_buf + rx_pos, len);
+  rx_pos += len;
+
+  return len;
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::read(char *buf, size_t len)
+{
+  return read((unsigned char *) buf, len);
+}
+
+////////////////////////////////////////
+
+int ESP32_W5500_HwUDP::peek()
+{
+  return (rx_pos < rx_len) ? rx_buf[rx_pos] : -1;
+}
+
+////////////////////////////////////////
+
+void ESP32_W5500_HwUDP::flush()
+{
+  rx_pos = rx_len;
+}
+
+////////////////////////////////////////
+
+IPAddress ESP32_W5500_HwUDP::remoteIP()
+{
+  return IPAddress(rx_ip);
+}
+
+////////////////////////////////////////
+
+uint16_t ESP32_W5500_HwUDP::remotePort()
+{
+  return rx_port;
+}
+
+////////////////////////////////////////
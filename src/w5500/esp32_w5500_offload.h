@@ -0,0 +1,138 @@
+/****************************************************************************************************************************
+  esp32_w5500_offload.h
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+ *****************************************************************************************************************************/
+
+#ifndef _ESP32_W5500_OFFLOAD_H_
+#define _ESP32_W5500_OFFLOAD_H_
+
+#include "esp32_w5500.h"
+
+#include "Client.h"
+#include "Server.h"
+#include "Udp.h"
+
+////////////////////////////////////////
+
+// Hybrid mode: set ESP32_W5500_Config::offloadSockets > 0 before begin(). These classes then run their connections
+// on the W5500's own TCP/IP engine (segmentation, ACKs, retransmissions), lwIP keeps everything else over MACRAW.
+// Data is moved by polling, there's no interrupt per hardware socket. A port served here can't be used through lwIP
+
+#define ESP32_W5500_HW_CONNECT_TIMEOUT_MS   3000
+#define ESP32_W5500_HW_WRITE_TIMEOUT_MS     3000
+#define ESP32_W5500_HW_UDP_MAX_PAYLOAD      1472
+
+////////////////////////////////////////
+
+// Copies refer to the same hardware socket, stop() on one of them closes it for all
+class ESP32_W5500_HwClient : public Client
+{
+  public:
+    ESP32_W5500_HwClient(ESP32_W5500& eth = ETH);
+    ESP32_W5500_HwClient(ESP32_W5500& eth, uint8_t sock);
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t *buf, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool();
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+    using Print::write;
+
+  private:
+    ESP32_W5500 *eth;
+    uint8_t sock;                     // 0 => none, socket 0 is MACRAW
+    int peeked;                       // byte read ahead by peek(), -1 => none
+};
+
+////////////////////////////////////////
+
+// Keeps one hardware socket listening, available() hands it over once a peer has connected and listens on a new one
+class ESP32_W5500_HwServer : public Server
+{
+  public:
+    ESP32_W5500_HwServer(uint16_t port = 80, ESP32_W5500& eth = ETH);
+    ~ESP32_W5500_HwServer();
+
+    void begin(uint16_t port = 0);
+    void end();
+    ESP32_W5500_HwClient available();
+
+    // not supported, write to the clients returned by available()
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *buf, size_t size);
+
+    using Print::write;
+
+  private:
+    ESP32_W5500 *eth;
+    uint16_t port;
+    uint8_t sock;                     // the listening one, 0 => none
+
+    bool listen();
+};
+
+////////////////////////////////////////
+
+class ESP32_W5500_HwUDP : public UDP
+{
+  public:
+    ESP32_W5500_HwUDP(ESP32_W5500& eth = ETH);
+    ~ESP32_W5500_HwUDP();
+
+    uint8_t begin(uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char *host, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *buf, size_t size);
+
+    int parsePacket();
+    int available();
+    int read();
+    int read(unsigned char *buf, size_t len);
+    int read(char *buf, size_t len);
+    int peek();
+    void flush();
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+    using Print::write;
+
+  private:
+    ESP32_W5500 *eth;
+    uint8_t sock;
+    uint8_t *tx_buf;
+    uint8_t *rx_buf;
+    size_t tx_len;
+    size_t rx_len;
+    size_t rx_pos;
+    uint32_t tx_ip;
+    uint16_t tx_port;
+    uint32_t rx_ip;
+    uint16_t rx_port;
+};
+
+////////////////////////////////////////
+
+#endif /* _ESP32_W5500_OFFLOAD_H_ */
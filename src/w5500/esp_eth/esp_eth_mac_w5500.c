@@ -34,6 +34,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <sys/cdefs.h>
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
@@ -44,12 +45,14 @@
 #include "esp_system.h"
 #include "esp_intr_alloc.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_rom_gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "hal/cpu_hal.h"
 #include "w5500.h"
+#include "esp_eth_w5500.h"
 #include "sdkconfig.h"
 
 ////////////////////////////////////////
@@ -57,8 +60,98 @@
 static const char *TAG = "w5500.mac";
 
 #define W5500_SPI_LOCK_TIMEOUT_MS (50)
-#define W5500_TX_MEM_SIZE (0x4000)
-#define W5500_RX_MEM_SIZE (0x4000)
+#define W5500_TX_TIMEOUT_MS (100)
+#define W5500_OFFLOAD_SEND_TIMEOUT_MS (3000) // beyond the chip's own ARP / retransmission timeout (RTR x RCR, ~1.8s)
+#define W5500_CMD_SPIN_US (100)
+#define W5500_CMD_YIELD_US (2000)
+#define W5500_IDLE_CHECK_MS (5000)
+#define W5500_STATS_WINDOW_SLOTS (8)
+#define W5500_STATS_SAMPLE_US (1000 * 1000)
+
+// Counters may be bumped by the w5500 task and a transmitting task at once, relaxed atomics keep them exact
+#define W5500_STAT_ADD(emac, counter, n) __atomic_fetch_add(&(emac)->stats.counter, (n), __ATOMIC_RELAXED)
+#define W5500_STAT_INC(emac, counter) W5500_STAT_ADD(emac, counter, 1)
+#define W5500_STAT_CLEAR(emac, counter) __atomic_store_n(&(emac)->stats.counter, 0, __ATOMIC_RELAXED)
+#define W5500_STAT_MAX(emac, counter, value) w5500_stat_max(&(emac)->stats.counter, (value))
+#define W5500_SOCK_STATUS_RETRIES (4)
+#define W5500_SPI_CHAIN_MAX (4)
+#define W5500_SPI_HEADER_SIZE (3) // 16 bit address + 8 bit control phase of every transaction
+#define W5500_MEM_SIZE (0x4000) // TX and RX buffer memory, each shared by all sockets
+#define W5500_HYBRID_SOCK0_MEM_SIZE (0x2000) // what the MACRAW socket keeps when hardware sockets are in use
+#define W5500_LOCAL_PORT_FIRST (0x8000) // ports picked for hardware sockets, below lwIP's ephemeral range
+#define W5500_LOCAL_PORT_LAST (0xBFFF)
+// SPI DMA bounces receive buffers whose address or length isn't word aligned through a temporary copy
+#define W5500_RX_ALIGN(len) (((len) + 3) & ~3U)
+#define W5500_RX_POOL_SLOT_SIZE W5500_RX_ALIGN(ETH_MAX_PACKET_SIZE)
+#define W5500_RX_BATCH_FRAMES_MAX (16)
+#define W5500_RX_PEEK_SIZE (2 + ETH_HEADER_LEN) // frame length header + Ethernet header, read before the payload
+
+////////////////////////////////////////
+
+// Socket TX_FSR .. RX_WR, contiguous registers fetched in one burst
+typedef struct
+{
+  uint16_t tx_fsr;
+  uint16_t tx_rd;
+  uint16_t tx_wr;
+  uint16_t rx_rsr;
+  uint16_t rx_rd;
+  uint16_t rx_wr;
+} w5500_sock_status_t;
+
+////////////////////////////////////////
+
+// SPI transactions issued back to back, e.g. frame payload + pointer update + command
+typedef struct
+{
+  spi_transaction_t trans[W5500_SPI_CHAIN_MAX];
+  uint32_t count;
+  uint32_t bytes;
+  uint32_t queued;                  // transactions handed to the SPI DMA and not collected yet
+} w5500_spi_chain_t;
+
+////////////////////////////////////////
+
+// Subscribed multicast address, refs counts the groups mapped onto it (IPv4 groups share MACs 32:1)
+typedef struct
+{
+  uint8_t addr[ETH_ADDR_LEN];
+  uint16_t refs;
+} w5500_mcast_entry_t;
+
+////////////////////////////////////////
+
+// Registered EtherType, type 0 => free slot. Changed and looked up under ethertype_lock only
+typedef struct
+{
+  uint16_t type;
+  eth_w5500_ethertype_cb_t cb;
+  void *arg;
+} w5500_ethertype_handler_t;
+
+////////////////////////////////////////
+
+// RX storm limiter state of one traffic class, only the w5500 task takes tokens
+typedef struct
+{
+  uint32_t rate;                    // frames per second, 0 => not limited
+  uint32_t burst;
+  uint32_t tokens;                  // in 1/1000 frames, up to burst * 1000
+  int64_t refill_us;
+  int64_t last_drop_us;
+} w5500_storm_bucket_t;
+
+////////////////////////////////////////
+
+// Traffic counters at one point in time, the rates are computed against the oldest sample of the window
+typedef struct
+{
+  int64_t time_us;
+  uint32_t rx_frames;
+  uint32_t tx_frames;
+  uint32_t rx_bytes;
+  uint32_t tx_bytes;
+} w5500_stats_sample_t;
 
 ////////////////////////////////////////
 
@@ -68,122 +161,2601 @@ typedef struct
   esp_eth_mediator_t *eth;
   spi_device_handle_t spi_hdl;
   SemaphoreHandle_t spi_lock;
+  TaskHandle_t spi_session_owner;   // task holding spi_lock and the SPI bus, NULL outside of a session
+  uint32_t spi_session_depth;
+  int64_t spi_session_start;
+  uint32_t spi_queue_threshold;     // chains moving at least this many bytes go through queued DMA transactions
   TaskHandle_t rx_task_hdl;
   uint32_t sw_reset_timeout_ms;
+  uint16_t sock_mem_size[8];        // TX and RX buffer memory of each socket, socket 0 is the MACRAW ring
+  uint32_t offload_sockets;         // hardware TCP / UDP sockets 1 .. offload_sockets
+  uint8_t sock_used;                // bit n set while hardware socket n is allocated, changed within an SPI session
+  uint8_t sock_sending;             // bit n set while a SEND of hardware socket n awaits SEND_OK
+  uint16_t next_local_port;
+  uint32_t init_reset_us;           // time the last init spent in the software reset / the default register setup
+  uint32_t init_setup_us;
   int int_gpio_num;
   uint8_t addr[6];
   bool packets_remain;
+  bool rx_polling;                  // interrupt masked, the RX task drains the ring in rounds of rx_poll_budget frames
+  uint32_t rx_poll_threshold;
+  uint32_t rx_poll_budget;
+  uint16_t int_level;
+  uint8_t *rx_pool;                 // rx_pool_depth receive buffers of W5500_RX_POOL_SLOT_SIZE bytes, one DMA block
+  uint32_t rx_pool_depth;
+  atomic_uint_least32_t rx_pool_free; // bit n set when rx_pool slot n is free
+  atomic_uint_least32_t rx_pool_refs; // 1 held by the driver + RX buffers out (pool or heap), the last one frees emac
+  uint8_t *rx_batch_buf;            // staging buffer for batched RX drain, NULL when batch mode is disabled
+  uint32_t rx_batch_size;
+  uint8_t *rx_batch_frames[W5500_RX_BATCH_FRAMES_MAX];
+  uint16_t rx_batch_lengths[W5500_RX_BATCH_FRAMES_MAX];
+  uint32_t rx_batch_raw;            // bit n set when rx_batch_frames[n] points into the staging buffer (raw frame)
+  bool rx_pipeline;                 // one queued chain per frame, payload + next header, see w5500_receive_pipelined
+  bool mcast_filter;                // drop multicast frames whose destination isn't in mcast_table
+  bool promiscuous;
+  portMUX_TYPE mcast_lock;          // protects mcast_*, changed from the tcpip thread and looked up by the w5500 task
+  uint64_t mcast_hash;              // bit w5500_mcast_hash(addr) set for every address in mcast_table
+  uint32_t mcast_overflow;          // subscriptions which didn't fit into mcast_table, all multicast passes while > 0
+  w5500_mcast_entry_t mcast_table[ETH_W5500_MCAST_FILTER_SIZE];
+  w5500_storm_bucket_t storm[ETH_W5500_RX_CLASS_MAX];
+  bool storm_limited;               // some class has a rate set
+  uint32_t storm_started;           // bit n set when class n started dropping, logged by the w5500 task when idle
+  portMUX_TYPE ethertype_lock;      // protects ethertype_handlers, the w5500 task copies an entry out before calling it
+  w5500_ethertype_handler_t ethertype_handlers[ETH_W5500_ETHERTYPE_HANDLERS_MAX];
+  volatile uint32_t ethertype_count;
+  volatile int64_t rx_irq_us;       // last RX interrupt, 0 => taken by the w5500 task
+  int64_t rx_event_us;              // interrupt (or poll round) the frames being drained belong to
+  SemaphoreHandle_t tx_lock;        // protects the TX queue, taken by the transmitting task and the w5500 task
+  SemaphoreHandle_t tx_space[ETH_W5500_TX_CLASS_MAX]; // given to each class with waiters when a queued frame completes
+  uint32_t tx_queue_depth;          // 0 => synchronous transmit, polling for SEND_OK
+  uint16_t tx_queue_end[ETH_W5500_TX_QUEUE_DEPTH_MAX]; // TX write pointer right after each queued frame
+  uint8_t tx_queue_class[ETH_W5500_TX_QUEUE_DEPTH_MAX];
+  int64_t tx_queue_since[ETH_W5500_TX_QUEUE_DEPTH_MAX]; // transmit call of each queued frame, for the class latency
+  uint32_t tx_waiting[ETH_W5500_TX_CLASS_MAX]; // transmitters waiting for room, changed with tx_lock held
+  uint16_t tx_bulk_bytes;           // ring space taken by queued bulk frames
+  uint16_t tx_bulk_limit;           // tx_bulk_share of the ring
+  eth_w5500_tx_classifier_t tx_classifier;
+  void *tx_classifier_arg;
+  uint32_t tx_queue_first;
+  uint32_t tx_queue_count;
+  uint16_t tx_head;                 // TX ring pointer where the next frame is written (TX_WR shadow)
+  uint16_t rx_rd;                   // RX_RD shadow, the driver is the only writer
+  uint16_t tx_tail;                 // TX ring pointer of the oldest frame not sent yet (chip's TX_RD)
+  bool tx_busy;                     // SEND issued for the oldest queued frame, waiting for SEND_OK
+  bool tx_send_ok;                  // SEND_OK cleared in Sn_IR but not processed yet (TX lock was busy)
+  TickType_t tx_busy_since;
+  eth_w5500_stats_t stats;
+  portMUX_TYPE stats_lock;          // protects stats_window, sampled by the w5500 task and read by get_stats
+  w5500_stats_sample_t stats_window[W5500_STATS_WINDOW_SLOTS];
+  uint32_t stats_window_head;       // slot of the next sample
+  uint32_t stats_window_count;
 } emac_w5500_t;
 
-////////////////////////////////////////
+////////////////////////////////////////
+
+// Raise a maximum, of two racing updates the larger one stays
+static inline void w5500_stat_max(uint32_t *max, uint32_t value)
+{
+  uint32_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+  while ((value > current) &&
+         !__atomic_compare_exchange_n(max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+////////////////////////////////////////
+
+static inline bool w5500_lock(emac_w5500_t *emac)
+{
+  return xSemaphoreTake(emac->spi_lock, pdMS_TO_TICKS(W5500_SPI_LOCK_TIMEOUT_MS)) == pdTRUE;
+}
+
+////////////////////////////////////////
+
+static inline bool w5500_unlock(emac_w5500_t *emac)
+{
+  return xSemaphoreGive(emac->spi_lock) == pdTRUE;
+}
+
+////////////////////////////////////////
+
+// Take the SPI lock and the SPI bus once for a whole register sequence (TX, RX drain, init) instead of per access.
+// Sessions nest, so accesses made by the owner inside a session don't lock again
+static esp_err_t w5500_session_begin(emac_w5500_t *emac)
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+  if (emac->spi_session_owner == self)
+  {
+    emac->spi_session_depth++;
+
+    return ESP_OK;
+  }
+
+  if (!w5500_lock(emac))
+  {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  if (spi_device_acquire_bus(emac->spi_hdl, portMAX_DELAY) != ESP_OK)
+  {
+    w5500_unlock(emac);
+
+    return ESP_FAIL;
+  }
+
+  emac->spi_session_owner = self;
+  emac->spi_session_depth = 1;
+  emac->spi_session_start = esp_timer_get_time();
+  W5500_STAT_INC(emac, spi_lock_acquisitions);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+static void w5500_session_end(emac_w5500_t *emac)
+{
+  if (--emac->spi_session_depth)
+  {
+    return;
+  }
+
+  uint32_t hold_us = (uint32_t)(esp_timer_get_time() - emac->spi_session_start);
+
+  W5500_STAT_ADD(emac, spi_lock_hold_total_us, hold_us);
+
+  if (hold_us > emac->stats.spi_lock_hold_max_us)
+  {
+    emac->stats.spi_lock_hold_max_us = hold_us;
+  }
+
+  emac->spi_session_owner = NULL;
+  spi_device_release_bus(emac->spi_hdl);
+  w5500_unlock(emac);
+}
+
+////////////////////////////////////////
+
+static inline bool w5500_tx_lock(emac_w5500_t *emac)
+{
+  return xSemaphoreTake(emac->tx_lock, pdMS_TO_TICKS(W5500_SPI_LOCK_TIMEOUT_MS)) == pdTRUE;
+}
+
+////////////////////////////////////////
+
+static inline bool w5500_tx_unlock(emac_w5500_t *emac)
+{
+  return xSemaphoreGive(emac->tx_lock) == pdTRUE;
+}
+
+////////////////////////////////////////
+
+static inline bool w5500_rx_pool_owns(emac_w5500_t *emac, const uint8_t *buffer)
+{
+  return emac->rx_pool && buffer >= emac->rx_pool &&
+         buffer < emac->rx_pool + emac->rx_pool_depth * W5500_RX_POOL_SLOT_SIZE;
+}
+
+////////////////////////////////////////
+
+// Lock-free: the RX task is the only taker, but buffers are given back from whichever task frees the pbuf
+static uint8_t *w5500_rx_pool_take(emac_w5500_t *emac)
+{
+  uint32_t free_mask = atomic_load_explicit(&emac->rx_pool_free, memory_order_acquire);
+
+  while (free_mask)
+  {
+    uint32_t slot = __builtin_ctz(free_mask);
+
+    if (atomic_compare_exchange_weak_explicit(&emac->rx_pool_free, &free_mask, free_mask & ~(1U << slot),
+                                              memory_order_acquire, memory_order_acquire))
+    {
+      return emac->rx_pool + slot * W5500_RX_POOL_SLOT_SIZE;
+    }
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////
+
+// Drop one reference, the last one (driver deleted, every RX buffer back) frees the pool and the instance
+static void w5500_rx_pool_unref(emac_w5500_t *emac)
+{
+  if (atomic_fetch_sub_explicit(&emac->rx_pool_refs, 1, memory_order_acq_rel) == 1)
+  {
+    heap_caps_free(emac->rx_pool);
+    free(emac);
+  }
+}
+
+////////////////////////////////////////
+
+static inline void w5500_rx_pool_give(emac_w5500_t *emac, uint8_t *buffer)
+{
+  uint32_t slot = (buffer - emac->rx_pool) / W5500_RX_POOL_SLOT_SIZE;
+
+  atomic_fetch_or_explicit(&emac->rx_pool_free, 1U << slot, memory_order_release);
+}
+
+////////////////////////////////////////
+
+// Buffers hold W5500_RX_ALIGN(length) bytes, so the payload can be read without a DMA bounce copy. Every buffer,
+// pool or heap, holds a reference: w5500_free_rx_buffer looks at emac, which must outlive the driver while lwIP
+// still has frames
+static uint8_t *w5500_alloc_rx_buffer(emac_w5500_t *emac, uint32_t length)
+{
+  uint8_t *buffer = w5500_rx_pool_take(emac);
+
+  if (buffer)
+  {
+    W5500_STAT_INC(emac, rx_pool_hits);
+  }
+  else
+  {
+    // pool ran dry (or is disabled), fall back to the heap, sized for this frame only
+    W5500_STAT_INC(emac, rx_pool_misses);
+    buffer = heap_caps_malloc(W5500_RX_ALIGN(length), MALLOC_CAP_DMA);
+  }
+
+  if (buffer)
+  {
+    atomic_fetch_add_explicit(&emac->rx_pool_refs, 1, memory_order_relaxed);
+  }
+
+  return buffer;
+}
+
+////////////////////////////////////////
+
+static void w5500_free_rx_buffer(emac_w5500_t *emac, void *buffer)
+{
+  if (w5500_rx_pool_owns(emac, buffer))
+  {
+    w5500_rx_pool_give(emac, buffer);
+  }
+  else
+  {
+    free(buffer);
+  }
+
+  w5500_rx_pool_unref(emac);
+}
+
+////////////////////////////////////////
+
+// Append one SPI transaction to a chain. Short writes are copied, other buffers must outlive the chain run
+static void w5500_chain_add(w5500_spi_chain_t *chain, uint32_t address, bool write, void *value, uint32_t len)
+{
+  spi_transaction_t *trans = &chain->trans[chain->count++];
+
+  memset(trans, 0, sizeof(spi_transaction_t));
+
+  trans->cmd = (address >> W5500_ADDR_OFFSET);
+  trans->addr = ((address & 0xFFFF) | ((write ? W5500_ACCESS_MODE_WRITE : W5500_ACCESS_MODE_READ) << W5500_RWB_OFFSET) |
+                 W5500_SPI_OP_MODE_VDM);
+  trans->length = 8 * len;
+  trans->user = value;
+
+  if (write && len <= 4)
+  {
+    trans->flags = SPI_TRANS_USE_TXDATA;
+    memcpy(trans->tx_data, value, len);
+  }
+  else if (write)
+  {
+    trans->tx_buffer = value;
+  }
+  else if (len <= 4)
+  {
+    // use direct reads for registers to prevent overwrites by 4-byte boundary writes
+    trans->flags = SPI_TRANS_USE_RXDATA;
+  }
+  else
+  {
+    trans->rx_buffer = value;
+  }
+
+  chain->bytes += len;
+}
+
+////////////////////////////////////////
+
+// Append a TX / RX buffer access of a socket, split in two at the end of its buffer memory
+static void w5500_chain_add_sock_buffer(w5500_spi_chain_t *chain, uint8_t sock, uint16_t mem_size, bool write,
+                                        void *buffer, uint32_t len, uint16_t offset)
+{
+  uint32_t remain = len;
+  uint8_t *buf = buffer;
+  offset %= mem_size;
+
+  if (offset + len > mem_size)
+  {
+    remain = (offset + len) % mem_size;
+    len = mem_size - offset;
+    w5500_chain_add(chain, write ? W5500_MEM_SOCK_TX(sock, offset) : W5500_MEM_SOCK_RX(sock, offset), write, buf, len);
+    offset = 0;
+    buf += len;
+  }
+
+  w5500_chain_add(chain, write ? W5500_MEM_SOCK_TX(sock, offset) : W5500_MEM_SOCK_RX(sock, offset), write, buf, remain);
+}
+
+////////////////////////////////////////
+
+// Append a TX / RX ring access of the MACRAW socket
+static void w5500_chain_add_buffer(emac_w5500_t *emac, w5500_spi_chain_t *chain, bool write, void *buffer,
+                                   uint32_t len, uint16_t offset)
+{
+  w5500_chain_add_sock_buffer(chain, 0, emac->sock_mem_size[0], write, buffer, len, offset);
+}
+
+////////////////////////////////////////
+
+// Start the transactions of a chain, within the caller's SPI session. Queued ones keep running on the SPI DMA
+// while the task carries on, until w5500_chain_finish() collects them; polled ones are done on return
+static esp_err_t w5500_chain_start(emac_w5500_t *emac, w5500_spi_chain_t *chain, bool queue)
+{
+  esp_err_t ret = ESP_OK;
+
+  chain->queued = 0;
+
+  if (queue)
+  {
+    for (; chain->queued < chain->count; chain->queued++)
+    {
+      if (spi_device_queue_trans(emac->spi_hdl, &chain->trans[chain->queued], portMAX_DELAY) != ESP_OK)
+      {
+        ESP_LOGE(TAG, "%s(%d): SPI queue transaction failed", __FUNCTION__, __LINE__);
+        ret = ESP_FAIL;
+        break;
+      }
+    }
+
+    W5500_STAT_ADD(emac, spi_queued_transactions, chain->queued);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < chain->count; i++)
+    {
+      if (spi_device_polling_transmit(emac->spi_hdl, &chain->trans[i]) != ESP_OK)
+      {
+        ESP_LOGE(TAG, "%s(%d): SPI transmit failed", __FUNCTION__, __LINE__);
+        ret = ESP_FAIL;
+        break;
+      }
+    }
+  }
+
+  W5500_STAT_ADD(emac, spi_transactions, chain->count);
+  W5500_STAT_ADD(emac, spi_bytes, chain->bytes + chain->count * W5500_SPI_HEADER_SIZE);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Wait for the queued transactions of a chain, then copy register values to output
+static esp_err_t w5500_chain_finish(emac_w5500_t *emac, w5500_spi_chain_t *chain)
+{
+  esp_err_t ret = ESP_OK;
+  spi_transaction_t *done = NULL;
+
+  // all queued transactions must be collected, even after a failure
+  for (; chain->queued; chain->queued--)
+  {
+    if (spi_device_get_trans_result(emac->spi_hdl, &done, portMAX_DELAY) != ESP_OK)
+    {
+      ESP_LOGE(TAG, "%s(%d): SPI transaction result failed", __FUNCTION__, __LINE__);
+      ret = ESP_FAIL;
+    }
+  }
+
+  for (uint32_t i = 0; i < chain->count; i++)
+  {
+    if (chain->trans[i].flags & SPI_TRANS_USE_RXDATA)
+    {
+      memcpy(chain->trans[i].user, chain->trans[i].rx_data, chain->trans[i].length / 8);
+    }
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Run all transactions of a chain in one SPI session. Long chains are queued to the SPI DMA back to back and the task
+// sleeps until they are done, short ones are cheaper to poll
+static esp_err_t w5500_chain_run(emac_w5500_t *emac, w5500_spi_chain_t *chain)
+{
+  esp_err_t ret = ESP_OK;
+
+  if (w5500_session_begin(emac) != ESP_OK)
+  {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  ret = w5500_chain_start(emac, chain, chain->bytes >= emac->spi_queue_threshold);
+
+  if (w5500_chain_finish(emac, chain) != ESP_OK)
+  {
+    ret = ESP_FAIL;
+  }
+
+  w5500_session_end(emac);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_write(emac_w5500_t *emac, uint32_t address, const void *value, uint32_t len)
+{
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+
+  w5500_chain_add(&chain, address, true, (void *)value, len);
+
+  return w5500_chain_run(emac, &chain);
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_read(emac_w5500_t *emac, uint32_t address, void *value, uint32_t len)
+{
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+
+  w5500_chain_add(&chain, address, false, value, len);
+
+  return w5500_chain_run(emac, &chain);
+}
+
+////////////////////////////////////////
+
+// Histogram bucket 0: < 8us, bucket n: 4 << n .. 8 << n us, the last one takes everything above
+static inline uint32_t w5500_hist_bucket(uint32_t latency_us, uint32_t buckets)
+{
+  uint32_t bucket = (latency_us < 8) ? 0 : (31 - __builtin_clz(latency_us) - 2);
+
+  return (bucket < buckets) ? bucket : (buckets - 1);
+}
+
+////////////////////////////////////////
+
+// Commands are issued by the w5500 task and by transmitting tasks, the histogram is updated like the counters
+static void w5500_cmd_latency_add(emac_w5500_t *emac, uint8_t command, uint32_t latency_us)
+{
+  eth_w5500_cmd_t cmd;
+
+  switch (command)
+  {
+    case W5500_SCR_OPEN:
+      cmd = ETH_W5500_CMD_OPEN;
+      break;
+
+    case W5500_SCR_CLOSE:
+      cmd = ETH_W5500_CMD_CLOSE;
+      break;
+
+    case W5500_SCR_SEND:
+      cmd = ETH_W5500_CMD_SEND;
+      break;
+
+    case W5500_SCR_RECV:
+      cmd = ETH_W5500_CMD_RECV;
+      break;
+
+    default:
+      return;
+  }
+
+  W5500_STAT_INC(emac, cmd_latency[cmd].count);
+  W5500_STAT_INC(emac, cmd_latency[cmd].buckets[w5500_hist_bucket(latency_us, ETH_W5500_CMD_HIST_BUCKETS)]);
+  W5500_STAT_MAX(emac, cmd_latency[cmd].max_us, latency_us);
+}
+
+////////////////////////////////////////
+
+// after W5500 accepts the command, the command register will be cleared automatically.
+// Commands normally complete within microseconds, so Sn_CR is busy-polled first, then polled between yields,
+// and only a command that is really stuck gets a tick of sleep between polls
+static esp_err_t w5500_wait_command(emac_w5500_t *emac, uint8_t sock, uint8_t command, uint32_t timeout_ms)
+{
+  esp_err_t ret = ESP_OK;
+  uint8_t cr = 0;
+  int64_t start = esp_timer_get_time();
+  int64_t elapsed = 0;
+
+  while (1)
+  {
+    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_CR(sock), &cr, sizeof(cr)), err, TAG, "Read SCR failed");
+    elapsed = esp_timer_get_time() - start;
+
+    if (!cr)
+    {
+      break;
+    }
+
+    ESP_GOTO_ON_FALSE(elapsed < (int64_t)timeout_ms * 1000, ESP_ERR_TIMEOUT, err, TAG, "Send command timeout");
+
+    if (elapsed >= W5500_CMD_YIELD_US)
+    {
+      vTaskDelay(1);
+    }
+    else if (elapsed >= W5500_CMD_SPIN_US)
+    {
+      taskYIELD();
+    }
+  }
+
+  // the histograms are about the MACRAW path
+  if (sock == 0)
+  {
+    w5500_cmd_latency_add(emac, command, (uint32_t)elapsed);
+  }
+
+err:
+
+  if (ret == ESP_ERR_TIMEOUT)
+  {
+    W5500_STAT_INC(emac, cmd_timeouts);
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_send_command(emac_w5500_t *emac, uint8_t sock, uint8_t command, uint32_t timeout_ms)
+{
+  esp_err_t ret = ESP_OK;
+
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_CR(sock), &command, sizeof(command)), err, TAG,
+                    "Write SCR failed");
+  ESP_GOTO_ON_ERROR(w5500_wait_command(emac, sock, command, timeout_ms), err, TAG, "Wait SCR failed");
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Fetch TX_FSR, TX_RD, TX_WR, RX_RSR, RX_RD and RX_WR of SOCK0 in a single SPI transaction.
+// The 16-bit registers may change between reading their high and low byte, so the snapshot is only accepted
+// when the free / received sizes agree with the pointers, or when two consecutive snapshots are identical
+static esp_err_t w5500_read_sock_status(emac_w5500_t *emac, uint8_t sock, w5500_sock_status_t *status)
+{
+  esp_err_t ret = ESP_OK;
+  uint16_t raw[2][6] __attribute__((aligned(4)));
+  uint32_t retry = 0;
+
+  for (retry = 0; retry < W5500_SOCK_STATUS_RETRIES; retry++)
+  {
+    uint16_t *cur = raw[retry & 1];
+
+    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_TX_FSR(sock), cur, sizeof(raw[0])), err, TAG,
+                      "Read socket status failed");
+
+    status->tx_fsr = __builtin_bswap16(cur[0]);
+    status->tx_rd  = __builtin_bswap16(cur[1]);
+    status->tx_wr  = __builtin_bswap16(cur[2]);
+    status->rx_rsr = __builtin_bswap16(cur[3]);
+    status->rx_rd  = __builtin_bswap16(cur[4]);
+    status->rx_wr  = __builtin_bswap16(cur[5]);
+
+    if ((status->tx_fsr == (uint16_t)(emac->sock_mem_size[sock] - (uint16_t)(status->tx_wr - status->tx_rd))) &&
+        (status->rx_rsr == (uint16_t)(status->rx_wr - status->rx_rd)))
+    {
+      break;
+    }
+
+    if (retry && !memcmp(raw[0], raw[1], sizeof(raw[0])))
+    {
+      break;
+    }
+
+    W5500_STAT_INC(emac, sock_status_retries);
+  }
+
+  ESP_GOTO_ON_FALSE(retry < W5500_SOCK_STATUS_RETRIES, ESP_ERR_INVALID_STATE, err, TAG, "Socket status unstable");
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Make room for the given number of transactions, running what's already chained if needed
+static esp_err_t w5500_chain_reserve(emac_w5500_t *emac, w5500_spi_chain_t *chain, uint32_t slots)
+{
+  esp_err_t ret = ESP_OK;
+
+  if (chain->count + slots > W5500_SPI_CHAIN_MAX)
+  {
+    ret = w5500_chain_run(emac, chain);
+    chain->count = 0;
+    chain->bytes = 0;
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Stream a frame given as segments (e.g. a pbuf chain) straight into the TX ring, no flattening copy.
+// Run within an SPI session, the chain is flushed whenever it fills up
+static esp_err_t w5500_chain_add_segments(emac_w5500_t *emac, w5500_spi_chain_t *chain,
+                                          const eth_w5500_tx_segment_t *segments, uint32_t count, uint16_t offset)
+{
+  esp_err_t ret = ESP_OK;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (segments[i].length == 0)
+    {
+      continue;
+    }
+
+    // a segment crossing the end of the ring takes two transactions
+    ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, chain, 2), err, TAG, "Write TX segments failed");
+    w5500_chain_add_buffer(emac, chain, true, (void *)segments[i].buffer, segments[i].length, offset);
+    offset += segments[i].length;
+  }
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_read_buffer(emac_w5500_t *emac, void *buffer, uint32_t len, uint16_t offset)
+{
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+
+  w5500_chain_add_buffer(emac, &chain, false, buffer, len, offset);
+
+  return w5500_chain_run(emac, &chain);
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_set_mac_addr(emac_w5500_t *emac)
+{
+  esp_err_t ret = ESP_OK;
+
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_MAC, emac->addr, 6), err, TAG, "Write MAC address register failed");
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+// RST clears itself within tens of microseconds, poll MR the way w5500_wait_command polls Sn_CR rather than
+// sleeping in 10ms steps
+static esp_err_t w5500_reset(emac_w5500_t *emac)
+{
+  esp_err_t ret = ESP_OK;
+  int64_t start = esp_timer_get_time();
+  int64_t elapsed = 0;
+
+  /* software reset */
+  uint8_t mr = W5500_MR_RST; // Set RST bit (auto clear)
+
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_MR, &mr, sizeof(mr)), err, TAG, "Write MR failed");
+
+  while (1)
+  {
+    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_MR, &mr, sizeof(mr)), err, TAG, "Read MR failed");
+    elapsed = esp_timer_get_time() - start;
+
+    if (!(mr & W5500_MR_RST))
+    {
+      break;
+    }
+
+    ESP_GOTO_ON_FALSE(elapsed < (int64_t)emac->sw_reset_timeout_ms * 1000, ESP_ERR_TIMEOUT, err, TAG,
+                      "Reset timeout");
+
+    if (elapsed >= W5500_CMD_YIELD_US)
+    {
+      vTaskDelay(1);
+    }
+    else if (elapsed >= W5500_CMD_SPIN_US)
+    {
+      taskYIELD();
+    }
+  }
+
+  emac->init_reset_us = (uint32_t)elapsed;
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_verify_id(emac_w5500_t *emac)
+{
+  esp_err_t ret = ESP_OK;
+  uint8_t version = 0;
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_VERSIONR, &version, sizeof(version)), err, TAG, "Read VERSIONR failed");
+
+  // W5500 doesn't have chip ID, we just print the version number instead
+  ESP_LOGI(TAG, "version=%x", version);
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+// All default registers in 13 short writes, chained W5500_SPI_CHAIN_MAX at a time: Sn_RXBUF_SIZE and Sn_TXBUF_SIZE
+// are adjacent, so each socket takes one 2-byte write. Short writes are copied into the transactions, the values
+// may live on the stack. Sockets without buffer memory (all but the MACRAW one, unless offloading) can't be opened
+static esp_err_t w5500_setup_default(emac_w5500_t *emac)
+{
+  esp_err_t ret = ESP_OK;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  int64_t start = esp_timer_get_time();
+  uint8_t reg_value = 0;
+
+  // Only SOCK0 can be used as MAC RAW mode, it gets the whole buffer (16KB TX and 16KB RX) without offloading
+  for (int i = 0; i < 8; i++)
+  {
+    uint8_t buf_size[2] = { emac->sock_mem_size[i] / 1024, emac->sock_mem_size[i] / 1024 };
+
+    ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 1), err, TAG, "Set socket buffer sizes failed");
+    w5500_chain_add(&chain, W5500_REG_SOCK_RXBUF_SIZE(i), true, buf_size, sizeof(buf_size));
+  }
+
+  /* Enable ping block, disable PPPoE, WOL */
+  reg_value = W5500_MR_PB;
+  ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 1), err, TAG, "Write MR failed");
+  w5500_chain_add(&chain, W5500_REG_MR, true, &reg_value, sizeof(reg_value));
+
+  /* Disable interrupt for all sockets by default */
+  reg_value = 0;
+  ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 1), err, TAG, "Write SIMR failed");
+  w5500_chain_add(&chain, W5500_REG_SIMR, true, &reg_value, sizeof(reg_value));
+
+  /* Enable MAC RAW mode for SOCK0, enable MAC filter, no blocking broadcast and multicast */
+  reg_value = W5500_SMR_MAC_RAW | W5500_SMR_MAC_FILTER;
+  ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 1), err, TAG, "Write SOCK0 MR failed");
+  w5500_chain_add(&chain, W5500_REG_SOCK_MR(0), true, &reg_value, sizeof(reg_value));
+
+  /* Enable receive event for SOCK0, and send done event when transmit completion is interrupt driven */
+  reg_value = W5500_SIR_RECV | (emac->tx_queue_depth ? W5500_SIR_SEND : 0);
+  ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 1), err, TAG, "Write SOCK0 IMR failed");
+  w5500_chain_add(&chain, W5500_REG_SOCK_IMR(0), true, &reg_value, sizeof(reg_value));
+
+  /* Set the interrupt re-assert level, the maximum (~1.7ms) lowers the chances of missing it */
+  uint16_t int_level = __builtin_bswap16(emac->int_level);
+  ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 1), err, TAG, "Write INTLEVEL failed");
+  w5500_chain_add(&chain, W5500_REG_INTLEVEL, true, &int_level, sizeof(int_level));
+
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "W5500 default setup failed");
+
+  emac->init_setup_us = (uint32_t)(esp_timer_get_time() - start);
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static inline bool is_w5500_sane_for_rxtx(emac_w5500_t *emac)
+{
+  uint8_t phycfg;
+
+  /* phy is ok for rx and tx operations if bits RST and LNK are set (no link down, no reset) */
+  if (w5500_read(emac, W5500_REG_PHYCFGR, &phycfg, 1) == ESP_OK && (phycfg & 0x8001))
+  {
+    return true;
+  }
+
+  return false;
+}
+
+////////////////////////////////////////
+
+// Drop all queued frames and restart the TX queue at the given TX ring pointer. Called with tx_lock held
+static void w5500_tx_queue_reset(emac_w5500_t *emac, uint16_t tx_wr)
+{
+  emac->tx_head = tx_wr;
+  emac->tx_tail = tx_wr;
+  emac->tx_queue_first = 0;
+  emac->tx_queue_count = 0;
+  emac->tx_bulk_bytes = 0;
+  emac->tx_busy = false;
+  emac->tx_send_ok = false;
+}
+
+////////////////////////////////////////
+
+// Account a frame of the given class sent, latency from the transmit call until SEND_OK
+static void w5500_tx_class_add(emac_w5500_t *emac, eth_w5500_tx_class_t tx_class, uint32_t length, int64_t since)
+{
+  uint32_t latency_us = (uint32_t)(esp_timer_get_time() - since);
+
+  W5500_STAT_INC(emac, tx_class[tx_class].frames);
+  W5500_STAT_ADD(emac, tx_class[tx_class].bytes, length);
+  W5500_STAT_ADD(emac, tx_class[tx_class].total_us, latency_us);
+  W5500_STAT_INC(emac, tx_class[tx_class].buckets[w5500_hist_bucket(latency_us, ETH_W5500_TX_HIST_BUCKETS)]);
+  W5500_STAT_MAX(emac, tx_class[tx_class].max_us, latency_us);
+}
+
+////////////////////////////////////////
+
+// Ring space was freed: every class with waiters checks again, those still behind a higher class go back to sleep.
+// Called with tx_lock held
+static void w5500_tx_wake(emac_w5500_t *emac)
+{
+  for (int i = 0; i < ETH_W5500_TX_CLASS_MAX; i++)
+  {
+    if (emac->tx_waiting[i])
+    {
+      xSemaphoreGive(emac->tx_space[i]);
+    }
+  }
+}
+
+////////////////////////////////////////
+
+// Commit the oldest queued frame to the chip and issue SEND, unless a SEND is already in flight.
+// Frames are written to the TX ring beyond TX_WR while the previous one is on the wire, because in MAC RAW mode
+// everything between TX_RD and TX_WR goes out as one frame. Called with tx_lock held
+static esp_err_t w5500_tx_kick(emac_w5500_t *emac)
+{
+  esp_err_t ret = ESP_OK;
+
+  if (emac->tx_busy || !emac->tx_queue_count)
+  {
+    return ESP_OK;
+  }
+
+  uint16_t offset = __builtin_bswap16(emac->tx_queue_end[emac->tx_queue_first]);
+  uint8_t command = W5500_SCR_SEND;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+
+  // update write pointer and issue SEND command, completion is signalled by the SEND_OK interrupt
+  w5500_chain_add(&chain, W5500_REG_SOCK_TX_WR(0), true, &offset, sizeof(offset));
+  w5500_chain_add(&chain, W5500_REG_SOCK_CR(0), true, &command, sizeof(command));
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "Write TX WR failed");
+  ESP_GOTO_ON_ERROR(w5500_wait_command(emac, 0, W5500_SCR_SEND, 100), err, TAG, "Issue SEND command failed");
+
+  emac->tx_busy = true;
+  emac->tx_busy_since = xTaskGetTickCount();
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+// The frame in flight is done (or given up on), release its ring space and start the next one. Called with tx_lock held
+static void w5500_tx_done(emac_w5500_t *emac)
+{
+  if (!emac->tx_busy)
+  {
+    return;
+  }
+
+  uint32_t first = emac->tx_queue_first;
+  uint16_t length = emac->tx_queue_end[first] - emac->tx_tail;
+
+  w5500_tx_class_add(emac, emac->tx_queue_class[first], length, emac->tx_queue_since[first]);
+
+  if (emac->tx_queue_class[first] == ETH_W5500_TX_BULK)
+  {
+    emac->tx_bulk_bytes -= length;
+  }
+
+  emac->tx_tail = emac->tx_queue_end[first];
+  emac->tx_queue_first = (first + 1) % ETH_W5500_TX_QUEUE_DEPTH_MAX;
+  emac->tx_queue_count--;
+  emac->tx_busy = false;
+
+  w5500_tx_wake(emac);
+  w5500_tx_kick(emac);
+}
+
+////////////////////////////////////////
+
+// Process a SEND_OK read (and cleared) from Sn_IR. It stays latched until the TX lock could be taken, w5500 task only
+static void w5500_tx_send_ok(emac_w5500_t *emac)
+{
+  if (!emac->tx_send_ok || !w5500_tx_lock(emac))
+  {
+    return;
+  }
+
+  emac->tx_send_ok = false;
+  w5500_tx_done(emac);
+  w5500_tx_unlock(emac);
+}
+
+////////////////////////////////////////
+
+// No SEND_OK for W5500_TX_TIMEOUT_MS. Unless TX_RD shows the frame went out, the chip still has it between TX_RD and
+// TX_WR, and the next SEND would send it together with the next frame as one. So the queue is dropped and SOCK0
+// reopened, which restarts both rings. Called with tx_lock held, w5500 task only
+static void w5500_tx_timeout(emac_w5500_t *emac)
+{
+  w5500_sock_status_t sock;
+  uint8_t status = 0;
+
+  if (w5500_read(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status)) == ESP_OK && (status & W5500_SIR_SEND))
+  {
+    // the interrupt was missed
+    status = W5500_SIR_SEND;
+    w5500_write(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status));
+    w5500_tx_done(emac);
+
+    return;
+  }
+
+  if (w5500_read_sock_status(emac, 0, &sock) == ESP_OK && sock.tx_rd == emac->tx_queue_end[emac->tx_queue_first])
+  {
+    // sent, SEND_OK lost
+    w5500_tx_done(emac);
+
+    return;
+  }
+
+  ESP_LOGW(TAG, "SEND timeout, %s, %u queued frames dropped", is_w5500_sane_for_rxtx(emac) ? "link ok" : "link down",
+           emac->tx_queue_count);
+  W5500_STAT_ADD(emac, tx_timeout_drops, emac->tx_queue_count);
+
+  if (w5500_send_command(emac, 0, W5500_SCR_CLOSE, 100) == ESP_OK &&
+      w5500_send_command(emac, 0, W5500_SCR_OPEN, 100) == ESP_OK &&
+      w5500_read_sock_status(emac, 0, &sock) == ESP_OK)
+  {
+    // frames in the RX ring went with it
+    emac->rx_rd = sock.rx_rd;
+    emac->packets_remain = false;
+    w5500_tx_queue_reset(emac, sock.tx_wr);
+  }
+  else
+  {
+    ESP_LOGE(TAG, "Reopen SOCK0 failed");
+    w5500_tx_queue_reset(emac, emac->tx_head);
+  }
+
+  w5500_tx_wake(emac);
+}
+
+////////////////////////////////////////
+
+// Catch a missed SEND_OK interrupt, or give up on a frame the chip never reported as sent
+static void w5500_tx_check_timeout(emac_w5500_t *emac)
+{
+  if (!emac->tx_queue_depth || !w5500_tx_lock(emac))
+  {
+    return;
+  }
+
+  if (emac->tx_send_ok)
+  {
+    // latched while the lock was busy, not a timeout
+    emac->tx_send_ok = false;
+    w5500_tx_done(emac);
+  }
+  else if (emac->tx_busy && (xTaskGetTickCount() - emac->tx_busy_since) >= pdMS_TO_TICKS(W5500_TX_TIMEOUT_MS))
+  {
+    w5500_tx_timeout(emac);
+  }
+
+  w5500_tx_unlock(emac);
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_start(esp_eth_mac_t *mac)
+{
+  esp_err_t ret = ESP_OK;
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  uint8_t reg_value = 0;
+  w5500_sock_status_t sock;
+  /* open SOCK0 */
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, 0, W5500_SCR_OPEN, 100), err, TAG, "Issue OPEN command failed");
+
+  /* sync the shadowed pointers and the TX queue with the freshly opened socket */
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, 0, &sock), err, TAG, "Read socket status failed");
+  emac->rx_rd = sock.rx_rd;
+
+  if (emac->tx_queue_depth)
+  {
+    ESP_GOTO_ON_FALSE(w5500_tx_lock(emac), ESP_ERR_TIMEOUT, err, TAG, "TX lock timeout");
+    w5500_tx_queue_reset(emac, sock.tx_wr);
+    w5500_tx_unlock(emac);
+  }
+  else
+  {
+    w5500_tx_queue_reset(emac, sock.tx_wr);
+  }
+
+  /* enable interrupt for SOCK0 */
+  reg_value = W5500_SIMR_SOCK0;
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SIMR, &reg_value, sizeof(reg_value)), err, TAG, "Write SIMR failed");
+
+err:
+  return ret;
+}
+
+static esp_err_t emac_w5500_stop(esp_eth_mac_t *mac)
+{
+  esp_err_t ret = ESP_OK;
+
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  uint8_t reg_value = 0;
+  /* disable interrupt */
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SIMR, &reg_value, sizeof(reg_value)), err, TAG, "Write SIMR failed");
+  /* close SOCK0 */
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, 0, W5500_SCR_CLOSE, 100), err, TAG, "Issue SCR_CLOSE command failed");
+
+  /* frames still queued can't be sent any more */
+  if (emac->tx_queue_depth && w5500_tx_lock(emac))
+  {
+    w5500_tx_queue_reset(emac, emac->tx_head);
+    w5500_tx_unlock(emac);
+  }
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+IRAM_ATTR static void w5500_isr_handler(void *arg)
+{
+  emac_w5500_t *emac = (emac_w5500_t *)arg;
+  BaseType_t high_task_wakeup = pdFALSE;
+
+  // frames are complete in the RX ring when INTn falls, the reference point of the raw RX latency
+  emac->rx_irq_us = esp_timer_get_time();
+
+  /* notify w5500 task */
+  vTaskNotifyGiveFromISR(emac->rx_task_hdl, &high_task_wakeup);
+
+  if (high_task_wakeup != pdFALSE)
+  {
+    portYIELD_FROM_ISR();
+  }
+}
+
+////////////////////////////////////////
+
+// Multicast MACs differ in their last bytes (01:00:5e:xx:xx:xx, 33:33:xx:xx:xx:xx), 6 bits of those pick the bin
+static inline uint32_t w5500_mcast_hash(const uint8_t *addr)
+{
+  return (addr[2] ^ addr[3] ^ addr[4] ^ addr[5]) & 63;
+}
+
+////////////////////////////////////////
+
+// Whether the RX paths read the Ethernet header together with the frame length, to filter before the payload
+static inline bool w5500_rx_peek_header(emac_w5500_t *emac)
+{
+  return (emac->mcast_filter && !emac->promiscuous) || emac->storm_limited;
+}
+
+////////////////////////////////////////
+
+// Whether a received frame goes to the stack, judged by its destination address (the first 6 frame bytes)
+static bool w5500_rx_accept(emac_w5500_t *emac, const uint8_t *dest)
+{
+  bool accept = false;
+
+  // unicast has passed the chip's own MAC filter already, broadcast carries ARP / DHCP
+  if (!(dest[0] & 0x01) || !emac->mcast_filter || emac->promiscuous ||
+      (dest[0] & dest[1] & dest[2] & dest[3] & dest[4] & dest[5]) == 0xFF)
+  {
+    return true;
+  }
+
+  portENTER_CRITICAL(&emac->mcast_lock);
+
+  if (emac->mcast_overflow)
+  {
+    accept = true;
+  }
+  else if (emac->mcast_hash & (1ULL << w5500_mcast_hash(dest)))
+  {
+    for (uint32_t i = 0; i < ETH_W5500_MCAST_FILTER_SIZE && !accept; i++)
+    {
+      accept = emac->mcast_table[i].refs && !memcmp(emac->mcast_table[i].addr, dest, ETH_ADDR_LEN);
+    }
+  }
+
+  portEXIT_CRITICAL(&emac->mcast_lock);
+
+  return accept;
+}
+
+////////////////////////////////////////
+
+static eth_w5500_rx_class_t w5500_rx_class(const uint8_t *eth_header)
+{
+  if (eth_header[12] == 0x08 && eth_header[13] == 0x06)
+  {
+    return ETH_W5500_RX_ARP;
+  }
+
+  if ((eth_header[0] & eth_header[1] & eth_header[2] & eth_header[3] & eth_header[4] & eth_header[5]) == 0xFF)
+  {
+    return ETH_W5500_RX_BROADCAST;
+  }
+
+  return (eth_header[0] & 0x01) ? ETH_W5500_RX_MULTICAST : ETH_W5500_RX_UNICAST;
+}
+
+////////////////////////////////////////
+
+// Token bucket of the frame's class, refilled at rate frames per second up to burst frames
+static bool w5500_storm_admit(emac_w5500_t *emac, const uint8_t *eth_header, uint32_t saved)
+{
+  eth_w5500_rx_class_t rx_class = w5500_rx_class(eth_header);
+  w5500_storm_bucket_t *bucket = &emac->storm[rx_class];
+
+  if (!bucket->rate)
+  {
+    return true;
+  }
+
+  int64_t now = esp_timer_get_time();
+  uint64_t refill = (uint64_t)(now - bucket->refill_us) * bucket->rate / 1000;
+  uint32_t full = bucket->burst * 1000;
+
+  bucket->tokens = (refill >= full - bucket->tokens) ? full : bucket->tokens + (uint32_t)refill;
+  bucket->refill_us = now;
+
+  if (bucket->tokens >= 1000)
+  {
+    bucket->tokens -= 1000;
+
+    return true;
+  }
+
+  if (now - bucket->last_drop_us >= ETH_W5500_STORM_HOLD_MS * 1000LL)
+  {
+    W5500_STAT_INC(emac, rx_storm_episodes);
+    emac->storm_started |= 1U << rx_class;
+  }
+
+  bucket->last_drop_us = now;
+  W5500_STAT_INC(emac, rx_storm_drops[rx_class]);
+  W5500_STAT_ADD(emac, rx_storm_spi_bytes_saved, saved);
+
+  return false;
+}
+
+////////////////////////////////////////
+
+// Checks run on the Ethernet header before the payload is read: multicast filter, then storm limiter.
+// saved: payload bytes a drop leaves unread in the ring
+static bool w5500_rx_admit(emac_w5500_t *emac, const uint8_t *eth_header, uint32_t saved)
+{
+  if (!w5500_rx_accept(emac, eth_header))
+  {
+    W5500_STAT_INC(emac, rx_mcast_drops);
+    W5500_STAT_ADD(emac, rx_mcast_spi_bytes_saved, saved);
+
+    return false;
+  }
+
+  return w5500_storm_admit(emac, eth_header, saved);
+}
+
+////////////////////////////////////////
+
+// Copy of the handler registered for the EtherType of a frame into *handler, false => the frame goes to the stack.
+// The copy is taken under ethertype_lock, so cb and arg always belong together even while they are being replaced
+static bool w5500_rx_raw_handler(emac_w5500_t *emac, const uint8_t *frame, uint32_t length,
+                                 w5500_ethertype_handler_t *handler)
+{
+  bool found = false;
+
+  if (!emac->ethertype_count || length < ETH_HEADER_LEN)
+  {
+    return false;
+  }
+
+  uint16_t type = (frame[12] << 8) | frame[13];
+
+  portENTER_CRITICAL(&emac->ethertype_lock);
+
+  for (int i = 0; i < ETH_W5500_ETHERTYPE_HANDLERS_MAX; i++)
+  {
+    if (emac->ethertype_handlers[i].type == type)
+    {
+      *handler = emac->ethertype_handlers[i];
+      found = true;
+      break;
+    }
+  }
+
+  portEXIT_CRITICAL(&emac->ethertype_lock);
+
+  return found;
+}
+
+////////////////////////////////////////
+
+// Pass a frame to the callback of its EtherType, if one is registered. The buffer stays the caller's
+static bool w5500_rx_raw(emac_w5500_t *emac, uint8_t *frame, uint32_t length)
+{
+  w5500_ethertype_handler_t handler;
+
+  if (!w5500_rx_raw_handler(emac, frame, length, &handler))
+  {
+    return false;
+  }
+
+  uint32_t latency = (uint32_t)(esp_timer_get_time() - emac->rx_event_us);
+
+  W5500_STAT_INC(emac, raw_rx_frames);
+  W5500_STAT_ADD(emac, raw_rx_bytes, length);
+  W5500_STAT_ADD(emac, raw_rx_latency_total_us, latency);
+
+  if (latency > emac->stats.raw_rx_latency_max_us)
+  {
+    emac->stats.raw_rx_latency_max_us = latency;
+  }
+
+  handler.cb(frame, length, handler.arg);
+
+  return true;
+}
+
+////////////////////////////////////////
+
+// Hand a received frame over: to its EtherType callback (the buffer is freed afterwards) or to the stack
+static void w5500_rx_deliver(emac_w5500_t *emac, uint8_t *buffer, uint32_t length)
+{
+  if (w5500_rx_raw(emac, buffer, length))
+  {
+    w5500_free_rx_buffer(emac, buffer);
+
+    return;
+  }
+
+  /* pass the buffer to stack (e.g. TCP/IP layer) */
+  W5500_STAT_INC(emac, rx_frames);
+  W5500_STAT_ADD(emac, rx_bytes, length);
+  emac->eth->stack_input(emac->eth, buffer, length);
+}
+
+////////////////////////////////////////
+
+// Receive one frame. The 2 byte length header is read first, so the payload goes straight into a buffer of the
+// right size: *buffer is allocated here when NULL, else it is the caller's, *length bytes big. A frame which doesn't
+// fit, or a header which makes no sense, is released from the ring with *length = 0
+static esp_err_t w5500_receive_frame(emac_w5500_t *emac, uint8_t **buffer, uint32_t *length)
+{
+  esp_err_t ret = ESP_OK;
+
+  w5500_sock_status_t sock;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  uint16_t offset = emac->rx_rd;
+  uint16_t rx_rd = 0;
+  uint8_t command = 0;
+  uint8_t header[W5500_RX_PEEK_SIZE] __attribute__((aligned(4)));
+  uint32_t header_len = w5500_rx_peek_header(emac) ? W5500_RX_PEEK_SIZE : 2;
+  uint16_t rx_len = 0;
+  uint16_t skip = 0;
+  uint32_t read_len = 0;
+  uint16_t remain_bytes = 0;
+  emac->packets_remain  = false;
+
+  ESP_RETURN_ON_ERROR(w5500_session_begin(emac), TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, 0, &sock), err, TAG, "Read socket status failed");
+  remain_bytes = sock.rx_rsr;
+
+  if (remain_bytes)
+  {
+    // read head first, with the Ethernet header when frames are filtered by destination
+    ESP_GOTO_ON_ERROR(w5500_read_buffer(emac, header, header_len, offset), err, TAG, "Read frame header failed");
+
+    rx_len = ((header[0] << 8) | header[1]) - 2; // data size includes 2 bytes of header
+    offset += 2;
+
+    if ((rx_len == 0) || (rx_len > ETH_MAX_PACKET_SIZE) || (rx_len + 2 > remain_bytes))
+    {
+      // ring is out of sync, nothing after this point can be trusted
+      ESP_LOGE(TAG, "Invalid frame size (%d), dropping %d bytes", rx_len, remain_bytes);
+      skip = (remain_bytes > 2) ? remain_bytes - 2 : 0;
+      rx_len = 0;
+    }
+    else if ((header_len > 2) && (rx_len >= ETH_HEADER_LEN) &&
+             !w5500_rx_admit(emac, header + 2, rx_len - ETH_HEADER_LEN))
+    {
+      // filtered or over its storm limit, the payload stays in the ring
+      skip = rx_len;
+      rx_len = 0;
+    }
+    else if (*buffer == NULL)
+    {
+      *buffer = w5500_alloc_rx_buffer(emac, rx_len);
+
+      // leave the frame in the ring, it is picked up again once memory frees up
+      ESP_GOTO_ON_FALSE(*buffer, ESP_ERR_NO_MEM, err_no_mem, TAG, "No mem for receive buffer");
+      read_len = W5500_RX_ALIGN(rx_len);
+    }
+    else if (rx_len > *length)
+    {
+      ESP_LOGE(TAG, "Frame size (%d) exceeds buffer size (%d), dropped", rx_len, *length);
+      skip = rx_len;
+      rx_len = 0;
+    }
+    else
+    {
+      read_len = (W5500_RX_ALIGN(rx_len) <= *length) ? W5500_RX_ALIGN(rx_len) : rx_len;
+    }
+
+    // read the payload, update read pointer and issue RECV command in one go
+    rx_rd = __builtin_bswap16((uint16_t)(offset + rx_len + skip));
+    command = W5500_SCR_RECV;
+
+    if (rx_len)
+    {
+      w5500_chain_add_buffer(emac, &chain, false, *buffer, read_len, offset);
+    }
+
+    w5500_chain_add(&chain, W5500_REG_SOCK_RX_RD(0), true, &rx_rd, sizeof(rx_rd));
+    w5500_chain_add(&chain, W5500_REG_SOCK_CR(0), true, &command, sizeof(command));
+    ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "Read payload failed, len=%d, offset=%d", rx_len,
+                      offset);
+
+    offset += rx_len + skip;
+    emac->rx_rd = offset;
+
+    ESP_GOTO_ON_ERROR(w5500_wait_command(emac, 0, W5500_SCR_RECV, 100), err, TAG, "Issue RECV command failed");
+
+    // check if there're more data need to process
+    remain_bytes -= rx_len + skip + 2;
+    emac->packets_remain = remain_bytes > 0;
+  }
+
+  *length = rx_len;
+
+err:
+  w5500_session_end(emac);
+
+  return ret;
+
+err_no_mem:
+  W5500_STAT_INC(emac, rx_drops_no_mem);
+  w5500_session_end(emac);
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Drain up to rx_batch_size bytes of the RX ring with a single buffer read, then split them into frames in memory.
+// RX_RD is advanced and RECV issued once per batch, frames cut off at the end of the staging buffer stay in the ring.
+static esp_err_t w5500_receive_batch(emac_w5500_t *emac, uint32_t *received)
+{
+  esp_err_t ret = ESP_OK;
+
+  w5500_sock_status_t sock;
+  uint16_t offset = emac->rx_rd;
+  uint16_t remain_bytes = 0;
+  uint32_t batch_len = 0;
+  uint32_t consumed = 0;
+  uint32_t frames = 0;
+  emac->packets_remain = false;
+  emac->rx_batch_raw = 0;
+
+  ESP_RETURN_ON_ERROR(w5500_session_begin(emac), TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, 0, &sock), err, TAG, "Read socket status failed");
+  remain_bytes = sock.rx_rsr;
+
+  if (!remain_bytes)
+  {
+    w5500_session_end(emac);
+
+    return ESP_OK;
+  }
+
+  batch_len = (remain_bytes < emac->rx_batch_size) ? remain_bytes : emac->rx_batch_size;
+  ESP_GOTO_ON_ERROR(w5500_read_buffer(emac, emac->rx_batch_buf, W5500_RX_ALIGN(batch_len), offset), err, TAG,
+                    "Read batch failed, len=%d, offset=%d", batch_len, offset);
+
+  while ((consumed + 2 <= batch_len) && (frames < W5500_RX_BATCH_FRAMES_MAX))
+  {
+    const uint8_t *frame = emac->rx_batch_buf + consumed;
+    uint16_t frame_size = (frame[0] << 8) | frame[1]; // size includes 2 bytes of header
+
+    if ((frame_size <= 2) || (frame_size - 2 > ETH_MAX_PACKET_SIZE))
+    {
+      // ring is out of sync, nothing after this point can be trusted
+      ESP_LOGE(TAG, "Invalid frame size (%d), dropping %d bytes", frame_size, remain_bytes - consumed);
+      consumed = remain_bytes;
+      break;
+    }
+
+    if (consumed + frame_size > batch_len)
+    {
+      // partially staged, pick it up in the next batch
+      break;
+    }
+
+    if ((frame_size - 2 >= ETH_HEADER_LEN) && !w5500_rx_admit(emac, frame + 2, 0))
+    {
+      // filtered or over its storm limit, already staged: only the allocation, copy and stack input are saved
+      consumed += frame_size;
+      continue;
+    }
+
+    w5500_ethertype_handler_t handler;
+
+    if (w5500_rx_raw_handler(emac, frame + 2, frame_size - 2, &handler))
+    {
+      // raw frames are handed over straight from the staging buffer, no allocation and no copy
+      emac->rx_batch_raw |= 1U << frames;
+      emac->rx_batch_frames[frames] = (uint8_t *)frame + 2;
+      emac->rx_batch_lengths[frames] = frame_size - 2;
+      frames++;
+      consumed += frame_size;
+      continue;
+    }
+
+    uint8_t *buffer = w5500_alloc_rx_buffer(emac, frame_size - 2);
+
+    if (!buffer)
+    {
+      ESP_LOGE(TAG, "No mem for receive buffer");
+      W5500_STAT_INC(emac, rx_drops_no_mem);
+      break;
+    }
+
+    // the one copy batching costs, fewer SPI transactions are bought with it
+    memcpy(buffer, frame + 2, frame_size - 2);
+    W5500_STAT_ADD(emac, rx_bytes_copied, frame_size - 2);
+    emac->rx_batch_frames[frames] = buffer;
+    emac->rx_batch_lengths[frames] = frame_size - 2;
+    frames++;
+
+    consumed += frame_size;
+  }
+
+  if (consumed)
+  {
+    // update read pointer
+    offset += consumed;
+    uint16_t rx_rd = __builtin_bswap16(offset);
+    uint8_t command = W5500_SCR_RECV;
+    w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+
+    /* update read pointer and issue RECV command */
+    w5500_chain_add(&chain, W5500_REG_SOCK_RX_RD(0), true, &rx_rd, sizeof(rx_rd));
+    w5500_chain_add(&chain, W5500_REG_SOCK_CR(0), true, &command, sizeof(command));
+    ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "Write RX RD failed");
+    emac->rx_rd = offset;
+
+    ESP_GOTO_ON_ERROR(w5500_wait_command(emac, 0, W5500_SCR_RECV, 100), err, TAG, "Issue RECV command failed");
+  }
+
+  emac->packets_remain = (consumed && remain_bytes > consumed);
+  W5500_STAT_INC(emac, rx_batches);
+
+err:
+  w5500_session_end(emac);
+
+  /* pass the buffers to stack (e.g. TCP/IP layer), or give them back if the ring could not be released.
+     The staging buffer is only refilled by the next batch, raw frames stay valid until then */
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    if (emac->rx_batch_raw & (1U << i))
+    {
+      if (ret == ESP_OK && !w5500_rx_raw(emac, emac->rx_batch_frames[i], emac->rx_batch_lengths[i]))
+      {
+        // unregistered in the meantime: the stack gets it after all, copied out of the staging buffer
+        uint8_t *buffer = w5500_alloc_rx_buffer(emac, emac->rx_batch_lengths[i]);
+
+        if (!buffer)
+        {
+          W5500_STAT_INC(emac, rx_drops_no_mem);
+          continue;
+        }
+
+        memcpy(buffer, emac->rx_batch_frames[i], emac->rx_batch_lengths[i]);
+        W5500_STAT_ADD(emac, rx_bytes_copied, emac->rx_batch_lengths[i]);
+        w5500_rx_deliver(emac, buffer, emac->rx_batch_lengths[i]);
+      }
+    }
+    else if (ret == ESP_OK)
+    {
+      w5500_rx_deliver(emac, emac->rx_batch_frames[i], emac->rx_batch_lengths[i]);
+    }
+    else
+    {
+      w5500_free_rx_buffer(emac, emac->rx_batch_frames[i]);
+    }
+  }
+
+  *received += (ret == ESP_OK) ? frames : 0;
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Pipelined RX: one queued DMA chain per frame reads its payload together with the length header of the following
+// frame, the task yields while it runs. The run walks the ring from one RSR snapshot, RX_RD is advanced and RECV issued
+// once at the end, then the frames go to the stack with the SPI session released (lwIP input and raw callbacks never
+// hold up TX or other devices on the bus). A run stops at W5500_RX_BATCH_FRAMES_MAX frames
+static esp_err_t w5500_receive_pipelined(emac_w5500_t *emac, uint32_t budget, uint32_t *received)
+{
+  esp_err_t ret = ESP_OK;
+
+  w5500_sock_status_t sock;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  uint16_t offset = emac->rx_rd;
+  uint16_t remain_bytes = 0;
+  uint8_t header[W5500_RX_PEEK_SIZE] __attribute__((aligned(4)));
+  uint32_t header_len = w5500_rx_peek_header(emac) ? W5500_RX_PEEK_SIZE : 2;
+  uint16_t rx_len = 0;
+  uint32_t consumed = 0;
+  uint32_t next = 0;
+  uint32_t frames = 0;
+  uint8_t *buffer = NULL;
+  bool more = false;
+  bool committed = false;
+  emac->packets_remain = false;
+
+  if (budget > W5500_RX_BATCH_FRAMES_MAX)
+  {
+    budget = W5500_RX_BATCH_FRAMES_MAX;
+  }
+
+  ESP_RETURN_ON_ERROR(w5500_session_begin(emac), TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, 0, &sock), err, TAG, "Read socket status failed");
+  remain_bytes = sock.rx_rsr;
+
+  if (remain_bytes < 2)
+  {
+    goto err;
+  }
+
+  ESP_GOTO_ON_ERROR(w5500_read_buffer(emac, header, header_len, offset), err, TAG, "Read frame header failed");
+
+  while (frames < budget)
+  {
+    rx_len = ((header[0] << 8) | header[1]) - 2; // data size includes 2 bytes of header
+
+    if ((rx_len == 0) || (rx_len > ETH_MAX_PACKET_SIZE) || (consumed + rx_len + 2 > remain_bytes))
+    {
+      // ring is out of sync, nothing after this point can be trusted
+      ESP_LOGE(TAG, "Invalid frame size (%d), dropping %d bytes", rx_len, remain_bytes - consumed);
+      consumed = remain_bytes;
+      break;
+    }
+
+    next = consumed + 2 + rx_len;
+
+    if ((header_len > 2) && (rx_len >= ETH_HEADER_LEN) &&
+        !w5500_rx_admit(emac, header + 2, rx_len - ETH_HEADER_LEN))
+    {
+      // filtered or over its storm limit, go straight on to the next header and leave the payload in the ring
+      consumed = next;
+
+      if (next + 2 > remain_bytes)
+      {
+        break;
+      }
+
+      ret = w5500_read_buffer(emac, header, header_len, offset + next);
+
+      if (ret != ESP_OK)
+      {
+        ESP_LOGE(TAG, "Read frame header failed");
+        break;
+      }
+
+      continue;
+    }
+
+    buffer = w5500_alloc_rx_buffer(emac, rx_len);
+
+    if (!buffer)
+    {
+      ESP_LOGE(TAG, "No mem for receive buffer");
+      W5500_STAT_INC(emac, rx_drops_no_mem);
+      break;
+    }
+
+    // payload of this frame and header of the next one, in one queued chain
+    more = (next + 2 <= remain_bytes) && (frames + 1 < budget);
+    chain.count = 0;
+    chain.bytes = 0;
+    w5500_chain_add_buffer(emac, &chain, false, buffer, W5500_RX_ALIGN(rx_len), offset + consumed + 2);
+
+    if (more)
+    {
+      w5500_chain_add_buffer(emac, &chain, false, header, header_len, offset + next);
+    }
+
+    ret = w5500_chain_start(emac, &chain, true);
+
+    if ((w5500_chain_finish(emac, &chain) != ESP_OK) || (ret != ESP_OK))
+    {
+      w5500_free_rx_buffer(emac, buffer);
+      ESP_LOGE(TAG, "Read payload failed, len=%d, offset=%d", rx_len, offset + consumed + 2);
+      ret = ESP_FAIL;
+      break;
+    }
+
+    emac->rx_batch_frames[frames] = buffer;
+    emac->rx_batch_lengths[frames] = rx_len;
+    consumed = next;
+    frames++;
+
+    if (!more)
+    {
+      break;
+    }
+  }
+
+  // frames read so far are committed even after a failed read, they must not come round again as duplicates
+  if (consumed)
+  {
+    // update read pointer
+    uint16_t rx_rd = __builtin_bswap16((uint16_t)(offset + consumed));
+    uint8_t command = W5500_SCR_RECV;
+
+    /* update read pointer and issue RECV command */
+    chain.count = 0;
+    chain.bytes = 0;
+    w5500_chain_add(&chain, W5500_REG_SOCK_RX_RD(0), true, &rx_rd, sizeof(rx_rd));
+    w5500_chain_add(&chain, W5500_REG_SOCK_CR(0), true, &command, sizeof(command));
+    ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "Write RX RD failed");
+    emac->rx_rd = offset + consumed;
+    committed = true;
+
+    ESP_GOTO_ON_ERROR(w5500_wait_command(emac, 0, W5500_SCR_RECV, 100), err, TAG, "Issue RECV command failed");
+  }
+
+  emac->packets_remain = (ret == ESP_OK) && consumed && (remain_bytes > consumed);
+
+err:
+  w5500_session_end(emac);
+
+  /* pass the frames to stack (e.g. TCP/IP layer) with the bus released. Without a new RX_RD they are still in the
+     ring and will be read again, so they are given back instead */
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    if (committed)
+    {
+      W5500_STAT_INC(emac, rx_pipelined_frames);
+      w5500_rx_deliver(emac, emac->rx_batch_frames[i], emac->rx_batch_lengths[i]);
+    }
+    else
+    {
+      w5500_free_rx_buffer(emac, emac->rx_batch_frames[i]);
+    }
+  }
+
+  *received += committed ? frames : 0;
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+// Remember the traffic counters once per W5500_STATS_SAMPLE_US, the oldest sample kept is the start of the rate window
+static void w5500_stats_sample(emac_w5500_t *emac, int64_t now)
+{
+  uint32_t last = (emac->stats_window_head + W5500_STATS_WINDOW_SLOTS - 1) % W5500_STATS_WINDOW_SLOTS;
+
+  if (emac->stats_window_count && now - emac->stats_window[last].time_us < W5500_STATS_SAMPLE_US)
+  {
+    return;
+  }
+
+  portENTER_CRITICAL(&emac->stats_lock);
+
+  w5500_stats_sample_t *sample = &emac->stats_window[emac->stats_window_head];
+
+  sample->time_us = now;
+  sample->rx_frames = emac->stats.rx_frames;
+  sample->tx_frames = emac->stats.tx_frames;
+  sample->rx_bytes = emac->stats.rx_bytes;
+  sample->tx_bytes = emac->stats.tx_bytes;
+
+  emac->stats_window_head = (emac->stats_window_head + 1) % W5500_STATS_WINDOW_SLOTS;
+
+  if (emac->stats_window_count < W5500_STATS_WINDOW_SLOTS)
+  {
+    emac->stats_window_count++;
+  }
+
+  portEXIT_CRITICAL(&emac->stats_lock);
+}
+
+////////////////////////////////////////
+
+// Receive up to budget frames, returns the number of frames passed to the stack.
+// packets_remain tells whether the ring still holds frames afterwards
+static uint32_t w5500_rx_drain(emac_w5500_t *emac, uint32_t budget)
+{
+  uint32_t received = 0;
+  uint8_t *buffer = NULL;
+  uint32_t length = 0;
+
+  if (emac->rx_pipeline)
+  {
+    while (w5500_receive_pipelined(emac, budget - received, &received) == ESP_OK && emac->packets_remain &&
+           received < budget);
+
+    return received;
+  }
+
+  if (emac->rx_batch_buf)
+  {
+    while (w5500_receive_batch(emac, &received) == ESP_OK && emac->packets_remain && received < budget);
+
+    return received;
+  }
+
+  do
+  {
+    buffer = NULL;
+    length = 0;
+
+    if (w5500_receive_frame(emac, &buffer, &length) == ESP_OK && length)
+    {
+      received++;
+      w5500_rx_deliver(emac, buffer, length);
+    }
+    else if (buffer)
+    {
+      w5500_free_rx_buffer(emac, buffer);
+    }
+  } while (emac->packets_remain && received < budget);
+
+  return received;
+}
+
+////////////////////////////////////////
+
+// Traffic is heavy enough that polling beats one wakeup per interrupt: mask the GPIO interrupt and keep draining
+static void w5500_rx_poll_enter(emac_w5500_t *emac)
+{
+  gpio_intr_disable(emac->int_gpio_num);
+  emac->rx_polling = true;
+  W5500_STAT_INC(emac, rx_poll_entries);
+}
+
+////////////////////////////////////////
+
+// Ring is empty, go back to sleeping until the next interrupt
+static void w5500_rx_poll_exit(emac_w5500_t *emac)
+{
+  emac->rx_polling = false;
+  gpio_intr_enable(emac->int_gpio_num);
+
+  /* INTn asserted while the interrupt was masked doesn't give another falling edge */
+  if (gpio_get_level(emac->int_gpio_num) == 0)
+  {
+    xTaskNotifyGive(emac->rx_task_hdl);
+  }
+}
+
+////////////////////////////////////////
+
+// Log the RX storms which started during the last drain, outside the SPI session they were found in
+static void w5500_storm_report(emac_w5500_t *emac)
+{
+  while (emac->storm_started)
+  {
+    int rx_class = __builtin_ctz(emac->storm_started);
+
+    emac->storm_started &= ~(1U << rx_class);
+    ESP_LOGW(TAG, "RX storm, limiting traffic class %d to %u frames/s", rx_class, emac->storm[rx_class].rate);
+  }
+}
+
+////////////////////////////////////////
+
+static void emac_w5500_task(void *arg)
+{
+  emac_w5500_t *emac = (emac_w5500_t *)arg;
+  uint8_t status = 0;
+  uint32_t frames = 0;
+  uint8_t handled = W5500_SIR_RECV | (emac->tx_queue_depth ? W5500_SIR_SEND : 0);
+
+  while (1)
+  {
+    w5500_stats_sample(emac, esp_timer_get_time());
+    w5500_storm_report(emac);
+
+    if (!emac->rx_polling)
+    {
+      // check if the task receives any notification, wake up earlier while a SEND is in flight or SEND_OK is latched
+      TickType_t wait = emac->tx_send_ok ? 1 : pdMS_TO_TICKS(emac->tx_busy ? W5500_TX_TIMEOUT_MS : W5500_IDLE_CHECK_MS);
+
+      if (ulTaskNotifyTake(pdTRUE, wait) == 0 &&
+          gpio_get_level(emac->int_gpio_num) != 0)                 // if no notification and no interrupt asserted
+      {
+        w5500_tx_send_ok(emac);
+        w5500_tx_check_timeout(emac);
+        continue;                                                // -> just continue to check again
+      }
+
+      W5500_STAT_INC(emac, rx_wakeups);
+    }
+    else
+    {
+      W5500_STAT_INC(emac, rx_poll_rounds);
+
+      // no idle wakeups while polling, a lost SEND_OK has to be caught here
+      w5500_tx_check_timeout(emac);
+    }
+
+    status = 0;
+
+    if (w5500_session_begin(emac) != ESP_OK)
+    {
+      continue;
+    }
+
+    /* read interrupt status */
+    w5500_read(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status));
+
+    status &= handled;
+
+    if (status)
+    {
+      // clear interrupt status
+      w5500_write(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status));
+    }
+
+    w5500_session_end(emac);
+
+    /* frame sent, start the next queued one. Sn_IR is cleared already, so a SEND_OK which can't be processed right
+       now is latched and retried on the next loop */
+    if (status & W5500_SIR_SEND)
+    {
+      emac->tx_send_ok = true;
+    }
+
+    w5500_tx_send_ok(emac);
+
+    /* packet received, or polling anyway */
+    if (!(status & W5500_SIR_RECV) && !emac->rx_polling)
+    {
+      continue;
+    }
+
+    // polled rounds have no interrupt to refer to, their frames may have waited up to a round already
+    emac->rx_event_us = (!emac->rx_polling && emac->rx_irq_us) ? emac->rx_irq_us : esp_timer_get_time();
+    emac->rx_irq_us = 0;
+
+    frames = w5500_rx_drain(emac, emac->rx_polling ? emac->rx_poll_budget : UINT32_MAX);
+
+    if (emac->rx_polling)
+    {
+      if (emac->packets_remain)
+      {
+        // budget used up, sleep a tick: taskYIELD() would only let equal or higher priority tasks run, starving
+        // IDLE (task watchdog) and everything below the w5500 task under sustained load
+        vTaskDelay(1);
+      }
+      else
+      {
+        w5500_rx_poll_exit(emac);
+      }
+    }
+    else if (emac->rx_poll_threshold && frames >= emac->rx_poll_threshold)
+    {
+      w5500_rx_poll_enter(emac);
+    }
+    else if (gpio_get_level(emac->int_gpio_num) == 0)
+    {
+      /* new events came in while draining and INTn stayed asserted, no falling edge to wake us up */
+      xTaskNotifyGive(emac->rx_task_hdl);
+    }
+  }
+
+  vTaskDelete(NULL);
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_mediator(esp_eth_mac_t *mac, esp_eth_mediator_t *eth)
+{
+  esp_err_t ret = ESP_OK;
+  ESP_GOTO_ON_FALSE(eth, ESP_ERR_INVALID_ARG, err, TAG, "Can't set mac's mediator to null");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  emac->eth = eth;
+  return ESP_OK;
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_write_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t reg_value)
+{
+  esp_err_t ret = ESP_OK;
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  // PHY register and MAC registers are mixed together in W5500
+  // The only PHY register is PHYCFGR
+  ESP_GOTO_ON_FALSE(phy_reg == W5500_REG_PHYCFGR, ESP_FAIL, err, TAG, "Wrong PHY register");
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_PHYCFGR, &reg_value, sizeof(uint8_t)), err, TAG,
+                    "write PHY register failed");
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_read_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t *reg_value)
+{
+  esp_err_t ret = ESP_OK;
+  ESP_GOTO_ON_FALSE(reg_value, ESP_ERR_INVALID_ARG, err, TAG, "Can't set reg_value to null");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  // PHY register and MAC registers are mixed together in W5500
+  // The only PHY register is PHYCFGR
+  ESP_GOTO_ON_FALSE(phy_reg == W5500_REG_PHYCFGR, ESP_FAIL, err, TAG, "Wrong PHY register");
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_PHYCFGR, reg_value, sizeof(uint8_t)), err, TAG,
+                    "read PHY register failed");
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_addr(esp_eth_mac_t *mac, uint8_t *addr)
+{
+  esp_err_t ret = ESP_OK;
+
+  ESP_GOTO_ON_FALSE(addr, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  memcpy(emac->addr, addr, 6);
+  ESP_GOTO_ON_ERROR(w5500_set_mac_addr(emac), err, TAG, "Set mac address failed");
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_get_addr(esp_eth_mac_t *mac, uint8_t *addr)
+{
+  esp_err_t ret = ESP_OK;
+
+  ESP_GOTO_ON_FALSE(addr, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  memcpy(addr, emac->addr, 6);
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_link(esp_eth_mac_t *mac, eth_link_t link)
+{
+  esp_err_t ret = ESP_OK;
+
+  switch (link)
+  {
+    case ETH_LINK_UP:
+      ESP_LOGD(TAG, "Link is up");
+      ESP_GOTO_ON_ERROR(mac->start(mac), err, TAG, "W5500 start failed");
+      break;
+
+    case ETH_LINK_DOWN:
+      ESP_LOGD(TAG, "link is down");
+      ESP_GOTO_ON_ERROR(mac->stop(mac), err, TAG, "W5500 stop failed");
+      break;
+
+    default:
+      ESP_GOTO_ON_FALSE(false, ESP_ERR_INVALID_ARG, err, TAG, "Unknown link status");
+      break;
+  }
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_speed(esp_eth_mac_t *mac, eth_speed_t speed)
+{
+  esp_err_t ret = ESP_OK;
+
+  switch (speed)
+  {
+    case ETH_SPEED_10M:
+      ESP_LOGD(TAG, "Setting to 10Mbps");
+      break;
+
+    case ETH_SPEED_100M:
+      ESP_LOGD(TAG, "Setting to 100Mbps");
+      break;
+
+    default:
+      ESP_GOTO_ON_FALSE(false, ESP_ERR_INVALID_ARG, err, TAG, "Unknown speed");
+      break;
+  }
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_duplex(esp_eth_mac_t *mac, eth_duplex_t duplex)
+{
+  esp_err_t ret = ESP_OK;
+
+  switch (duplex)
+  {
+    case ETH_DUPLEX_HALF:
+      ESP_LOGD(TAG, "Setting to HALF_DUPLEX");
+      break;
+
+    case ETH_DUPLEX_FULL:
+      ESP_LOGD(TAG, "Setting to FULL_DUPLEX");
+      break;
+
+    default:
+      ESP_GOTO_ON_FALSE(false, ESP_ERR_INVALID_ARG, err, TAG, "Unknown duplex");
+      break;
+  }
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_promiscuous(esp_eth_mac_t *mac, bool enable)
+{
+  esp_err_t ret = ESP_OK;
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  uint8_t smr = 0;
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_MR(0), &smr, sizeof(smr)), err, TAG, "Read SOCK0 MR failed");
+
+  if (enable)
+  {
+    smr &= ~W5500_SMR_MAC_FILTER;
+  }
+  else
+  {
+    smr |= W5500_SMR_MAC_FILTER;
+  }
+
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_MR(0), &smr, sizeof(smr)), err, TAG, "Write SOCK0 MR failed");
+
+  // every frame is wanted then, multicast of groups not subscribed included
+  emac->promiscuous = enable;
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_enable_flow_ctrl(esp_eth_mac_t *mac, bool enable)
+{
+  /* w5500 doesn't support flow control function, so accept any value */
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_set_peer_pause_ability(esp_eth_mac_t *mac, uint32_t ability)
+{
+  /* w5500 doesn't support PAUSE function, so accept any value */
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+////////////////////////////////////////
+
+// TX class of a frame: the classifier hook first, then VLAN PCP, DSCP, ARP. Only the first segment is looked at
+static eth_w5500_tx_class_t w5500_tx_class(emac_w5500_t *emac, const eth_w5500_tx_segment_t *segment)
+{
+  const uint8_t *frame = segment->buffer;
+  uint32_t length = segment->length;
+  eth_w5500_tx_classifier_t classifier = emac->tx_classifier;
+
+  if (classifier)
+  {
+    eth_w5500_tx_class_t tx_class = classifier(frame, length, emac->tx_classifier_arg);
+
+    if (tx_class < ETH_W5500_TX_CLASS_MAX)
+    {
+      return tx_class;
+    }
+  }
+
+  if (length < ETH_HEADER_LEN + 2)
+  {
+    return ETH_W5500_TX_NORMAL;
+  }
+
+  uint16_t type = (frame[12] << 8) | frame[13];
+  uint8_t dscp = 0;
+
+  switch (type)
+  {
+    case 0x8100:      // VLAN tag
+      {
+        uint8_t pcp = frame[14] >> 5;
+
+        return (pcp >= 5) ? ETH_W5500_TX_STRICT : ((pcp == 1) ? ETH_W5500_TX_BULK : ETH_W5500_TX_NORMAL);
+      }
+
+    case 0x0806:      // ARP
+      return ETH_W5500_TX_STRICT;
+
+    case 0x0800:      // IPv4, TOS
+      dscp = frame[15] >> 2;
+      break;
+
+    case 0x86DD:      // IPv6, traffic class
+      dscp = ((frame[14] & 0x0F) << 2) | (frame[15] >> 6);
+      break;
+
+    default:
+      return ETH_W5500_TX_NORMAL;
+  }
+
+  // CS1 and LE (lower effort) are background traffic
+  if (dscp == 8 || dscp == 1)
+  {
+    return ETH_W5500_TX_BULK;
+  }
+
+  return (dscp >= 40) ? ETH_W5500_TX_STRICT : ETH_W5500_TX_NORMAL;
+}
+
+////////////////////////////////////////
+
+// May a frame of this class enter the TX ring now. Called with tx_lock held
+static bool w5500_tx_admit(emac_w5500_t *emac, eth_w5500_tx_class_t tx_class, uint32_t length)
+{
+  uint16_t free_size = emac->sock_mem_size[0] - (uint16_t)(emac->tx_head - emac->tx_tail);
+
+  if (emac->tx_queue_count >= emac->tx_queue_depth || length > free_size)
+  {
+    return false;
+  }
+
+  // strict priority among the waiters
+  for (int i = 0; i < (int)tx_class; i++)
+  {
+    if (emac->tx_waiting[i])
+    {
+      return false;
+    }
+  }
+
+  // room for a strict frame to skip the line at any time
+  if (tx_class != ETH_W5500_TX_STRICT && emac->tx_queue_depth > 2 &&
+      (emac->tx_queue_count + 1 >= emac->tx_queue_depth || length + ETH_MAX_PACKET_SIZE > free_size))
+  {
+    return false;
+  }
+
+  // an empty share always takes one frame, whatever its size
+  return (tx_class != ETH_W5500_TX_BULK) || !emac->tx_bulk_bytes ||
+         (emac->tx_bulk_bytes + length <= emac->tx_bulk_limit);
+}
+
+////////////////////////////////////////
+
+// Copy the frame into the TX ring and return, the w5500 task sends it once the frames ahead of it are done
+static esp_err_t w5500_transmit_queued(emac_w5500_t *emac, const eth_w5500_tx_segment_t *segments, uint32_t count,
+                                       uint32_t length, eth_w5500_tx_class_t tx_class, int64_t since)
+{
+  esp_err_t ret = ESP_OK;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  bool waiting = false;
+
+  // wait for a queue slot and ring space this class may take, SEND_OK of the frames ahead releases them
+  while (1)
+  {
+    ESP_GOTO_ON_FALSE(w5500_tx_lock(emac), ESP_ERR_TIMEOUT, out, TAG, "TX lock timeout");
+
+    if (w5500_tx_admit(emac, tx_class, length))
+    {
+      break;
+    }
+
+    // called back from the w5500 task (raw EtherType callback): it is the one giving tx_space, so it can't wait
+    if (xTaskGetCurrentTaskHandle() == emac->rx_task_hdl)
+    {
+      w5500_tx_unlock(emac);
+      ret = ESP_ERR_NO_MEM;
+      goto out;
+    }
+
+    // counted with tx_lock held, so no completion in between misses this waiter
+    if (!waiting)
+    {
+      emac->tx_waiting[tx_class]++;
+      waiting = true;
+    }
+
+    w5500_tx_unlock(emac);
+
+    ESP_GOTO_ON_FALSE(xSemaphoreTake(emac->tx_space[tx_class], pdMS_TO_TICKS(W5500_TX_TIMEOUT_MS)) == pdTRUE,
+                      ESP_ERR_NO_MEM, out, TAG, "No TX space for send length (%d)", length);
+  }
+
+  if (waiting)
+  {
+    emac->tx_waiting[tx_class]--;
+    waiting = false;
+  }
+
+  // copy data to tx memory, behind the frames still waiting to be sent
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_chain_add_segments(emac, &chain, segments, count, emac->tx_head), err_session, TAG,
+                    "Write frame failed");
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Write frame failed");
+
+  uint32_t slot = (emac->tx_queue_first + emac->tx_queue_count) % ETH_W5500_TX_QUEUE_DEPTH_MAX;
+
+  emac->tx_head += length;
+  emac->tx_queue_end[slot] = emac->tx_head;
+  emac->tx_queue_class[slot] = tx_class;
+  emac->tx_queue_since[slot] = since;
+  emac->tx_queue_count++;
+
+  if (tx_class == ETH_W5500_TX_BULK)
+  {
+    emac->tx_bulk_bytes += length;
+  }
+
+  W5500_STAT_INC(emac, tx_frames);
+  W5500_STAT_ADD(emac, tx_bytes, length);
+
+  // start it right away if the wire is idle, a failure leaves it queued for the next kick
+  w5500_tx_kick(emac);
+
+err_session:
+  w5500_session_end(emac);
+err:
+  w5500_tx_unlock(emac);
+out:
+
+  if (waiting && w5500_tx_lock(emac))
+  {
+    emac->tx_waiting[tx_class]--;
+    w5500_tx_unlock(emac);
+  }
+
+  if (ret == ESP_ERR_NO_MEM)
+  {
+    W5500_STAT_INC(emac, tx_drops_no_mem);
+    W5500_STAT_INC(emac, tx_class[tx_class].drops);
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_transmit_segments(emac_w5500_t *emac, const eth_w5500_tx_segment_t *segments, uint32_t count)
+{
+  esp_err_t ret = ESP_OK;
+
+  w5500_sock_status_t sock;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  uint32_t length = 0;
+  uint16_t offset = 0;
+  uint8_t command = 0;
+  int64_t since = esp_timer_get_time();
+  eth_w5500_tx_class_t tx_class = w5500_tx_class(emac, &segments[0]);
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    length += segments[i].length;
+  }
+
+  if (emac->tx_queue_depth)
+  {
+    return w5500_transmit_queued(emac, segments, count, length, tx_class, since);
+  }
+
+  ESP_RETURN_ON_ERROR(w5500_session_begin(emac), TAG, "SPI lock timeout");
+
+  // check if there're free memory to store this packet
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, 0, &sock), err, TAG, "Read socket status failed");
+  ESP_GOTO_ON_FALSE(length <= sock.tx_fsr, ESP_ERR_NO_MEM, err, TAG, "Free size (%d) < send length (%d)", sock.tx_fsr,
+                    length);
+
+  // copy data to tx memory at the shadowed write pointer, update write pointer and issue SEND command in one go
+  offset = __builtin_bswap16((uint16_t)(emac->tx_head + length));
+  command = W5500_SCR_SEND;
+
+  ESP_GOTO_ON_ERROR(w5500_chain_add_segments(emac, &chain, segments, count, emac->tx_head), err, TAG,
+                    "Write frame failed");
+  ESP_GOTO_ON_ERROR(w5500_chain_reserve(emac, &chain, 2), err, TAG, "Write frame failed");
+  w5500_chain_add(&chain, W5500_REG_SOCK_TX_WR(0), true, &offset, sizeof(offset));
+  w5500_chain_add(&chain, W5500_REG_SOCK_CR(0), true, &command, sizeof(command));
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "Write frame failed");
+
+  emac->tx_head += length;
+  emac->tx_tail = emac->tx_head;
+  W5500_STAT_INC(emac, tx_frames);
+  W5500_STAT_ADD(emac, tx_bytes, length);
+
+  ESP_GOTO_ON_ERROR(w5500_wait_command(emac, 0, W5500_SCR_SEND, 100), err, TAG, "Issue SEND command failed");
+
+  // pooling the TX done event
+  int retry = 0;
+  uint8_t status = 0;
+
+  while (!(status & W5500_SIR_SEND))
+  {
+    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status)), err, TAG, "Read SOCK0 IR failed");
+
+    if ((retry++ > 3 && !is_w5500_sane_for_rxtx(emac)) || retry > 10)
+    {
+      ret = ESP_FAIL;
+      goto err;
+    }
+  }
+
+  // clear the event bit
+  status  = W5500_SIR_SEND;
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status)), err, TAG, "Write SOCK0 IR failed");
+
+  // one frame at a time, in arrival order: only the statistics are per class
+  w5500_tx_class_add(emac, tx_class, length, since);
+
+err:
+  w5500_session_end(emac);
+
+  if (ret == ESP_ERR_NO_MEM)
+  {
+    W5500_STAT_INC(emac, tx_drops_no_mem);
+    W5500_STAT_INC(emac, tx_class[tx_class].drops);
+  }
+
+  return ret;
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_transmit(esp_eth_mac_t *mac, uint8_t *buf, uint32_t length)
+{
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  eth_w5500_tx_segment_t segment = { .buffer = buf, .length = length };
+
+  return w5500_transmit_segments(emac, &segment, 1);
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_receive(esp_eth_mac_t *mac, uint8_t *buf, uint32_t *length)
+{
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  return w5500_receive_frame(emac, &buf, length);
+}
+
+////////////////////////////////////////
+
+static esp_err_t emac_w5500_init(esp_eth_mac_t *mac)
+{
+  esp_err_t ret = ESP_OK;
+
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  esp_eth_mediator_t *eth = emac->eth;
+  esp_rom_gpio_pad_select_gpio(emac->int_gpio_num);
+  gpio_set_direction(emac->int_gpio_num, GPIO_MODE_INPUT);
+  gpio_set_pull_mode(emac->int_gpio_num, GPIO_PULLUP_ONLY);
+  gpio_set_intr_type(emac->int_gpio_num, GPIO_INTR_NEGEDGE); // active low
+  gpio_intr_enable(emac->int_gpio_num);
+  gpio_isr_handler_add(emac->int_gpio_num, w5500_isr_handler, emac);
+
+  ESP_GOTO_ON_ERROR(eth->on_state_changed(eth, ETH_STATE_LLINIT, NULL), err, TAG, "Lowlevel init failed");
+
+  /* the whole register setup runs in one SPI session */
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+
+  /* reset w5500 */
+  ESP_GOTO_ON_ERROR(w5500_reset(emac), err_session, TAG, "Reset w5500 failed");
 
-static inline bool w5500_lock(emac_w5500_t *emac)
-{
-  return xSemaphoreTake(emac->spi_lock, pdMS_TO_TICKS(W5500_SPI_LOCK_TIMEOUT_MS)) == pdTRUE;
+  /* verify chip id */
+  ESP_GOTO_ON_ERROR(w5500_verify_id(emac), err_session, TAG, "Verify chip ID failed");
+
+  /* default setup of internal registers */
+  ESP_GOTO_ON_ERROR(w5500_setup_default(emac), err_session, TAG, "W5500 default setup failed");
+
+  w5500_session_end(emac);
+
+  return ESP_OK;
+
+err_session:
+  w5500_session_end(emac);
+err:
+  gpio_isr_handler_remove(emac->int_gpio_num);
+  gpio_reset_pin(emac->int_gpio_num);
+  eth->on_state_changed(eth, ETH_STATE_DEINIT, NULL);
+
+  return ret;
 }
 
 ////////////////////////////////////////
 
-static inline bool w5500_unlock(emac_w5500_t *emac)
+static esp_err_t emac_w5500_deinit(esp_eth_mac_t *mac)
 {
-  return xSemaphoreGive(emac->spi_lock) == pdTRUE;
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  esp_eth_mediator_t *eth = emac->eth;
+  mac->stop(mac);
+  gpio_isr_handler_remove(emac->int_gpio_num);
+  gpio_reset_pin(emac->int_gpio_num);
+  eth->on_state_changed(eth, ETH_STATE_DEINIT, NULL);
+
+  return ESP_OK;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_write(emac_w5500_t *emac, uint32_t address, const void *value, uint32_t len)
+static esp_err_t emac_w5500_del(esp_eth_mac_t *mac)
 {
-  esp_err_t ret = ESP_OK;
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  spi_transaction_t trans =
-  {
-    .cmd = (address >> W5500_ADDR_OFFSET),
-    .addr = ((address & 0xFFFF) | (W5500_ACCESS_MODE_WRITE << W5500_RWB_OFFSET) | W5500_SPI_OP_MODE_VDM),
-    .length = 8 * len,
-    .tx_buffer = value
-  };
+  vTaskDelete(emac->rx_task_hdl);
+  vSemaphoreDelete(emac->spi_lock);
 
-  if (w5500_lock(emac))
+  if (emac->tx_queue_depth)
   {
-    if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK)
+    vSemaphoreDelete(emac->tx_lock);
+
+    for (int i = 0; i < ETH_W5500_TX_CLASS_MAX; i++)
     {
-      ESP_LOGE(TAG, "%s(%d): SPI transmit failed", __FUNCTION__, __LINE__);
-      ret = ESP_FAIL;
+      vSemaphoreDelete(emac->tx_space[i]);
     }
+  }
 
-    w5500_unlock(emac);
+  heap_caps_free(emac->rx_batch_buf);
+  emac->rx_batch_buf = NULL;
+
+  // lwIP may still hold received frames, the pool and emac stay until the last of them is freed
+  w5500_rx_pool_unref(emac);
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+void esp_eth_mac_w5500_free_rx_buffer(esp_eth_mac_t *mac, void *buffer)
+{
+  if (mac && buffer)
+  {
+    w5500_free_rx_buffer(__containerof(mac, emac_w5500_t, parent), buffer);
   }
-  else
+}
+
+////////////////////////////////////////
+
+esp_err_t esp_eth_mac_w5500_transmit_segments(esp_eth_mac_t *mac, const eth_w5500_tx_segment_t *segments,
+                                             uint32_t count)
+{
+  esp_err_t ret = ESP_OK;
+
+  ESP_GOTO_ON_FALSE(mac && segments && count, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  ret = w5500_transmit_segments(emac, segments, count);
+
+  if (ret == ESP_OK && count > 1)
   {
-    ret = ESP_ERR_TIMEOUT;
+    W5500_STAT_INC(emac, tx_segmented_frames);
   }
 
+err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_read(emac_w5500_t *emac, uint32_t address, void *value, uint32_t len)
+esp_err_t esp_eth_mac_w5500_get_stats(esp_eth_mac_t *mac, eth_w5500_stats_t *stats)
 {
   esp_err_t ret = ESP_OK;
 
-  spi_transaction_t trans =
-  {
-    // use direct reads for registers to prevent overwrites by 4-byte boundary writes
-    .flags = len <= 4 ? SPI_TRANS_USE_RXDATA : 0,
-    .cmd = (address >> W5500_ADDR_OFFSET),
-    .addr = ((address & 0xFFFF) | (W5500_ACCESS_MODE_READ << W5500_RWB_OFFSET) | W5500_SPI_OP_MODE_VDM),
-    .length = 8 * len,
-    .rx_buffer = value
-  };
+  ESP_GOTO_ON_FALSE(mac && stats, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  w5500_stats_sample_t sample;
+  w5500_stats_sample_t current;
+  bool sampled = false;
 
-  if (w5500_lock(emac))
-  {
-    if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK)
-    {
-      ESP_LOGE(TAG, "%s(%d): SPI transmit failed", __FUNCTION__, __LINE__);
-      ret = ESP_FAIL;
-    }
+  // counters are updated with atomics and copied without the lock, a 64 bit one may still be mid-update
+  memcpy(stats, &emac->stats, sizeof(eth_w5500_stats_t));
+  stats->spi_lock_hold_total_us = __atomic_load_n(&emac->stats.spi_lock_hold_total_us, __ATOMIC_RELAXED);
+  stats->raw_rx_latency_total_us = __atomic_load_n(&emac->stats.raw_rx_latency_total_us, __ATOMIC_RELAXED);
 
-    w5500_unlock(emac);
+  for (int i = 0; i < ETH_W5500_TX_CLASS_MAX; i++)
+  {
+    stats->tx_class[i].total_us = __atomic_load_n(&emac->stats.tx_class[i].total_us, __ATOMIC_RELAXED);
   }
-  else
+
+  // only the oldest sample and the counters it is compared with are taken together, a reset can't come in between
+  portENTER_CRITICAL(&emac->stats_lock);
+
+  if (emac->stats_window_count)
   {
-    ret = ESP_ERR_TIMEOUT;
+    uint32_t oldest = (emac->stats_window_count < W5500_STATS_WINDOW_SLOTS) ? 0 : emac->stats_window_head;
+
+    sample = emac->stats_window[oldest];
+    current.rx_frames = emac->stats.rx_frames;
+    current.tx_frames = emac->stats.tx_frames;
+    current.rx_bytes = emac->stats.rx_bytes;
+    current.tx_bytes = emac->stats.tx_bytes;
+    sampled = true;
   }
 
-  if ((trans.flags & SPI_TRANS_USE_RXDATA) && len <= 4)
+  portEXIT_CRITICAL(&emac->stats_lock);
+
+  // rates over the sliding window, from its oldest sample up to now
+  uint64_t window_us = sampled ? esp_timer_get_time() - sample.time_us : 0;
+
+  if (window_us)
   {
-    memcpy(value, trans.rx_data, len);  // copy register values to output
+    stats->rate_window_ms = window_us / 1000;
+    stats->rx_frames_per_s = (uint64_t)(current.rx_frames - sample.rx_frames) * 1000000 / window_us;
+    stats->tx_frames_per_s = (uint64_t)(current.tx_frames - sample.tx_frames) * 1000000 / window_us;
+    stats->rx_bytes_per_s = (uint64_t)(current.rx_bytes - sample.rx_bytes) * 1000000 / window_us;
+    stats->tx_bytes_per_s = (uint64_t)(current.tx_bytes - sample.tx_bytes) * 1000000 / window_us;
   }
 
+err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_send_command(emac_w5500_t *emac, uint8_t command, uint32_t timeout_ms)
+esp_err_t esp_eth_mac_w5500_reset_stats(esp_eth_mac_t *mac)
 {
   esp_err_t ret = ESP_OK;
 
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_CR(0), &command, sizeof(command)), err, TAG, "Write SCR failed");
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  // after W5500 accepts the command, the command register will be cleared automatically
-  uint32_t to = 0;
+  uint32_t *word = (uint32_t *)&emac->stats;
 
-  for (to = 0; to < timeout_ms / 10; to++)
+  // zeroed the way the counters are updated, with atomics: a memset could lose to an add in flight or tear a
+  // 64 bit counter. Those are cleared once more as a whole after the word by word pass
+  for (uint32_t i = 0; i < sizeof(eth_w5500_stats_t) / sizeof(uint32_t); i++)
   {
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_CR(0), &command, sizeof(command)), err, TAG, "Read SCR failed");
+    __atomic_store_n(&word[i], 0, __ATOMIC_RELAXED);
+  }
 
-    if (!command)
-    {
-      break;
-    }
+  W5500_STAT_CLEAR(emac, spi_lock_hold_total_us);
+  W5500_STAT_CLEAR(emac, raw_rx_latency_total_us);
 
-    vTaskDelay(pdMS_TO_TICKS(10));
+  for (int i = 0; i < ETH_W5500_TX_CLASS_MAX; i++)
+  {
+    W5500_STAT_CLEAR(emac, tx_class[i].total_us);
   }
 
-  ESP_GOTO_ON_FALSE(to < timeout_ms / 10, ESP_ERR_TIMEOUT, err, TAG, "Send command timeout");
+  // samples of the counters from before the reset, or taken halfway through it, are dropped
+  portENTER_CRITICAL(&emac->stats_lock);
+  emac->stats_window_head = 0;
+  emac->stats_window_count = 0;
+  portEXIT_CRITICAL(&emac->stats_lock);
+
+  // restart the rate window right away
+  w5500_stats_sample(emac, esp_timer_get_time());
 
 err:
   return ret;
@@ -191,20 +2763,17 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_get_tx_free_size(emac_w5500_t *emac, uint16_t *size)
+esp_err_t esp_eth_mac_w5500_set_int_level(esp_eth_mac_t *mac, uint16_t int_level)
 {
   esp_err_t ret = ESP_OK;
-  uint16_t free0, free1 = 0;
 
-  // read TX_FSR register more than once, until we get the same value
-  // this is a trick because we might be interrupted between reading the high/low part of the TX_FSR register (16 bits in length)
-  do
-  {
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_TX_FSR(0), &free0, sizeof(free0)), err, TAG, "Read TX FSR failed");
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_TX_FSR(0), &free1, sizeof(free1)), err, TAG, "Read TX FSR failed");
-  } while (free0 != free1);
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  uint16_t reg_value = __builtin_bswap16(int_level);
 
-  *size = __builtin_bswap16(free0);
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_INTLEVEL, &reg_value, sizeof(reg_value)), err, TAG,
+                    "Write INTLEVEL failed");
+  emac->int_level = int_level;
 
 err:
   return ret;
@@ -212,20 +2781,16 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_get_rx_received_size(emac_w5500_t *emac, uint16_t *size)
+esp_err_t esp_eth_mac_w5500_set_rx_poll(esp_eth_mac_t *mac, uint32_t threshold, uint32_t budget)
 {
   esp_err_t ret = ESP_OK;
-  uint16_t received0, received1 = 0;
 
-  do
-  {
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_RX_RSR(0), &received0, sizeof(received0)), err, TAG,
-                      "Read RX RSR failed");
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_RX_RSR(0), &received1, sizeof(received1)), err, TAG,
-                      "Read RX RSR failed");
-  } while (received0 != received1);
+  ESP_GOTO_ON_FALSE(mac && budget, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  *size = __builtin_bswap16(received0);
+  // picked up by the RX task on its next round, polling stops by itself once the ring is empty
+  emac->rx_poll_budget = budget;
+  emac->rx_poll_threshold = threshold;
 
 err:
   return ret;
@@ -233,23 +2798,17 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_write_buffer(emac_w5500_t *emac, const void *buffer, uint32_t len, uint16_t offset)
+esp_err_t esp_eth_mac_w5500_get_link(esp_eth_mac_t *mac, eth_link_t *link)
 {
   esp_err_t ret = ESP_OK;
-  uint32_t remain = len;
-  const uint8_t *buf = buffer;
-  offset %= W5500_TX_MEM_SIZE;
+  uint8_t phycfg = 0;
 
-  if (offset + len > W5500_TX_MEM_SIZE)
-  {
-    remain = (offset + len) % W5500_TX_MEM_SIZE;
-    len = W5500_TX_MEM_SIZE - offset;
-    ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_MEM_SOCK_TX(0, offset), buf, len), err, TAG, "Write TX buffer failed");
-    offset += len;
-    buf += len;
-  }
+  ESP_GOTO_ON_FALSE(mac && link, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_MEM_SOCK_TX(0, offset), buf, remain), err, TAG, "Write TX buffer failed");
+  // LNK is bit 0 of PHYCFGR, a single register read
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_PHYCFGR, &phycfg, sizeof(phycfg)), err, TAG, "Read PHYCFGR failed");
+  *link = (phycfg & 0x01) ? ETH_LINK_UP : ETH_LINK_DOWN;
 
 err:
   return ret;
@@ -257,23 +2816,15 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_read_buffer(emac_w5500_t *emac, void *buffer, uint32_t len, uint16_t offset)
+esp_err_t esp_eth_mac_w5500_set_rx_pipeline(esp_eth_mac_t *mac, bool enable)
 {
   esp_err_t ret = ESP_OK;
-  uint32_t remain = len;
-  uint8_t *buf = buffer;
-  offset %= W5500_RX_MEM_SIZE;
 
-  if (offset + len > W5500_RX_MEM_SIZE)
-  {
-    remain = (offset + len) % W5500_RX_MEM_SIZE;
-    len = W5500_RX_MEM_SIZE - offset;
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_MEM_SOCK_RX(0, offset), buf, len), err, TAG, "Read RX buffer failed");
-    offset += len;
-    buf += len;
-  }
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_MEM_SOCK_RX(0, offset), buf, remain), err, TAG, "Read RX buffer failed");
+  // picked up by the RX task on its next drain
+  emac->rx_pipeline = enable;
 
 err:
   return ret;
@@ -281,11 +2832,15 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_set_mac_addr(emac_w5500_t *emac)
+esp_err_t esp_eth_mac_w5500_get_init_timing(esp_eth_mac_t *mac, uint32_t *reset_us, uint32_t *setup_us)
 {
   esp_err_t ret = ESP_OK;
 
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_MAC, emac->addr, 6), err, TAG, "Write MAC address register failed");
+  ESP_GOTO_ON_FALSE(mac && reset_us && setup_us, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  *reset_us = emac->init_reset_us;
+  *setup_us = emac->init_setup_us;
 
 err:
   return ret;
@@ -293,30 +2848,78 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_reset(emac_w5500_t *emac)
+esp_err_t esp_eth_mac_w5500_mcast_filter(esp_eth_mac_t *mac, const uint8_t *addr, bool add)
 {
   esp_err_t ret = ESP_OK;
+  int found = -1;
+  int free_slot = -1;
+  bool overflow = false;
 
-  /* software reset */
-  uint8_t mr = W5500_MR_RST; // Set RST bit (auto clear)
-
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_MR, &mr, sizeof(mr)), err, TAG, "Write MR failed");
+  ESP_GOTO_ON_FALSE(mac && addr && (addr[0] & 0x01), ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  uint32_t to = 0;
+  portENTER_CRITICAL(&emac->mcast_lock);
 
-  for (to = 0; to < emac->sw_reset_timeout_ms / 10; to++)
+  for (int i = 0; i < ETH_W5500_MCAST_FILTER_SIZE; i++)
   {
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_MR, &mr, sizeof(mr)), err, TAG, "Read MR failed");
+    if (!emac->mcast_table[i].refs)
+    {
+      free_slot = (free_slot < 0) ? i : free_slot;
+    }
+    else if (!memcmp(emac->mcast_table[i].addr, addr, ETH_ADDR_LEN))
+    {
+      found = i;
+    }
+  }
 
-    if (!(mr & W5500_MR_RST))
+  if (add)
+  {
+    if (found >= 0)
     {
-      break;
+      emac->mcast_table[found].refs++;
+    }
+    else if (free_slot >= 0)
+    {
+      memcpy(emac->mcast_table[free_slot].addr, addr, ETH_ADDR_LEN);
+      emac->mcast_table[free_slot].refs = 1;
+      emac->mcast_hash |= 1ULL << w5500_mcast_hash(addr);
+    }
+    else
+    {
+      overflow = (emac->mcast_overflow++ == 0);
     }
+  }
+  else if (found >= 0)
+  {
+    if (--emac->mcast_table[found].refs == 0)
+    {
+      // a bin may be shared, rebuild from what's left
+      emac->mcast_hash = 0;
 
-    vTaskDelay(pdMS_TO_TICKS(10));
+      for (int i = 0; i < ETH_W5500_MCAST_FILTER_SIZE; i++)
+      {
+        if (emac->mcast_table[i].refs)
+        {
+          emac->mcast_hash |= 1ULL << w5500_mcast_hash(emac->mcast_table[i].addr);
+        }
+      }
+    }
+  }
+  else if (emac->mcast_overflow)
+  {
+    emac->mcast_overflow--;
   }
+  else
+  {
+    ret = ESP_ERR_NOT_FOUND;
+  }
+
+  portEXIT_CRITICAL(&emac->mcast_lock);
 
-  ESP_GOTO_ON_FALSE(to < emac->sw_reset_timeout_ms / 10, ESP_ERR_TIMEOUT, err, TAG, "Reset timeout");
+  if (overflow)
+  {
+    ESP_LOGW(TAG, "Multicast filter full (%d addresses), passing all multicast", ETH_W5500_MCAST_FILTER_SIZE);
+  }
 
 err:
   return ret;
@@ -324,14 +2927,18 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_verify_id(emac_w5500_t *emac)
+esp_err_t esp_eth_mac_w5500_mcast_filter_clear(esp_eth_mac_t *mac)
 {
   esp_err_t ret = ESP_OK;
-  uint8_t version = 0;
-  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_VERSIONR, &version, sizeof(version)), err, TAG, "Read VERSIONR failed");
 
-  // W5500 doesn't have chip ID, we just print the version number instead
-  ESP_LOGI(TAG, "version=%x", version);
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+
+  portENTER_CRITICAL(&emac->mcast_lock);
+  memset(emac->mcast_table, 0, sizeof(emac->mcast_table));
+  emac->mcast_hash = 0;
+  emac->mcast_overflow = 0;
+  portEXIT_CRITICAL(&emac->mcast_lock);
 
 err:
   return ret;
@@ -339,49 +2946,53 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t w5500_setup_default(emac_w5500_t *emac)
+esp_err_t esp_eth_mac_w5500_set_storm_limit(esp_eth_mac_t *mac, eth_w5500_rx_class_t rx_class,
+                                            const eth_w5500_storm_limit_t *limit)
 {
   esp_err_t ret = ESP_OK;
-  uint8_t reg_value = 16;
+  bool limited = false;
 
-  // Only SOCK0 can be used as MAC RAW mode, so we give the whole buffer (16KB TX and 16KB RX) to SOCK0
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_RXBUF_SIZE(0), &reg_value, sizeof(reg_value)), err, TAG,
-                    "Set rx buffer size failed");
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_TXBUF_SIZE(0), &reg_value, sizeof(reg_value)), err, TAG,
-                    "Set tx buffer size failed");
+  ESP_GOTO_ON_FALSE(mac && limit && rx_class < ETH_W5500_RX_CLASS_MAX && (!limit->rate || limit->burst),
+                    ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  reg_value = 0;
+  // the w5500 task uses the bucket meanwhile, a frame or two judged by a mix of old and new values don't matter
+  emac->storm[rx_class].rate = 0;
+  emac->storm[rx_class].burst = limit->burst;
+  emac->storm[rx_class].tokens = limit->burst * 1000;
+  emac->storm[rx_class].refill_us = esp_timer_get_time();
+  emac->storm[rx_class].rate = limit->rate;
 
-  for (int i = 1; i < 8; i++)
+  for (int i = 0; i < ETH_W5500_RX_CLASS_MAX; i++)
   {
-    ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_RXBUF_SIZE(i), &reg_value, sizeof(reg_value)), err, TAG,
-                      "Set SOCK_RXBUF_SIZE failed");
-    ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_TXBUF_SIZE(i), &reg_value, sizeof(reg_value)), err, TAG,
-                      "Set SOCK_TXBUF_SIZE failed");
+    limited |= emac->storm[i].rate != 0;
   }
 
-  /* Enable ping block, disable PPPoE, WOL */
-  reg_value = W5500_MR_PB;
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_MR, &reg_value, sizeof(reg_value)), err, TAG, "Write MR failed");
+  emac->storm_limited = limited;
 
-  /* Disable interrupt for all sockets by default */
-  reg_value = 0;
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SIMR, &reg_value, sizeof(reg_value)), err, TAG, "Write SIMR failed");
+err:
+  return ret;
+}
 
-  /* Enable MAC RAW mode for SOCK0, enable MAC filter, no blocking broadcast and multicast */
-  reg_value = W5500_SMR_MAC_RAW | W5500_SMR_MAC_FILTER;
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_MR(0), &reg_value, sizeof(reg_value)), err, TAG,
-                    "Write SOCK0 MR failed");
+////////////////////////////////////////
+
+esp_err_t esp_eth_mac_w5500_get_storm(esp_eth_mac_t *mac, uint32_t *classes)
+{
+  esp_err_t ret = ESP_OK;
 
-  /* Enable receive event for SOCK0 */
-  reg_value = W5500_SIR_RECV;
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_IMR(0), &reg_value, sizeof(reg_value)), err, TAG,
-                    "Write SOCK0 IMR failed");
+  ESP_GOTO_ON_FALSE(mac && classes, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  int64_t now = esp_timer_get_time();
 
-  /* Set the interrupt re-assert level to maximum (~1.5ms) to lower the chances of missing it */
-  uint16_t int_level = __builtin_bswap16(0xFFFF);
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_INTLEVEL, &int_level, sizeof(int_level)), err, TAG,
-                    "Write INTLEVEL failed");
+  *classes = 0;
+
+  for (int i = 0; i < ETH_W5500_RX_CLASS_MAX; i++)
+  {
+    if (emac->storm[i].rate && now - emac->storm[i].last_drop_us < ETH_W5500_STORM_HOLD_MS * 1000LL)
+    {
+      *classes |= 1 << i;
+    }
+  }
 
 err:
   return ret;
@@ -389,33 +3000,83 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_start(esp_eth_mac_t *mac)
+esp_err_t esp_eth_mac_w5500_register_ethertype(esp_eth_mac_t *mac, uint16_t ether_type, eth_w5500_ethertype_cb_t cb,
+                                               void *arg)
 {
   esp_err_t ret = ESP_OK;
+  int found = -1;
+  int free_slot = -1;
+
+  ESP_GOTO_ON_FALSE(mac && ether_type >= 0x0600, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  uint8_t reg_value = 0;
-  /* open SOCK0 */
-  ESP_GOTO_ON_ERROR(w5500_send_command(emac, W5500_SCR_OPEN, 100), err, TAG, "Issue OPEN command failed");
+  portENTER_CRITICAL(&emac->ethertype_lock);
 
-  /* enable interrupt for SOCK0 */
-  reg_value = W5500_SIMR_SOCK0;
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SIMR, &reg_value, sizeof(reg_value)), err, TAG, "Write SIMR failed");
+  for (int i = 0; i < ETH_W5500_ETHERTYPE_HANDLERS_MAX; i++)
+  {
+    if (emac->ethertype_handlers[i].type == ether_type)
+    {
+      found = i;
+    }
+    else if (!emac->ethertype_handlers[i].type && free_slot < 0)
+    {
+      free_slot = i;
+    }
+  }
+
+  if (!cb)
+  {
+    if (found >= 0)
+    {
+      emac->ethertype_handlers[found].type = 0;
+      emac->ethertype_count--;
+    }
+    else
+    {
+      ret = ESP_ERR_NOT_FOUND;
+    }
+  }
+  else if (found >= 0)
+  {
+    // replace the callback, cb and arg change together
+    emac->ethertype_handlers[found].cb = cb;
+    emac->ethertype_handlers[found].arg = arg;
+  }
+  else if (free_slot >= 0)
+  {
+    emac->ethertype_handlers[free_slot].cb = cb;
+    emac->ethertype_handlers[free_slot].arg = arg;
+    emac->ethertype_handlers[free_slot].type = ether_type;
+    emac->ethertype_count++;
+  }
+  else
+  {
+    ret = ESP_ERR_NO_MEM;
+  }
+
+  portEXIT_CRITICAL(&emac->ethertype_lock);
+
+  // logged outside the critical section
+  ESP_GOTO_ON_FALSE(ret != ESP_ERR_NOT_FOUND, ret, err, TAG, "EtherType 0x%04x not registered", ether_type);
+  ESP_GOTO_ON_FALSE(ret != ESP_ERR_NO_MEM, ret, err, TAG, "No free EtherType handler");
 
 err:
   return ret;
 }
 
-static esp_err_t emac_w5500_stop(esp_eth_mac_t *mac)
+////////////////////////////////////////
+
+esp_err_t esp_eth_mac_w5500_set_tx_classifier(esp_eth_mac_t *mac, eth_w5500_tx_classifier_t classifier, void *arg)
 {
   esp_err_t ret = ESP_OK;
 
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
-  uint8_t reg_value = 0;
-  /* disable interrupt */
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SIMR, &reg_value, sizeof(reg_value)), err, TAG, "Write SIMR failed");
-  /* close SOCK0 */
-  ESP_GOTO_ON_ERROR(w5500_send_command(emac, W5500_SCR_CLOSE, 100), err, TAG, "Issue SCR_CLOSE command failed");
+
+  // a transmit in between runs the default classification
+  emac->tx_classifier = NULL;
+  emac->tx_classifier_arg = arg;
+  emac->tx_classifier = classifier;
 
 err:
   return ret;
@@ -423,140 +3084,143 @@ err:
 
 ////////////////////////////////////////
 
-IRAM_ATTR static void w5500_isr_handler(void *arg)
+esp_err_t esp_eth_mac_w5500_set_ip(esp_eth_mac_t *mac, uint32_t ip, uint32_t netmask, uint32_t gw)
 {
-  emac_w5500_t *emac = (emac_w5500_t *)arg;
-  BaseType_t high_task_wakeup = pdFALSE;
+  esp_err_t ret = ESP_OK;
+  uint32_t gw_subnet[2] = { gw, netmask };
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
 
-  /* notify w5500 task */
-  vTaskNotifyGiveFromISR(emac->rx_task_hdl, &high_task_wakeup);
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  if (high_task_wakeup != pdFALSE)
-  {
-    portYIELD_FROM_ISR();
-  }
+  // GAR and SUBR are adjacent, the chain runs synchronously so the stack buffer outlives it
+  w5500_chain_add(&chain, W5500_REG_GAR, true, gw_subnet, sizeof(gw_subnet));
+  w5500_chain_add(&chain, W5500_REG_SIPR, true, &ip, sizeof(ip));
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err, TAG, "Write IP address failed");
+
+err:
+  return ret;
 }
 
 ////////////////////////////////////////
 
-static void emac_w5500_task(void *arg)
+static inline bool w5500_sock_allocated(emac_w5500_t *emac, uint8_t sock)
 {
-  emac_w5500_t *emac = (emac_w5500_t *)arg;
-  uint8_t status = 0;
-  uint8_t *buffer = NULL;
-  uint32_t length = 0;
+  return (sock >= 1) && (sock <= emac->offload_sockets) && (emac->sock_used & (1 << sock));
+}
+
+////////////////////////////////////////
+
+// Poll Sn_IR for the end of a hardware socket's SEND: SEND_OK, or TIMEOUT once ARP / TCP retransmissions gave up.
+// Runs outside of an SPI session, the RX task keeps the MACRAW ring drained meanwhile
+static esp_err_t w5500_sock_wait_send(emac_w5500_t *emac, uint8_t sock)
+{
+  esp_err_t ret = ESP_OK;
+  uint8_t ir = 0;
+  int64_t start = esp_timer_get_time();
+  int64_t elapsed = 0;
 
   while (1)
   {
-    // check if the task receives any notification
-    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)) == 0 &&    // if no notification ...
-        gpio_get_level(emac->int_gpio_num) != 0)
+    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_IR(sock), &ir, sizeof(ir)), err, TAG, "Read Sn_IR failed");
+    elapsed = esp_timer_get_time() - start;
+
+    if (ir & (W5500_SIR_SEND | W5500_SIR_TIMEOUT))
     {
-      // ...and no interrupt asserted
-      continue;                                                // -> just continue to check again
+      break;
     }
 
-    /* read interrupt status */
-    w5500_read(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status));
+    ESP_GOTO_ON_FALSE(elapsed < W5500_OFFLOAD_SEND_TIMEOUT_MS * 1000, ESP_ERR_TIMEOUT, err, TAG,
+                      "Socket %d SEND timeout", sock);
 
-    /* packet received */
-    if (status & W5500_SIR_RECV)
+    if (elapsed >= W5500_CMD_YIELD_US)
     {
-      status = W5500_SIR_RECV;
-      // clear interrupt status
-      w5500_write(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status));
-
-      do
-      {
-        length = ETH_MAX_PACKET_SIZE;
-        buffer = heap_caps_malloc(length, MALLOC_CAP_DMA);
-
-        if (!buffer)
-        {
-          ESP_LOGE(TAG, "No mem for receive buffer");
-          break;
-        }
-        else if (emac->parent.receive(&emac->parent, buffer, &length) == ESP_OK)
-        {
-          /* pass the buffer to stack (e.g. TCP/IP layer) */
-          if (length)
-          {
-            emac->eth->stack_input(emac->eth, buffer, length);
-          }
-          else
-          {
-            free(buffer);
-          }
-        }
-        else
-        {
-          free(buffer);
-        }
-      } while (emac->packets_remain);
+      vTaskDelay(1);
+    }
+    else if (elapsed >= W5500_CMD_SPIN_US)
+    {
+      taskYIELD();
     }
   }
 
-  vTaskDelete(NULL);
-}
+  // write 1 to clear
+  ir &= W5500_SIR_SEND | W5500_SIR_TIMEOUT;
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_IR(sock), &ir, sizeof(ir)), err, TAG, "Write Sn_IR failed");
+  __atomic_fetch_and(&emac->sock_sending, (uint8_t)~(1 << sock), __ATOMIC_RELAXED);
 
-////////////////////////////////////////
+  ESP_GOTO_ON_FALSE(!(ir & W5500_SIR_TIMEOUT), ESP_ERR_TIMEOUT, err, TAG, "Socket %d peer unreachable", sock);
 
-static esp_err_t emac_w5500_set_mediator(esp_eth_mac_t *mac, esp_eth_mediator_t *eth)
-{
-  esp_err_t ret = ESP_OK;
-  ESP_GOTO_ON_FALSE(eth, ESP_ERR_INVALID_ARG, err, TAG, "Can't set mac's mediator to null");
-  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
-  emac->eth = eth;
-  return ESP_OK;
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_write_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t reg_value)
+esp_err_t esp_eth_mac_w5500_sock_open(esp_eth_mac_t *mac, eth_w5500_sock_proto_t proto, uint16_t port,
+                                      uint8_t *sock)
 {
   esp_err_t ret = ESP_OK;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  uint8_t mode = proto;
+  uint8_t ir = 0xFF;
+  uint8_t sr = 0;
+  uint8_t sn = 0;
+
+  ESP_GOTO_ON_FALSE(mac && sock && (proto == ETH_W5500_SOCK_TCP || proto == ETH_W5500_SOCK_UDP),
+                    ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
 
-  // PHY register and MAC registers are mixed together in W5500
-  // The only PHY register is PHYCFGR
-  ESP_GOTO_ON_FALSE(phy_reg == W5500_REG_PHYCFGR, ESP_FAIL, err, TAG, "Wrong PHY register");
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_PHYCFGR, &reg_value, sizeof(uint8_t)), err, TAG,
-                    "write PHY register failed");
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
 
-err:
-  return ret;
-}
+  for (sn = 1; sn <= emac->offload_sockets; sn++)
+  {
+    if (!(emac->sock_used & (1 << sn)))
+    {
+      break;
+    }
+  }
 
-////////////////////////////////////////
+  ESP_GOTO_ON_FALSE(sn <= emac->offload_sockets, ESP_ERR_NOT_FOUND, err_session, TAG, "No free hardware socket");
 
-static esp_err_t emac_w5500_read_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t *reg_value)
-{
-  esp_err_t ret = ESP_OK;
-  ESP_GOTO_ON_FALSE(reg_value, ESP_ERR_INVALID_ARG, err, TAG, "Can't set reg_value to null");
-  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  if (!port)
+  {
+    port = emac->next_local_port;
+    emac->next_local_port = (port == W5500_LOCAL_PORT_LAST) ? W5500_LOCAL_PORT_FIRST : port + 1;
+  }
 
-  // PHY register and MAC registers are mixed together in W5500
-  // The only PHY register is PHYCFGR
-  ESP_GOTO_ON_FALSE(phy_reg == W5500_REG_PHYCFGR, ESP_FAIL, err, TAG, "Wrong PHY register");
-  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_PHYCFGR, reg_value, sizeof(uint8_t)), err, TAG,
-                    "read PHY register failed");
+  uint16_t port_be = __builtin_bswap16(port);
+
+  w5500_chain_add(&chain, W5500_REG_SOCK_MR(sn), true, &mode, sizeof(mode));
+  w5500_chain_add(&chain, W5500_REG_SOCK_PORT(sn), true, &port_be, sizeof(port_be));
+  w5500_chain_add(&chain, W5500_REG_SOCK_IR(sn), true, &ir, sizeof(ir));
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Socket setup failed");
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, sn, W5500_SCR_OPEN, 100), err_session, TAG, "Issue OPEN failed");
+
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_SR(sn), &sr, sizeof(sr)), err_session, TAG, "Read Sn_SR failed");
+  ESP_GOTO_ON_FALSE(sr == ((proto == ETH_W5500_SOCK_TCP) ? ETH_W5500_SOCK_INIT : ETH_W5500_SOCK_UDP_OPEN),
+                    ESP_FAIL, err_session, TAG, "Socket %d didn't open (SR 0x%02x)", sn, sr);
 
+  emac->sock_used |= 1 << sn;
+  __atomic_fetch_and(&emac->sock_sending, (uint8_t)~(1 << sn), __ATOMIC_RELAXED);
+  *sock = sn;
+
+err_session:
+  w5500_session_end(emac);
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_set_addr(esp_eth_mac_t *mac, uint8_t *addr)
+esp_err_t esp_eth_mac_w5500_sock_listen(esp_eth_mac_t *mac, uint8_t sock)
 {
   esp_err_t ret = ESP_OK;
 
-  ESP_GOTO_ON_FALSE(addr, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
-  memcpy(emac->addr, addr, 6);
-  ESP_GOTO_ON_ERROR(w5500_set_mac_addr(emac), err, TAG, "Set mac address failed");
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
+
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, sock, W5500_SCR_LISTEN, 100), err, TAG, "Issue LISTEN failed");
 
 err:
   return ret;
@@ -564,40 +3228,43 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_get_addr(esp_eth_mac_t *mac, uint8_t *addr)
+esp_err_t esp_eth_mac_w5500_sock_connect(esp_eth_mac_t *mac, uint8_t sock, uint32_t ip, uint16_t port)
 {
   esp_err_t ret = ESP_OK;
+  uint8_t dest[6];
 
-  ESP_GOTO_ON_FALSE(addr, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  ESP_GOTO_ON_FALSE(mac && ip, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
-  memcpy(addr, emac->addr, 6);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
+
+  // DIPR and DPORT are adjacent
+  memcpy(dest, &ip, 4);
+  dest[4] = port >> 8;
+  dest[5] = port & 0xFF;
 
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_DIPR(sock), dest, sizeof(dest)), err_session, TAG,
+                    "Write destination failed");
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, sock, W5500_SCR_CONNECT, 100), err_session, TAG,
+                    "Issue CONNECT failed");
+
+err_session:
+  w5500_session_end(emac);
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_set_link(esp_eth_mac_t *mac, eth_link_t link)
+esp_err_t esp_eth_mac_w5500_sock_disconnect(esp_eth_mac_t *mac, uint8_t sock)
 {
   esp_err_t ret = ESP_OK;
 
-  switch (link)
-  {
-    case ETH_LINK_UP:
-      ESP_LOGD(TAG, "Link is up");
-      ESP_GOTO_ON_ERROR(mac->start(mac), err, TAG, "W5500 start failed");
-      break;
-
-    case ETH_LINK_DOWN:
-      ESP_LOGD(TAG, "link is down");
-      ESP_GOTO_ON_ERROR(mac->stop(mac), err, TAG, "W5500 stop failed");
-      break;
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-    default:
-      ESP_GOTO_ON_FALSE(false, ESP_ERR_INVALID_ARG, err, TAG, "Unknown link status");
-      break;
-  }
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, sock, W5500_SCR_DISCON, 100), err, TAG, "Issue DISCON failed");
 
 err:
   return ret;
@@ -605,74 +3272,72 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_set_speed(esp_eth_mac_t *mac, eth_speed_t speed)
+esp_err_t esp_eth_mac_w5500_sock_close(esp_eth_mac_t *mac, uint8_t sock)
 {
   esp_err_t ret = ESP_OK;
+  uint8_t ir = 0xFF;
 
-  switch (speed)
-  {
-    case ETH_SPEED_10M:
-      ESP_LOGD(TAG, "Setting to 10Mbps");
-      break;
+  ESP_GOTO_ON_FALSE(mac, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-    case ETH_SPEED_100M:
-      ESP_LOGD(TAG, "Setting to 100Mbps");
-      break;
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, sock, W5500_SCR_CLOSE, 100), err_session, TAG, "Issue CLOSE failed");
+  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_IR(sock), &ir, sizeof(ir)), err_session, TAG,
+                    "Write Sn_IR failed");
 
-    default:
-      ESP_GOTO_ON_FALSE(false, ESP_ERR_INVALID_ARG, err, TAG, "Unknown speed");
-      break;
-  }
+  emac->sock_used &= ~(1 << sock);
+  __atomic_fetch_and(&emac->sock_sending, (uint8_t)~(1 << sock), __ATOMIC_RELAXED);
 
+err_session:
+  w5500_session_end(emac);
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_set_duplex(esp_eth_mac_t *mac, eth_duplex_t duplex)
+esp_err_t esp_eth_mac_w5500_sock_info(esp_eth_mac_t *mac, uint8_t sock, eth_w5500_sock_info_t *info)
 {
   esp_err_t ret = ESP_OK;
+  w5500_sock_status_t status;
+  uint8_t sr = 0;
 
-  switch (duplex)
-  {
-    case ETH_DUPLEX_HALF:
-      ESP_LOGD(TAG, "Setting to HALF_DUPLEX");
-      break;
+  ESP_GOTO_ON_FALSE(mac && info, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-    case ETH_DUPLEX_FULL:
-      ESP_LOGD(TAG, "Setting to FULL_DUPLEX");
-      break;
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_SR(sock), &sr, sizeof(sr)), err_session, TAG,
+                    "Read Sn_SR failed");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, sock, &status), err_session, TAG, "Read socket status failed");
 
-    default:
-      ESP_GOTO_ON_FALSE(false, ESP_ERR_INVALID_ARG, err, TAG, "Unknown duplex");
-      break;
-  }
+  info->state = (eth_w5500_sock_state_t)sr;
+  info->rx_size = status.rx_rsr;
+  info->tx_free = status.tx_fsr;
 
+err_session:
+  w5500_session_end(emac);
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_set_promiscuous(esp_eth_mac_t *mac, bool enable)
+esp_err_t esp_eth_mac_w5500_sock_remote(esp_eth_mac_t *mac, uint8_t sock, uint32_t *ip, uint16_t *port)
 {
   esp_err_t ret = ESP_OK;
-  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  uint8_t dest[6];
 
-  uint8_t smr = 0;
-  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_MR(0), &smr, sizeof(smr)), err, TAG, "Read SOCK0 MR failed");
+  ESP_GOTO_ON_FALSE(mac && ip && port, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-  if (enable)
-  {
-    smr &= ~W5500_SMR_MAC_FILTER;
-  }
-  else
-  {
-    smr |= W5500_SMR_MAC_FILTER;
-  }
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_DIPR(sock), dest, sizeof(dest)), err, TAG,
+                    "Read destination failed");
 
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_MR(0), &smr, sizeof(smr)), err, TAG, "Write SOCK0 MR failed");
+  memcpy(ip, dest, 4);
+  *port = (dest[4] << 8) | dest[5];
 
 err:
   return ret;
@@ -680,213 +3345,260 @@ err:
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_enable_flow_ctrl(esp_eth_mac_t *mac, bool enable)
+// TCP: one SEND may be in flight per socket, its SEND_OK is collected before the next chunk goes out
+esp_err_t esp_eth_mac_w5500_sock_send(esp_eth_mac_t *mac, uint8_t sock, const void *buffer, uint32_t length,
+                                      uint32_t *sent)
 {
-  /* w5500 doesn't support flow control function, so accept any value */
-  return ESP_ERR_NOT_SUPPORTED;
-}
+  esp_err_t ret = ESP_OK;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  w5500_sock_status_t status;
+  uint8_t sr = 0;
+  uint8_t command = W5500_SCR_SEND;
 
-////////////////////////////////////////
+  ESP_GOTO_ON_FALSE(mac && buffer && sent, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
+  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-static esp_err_t emac_w5500_set_peer_pause_ability(esp_eth_mac_t *mac, uint32_t ability)
-{
-  /* w5500 doesn't support PAUSE function, so accept any value */
-  return ESP_ERR_NOT_SUPPORTED;
-}
+  *sent = 0;
 
-////////////////////////////////////////
+  if (emac->sock_sending & (1 << sock))
+  {
+    ESP_GOTO_ON_ERROR(w5500_sock_wait_send(emac, sock), err, TAG, "Previous SEND failed");
+  }
 
-static inline bool is_w5500_sane_for_rxtx(emac_w5500_t *emac)
-{
-  uint8_t phycfg;
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_SR(sock), &sr, sizeof(sr)), err_session, TAG,
+                    "Read Sn_SR failed");
+  ESP_GOTO_ON_FALSE(sr == ETH_W5500_SOCK_ESTABLISHED || sr == ETH_W5500_SOCK_CLOSE_WAIT, ESP_ERR_INVALID_STATE,
+                    err_session, TAG, "Socket %d not connected", sock);
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, sock, &status), err_session, TAG, "Read socket status failed");
 
-  /* phy is ok for rx and tx operations if bits RST and LNK are set (no link down, no reset) */
-  if (w5500_read(emac, W5500_REG_PHYCFGR, &phycfg, 1) == ESP_OK && (phycfg & 0x8001))
+  uint32_t len = (length < status.tx_fsr) ? length : status.tx_fsr;
+
+  if (len)
   {
-    return true;
+    uint16_t tx_wr = __builtin_bswap16((uint16_t)(status.tx_wr + len));
+
+    // payload (two transactions at the buffer end), write pointer and SEND in one go
+    w5500_chain_add_sock_buffer(&chain, sock, emac->sock_mem_size[sock], true, (void *)buffer, len, status.tx_wr);
+    w5500_chain_add(&chain, W5500_REG_SOCK_TX_WR(sock), true, &tx_wr, sizeof(tx_wr));
+    w5500_chain_add(&chain, W5500_REG_SOCK_CR(sock), true, &command, sizeof(command));
+    ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Write TX buffer failed");
+    ESP_GOTO_ON_ERROR(w5500_wait_command(emac, sock, W5500_SCR_SEND, 100), err_session, TAG, "Issue SEND failed");
+
+    __atomic_fetch_or(&emac->sock_sending, (uint8_t)(1 << sock), __ATOMIC_RELAXED);
+    W5500_STAT_ADD(emac, offload_tx_bytes, len);
+    *sent = len;
   }
 
-  return false;
+err_session:
+  w5500_session_end(emac);
+err:
+  return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_transmit(esp_eth_mac_t *mac, uint8_t *buf, uint32_t length)
+esp_err_t esp_eth_mac_w5500_sock_sendto(esp_eth_mac_t *mac, uint8_t sock, const void *buffer, uint32_t length,
+                                        uint32_t ip, uint16_t port)
 {
   esp_err_t ret = ESP_OK;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  w5500_sock_status_t status;
+  uint8_t dest[6];
 
+  ESP_GOTO_ON_FALSE(mac && buffer && length && ip, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
-  uint16_t offset = 0;
-
-  // check if there're free memory to store this packet
-  uint16_t free_size = 0;
-  ESP_GOTO_ON_ERROR(w5500_get_tx_free_size(emac, &free_size), err, TAG, "Get free size failed");
-  ESP_GOTO_ON_FALSE(length <= free_size, ESP_ERR_NO_MEM, err, TAG, "Free size (%d) < send length (%d)", length,
-                    free_size);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
+  ESP_GOTO_ON_FALSE(length <= emac->sock_mem_size[sock], ESP_ERR_INVALID_SIZE, err, TAG, "Datagram too large");
 
-  // get current write pointer
-  ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_TX_WR(0), &offset, sizeof(offset)), err, TAG, "Read TX WR failed");
-  offset = __builtin_bswap16(offset);
+  memcpy(dest, &ip, 4);
+  dest[4] = port >> 8;
+  dest[5] = port & 0xFF;
 
-  // copy data to tx memory
-  ESP_GOTO_ON_ERROR(w5500_write_buffer(emac, buf, length, offset), err, TAG, "Write frame failed");
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, sock, &status), err_session, TAG, "Read socket status failed");
 
-  // update write pointer
-  offset += length;
-  offset = __builtin_bswap16(offset);
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_TX_WR(0), &offset, sizeof(offset)), err, TAG, "Write TX WR failed");
+  // the previous datagram was waited for, anything else means the chip is still busy with it
+  ESP_GOTO_ON_FALSE(length <= status.tx_fsr, ESP_ERR_TIMEOUT, err_session, TAG, "TX buffer full");
 
-  // issue SEND command
-  ESP_GOTO_ON_ERROR(w5500_send_command(emac, W5500_SCR_SEND, 100), err, TAG, "Issue SEND command failed");
+  uint16_t tx_wr = __builtin_bswap16((uint16_t)(status.tx_wr + length));
 
-  // pooling the TX done event
-  int retry = 0;
-  uint8_t status = 0;
+  w5500_chain_add(&chain, W5500_REG_SOCK_DIPR(sock), true, dest, sizeof(dest));
+  w5500_chain_add_sock_buffer(&chain, sock, emac->sock_mem_size[sock], true, (void *)buffer, length, status.tx_wr);
+  w5500_chain_add(&chain, W5500_REG_SOCK_TX_WR(sock), true, &tx_wr, sizeof(tx_wr));
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Write TX buffer failed");
+  ESP_GOTO_ON_ERROR(w5500_send_command(emac, sock, W5500_SCR_SEND, 100), err_session, TAG, "Issue SEND failed");
 
-  while (!(status & W5500_SIR_SEND))
-  {
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status)), err, TAG, "Read SOCK0 IR failed");
+  __atomic_fetch_or(&emac->sock_sending, (uint8_t)(1 << sock), __ATOMIC_RELAXED);
+  w5500_session_end(emac);
 
-    if ((retry++ > 3 && !is_w5500_sane_for_rxtx(emac)) || retry > 10)
-    {
-      return ESP_FAIL;
-    }
-  }
+  // ARP for a new destination may take the chip's full retry time, don't hold the SPI bus meanwhile
+  ESP_GOTO_ON_ERROR(w5500_sock_wait_send(emac, sock), err, TAG, "SEND failed");
+  W5500_STAT_ADD(emac, offload_tx_bytes, length);
 
-  // clear the event bit
-  status  = W5500_SIR_SEND;
-  ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_IR(0), &status, sizeof(status)), err, TAG, "Write SOCK0 IR failed");
+  return ESP_OK;
 
+err_session:
+  w5500_session_end(emac);
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_receive(esp_eth_mac_t *mac, uint8_t *buf, uint32_t *length)
+esp_err_t esp_eth_mac_w5500_sock_recv(esp_eth_mac_t *mac, uint8_t sock, void *buffer, uint32_t length,
+                                      uint32_t *received)
 {
   esp_err_t ret = ESP_OK;
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  w5500_sock_status_t status;
+  uint8_t command = W5500_SCR_RECV;
 
+  ESP_GOTO_ON_FALSE(mac && buffer && received, ESP_ERR_INVALID_ARG, err, TAG, "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-  uint16_t offset = 0;
-  uint16_t rx_len = 0;
-  uint16_t remain_bytes = 0;
-  emac->packets_remain  = false;
-
-  w5500_get_rx_received_size(emac, &remain_bytes);
-
-  if (remain_bytes)
-  {
-    // get current read pointer
-    ESP_GOTO_ON_ERROR(w5500_read(emac, W5500_REG_SOCK_RX_RD(0), &offset, sizeof(offset)), err, TAG, "Read RX RD failed");
-
-    offset = __builtin_bswap16(offset);
-
-    // read head first
-    ESP_GOTO_ON_ERROR(w5500_read_buffer(emac, &rx_len, sizeof(rx_len), offset), err, TAG, "Read frame header failed");
+  *received = 0;
 
-    rx_len = __builtin_bswap16(rx_len) - 2; // data size includes 2 bytes of header
-    offset += 2;
-
-    // read the payload
-    ESP_GOTO_ON_ERROR(w5500_read_buffer(emac, buf, rx_len, offset), err, TAG, "Read payload failed, len=%d, offset=%d",
-                      rx_len, offset);
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, sock, &status), err_session, TAG, "Read socket status failed");
 
-    offset += rx_len;
+  uint32_t len = (length < status.rx_rsr) ? length : status.rx_rsr;
 
-    // update read pointer
-    offset = __builtin_bswap16(offset);
-    ESP_GOTO_ON_ERROR(w5500_write(emac, W5500_REG_SOCK_RX_RD(0), &offset, sizeof(offset)), err, TAG, "Write RX RD failed");
+  if (len)
+  {
+    uint16_t rx_rd = __builtin_bswap16((uint16_t)(status.rx_rd + len));
 
-    /* issue RECV command */
-    ESP_GOTO_ON_ERROR(w5500_send_command(emac, W5500_SCR_RECV, 100), err, TAG, "Issue RECV command failed");
+    // payload (two transactions at the buffer end), read pointer and RECV in one go
+    w5500_chain_add_sock_buffer(&chain, sock, emac->sock_mem_size[sock], false, buffer, len, status.rx_rd);
+    w5500_chain_add(&chain, W5500_REG_SOCK_RX_RD(sock), true, &rx_rd, sizeof(rx_rd));
+    w5500_chain_add(&chain, W5500_REG_SOCK_CR(sock), true, &command, sizeof(command));
+    ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Read RX buffer failed");
+    ESP_GOTO_ON_ERROR(w5500_wait_command(emac, sock, W5500_SCR_RECV, 100), err_session, TAG, "Issue RECV failed");
 
-    // check if there're more data need to process
-    remain_bytes -= rx_len + 2;
-    emac->packets_remain = remain_bytes > 0;
+    W5500_STAT_ADD(emac, offload_rx_bytes, len);
+    *received = len;
   }
 
-  *length = rx_len;
-
+err_session:
+  w5500_session_end(emac);
 err:
   return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_init(esp_eth_mac_t *mac)
+// Each UDP datagram in the RX buffer comes with an 8 byte header: sender IP, sender port, payload size
+esp_err_t esp_eth_mac_w5500_sock_recvfrom(esp_eth_mac_t *mac, uint8_t sock, void *buffer, uint32_t length,
+                                          uint32_t *received, uint32_t *size, uint32_t *ip, uint16_t *port)
 {
   esp_err_t ret = ESP_OK;
-
+  w5500_spi_chain_t chain = { .count = 0, .bytes = 0 };
+  w5500_sock_status_t status;
+  uint8_t header[8] __attribute__((aligned(4)));
+  uint8_t command = W5500_SCR_RECV;
+  uint32_t len = 0;
+  uint16_t data_len = 0;
+
+  ESP_GOTO_ON_FALSE(mac && buffer && received && size && ip && port, ESP_ERR_INVALID_ARG, err, TAG,
+                    "Invalid argument");
   emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  ESP_GOTO_ON_FALSE(w5500_sock_allocated(emac, sock), ESP_ERR_INVALID_ARG, err, TAG, "Invalid socket");
 
-  esp_eth_mediator_t *eth = emac->eth;
-  esp_rom_gpio_pad_select_gpio(emac->int_gpio_num);
-  gpio_set_direction(emac->int_gpio_num, GPIO_MODE_INPUT);
-  gpio_set_pull_mode(emac->int_gpio_num, GPIO_PULLUP_ONLY);
-  gpio_set_intr_type(emac->int_gpio_num, GPIO_INTR_NEGEDGE); // active low
-  gpio_intr_enable(emac->int_gpio_num);
-  gpio_isr_handler_add(emac->int_gpio_num, w5500_isr_handler, emac);
-
-  ESP_GOTO_ON_ERROR(eth->on_state_changed(eth, ETH_STATE_LLINIT, NULL), err, TAG, "Lowlevel init failed");
+  *received = 0;
+  *size = 0;
 
-  /* reset w5500 */
-  ESP_GOTO_ON_ERROR(w5500_reset(emac), err, TAG, "Reset w5500 failed");
+  ESP_GOTO_ON_ERROR(w5500_session_begin(emac), err, TAG, "SPI lock timeout");
+  ESP_GOTO_ON_ERROR(w5500_read_sock_status(emac, sock, &status), err_session, TAG, "Read socket status failed");
 
-  /* verify chip id */
-  ESP_GOTO_ON_ERROR(w5500_verify_id(emac), err, TAG, "Verify chip ID failed");
+  if (status.rx_rsr < sizeof(header))
+  {
+    goto err_session;
+  }
 
-  /* default setup of internal registers */
-  ESP_GOTO_ON_ERROR(w5500_setup_default(emac), err, TAG, "W5500 default setup failed");
+  w5500_chain_add_sock_buffer(&chain, sock, emac->sock_mem_size[sock], false, header, sizeof(header), status.rx_rd);
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Read datagram header failed");
+  chain.count = 0;
+  chain.bytes = 0;
 
-  return ESP_OK;
+  data_len = (header[6] << 8) | header[7];
 
-err:
-  gpio_isr_handler_remove(emac->int_gpio_num);
-  gpio_reset_pin(emac->int_gpio_num);
-  eth->on_state_changed(eth, ETH_STATE_DEINIT, NULL);
+  if (data_len + sizeof(header) > status.rx_rsr)
+  {
+    // out of sync, drop everything received
+    ESP_LOGE(TAG, "Socket %d invalid datagram size (%d), dropping %d bytes", sock, data_len, status.rx_rsr);
+    data_len = status.rx_rsr - sizeof(header);
+  }
+  else
+  {
+    len = (length < data_len) ? length : data_len;
+    memcpy(ip, header, 4);
+    *port = (header[4] << 8) | header[5];
+    *size = data_len;
+  }
 
-  return ret;
-}
+  uint16_t rx_rd = __builtin_bswap16((uint16_t)(status.rx_rd + sizeof(header) + data_len));
 
-////////////////////////////////////////
+  if (len)
+  {
+    w5500_chain_add_sock_buffer(&chain, sock, emac->sock_mem_size[sock], false, buffer, len,
+                                status.rx_rd + sizeof(header));
+  }
 
-static esp_err_t emac_w5500_deinit(esp_eth_mac_t *mac)
-{
-  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
+  w5500_chain_add(&chain, W5500_REG_SOCK_RX_RD(sock), true, &rx_rd, sizeof(rx_rd));
+  w5500_chain_add(&chain, W5500_REG_SOCK_CR(sock), true, &command, sizeof(command));
+  ESP_GOTO_ON_ERROR(w5500_chain_run(emac, &chain), err_session, TAG, "Read datagram failed");
+  ESP_GOTO_ON_ERROR(w5500_wait_command(emac, sock, W5500_SCR_RECV, 100), err_session, TAG, "Issue RECV failed");
 
-  esp_eth_mediator_t *eth = emac->eth;
-  mac->stop(mac);
-  gpio_isr_handler_remove(emac->int_gpio_num);
-  gpio_reset_pin(emac->int_gpio_num);
-  eth->on_state_changed(eth, ETH_STATE_DEINIT, NULL);
+  W5500_STAT_ADD(emac, offload_rx_bytes, len);
+  *received = len;
 
-  return ESP_OK;
+err_session:
+  w5500_session_end(emac);
+err:
+  return ret;
 }
 
 ////////////////////////////////////////
 
-static esp_err_t emac_w5500_del(esp_eth_mac_t *mac)
+esp_eth_mac_t *esp_eth_mac_new_w5500(const eth_w5500_config_t *w5500_config, const eth_mac_config_t *mac_config)
 {
-  emac_w5500_t *emac = __containerof(mac, emac_w5500_t, parent);
-
-  vTaskDelete(emac->rx_task_hdl);
-  vSemaphoreDelete(emac->spi_lock);
-  free(emac);
-
-  return ESP_OK;
+  return esp_eth_mac_new_w5500_ext(w5500_config, mac_config, NULL);
 }
 
 ////////////////////////////////////////
 
-esp_eth_mac_t *esp_eth_mac_new_w5500(const eth_w5500_config_t *w5500_config, const eth_mac_config_t *mac_config)
+esp_eth_mac_t *esp_eth_mac_new_w5500_ext(const eth_w5500_config_t *w5500_config, const eth_mac_config_t *mac_config,
+                                         const eth_w5500_ext_config_t *ext_config)
 {
   esp_eth_mac_t *ret = NULL;
   emac_w5500_t *emac = NULL;
+  eth_w5500_ext_config_t default_ext_config = ETH_W5500_EXT_DEFAULT_CONFIG();
 
   ESP_GOTO_ON_FALSE(w5500_config && mac_config, NULL, err, TAG, "Invalid argument");
 
+  if (!ext_config)
+  {
+    ext_config = &default_ext_config;
+  }
+
+  ESP_GOTO_ON_FALSE(ext_config->rx_pool_depth <= ETH_W5500_RX_POOL_DEPTH_MAX, NULL, err, TAG, "Invalid RX pool depth");
+  ESP_GOTO_ON_FALSE(ext_config->tx_queue_depth <= ETH_W5500_TX_QUEUE_DEPTH_MAX, NULL, err, TAG,
+                    "Invalid TX queue depth");
+  ESP_GOTO_ON_FALSE(ext_config->offload_sockets <= ETH_W5500_OFFLOAD_SOCKETS_MAX, NULL, err, TAG,
+                    "Invalid number of offload sockets");
+
+  uint16_t sock0_mem_size = ext_config->offload_sockets ? W5500_HYBRID_SOCK0_MEM_SIZE : W5500_MEM_SIZE;
+
+  ESP_GOTO_ON_FALSE(!ext_config->rx_batch_size || (ext_config->rx_batch_size >= ETH_MAX_PACKET_SIZE + 2 &&
+                                                   ext_config->rx_batch_size <= sock0_mem_size),
+                    NULL, err, TAG, "Invalid RX batch size");
+  ESP_GOTO_ON_FALSE(ext_config->rx_poll_budget, NULL, err, TAG, "Invalid RX poll budget");
+  ESP_GOTO_ON_FALSE(ext_config->rx_task_core < portNUM_PROCESSORS, NULL, err, TAG, "Invalid RX task core");
+  ESP_GOTO_ON_FALSE(ext_config->tx_bulk_share && ext_config->tx_bulk_share <= 100, NULL, err, TAG,
+                    "Invalid TX bulk share");
+
   emac = calloc(1, sizeof(emac_w5500_t));
   ESP_GOTO_ON_FALSE(emac, NULL, err, TAG, "No mem for MAC instance");
 
@@ -897,6 +3609,43 @@ esp_eth_mac_t *esp_eth_mac_new_w5500(const eth_w5500_config_t *w5500_config, con
   emac->sw_reset_timeout_ms = mac_config->sw_reset_timeout_ms;
   emac->int_gpio_num = w5500_config->int_gpio_num;
   emac->spi_hdl = w5500_config->spi_hdl;
+  emac->spi_queue_threshold = ext_config->spi_queue_threshold;
+  emac->rx_poll_threshold = ext_config->rx_poll_threshold;
+  emac->rx_poll_budget = ext_config->rx_poll_budget;
+  emac->rx_pipeline = ext_config->rx_pipeline;
+  emac->mcast_filter = ext_config->mcast_filter;
+
+  for (int i = 0; i < ETH_W5500_RX_CLASS_MAX; i++)
+  {
+    ESP_GOTO_ON_FALSE(!ext_config->storm_limits[i].rate || ext_config->storm_limits[i].burst, NULL, err, TAG,
+                      "Invalid storm limit burst");
+    emac->storm[i].rate = ext_config->storm_limits[i].rate;
+    emac->storm[i].burst = ext_config->storm_limits[i].burst;
+    emac->storm[i].tokens = emac->storm[i].burst * 1000;
+    emac->storm[i].last_drop_us = -ETH_W5500_STORM_HOLD_MS * 1000LL;
+    emac->storm_limited |= emac->storm[i].rate != 0;
+  }
+  emac->int_level = ext_config->int_level;
+
+  /* socket 0 keeps half of the buffer memory in hybrid mode, the hardware sockets share the other half in the
+     largest power of two KB the chip supports */
+  emac->sock_mem_size[0] = sock0_mem_size;
+  emac->tx_bulk_limit = sock0_mem_size * ext_config->tx_bulk_share / 100;
+  emac->offload_sockets = ext_config->offload_sockets;
+  emac->next_local_port = W5500_LOCAL_PORT_FIRST;
+
+  for (uint32_t i = 1; i <= emac->offload_sockets; i++)
+  {
+    uint32_t share = (W5500_MEM_SIZE - sock0_mem_size) / emac->offload_sockets;
+
+    emac->sock_mem_size[i] = 1 << (31 - __builtin_clz(share));
+  }
+
+  atomic_init(&emac->rx_pool_refs, 1);
+  portMUX_INITIALIZE(&emac->stats_lock);
+  portMUX_INITIALIZE(&emac->mcast_lock);
+  portMUX_INITIALIZE(&emac->ethertype_lock);
+  w5500_stats_sample(emac, esp_timer_get_time());
   emac->parent.set_mediator = emac_w5500_set_mediator;
   emac->parent.init = emac_w5500_init;
   emac->parent.deinit = emac_w5500_deinit;
@@ -920,10 +3669,47 @@ esp_eth_mac_t *esp_eth_mac_new_w5500(const eth_w5500_config_t *w5500_config, con
   emac->spi_lock = xSemaphoreCreateMutex();
   ESP_GOTO_ON_FALSE(emac->spi_lock, NULL, err, TAG, "Create lock failed");
 
+  /* TX queue, completion is signalled by the SEND_OK interrupt */
+  if (ext_config->tx_queue_depth)
+  {
+    emac->tx_lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(emac->tx_lock, NULL, err, TAG, "Create TX lock failed");
+
+    for (int i = 0; i < ETH_W5500_TX_CLASS_MAX; i++)
+    {
+      emac->tx_space[i] = xSemaphoreCreateBinary();
+      ESP_GOTO_ON_FALSE(emac->tx_space[i], NULL, err, TAG, "Create TX semaphore failed");
+    }
+
+    emac->tx_queue_depth = ext_config->tx_queue_depth;
+  }
+
+  /* preallocate RX frame buffers, they live as long as the driver */
+  if (ext_config->rx_pool_depth)
+  {
+    emac->rx_pool = heap_caps_malloc(ext_config->rx_pool_depth * W5500_RX_POOL_SLOT_SIZE, MALLOC_CAP_DMA);
+    ESP_GOTO_ON_FALSE(emac->rx_pool, NULL, err, TAG, "No mem for RX pool");
+    emac->rx_pool_depth = ext_config->rx_pool_depth;
+    atomic_init(&emac->rx_pool_free, (emac->rx_pool_depth == ETH_W5500_RX_POOL_DEPTH_MAX) ? UINT32_MAX :
+                ((1U << emac->rx_pool_depth) - 1));
+  }
+
+  /* staging buffer for batched RX drain */
+  if (ext_config->rx_batch_size)
+  {
+    emac->rx_batch_buf = heap_caps_malloc(W5500_RX_ALIGN(ext_config->rx_batch_size), MALLOC_CAP_DMA);
+    ESP_GOTO_ON_FALSE(emac->rx_batch_buf, NULL, err, TAG, "No mem for RX batch buffer");
+    emac->rx_batch_size = ext_config->rx_batch_size;
+  }
+
   /* create w5500 task */
   BaseType_t core_num = tskNO_AFFINITY;
 
-  if (mac_config->flags & ETH_MAC_FLAG_PIN_TO_CORE)
+  if (ext_config->rx_task_core >= 0)
+  {
+    core_num = ext_config->rx_task_core;
+  }
+  else if (mac_config->flags & ETH_MAC_FLAG_PIN_TO_CORE)
   {
     core_num = cpu_hal_get_core_id();
   }
@@ -948,6 +3734,21 @@ err:
       vSemaphoreDelete(emac->spi_lock);
     }
 
+    if (emac->tx_lock)
+    {
+      vSemaphoreDelete(emac->tx_lock);
+    }
+
+    for (int i = 0; i < ETH_W5500_TX_CLASS_MAX; i++)
+    {
+      if (emac->tx_space[i])
+      {
+        vSemaphoreDelete(emac->tx_space[i]);
+      }
+    }
+
+    heap_caps_free(emac->rx_pool);
+    heap_caps_free(emac->rx_batch_buf);
     free(emac);
   }
 
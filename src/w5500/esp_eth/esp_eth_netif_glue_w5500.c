@@ -0,0 +1,304 @@
+/****************************************************************************************************************************
+  esp_eth_netif_glue_w5500.c
+
+  For Ethernet shields using ESP32_W5500 (ESP32 + W5500)
+
+  WebServer_ESP32_W5500 is a library for the ESP32 with Ethernet W5500 to run WebServer
+
+  Based on and modified from ESP32-IDF https://github.com/espressif/esp-idf
+  Built by Khoi Hoang https://github.com/khoih-prog/WebServer_ESP32_W5500
+  Licensed under GPLv3 license
+
+  Version: 1.5.3
+
+  Version Modified By   Date      Comments
+  ------- -----------  ---------- -----------
+  1.5.1   K Hoang      29/11/2022 Initial coding for ESP32_W5500 (ESP32 + W5500). Sync with WebServer_WT32_ETH01 v1.5.1
+  1.5.2   K Hoang      06/01/2023 Suppress compile error when using aggressive compile settings
+  1.5.3   K Hoang      11/01/2023 Using `SPI_DMA_CH_AUTO` and built-in ESP32 MAC
+ *****************************************************************************************************************************/
+
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "esp_netif.h"
+#include "esp_eth.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_event.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "esp_eth_w5500.h"
+
+////////////////////////////////////////
+
+static const char *TAG = "w5500.glue";
+
+// pbuf chains up to this many segments are described on the stack
+#define W5500_GLUE_TX_SEGMENTS    8
+
+////////////////////////////////////////
+
+// The esp-netif io driver handle, must start with esp_netif_driver_base_t
+typedef struct w5500_netif_glue_s
+{
+  esp_netif_driver_base_t base;
+  esp_eth_handle_t eth_driver;
+  esp_eth_mac_t *mac;
+  netif_linkoutput_fn linkoutput;   // esp-netif's own linkoutput, still used for single pbufs
+  esp_event_handler_instance_t eth_event_handler;
+  atomic_uint_least32_t refs;       // 1 held by the owner + received frames out with lwIP, the last one frees the glue
+} w5500_netif_glue_t;
+
+////////////////////////////////////////
+
+// Drop one reference, the last one (glue deleted, every received frame back) frees the glue
+static void w5500_glue_unref(w5500_netif_glue_t *glue)
+{
+  if (atomic_fetch_sub_explicit(&glue->refs, 1, memory_order_acq_rel) == 1)
+  {
+    free(glue);
+  }
+}
+
+////////////////////////////////////////
+
+// esp-netif wraps the driver buffer in a reference pbuf, the frame reaches tcpip_input without another copy
+// (unless CONFIG_LWIP_L2_TO_L3_COPY is set). The buffer comes back through w5500_glue_free_rx_buffer(), which may
+// be after the glue was deleted, so every frame holds a reference
+static esp_err_t w5500_glue_input(esp_eth_handle_t eth_handle, uint8_t *buffer, uint32_t length, void *priv)
+{
+  w5500_netif_glue_t *glue = (w5500_netif_glue_t *)priv;
+
+  atomic_fetch_add_explicit(&glue->refs, 1, memory_order_relaxed);
+
+  return esp_netif_receive(glue->base.netif, buffer, length, NULL);
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_glue_transmit(void *h, void *buffer, size_t length)
+{
+  w5500_netif_glue_t *glue = (w5500_netif_glue_t *)h;
+
+  return esp_eth_transmit(glue->eth_driver, buffer, length);
+}
+
+////////////////////////////////////////
+
+// called by lwIP when the pbuf wrapping a received frame is freed
+static void w5500_glue_free_rx_buffer(void *h, void *buffer)
+{
+  w5500_netif_glue_t *glue = (w5500_netif_glue_t *)h;
+
+  // the buffer holds its own reference on the MAC instance, so glue->mac is valid even after the driver uninstall
+  esp_eth_mac_w5500_free_rx_buffer(glue->mac, buffer);
+  w5500_glue_unref(glue);
+}
+
+////////////////////////////////////////
+
+// lwIP linkoutput. esp-netif flattens every pbuf chain into a fresh pbuf before handing it to the driver,
+// here the chain is passed down as segments and each one is written straight into the w5500 TX ring
+static err_t w5500_glue_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  w5500_netif_glue_t *glue = (w5500_netif_glue_t *)esp_netif_get_io_driver(esp_netif_get_handle_from_netif_impl(
+                               netif));
+  eth_w5500_tx_segment_t stack_segments[W5500_GLUE_TX_SEGMENTS];
+  eth_w5500_tx_segment_t *segments = stack_segments;
+  uint32_t count = 0;
+  esp_err_t ret;
+
+  if (p->next == NULL)
+  {
+    return glue->linkoutput(netif, p);
+  }
+
+  for (struct pbuf *q = p; q; q = q->next)
+  {
+    count++;
+  }
+
+  if (count > W5500_GLUE_TX_SEGMENTS)
+  {
+    // only the segment list is allocated, the payload is still not copied
+    segments = malloc(count * sizeof(eth_w5500_tx_segment_t));
+
+    if (segments == NULL)
+    {
+      return ERR_MEM;
+    }
+  }
+
+  count = 0;
+
+  for (struct pbuf *q = p; q; q = q->next)
+  {
+    if (q->len)
+    {
+      segments[count].buffer = q->payload;
+      segments[count].length = q->len;
+      count++;
+    }
+  }
+
+  ret = esp_eth_mac_w5500_transmit_segments(glue->mac, segments, count);
+
+  if (segments != stack_segments)
+  {
+    free(segments);
+  }
+
+  if (ret == ESP_OK)
+  {
+    return ERR_OK;
+  }
+
+  return (ret == ESP_ERR_NO_MEM) ? ERR_MEM : ERR_IF;
+}
+
+////////////////////////////////////////
+
+// The lwIP netif only exists once esp-netif has been started, hook its linkoutput then
+static void w5500_glue_hook_linkoutput(w5500_netif_glue_t *glue)
+{
+  struct netif *netif = (struct netif *)esp_netif_get_netif_impl(glue->base.netif);
+
+  if (netif && netif->linkoutput && netif->linkoutput != w5500_glue_linkoutput)
+  {
+    glue->linkoutput = netif->linkoutput;
+    netif->linkoutput = w5500_glue_linkoutput;
+    ESP_LOGD(TAG, "scatter-gather TX enabled");
+  }
+}
+
+////////////////////////////////////////
+
+// Drive the esp-netif of this w5500 only. The default Ethernet handlers act on the one default Ethernet netif
+// whichever driver posted the event, so they can't serve several w5500 instances
+static void w5500_glue_eth_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+  w5500_netif_glue_t *glue = (w5500_netif_glue_t *)arg;
+
+  if (*(esp_eth_handle_t *)event_data != glue->eth_driver)
+  {
+    return;
+  }
+
+  switch (event_id)
+  {
+    case ETHERNET_EVENT_START:
+      esp_netif_action_start(glue->base.netif, base, event_id, event_data);
+      w5500_glue_hook_linkoutput(glue);
+      break;
+
+    case ETHERNET_EVENT_STOP:
+      esp_netif_action_stop(glue->base.netif, base, event_id, event_data);
+      break;
+
+    case ETHERNET_EVENT_CONNECTED:
+      esp_netif_action_connected(glue->base.netif, base, event_id, event_data);
+      break;
+
+    case ETHERNET_EVENT_DISCONNECTED:
+      esp_netif_action_disconnected(glue->base.netif, base, event_id, event_data);
+      break;
+
+    default:
+      break;
+  }
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_glue_post_attach(esp_netif_t *esp_netif, void *args)
+{
+  uint8_t eth_mac[6];
+  w5500_netif_glue_t *glue = (w5500_netif_glue_t *)args;
+
+  glue->base.netif = esp_netif;
+
+  esp_eth_update_input_path(glue->eth_driver, w5500_glue_input, glue);
+
+  // set driver related config to esp-netif
+  esp_netif_driver_ifconfig_t driver_ifconfig =
+  {
+    .handle                 = glue,
+    .transmit               = w5500_glue_transmit,
+    .driver_free_rx_buffer  = w5500_glue_free_rx_buffer
+  };
+
+  ESP_ERROR_CHECK(esp_netif_set_driver_config(esp_netif, &driver_ifconfig));
+
+  esp_eth_ioctl(glue->eth_driver, ETH_CMD_G_MAC_ADDR, eth_mac);
+  ESP_LOGI(TAG, "%02x:%02x:%02x:%02x:%02x:%02x", eth_mac[0], eth_mac[1], eth_mac[2], eth_mac[3], eth_mac[4],
+           eth_mac[5]);
+
+  esp_netif_set_mac(esp_netif, eth_mac);
+
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(ETH_EVENT, ESP_EVENT_ANY_ID, w5500_glue_eth_event_handler,
+                                                      glue, &glue->eth_event_handler));
+
+  ESP_LOGI(TAG, "w5500 attached to netif");
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
+
+esp_eth_w5500_netif_glue_handle_t esp_eth_w5500_new_netif_glue(esp_eth_handle_t eth_hdl, esp_eth_mac_t *mac)
+{
+  w5500_netif_glue_t *ret = NULL;
+
+  ESP_GOTO_ON_FALSE(eth_hdl && mac, NULL, err, TAG, "Invalid argument");
+
+  w5500_netif_glue_t *glue = calloc(1, sizeof(w5500_netif_glue_t));
+  ESP_GOTO_ON_FALSE(glue, NULL, err, TAG, "No mem for netif glue");
+
+  glue->eth_driver = eth_hdl;
+  glue->mac = mac;
+  glue->base.post_attach = w5500_glue_post_attach;
+  atomic_init(&glue->refs, 1);
+  esp_eth_increase_reference(eth_hdl);
+
+  return glue;
+
+err:
+  return ret;
+}
+
+////////////////////////////////////////
+
+esp_err_t esp_eth_w5500_del_netif_glue(esp_eth_w5500_netif_glue_handle_t glue)
+{
+  if (glue)
+  {
+    if (glue->eth_event_handler)
+    {
+      esp_event_handler_instance_unregister(ETH_EVENT, ESP_EVENT_ANY_ID, glue->eth_event_handler);
+    }
+
+    esp_eth_decrease_reference(glue->eth_driver);
+
+    // lwIP may still hold received frames, the glue stays until the last of them is freed
+    w5500_glue_unref(glue);
+  }
+
+  return ESP_OK;
+}
+
+////////////////////////////////////////
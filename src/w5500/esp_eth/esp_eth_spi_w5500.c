@@ -28,38 +28,236 @@
 #include "esp_event.h"
 #include "driver/gpio.h"
 #include "esp_eth_w5500.h"
+#include "w5500.h"
 #include "driver/spi_master.h"
 
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_heap_caps.h"
 
 static const char *TAG = "w5500.spi";
 
+#define W5500_SPI_TUNE_APB_HZ       (80 * 1000 * 1000) // SPI clocks are APB divided by an integer
+#define W5500_SPI_TUNE_TEST_SIZE    (1024)             // fits the TX buffer of SOCK0 even before it's resized to 16KB
+#define W5500_SPI_TUNE_ROUNDS       (4)
+#define W5500_SPI_TUNE_SOAK_ROUNDS  (32)               // the clock taken must also survive a longer run
+
 ////////////////////////////////////////
 
-esp_eth_mac_t* w5500_new_mac( spi_device_handle_t *spi_handle, int INT_GPIO )
+esp_eth_mac_t* w5500_new_mac( spi_device_handle_t *spi_handle, int INT_GPIO, const eth_mac_config_t *MAC_CONFIG,
+                              const eth_w5500_ext_config_t *EXT_CONFIG )
 {
   eth_w5500_config_t w5500_config = ETH_W5500_DEFAULT_CONFIG( *spi_handle );
   w5500_config.int_gpio_num = INT_GPIO;
 
-  eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+  eth_mac_config_t mac_config = *MAC_CONFIG;
 
   //eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
   //phy_config.reset_gpio_num = -1;
 
   mac_config.smi_mdc_gpio_num  = -1; // w5500 doesn't have SMI interface
   mac_config.smi_mdio_gpio_num = -1;
-  mac_config.rx_task_prio      = 1;
 
-  return esp_eth_mac_new_w5500( &w5500_config, &mac_config );
+  return esp_eth_mac_new_w5500_ext( &w5500_config, &mac_config, EXT_CONFIG );
+}
+
+////////////////////////////////////////
+
+static esp_err_t w5500_spi_tune_access(spi_device_handle_t spi_handle, bool write, uint8_t *buffer, uint32_t len)
+{
+  spi_transaction_t trans =
+  {
+    .cmd = (W5500_MEM_SOCK_TX(0, 0) >> W5500_ADDR_OFFSET),
+    .addr = ((W5500_MEM_SOCK_TX(0, 0) & 0xFFFF) |
+             ((write ? W5500_ACCESS_MODE_WRITE : W5500_ACCESS_MODE_READ) << W5500_RWB_OFFSET) | W5500_SPI_OP_MODE_VDM),
+    .length = 8 * len,
+  };
+
+  if (write)
+  {
+    trans.tx_buffer = buffer;
+  }
+  else
+  {
+    trans.rx_buffer = buffer;
+  }
+
+  return spi_device_polling_transmit(spi_handle, &trans);
+}
+
+////////////////////////////////////////
+
+static void w5500_spi_tune_pattern(uint8_t *buffer, uint32_t pattern, uint32_t round)
+{
+  uint32_t lfsr = 0xACE1u + round;
+
+  for (uint32_t i = 0; i < W5500_SPI_TUNE_TEST_SIZE; i++)
+  {
+    switch (pattern)
+    {
+      case 0:
+        buffer[i] = (i & 1) ? 0x55 : 0xAA;            // every line toggling every bit
+        break;
+
+      case 1:
+        buffer[i] = (i & 1) ? 0x00 : 0xFF;            // long runs, then full swings
+        break;
+
+      case 2:
+        buffer[i] = 1 << ((i + round) & 7);           // walking one
+        break;
+
+      default:
+        lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u); // pseudo random
+        buffer[i] = lfsr;
+        break;
+    }
+  }
+}
+
+////////////////////////////////////////
+
+// Write / read back test patterns through the SOCK0 TX buffer memory at the device's clock
+static bool w5500_spi_tune_verify(spi_device_handle_t spi_handle, uint8_t *tx_buf, uint8_t *rx_buf, uint32_t rounds)
+{
+  for (uint32_t round = 0; round < rounds; round++)
+  {
+    for (uint32_t pattern = 0; pattern < 4; pattern++)
+    {
+      w5500_spi_tune_pattern(tx_buf, pattern, round);
+      memset(rx_buf, ~tx_buf[0], W5500_SPI_TUNE_TEST_SIZE);
+
+      if (w5500_spi_tune_access(spi_handle, true, tx_buf, W5500_SPI_TUNE_TEST_SIZE) != ESP_OK ||
+          w5500_spi_tune_access(spi_handle, false, rx_buf, W5500_SPI_TUNE_TEST_SIZE) != ESP_OK ||
+          memcmp(tx_buf, rx_buf, W5500_SPI_TUNE_TEST_SIZE))
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+////////////////////////////////////////
+
+static bool w5500_spi_tune_step(int SPIHOST, spi_device_interface_config_t *devcfg, uint32_t clock_hz,
+                                uint8_t *tx_buf, uint8_t *rx_buf, uint32_t rounds)
+{
+  spi_device_handle_t spi_handle = NULL;
+  bool passed = false;
+
+  devcfg->clock_speed_hz = clock_hz;
+  devcfg->cs_ena_posttrans = w5500_cal_spi_cs_hold_time((clock_hz + 999999) / 1000000);
+
+  // fails e.g. when the pins go through the GPIO matrix and the clock is too fast for full duplex reads
+  if (spi_bus_add_device(SPIHOST, devcfg, &spi_handle) == ESP_OK)
+  {
+    passed = w5500_spi_tune_verify(spi_handle, tx_buf, rx_buf, rounds);
+    spi_bus_remove_device(spi_handle);
+  }
+
+  return passed;
+}
+
+////////////////////////////////////////
+
+// Next APB divided clock below clock_hz, not below floor_hz
+static uint32_t w5500_spi_tune_slower(uint32_t clock_hz, uint32_t floor_hz)
+{
+  uint32_t slower_hz = W5500_SPI_TUNE_APB_HZ / (W5500_SPI_TUNE_APB_HZ / clock_hz + 1);
+
+  return (slower_hz > floor_hz) ? slower_hz : floor_hz;
+}
+
+////////////////////////////////////////
+
+// Step SCLK up from the requested clock through the APB dividers up to max_mhz, then back off one divider from the
+// fastest clock passing the pattern test, as margin. That one has to pass a longer soak too, else the next slower
+// divider is tried. Falls back to the requested clock when nothing faster is clean
+static uint32_t w5500_spi_autotune(int SPIHOST, spi_device_interface_config_t devcfg, int start_mhz, int max_mhz)
+{
+  uint32_t start_hz = start_mhz * 1000 * 1000;
+  uint32_t best_hz = start_hz;
+  uint8_t *tx_buf = heap_caps_malloc(W5500_SPI_TUNE_TEST_SIZE, MALLOC_CAP_DMA);
+  uint8_t *rx_buf = heap_caps_malloc(W5500_SPI_TUNE_TEST_SIZE, MALLOC_CAP_DMA);
+
+  if (!tx_buf || !rx_buf)
+  {
+    ESP_LOGE(TAG, "%s(%d): No mem for SPI auto-tune", __FUNCTION__, __LINE__);
+    goto out;
+  }
+
+  if (max_mhz > ETH_W5500_SPI_CLOCK_MAX_MHZ)
+  {
+    max_mhz = ETH_W5500_SPI_CLOCK_MAX_MHZ;
+  }
+
+  for (uint32_t div = W5500_SPI_TUNE_APB_HZ / start_hz; div >= 1; div--)
+  {
+    uint32_t clock_hz = W5500_SPI_TUNE_APB_HZ / div;
+
+    if (clock_hz <= best_hz)
+    {
+      continue;
+    }
+
+    if (clock_hz > (uint32_t)max_mhz * 1000 * 1000 ||
+        !w5500_spi_tune_step(SPIHOST, &devcfg, clock_hz, tx_buf, rx_buf, W5500_SPI_TUNE_ROUNDS))
+    {
+      break;
+    }
+
+    ESP_LOGD(TAG, "SPI clock %u Hz passed", clock_hz);
+    best_hz = clock_hz;
+  }
+
+  // margin: the highest passing step is the edge of what the wiring carries, run one divider below it
+  if (best_hz > start_hz)
+  {
+    best_hz = w5500_spi_tune_slower(best_hz, start_hz);
+  }
+
+  while (best_hz > start_hz &&
+         !w5500_spi_tune_step(SPIHOST, &devcfg, best_hz, tx_buf, rx_buf, W5500_SPI_TUNE_SOAK_ROUNDS))
+  {
+    ESP_LOGW(TAG, "SPI clock %u Hz failed soak test", best_hz);
+    best_hz = w5500_spi_tune_slower(best_hz, start_hz);
+  }
+
+out:
+  heap_caps_free(tx_buf);
+  heap_caps_free(rx_buf);
+
+  return best_hz;
+}
+
+////////////////////////////////////////
+
+// One pass of the pattern test at a clock tuned on an earlier boot, the wiring may have changed since
+static bool w5500_spi_check_clock(int SPIHOST, spi_device_interface_config_t devcfg, uint32_t clock_hz)
+{
+  uint8_t *tx_buf = heap_caps_malloc(W5500_SPI_TUNE_TEST_SIZE, MALLOC_CAP_DMA);
+  uint8_t *rx_buf = heap_caps_malloc(W5500_SPI_TUNE_TEST_SIZE, MALLOC_CAP_DMA);
+  bool passed = tx_buf && rx_buf && w5500_spi_tune_step(SPIHOST, &devcfg, clock_hz, tx_buf, rx_buf, 1);
+
+  heap_caps_free(tx_buf);
+  heap_caps_free(rx_buf);
+
+  return passed;
 }
 
 ////////////////////////////////////////
 
 esp_eth_mac_t* w5500_begin(int MISO_GPIO, int MOSI_GPIO, int SCLK_GPIO, int CS_GPIO, int INT_GPIO, int SPICLOCK_MHZ,
-                           int SPIHOST)
+                           int SPIHOST, int SPI_QUEUE_SIZE, int DMA_CHANNEL, int SPICLOCK_MAX_MHZ,
+                           uint32_t *SPICLOCK_HZ, const eth_mac_config_t *MAC_CONFIG,
+                           const eth_w5500_ext_config_t *EXT_CONFIG)
 {
-  if (ESP_OK != gpio_install_isr_service(0))
+  esp_err_t err = gpio_install_isr_service(0);
+
+  // ESP_ERR_INVALID_STATE: already installed, e.g. by another w5500 instance
+  if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE))
   {
     ESP_LOGE(TAG, "%s(%d): Error gpio_install_isr_service", __FUNCTION__, __LINE__);
 
@@ -74,9 +272,18 @@ esp_eth_mac_t* w5500_begin(int MISO_GPIO, int MOSI_GPIO, int SCLK_GPIO, int CS_G
     .sclk_io_num   = SCLK_GPIO,
     .quadwp_io_num = -1,
     .quadhd_io_num = -1,
+    // a batched RX drain may move up to the whole 16KB socket buffer in one transaction
+    .max_transfer_sz = 16 * 1024,
   };
 
-  if ( ESP_OK != spi_bus_initialize( SPIHOST, &buscfg, SPI_DMA_CH_AUTO ))
+  err = spi_bus_initialize( SPIHOST, &buscfg, DMA_CHANNEL );
+
+  // ESP_ERR_INVALID_STATE: bus already up, another w5500 shares it with its own CS, the pins given here are unused
+  if (err == ESP_ERR_INVALID_STATE)
+  {
+    ESP_LOGI(TAG, "SPI host %d already initialized, sharing the bus", SPIHOST);
+  }
+  else if (err != ESP_OK)
   {
     ESP_LOGE(TAG, "%s(%d): Error spi_bus_initialize", __FUNCTION__, __LINE__);
 
@@ -90,10 +297,35 @@ esp_eth_mac_t* w5500_begin(int MISO_GPIO, int MOSI_GPIO, int SCLK_GPIO, int CS_G
     .mode = 0,
     .clock_speed_hz = SPICLOCK_MHZ * 1000 * 1000,
     .spics_io_num = CS_GPIO,
-    .queue_size = 20,
+    .queue_size = SPI_QUEUE_SIZE,
     .cs_ena_posttrans = w5500_cal_spi_cs_hold_time(SPICLOCK_MHZ),
   };
 
+  /* a clock tuned on an earlier boot (fast boot) is checked with one pass of the pattern test. Without one, or when
+     it fails, optionally find the fastest clock the board's wiring carries cleanly */
+  if (*SPICLOCK_HZ && !w5500_spi_check_clock(SPIHOST, devcfg, *SPICLOCK_HZ))
+  {
+    ESP_LOGW(TAG, "Cached SPI clock %u Hz failed the pattern test, tuning again", *SPICLOCK_HZ);
+    *SPICLOCK_HZ = 0;
+  }
+
+  if (*SPICLOCK_HZ)
+  {
+    devcfg.clock_speed_hz = *SPICLOCK_HZ;
+    devcfg.cs_ena_posttrans = w5500_cal_spi_cs_hold_time((*SPICLOCK_HZ + 999999) / 1000000);
+  }
+  else if (SPICLOCK_MAX_MHZ > SPICLOCK_MHZ)
+  {
+    uint32_t clock_hz = w5500_spi_autotune(SPIHOST, devcfg, SPICLOCK_MHZ, SPICLOCK_MAX_MHZ);
+
+    devcfg.clock_speed_hz = clock_hz;
+    devcfg.cs_ena_posttrans = w5500_cal_spi_cs_hold_time((clock_hz + 999999) / 1000000);
+
+    ESP_LOGI(TAG, "SPI clock auto-tuned to %u Hz, cs_ena_posttrans=%d", clock_hz, devcfg.cs_ena_posttrans);
+  }
+
+  *SPICLOCK_HZ = devcfg.clock_speed_hz;
+
   spi_device_handle_t spi_handle = NULL;
 
   if (ESP_OK != spi_bus_add_device( SPIHOST, &devcfg, &spi_handle ))
@@ -103,7 +335,7 @@ esp_eth_mac_t* w5500_begin(int MISO_GPIO, int MOSI_GPIO, int SCLK_GPIO, int CS_G
     return NULL;
   }
 
-  return w5500_new_mac( &spi_handle, INT_GPIO );
+  return w5500_new_mac( &spi_handle, INT_GPIO, MAC_CONFIG, EXT_CONFIG );
 }
 
 ////////////////////////////////////////
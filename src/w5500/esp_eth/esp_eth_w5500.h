@@ -40,6 +40,7 @@ extern "C" {
 
 ////////////////////////////////////////
 
+#include "esp_eth.h"
 #include "esp_eth_phy.h"
 #include "esp_eth_mac.h"
 #include "driver/spi_master.h"
@@ -48,6 +49,413 @@ extern "C" {
 
 #define CS_HOLD_TIME_MIN_NS     210
 
+// Fastest SCLK the w5500 accepts (80MHz in the datasheet, 33.3MHz guaranteed), and the most cs_ena_posttrans allows
+#define ETH_W5500_SPI_CLOCK_MAX_MHZ     80
+#define ETH_W5500_CS_POSTTRANS_MAX      16
+
+////////////////////////////////////////
+
+// Max number of preallocated RX frame buffers (one bit per buffer in the pool free mask)
+#define ETH_W5500_RX_POOL_DEPTH_MAX     32
+
+#ifndef ETH_W5500_RX_POOL_DEPTH
+  #define ETH_W5500_RX_POOL_DEPTH       8
+#endif
+
+// Max number of frames in the TX queue
+#define ETH_W5500_TX_QUEUE_DEPTH_MAX    16
+
+// Frames which may wait in the w5500 TX ring behind the one being sent, 0 => transmit blocks until SEND_OK
+#ifndef ETH_W5500_TX_QUEUE_DEPTH
+  #define ETH_W5500_TX_QUEUE_DEPTH      8
+#endif
+
+// Share of the socket 0 TX ring (percent) bulk class frames may occupy at once, the rest stays free for the others
+#ifndef ETH_W5500_TX_BULK_SHARE
+  #define ETH_W5500_TX_BULK_SHARE       50
+#endif
+
+// SPI sequences moving at least this many bytes are queued to the SPI DMA instead of polled
+#ifndef ETH_W5500_SPI_QUEUE_THRESHOLD
+  #define ETH_W5500_SPI_QUEUE_THRESHOLD 256
+#endif
+
+// Staging buffer size for batched RX drain, 0 => one SPI read sequence per frame, straight into its buffer (no copy).
+// Batching saves SPI transactions on bursts of small frames but copies every frame out of the staging buffer
+#ifndef ETH_W5500_RX_BATCH_SIZE
+  #define ETH_W5500_RX_BATCH_SIZE       0
+#endif
+
+// Read each RX frame's payload and the next frame's header in one queued DMA chain, frames go to the stack after the
+// run. Takes precedence over batching
+#ifndef ETH_W5500_RX_PIPELINE
+  #define ETH_W5500_RX_PIPELINE         false
+#endif
+
+// Frames drained in one interrupt wakeup from which the RX task masks the interrupt and polls, 0 => never poll
+#ifndef ETH_W5500_RX_POLL_THRESHOLD
+  #define ETH_W5500_RX_POLL_THRESHOLD   4
+#endif
+
+// Frames received per poll round before the RX task yields the CPU
+#ifndef ETH_W5500_RX_POLL_BUDGET
+  #define ETH_W5500_RX_POLL_BUDGET      16
+#endif
+
+// Hardware TCP / UDP sockets (1 - n) next to the MACRAW socket 0, which keeps 8KB of each buffer memory then.
+// 0 => socket 0 gets all 16KB, everything goes through lwIP
+#define ETH_W5500_OFFLOAD_SOCKETS_MAX   7
+
+#ifndef ETH_W5500_OFFLOAD_SOCKETS
+  #define ETH_W5500_OFFLOAD_SOCKETS     0
+#endif
+
+// Multicast frames are only passed to the stack for groups subscribed through esp_eth_mac_w5500_mcast_filter(),
+// others are dropped after the Ethernet header has been read. Broadcast always passes. Off by default: with it on,
+// multicast received without a join through lwIP's IGMP / MLD (raw callbacks, all-multicast users) is lost
+#ifndef ETH_W5500_MCAST_FILTER
+  #define ETH_W5500_MCAST_FILTER        false
+#endif
+
+// Multicast MAC addresses the filter holds, beyond that every multicast frame passes
+#ifndef ETH_W5500_MCAST_FILTER_SIZE
+  #define ETH_W5500_MCAST_FILTER_SIZE   16
+#endif
+
+// RX storm protection, token bucket per traffic class: sustained frames per second and burst, rate 0 => unlimited.
+// Frames over the limit are discarded in the ring after the Ethernet header has been read. Off by default, set the
+// rates to opt in
+
+// A class counts as storming while its last drop is more recent than this
+#ifndef ETH_W5500_STORM_HOLD_MS
+  #define ETH_W5500_STORM_HOLD_MS       1000
+#endif
+
+// The bursts go with rates of e.g. 1000 multicast, 500 broadcast and 200 ARP frames per second
+#ifndef ETH_W5500_STORM_UCAST_RATE
+  #define ETH_W5500_STORM_UCAST_RATE    0
+#endif
+
+#ifndef ETH_W5500_STORM_UCAST_BURST
+  #define ETH_W5500_STORM_UCAST_BURST   0
+#endif
+
+#ifndef ETH_W5500_STORM_MCAST_RATE
+  #define ETH_W5500_STORM_MCAST_RATE    0
+#endif
+
+#ifndef ETH_W5500_STORM_MCAST_BURST
+  #define ETH_W5500_STORM_MCAST_BURST   200
+#endif
+
+#ifndef ETH_W5500_STORM_BCAST_RATE
+  #define ETH_W5500_STORM_BCAST_RATE    0
+#endif
+
+#ifndef ETH_W5500_STORM_BCAST_BURST
+  #define ETH_W5500_STORM_BCAST_BURST   100
+#endif
+
+#ifndef ETH_W5500_STORM_ARP_RATE
+  #define ETH_W5500_STORM_ARP_RATE      0
+#endif
+
+#ifndef ETH_W5500_STORM_ARP_BURST
+  #define ETH_W5500_STORM_ARP_BURST     50
+#endif
+
+// EtherTypes which may be delivered to their own callback instead of lwIP, see esp_eth_mac_w5500_register_ethertype()
+#ifndef ETH_W5500_ETHERTYPE_HANDLERS_MAX
+  #define ETH_W5500_ETHERTYPE_HANDLERS_MAX  4
+#endif
+
+// INTLEVEL, interrupt re-assert delay in units of 4 PLL clocks (~26.7ns), 0xFFFF => ~1.7ms
+#ifndef ETH_W5500_INT_LEVEL
+  #define ETH_W5500_INT_LEVEL           0xFFFF
+#endif
+
+////////////////////////////////////////
+
+/**
+   @brief Traffic classes of the RX storm limiter, ARP is told apart by its EtherType whatever the destination
+
+*/
+typedef enum
+{
+  ETH_W5500_RX_UNICAST,
+  ETH_W5500_RX_MULTICAST,
+  ETH_W5500_RX_BROADCAST,
+  ETH_W5500_RX_ARP,
+  ETH_W5500_RX_CLASS_MAX,
+} eth_w5500_rx_class_t;
+
+/**
+   @brief Token bucket of one traffic class
+
+*/
+typedef struct
+{
+  uint32_t rate;            /*!< Sustained frames per second, 0 => not limited */
+  uint32_t burst;           /*!< Frames accepted back to back after a quiet period, >= 1 when rate is set */
+} eth_w5500_storm_limit_t;
+
+// positional, indexed by eth_w5500_rx_class_t
+#define ETH_W5500_STORM_DEFAULT_LIMITS                                  \
+  {                                                                     \
+    { ETH_W5500_STORM_UCAST_RATE, ETH_W5500_STORM_UCAST_BURST },        \
+    { ETH_W5500_STORM_MCAST_RATE, ETH_W5500_STORM_MCAST_BURST },        \
+    { ETH_W5500_STORM_BCAST_RATE, ETH_W5500_STORM_BCAST_BURST },        \
+    { ETH_W5500_STORM_ARP_RATE, ETH_W5500_STORM_ARP_BURST },            \
+  }
+
+////////////////////////////////////////
+
+/**
+   @brief Receive callback of a registered EtherType, runs in the w5500 RX task
+
+   The frame (Ethernet header included) lies in the driver's receive buffer, an RX pool slot or the batch staging
+   buffer, and is only valid until the callback returns. It may be modified, e.g. turned into the reply in place.
+
+   It is called outside the SPI session, so sending from it (esp_eth_transmit()) works, but it must not block: the
+   w5500 task is the one completing transmissions, so with a full TX queue a send from here fails at once with
+   ESP_ERR_NO_MEM instead of waiting. Received frames wait in the W5500 ring while the callback runs.
+
+*/
+typedef void (*eth_w5500_ethertype_cb_t)(uint8_t *frame, uint32_t length, void *arg);
+
+////////////////////////////////////////
+
+/**
+   @brief TX priority classes, in order of precedence
+
+   With the TX queue enabled, a frame only enters the w5500 TX ring while no frame of a higher class is waiting for
+   room. Non-strict frames leave a queue slot and a full frame of ring space to the strict class (TX queue depth > 2),
+   bulk frames also stop at eth_w5500_ext_config_t::tx_bulk_share of the ring.
+   Default classification: VLAN PCP 5 - 7, DSCP 40 and above (CS5, EF, CS6, CS7) and ARP => strict, VLAN PCP 1,
+   DSCP CS1 and LE => bulk, everything else normal. Sockets choose theirs through the IP_TOS / IPV6_TCLASS option.
+
+*/
+typedef enum
+{
+  ETH_W5500_TX_STRICT,
+  ETH_W5500_TX_NORMAL,
+  ETH_W5500_TX_BULK,
+  ETH_W5500_TX_CLASS_MAX,
+} eth_w5500_tx_class_t;
+
+/**
+   @brief TX classifier hook, runs in the transmitting task (mostly lwIP's tcpip thread) for every frame
+
+   Gets the first segment of the frame, usually all of its headers. ETH_W5500_TX_CLASS_MAX => default classification.
+
+*/
+typedef eth_w5500_tx_class_t (*eth_w5500_tx_classifier_t)(const uint8_t *frame, uint32_t length, void *arg);
+
+////////////////////////////////////////
+
+/**
+   @brief w5500 driver specific configuration, not covered by eth_w5500_config_t / eth_mac_config_t
+
+*/
+typedef struct
+{
+  uint32_t rx_pool_depth;   /*!< Number of preallocated RX frame buffers, 0 disables the pool */
+  uint32_t rx_batch_size;   /*!< Batched RX staging buffer (ETH_MAX_PACKET_SIZE + 2 - 16384 bytes), 0 disables */
+  uint32_t tx_queue_depth;  /*!< Asynchronous TX queue depth (0 - ETH_W5500_TX_QUEUE_DEPTH_MAX), 0 disables */
+  uint32_t spi_queue_threshold; /*!< Bytes from which SPI sequences use queued DMA, UINT32_MAX => always poll */
+  uint32_t rx_poll_threshold; /*!< Frames per interrupt wakeup switching RX to polled mode, 0 => interrupts only */
+  uint32_t rx_poll_budget;  /*!< Frames per poll round before yielding, must not be 0 */
+  uint16_t int_level;       /*!< INTLEVEL register value, interrupt re-assert delay */
+  int rx_task_core;         /*!< Core the RX task is pinned to, -1 => as set by ETH_MAC_FLAG_PIN_TO_CORE */
+  bool rx_pipeline;         /*!< Pipelined RX, one queued DMA chain per frame: its payload and the next header */
+  uint32_t offload_sockets; /*!< Hardware TCP / UDP sockets (0 - ETH_W5500_OFFLOAD_SOCKETS_MAX), 0 disables */
+  bool mcast_filter;        /*!< Drop multicast frames of groups not subscribed, see esp_eth_mac_w5500_mcast_filter() */
+  eth_w5500_storm_limit_t storm_limits[ETH_W5500_RX_CLASS_MAX]; /*!< RX storm limiter, per eth_w5500_rx_class_t */
+  uint32_t tx_bulk_share;   /*!< Percent of the TX ring (1 - 100) bulk frames may occupy, with the TX queue enabled */
+} eth_w5500_ext_config_t;
+
+#define ETH_W5500_EXT_DEFAULT_CONFIG()              \
+  {                                                 \
+    .rx_pool_depth = ETH_W5500_RX_POOL_DEPTH,       \
+    .rx_batch_size = ETH_W5500_RX_BATCH_SIZE,       \
+    .tx_queue_depth = ETH_W5500_TX_QUEUE_DEPTH,     \
+    .spi_queue_threshold = ETH_W5500_SPI_QUEUE_THRESHOLD, \
+    .rx_poll_threshold = ETH_W5500_RX_POLL_THRESHOLD, \
+    .rx_poll_budget = ETH_W5500_RX_POLL_BUDGET,     \
+    .int_level = ETH_W5500_INT_LEVEL,               \
+    .rx_task_core = -1,                             \
+    .rx_pipeline = ETH_W5500_RX_PIPELINE,           \
+    .offload_sockets = ETH_W5500_OFFLOAD_SOCKETS,   \
+    .mcast_filter = ETH_W5500_MCAST_FILTER,         \
+    .storm_limits = ETH_W5500_STORM_DEFAULT_LIMITS, \
+    .tx_bulk_share = ETH_W5500_TX_BULK_SHARE,       \
+  }
+
+////////////////////////////////////////
+
+// Buckets of the socket command latency histogram, bucket 0: < 8us, bucket n: 4 << n .. 8 << n us, last: above
+#define ETH_W5500_CMD_HIST_BUCKETS      12
+
+////////////////////////////////////////
+
+/**
+   @brief socket commands tracked by the command latency histogram
+
+*/
+typedef enum
+{
+  ETH_W5500_CMD_OPEN,
+  ETH_W5500_CMD_CLOSE,
+  ETH_W5500_CMD_SEND,
+  ETH_W5500_CMD_RECV,
+  ETH_W5500_CMD_MAX,
+} eth_w5500_cmd_t;
+
+////////////////////////////////////////
+
+/**
+   @brief completion latency of one socket command, from issuing it until Sn_CR reads back as cleared
+
+*/
+typedef struct
+{
+  uint32_t count;           /*!< Completed commands */
+  uint32_t max_us;          /*!< Slowest completion */
+  uint32_t buckets[ETH_W5500_CMD_HIST_BUCKETS]; /*!< Latency histogram, see ETH_W5500_CMD_HIST_BUCKETS */
+} eth_w5500_cmd_latency_t;
+
+// Buckets of the per class TX latency histogram, layout as ETH_W5500_CMD_HIST_BUCKETS, last: 32ms and above
+#define ETH_W5500_TX_HIST_BUCKETS       14
+
+/**
+   @brief TX counters and latency of one priority class, latency is from the transmit call until SEND_OK
+
+*/
+typedef struct
+{
+  uint32_t frames;          /*!< Frames sent */
+  uint32_t bytes;
+  uint32_t drops;           /*!< Frames refused with ESP_ERR_NO_MEM, part of tx_drops_no_mem */
+  uint32_t max_us;          /*!< Slowest frame */
+  uint64_t total_us;        /*!< Accumulated, divide by frames for the average */
+  uint32_t buckets[ETH_W5500_TX_HIST_BUCKETS]; /*!< Latency histogram, see ETH_W5500_TX_HIST_BUCKETS */
+} eth_w5500_tx_class_stats_t;
+
+////////////////////////////////////////
+
+/**
+   @brief one piece of a frame passed to esp_eth_mac_w5500_transmit_segments()
+
+*/
+typedef struct
+{
+  const void *buffer;
+  uint32_t length;
+} eth_w5500_tx_segment_t;
+
+////////////////////////////////////////
+
+/**
+   @brief Protocol of a hardware socket, Sn_MR values
+
+*/
+typedef enum
+{
+  ETH_W5500_SOCK_TCP = 0x01,
+  ETH_W5500_SOCK_UDP = 0x02,
+} eth_w5500_sock_proto_t;
+
+/**
+   @brief Hardware socket state, Sn_SR values
+
+*/
+typedef enum
+{
+  ETH_W5500_SOCK_CLOSED      = 0x00,
+  ETH_W5500_SOCK_INIT        = 0x13,
+  ETH_W5500_SOCK_LISTEN      = 0x14,
+  ETH_W5500_SOCK_SYNSENT     = 0x15,
+  ETH_W5500_SOCK_SYNRECV     = 0x16,
+  ETH_W5500_SOCK_ESTABLISHED = 0x17,
+  ETH_W5500_SOCK_FIN_WAIT    = 0x18,
+  ETH_W5500_SOCK_CLOSING     = 0x1A,
+  ETH_W5500_SOCK_TIME_WAIT   = 0x1B,
+  ETH_W5500_SOCK_CLOSE_WAIT  = 0x1C,
+  ETH_W5500_SOCK_LAST_ACK    = 0x1D,
+  ETH_W5500_SOCK_UDP_OPEN    = 0x22,
+} eth_w5500_sock_state_t;
+
+/**
+   @brief Hardware socket snapshot
+
+*/
+typedef struct
+{
+  eth_w5500_sock_state_t state;
+  uint32_t rx_size;         /*!< Bytes in the RX buffer, UDP: datagrams including their 8 byte headers */
+  uint32_t tx_free;         /*!< Free bytes in the TX buffer */
+} eth_w5500_sock_info_t;
+
+////////////////////////////////////////
+
+/**
+   @brief w5500 driver statistics
+
+*/
+typedef struct
+{
+  uint32_t rx_pool_hits;    /*!< RX frames received into a preallocated pool buffer */
+  uint32_t rx_pool_misses;  /*!< RX frames which had to fall back to heap allocation because the pool ran dry */
+  uint32_t rx_frames;       /*!< Frames passed to the stack */
+  uint32_t rx_bytes;        /*!< Bytes passed to the stack */
+  uint32_t rx_drops_no_mem; /*!< Frames left in the ring because no receive buffer could be allocated */
+  uint32_t rx_batches;      /*!< Batched RX drains, rx_frames / rx_batches is the number of frames per SPI burst */
+  uint32_t rx_bytes_copied; /*!< RX payload bytes copied inside the driver, only batched RX copies out of staging */
+  uint32_t rx_pipelined_frames; /*!< RX frames read by pipelined runs, payload chained with the next header */
+  uint32_t tx_frames;       /*!< Frames written to the w5500 TX ring */
+  uint32_t tx_bytes;        /*!< Bytes written to the w5500 TX ring */
+  uint32_t tx_drops_no_mem; /*!< Frames refused with ESP_ERR_NO_MEM because the TX ring / queue stayed full */
+  uint32_t tx_segmented_frames; /*!< Frames streamed from several segments (pbuf chain), no flattening copy */
+  uint32_t tx_timeout_drops;/*!< Queued frames dropped when SOCK0 was reopened after a SEND without SEND_OK */
+  uint32_t spi_transactions;/*!< SPI transactions issued to the w5500, divide by rx_frames + tx_frames for per packet */
+  uint32_t spi_queued_transactions; /*!< Part of spi_transactions queued to DMA while the task yields */
+  uint32_t spi_bytes;       /*!< Bytes clocked over SPI, address / control phase included */
+  uint32_t sock_status_retries; /*!< Socket status snapshots re-read because a pointer changed during the burst */
+  uint32_t cmd_timeouts;    /*!< Socket commands the w5500 didn't accept in time */
+  uint32_t spi_lock_acquisitions; /*!< SPI sessions, i.e. times the SPI lock and bus were taken */
+  uint32_t spi_lock_hold_max_us;  /*!< Longest time the SPI lock and bus were held by one session */
+  uint64_t spi_lock_hold_total_us;/*!< Accumulated SPI lock hold time */
+  uint32_t rx_wakeups;      /*!< RX task wakeups by the w5500 interrupt */
+  uint32_t rx_poll_entries; /*!< Switches from interrupt driven to polled RX */
+  uint32_t rx_poll_rounds;  /*!< Poll rounds run with the interrupt masked */
+  uint32_t offload_tx_bytes;/*!< Payload bytes sent through hardware TCP / UDP sockets, not part of tx_bytes */
+  uint32_t offload_rx_bytes;/*!< Payload bytes received through hardware TCP / UDP sockets, not part of rx_bytes */
+  uint32_t rx_mcast_drops;  /*!< Multicast frames of groups not subscribed, dropped before reaching the stack */
+  uint32_t rx_mcast_spi_bytes_saved; /*!< Payload bytes of those left in the ring unread, 0 in batched RX mode */
+  uint32_t rx_storm_drops[ETH_W5500_RX_CLASS_MAX]; /*!< Frames over their class limit, discarded in the ring */
+  uint32_t rx_storm_spi_bytes_saved; /*!< Payload bytes of those left in the ring unread, 0 in batched RX mode */
+  uint32_t rx_storm_episodes; /*!< Times a class started dropping after ETH_W5500_STORM_HOLD_MS without drops */
+  uint32_t raw_rx_frames;   /*!< Frames of a registered EtherType passed to their callback, not part of rx_frames */
+  uint32_t raw_rx_bytes;
+  uint32_t raw_rx_latency_max_us; /*!< Longest time from the w5500 RX interrupt to a raw callback */
+  uint64_t raw_rx_latency_total_us; /*!< Accumulated, divide by raw_rx_frames for the average */
+  eth_w5500_cmd_latency_t cmd_latency[ETH_W5500_CMD_MAX]; /*!< Per command latency, indexed by eth_w5500_cmd_t */
+  eth_w5500_tx_class_stats_t tx_class[ETH_W5500_TX_CLASS_MAX]; /*!< Per TX class, indexed by eth_w5500_tx_class_t */
+  uint32_t rate_window_ms;  /*!< Sliding window (up to ~8s) the rates below are computed over */
+  uint32_t rx_frames_per_s;
+  uint32_t tx_frames_per_s;
+  uint32_t rx_bytes_per_s;
+  uint32_t tx_bytes_per_s;
+} eth_w5500_stats_t;
+
+////////////////////////////////////////
+
+/**
+   @brief Handle of the netif glue between w5500 driver and esp-netif
+
+*/
+typedef struct w5500_netif_glue_s *esp_eth_w5500_netif_glue_handle_t;
+
 ////////////////////////////////////////
 
 /*
@@ -75,12 +483,12 @@ extern "C" {
    @brief Compute amount of SPI bit-cycles the CS should stay active after the transmission
           to meet w5500 CS Hold Time specification.
 
-   @param clock_speed_mhz SPI Clock frequency in MHz (valid range is <1, 20>)
-   @return uint8_t
+   @param clock_speed_mhz SPI Clock frequency in MHz (valid range is <1, 80>), round fractional clocks up
+   @return uint8_t, capped at ETH_W5500_CS_POSTTRANS_MAX
 */
 static inline uint8_t w5500_cal_spi_cs_hold_time(int clock_speed_mhz)
 {
-  if (clock_speed_mhz <= 0 || clock_speed_mhz > 20)
+  if (clock_speed_mhz <= 0 || clock_speed_mhz > ETH_W5500_SPI_CLOCK_MAX_MHZ)
   {
     return 0;
   }
@@ -93,7 +501,7 @@ static inline uint8_t w5500_cal_spi_cs_hold_time(int clock_speed_mhz)
     cs_posttrans += 1;
   }
 
-  return cs_posttrans;
+  return (cs_posttrans > ETH_W5500_CS_POSTTRANS_MAX) ? ETH_W5500_CS_POSTTRANS_MAX : cs_posttrans;
 }
 
 ////////////////////////////////////////
@@ -113,6 +521,375 @@ esp_eth_mac_t *esp_eth_mac_new_w5500(const eth_w5500_config_t *w5500_config,
 
 ////////////////////////////////////////
 
+/**
+  @brief Create w5500 Ethernet MAC instance with driver specific configuration
+
+  @param[in] w5500_config: w5500 specific configuration
+  @param[in] mac_config: Ethernet MAC configuration
+  @param[in] ext_config: w5500 driver specific configuration, NULL to use ETH_W5500_EXT_DEFAULT_CONFIG()
+
+  @return
+       - instance: create MAC instance successfully
+       - NULL: create MAC instance failed because some error occurred
+*/
+esp_eth_mac_t *esp_eth_mac_new_w5500_ext(const eth_w5500_config_t *w5500_config,
+                                         const eth_mac_config_t *mac_config,
+                                         const eth_w5500_ext_config_t *ext_config);
+
+////////////////////////////////////////
+
+/**
+  @brief Release a receive buffer handed to the stack by the w5500 driver
+
+  Every buffer holds a reference on the MAC instance, so this may be called after mac->del()
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] buffer: buffer passed to stack_input, either a pool buffer or a heap fallback
+*/
+void esp_eth_mac_w5500_free_rx_buffer(esp_eth_mac_t *mac, void *buffer);
+
+////////////////////////////////////////
+
+/**
+  @brief Transmit a frame given as a list of segments, e.g. a pbuf chain, without flattening it first.
+         Each segment is written straight into the w5500 TX ring.
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] segments: frame segments, in order
+  @param[in] count: number of segments
+
+  @return
+       - ESP_OK: frame queued / sent
+       - ESP_ERR_INVALID_ARG: invalid argument
+       - ESP_ERR_NO_MEM: no room in the TX ring
+       - ESP_FAIL / ESP_ERR_TIMEOUT: SPI access or SEND failed
+*/
+esp_err_t esp_eth_mac_w5500_transmit_segments(esp_eth_mac_t *mac, const eth_w5500_tx_segment_t *segments,
+                                             uint32_t count);
+
+////////////////////////////////////////
+
+/**
+  @brief Get a snapshot of w5500 driver statistics
+
+  @param[in] mac: w5500 MAC instance
+  @param[out] stats: statistics
+
+  @return
+       - ESP_OK: statistics copied
+       - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_mac_w5500_get_stats(esp_eth_mac_t *mac, eth_w5500_stats_t *stats);
+
+////////////////////////////////////////
+
+/**
+  @brief Clear w5500 driver statistics and restart the rate window
+
+  @param[in] mac: w5500 MAC instance
+
+  @return
+       - ESP_OK: statistics cleared
+       - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_mac_w5500_reset_stats(esp_eth_mac_t *mac);
+
+////////////////////////////////////////
+
+/**
+  @brief Change the w5500 interrupt re-assert delay (INTLEVEL register) at runtime
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] int_level: INTLEVEL value, see ETH_W5500_INT_LEVEL
+
+  @return
+       - ESP_OK: INTLEVEL written
+       - ESP_ERR_INVALID_ARG: invalid argument
+       - ESP_FAIL / ESP_ERR_TIMEOUT: SPI access failed
+*/
+esp_err_t esp_eth_mac_w5500_set_int_level(esp_eth_mac_t *mac, uint16_t int_level);
+
+////////////////////////////////////////
+
+/**
+  @brief Tune the adaptive interrupt / polled RX mode at runtime
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] threshold: frames per interrupt wakeup switching to polled mode, 0 => interrupts only
+  @param[in] budget: frames per poll round before the RX task yields
+
+  @return
+       - ESP_OK: settings applied, from the next wakeup of the RX task
+       - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_mac_w5500_set_rx_poll(esp_eth_mac_t *mac, uint32_t threshold, uint32_t budget);
+
+////////////////////////////////////////
+
+/**
+  @brief Read the current PHY link state straight from the w5500, independent of the esp_eth link check period
+
+  @param[in] mac: w5500 MAC instance
+  @param[out] link: ETH_LINK_UP / ETH_LINK_DOWN
+
+  @return
+       - ESP_OK: link read
+       - ESP_ERR_INVALID_ARG: invalid argument
+       - ESP_FAIL / ESP_ERR_TIMEOUT: SPI access failed
+*/
+esp_err_t esp_eth_mac_w5500_get_link(esp_eth_mac_t *mac, eth_link_t *link);
+
+////////////////////////////////////////
+
+/**
+  @brief Switch pipelined RX on or off at runtime, see eth_w5500_ext_config_t::rx_pipeline
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] enable: true => pipelined RX, false => batched or per frame RX as configured
+
+  @return
+       - ESP_OK: applied from the next RX drain
+       - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_mac_w5500_set_rx_pipeline(esp_eth_mac_t *mac, bool enable);
+
+////////////////////////////////////////
+
+/**
+  @brief Time the last MAC init spent on the chip itself, part of the boot timing report
+
+  @param[in] mac: w5500 MAC instance
+  @param[out] reset_us: software reset, from writing MR.RST until the chip cleared it
+  @param[out] setup_us: default register setup (socket buffers, MAC RAW mode, interrupts)
+
+  @return
+       - ESP_OK: timing read, both 0 before esp_eth_driver_install()
+       - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_mac_w5500_get_init_timing(esp_eth_mac_t *mac, uint32_t *reset_us, uint32_t *setup_us);
+
+////////////////////////////////////////
+
+/**
+  @brief Subscribe to / unsubscribe from a multicast MAC address, for lwIP's igmp_mac_filter / mld_mac_filter hooks
+
+  Subscriptions are counted, an address passes until it has been removed as often as it was added. Once more than
+  ETH_W5500_MCAST_FILTER_SIZE addresses are subscribed, all multicast passes until the excess is removed again.
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] addr: multicast MAC address (6 bytes, I/G bit set)
+  @param[in] add: true => subscribe, false => unsubscribe
+
+  @return
+       - ESP_OK: filter updated
+       - ESP_ERR_INVALID_ARG: NULL pointer or not a multicast address
+       - ESP_ERR_NOT_FOUND: address to remove was never added
+*/
+esp_err_t esp_eth_mac_w5500_mcast_filter(esp_eth_mac_t *mac, const uint8_t *addr, bool add);
+
+/**
+  @brief Forget every multicast subscription, e.g. before re-adding the groups of a restarted netif
+*/
+esp_err_t esp_eth_mac_w5500_mcast_filter_clear(esp_eth_mac_t *mac);
+
+/**
+  @brief Change the RX storm limit of one traffic class at run time, the bucket starts full
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] rx_class: traffic class
+  @param[in] limit: frames per second and burst, rate 0 => not limited
+
+  @return
+       - ESP_OK / ESP_ERR_INVALID_ARG
+*/
+esp_err_t esp_eth_mac_w5500_set_storm_limit(esp_eth_mac_t *mac, eth_w5500_rx_class_t rx_class,
+                                            const eth_w5500_storm_limit_t *limit);
+
+/**
+  @brief Traffic classes in a storm: frames dropped by the limiter within the last ETH_W5500_STORM_HOLD_MS
+
+  @param[in] mac: w5500 MAC instance
+  @param[out] classes: bit (1 << eth_w5500_rx_class_t) set per class being limited, 0 => no storm
+
+  @return
+       - ESP_OK / ESP_ERR_INVALID_ARG
+*/
+esp_err_t esp_eth_mac_w5500_get_storm(esp_eth_mac_t *mac, uint32_t *classes);
+
+/**
+  @brief Deliver the received frames of one EtherType to a callback instead of the stack (lwIP)
+
+  The frames pass the multicast filter and the storm limiter first, there's no copy between the SPI read and the
+  callback. Send with esp_eth_transmit(), frames go out as given.
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] ether_type: EtherType in host byte order, e.g. 0x88B5
+  @param[in] cb: callback, NULL => unregister the EtherType
+  @param[in] arg: passed to the callback
+
+  @return
+       - ESP_OK: (un)registered
+       - ESP_ERR_INVALID_ARG: mac NULL, or EtherType below 0x0600 (a length field)
+       - ESP_ERR_NO_MEM: ETH_W5500_ETHERTYPE_HANDLERS_MAX EtherTypes registered already
+       - ESP_ERR_NOT_FOUND: EtherType to unregister not registered
+*/
+esp_err_t esp_eth_mac_w5500_register_ethertype(esp_eth_mac_t *mac, uint16_t ether_type, eth_w5500_ethertype_cb_t cb,
+                                               void *arg);
+
+/**
+  @brief Set the TX classifier hook, consulted before the default DSCP / VLAN PCP classification
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] classifier: hook, NULL => default classification only
+  @param[in] arg: passed to the hook
+
+  @return
+       - ESP_OK / ESP_ERR_INVALID_ARG
+*/
+esp_err_t esp_eth_mac_w5500_set_tx_classifier(esp_eth_mac_t *mac, eth_w5500_tx_classifier_t classifier, void *arg);
+
+////////////////////////////////////////
+
+/*
+  Hardware socket offload (eth_w5500_ext_config_t::offload_sockets > 0)
+
+  Sockets 1 - n run the w5500's own TCP / UDP engine next to the MACRAW socket 0: segmentation, ACKs and
+  retransmissions happen in the chip, the ESP32 only moves payload over SPI. Frames for a port bound to a hardware
+  socket never reach socket 0 (and lwIP), everything else does. The chip shares lwIP's MAC and IPv4 address, set with
+  esp_eth_mac_w5500_set_ip(). Ports picked for outgoing connections come from 0x8000 - 0xBFFF, below lwIP's
+  ephemeral range. The calls may block for a few milliseconds (SPI session, command completion), not from an ISR.
+*/
+
+/**
+  @brief Set the IPv4 address, netmask and gateway the hardware sockets use (network byte order, as esp_ip4_addr_t)
+
+  @return
+       - ESP_OK / ESP_ERR_INVALID_ARG / ESP_FAIL / ESP_ERR_TIMEOUT
+*/
+esp_err_t esp_eth_mac_w5500_set_ip(esp_eth_mac_t *mac, uint32_t ip, uint32_t netmask, uint32_t gw);
+
+/**
+  @brief Open a free hardware socket
+
+  @param[in] mac: w5500 MAC instance
+  @param[in] proto: TCP or UDP
+  @param[in] port: local port, 0 => pick one (outgoing TCP connections)
+  @param[out] sock: socket number (1 - offload_sockets)
+
+  @return
+       - ESP_OK: socket open (TCP: INIT, UDP: ready to send / receive)
+       - ESP_ERR_NOT_FOUND: no free hardware socket
+       - ESP_ERR_INVALID_ARG / ESP_FAIL / ESP_ERR_TIMEOUT
+*/
+esp_err_t esp_eth_mac_w5500_sock_open(esp_eth_mac_t *mac, eth_w5500_sock_proto_t proto, uint16_t port,
+                                      uint8_t *sock);
+
+/**
+  @brief Wait for an incoming connection (TCP socket in INIT), see esp_eth_mac_w5500_sock_info() for its arrival
+*/
+esp_err_t esp_eth_mac_w5500_sock_listen(esp_eth_mac_t *mac, uint8_t sock);
+
+/**
+  @brief Start connecting a TCP socket in INIT, ESTABLISHED (or CLOSED on failure) shows up in the socket state
+*/
+esp_err_t esp_eth_mac_w5500_sock_connect(esp_eth_mac_t *mac, uint8_t sock, uint32_t ip, uint16_t port);
+
+/**
+  @brief Start a graceful TCP close (FIN), the socket stays allocated until esp_eth_mac_w5500_sock_close()
+*/
+esp_err_t esp_eth_mac_w5500_sock_disconnect(esp_eth_mac_t *mac, uint8_t sock);
+
+/**
+  @brief Close a socket at once (TCP: RST if still connected) and give it back
+*/
+esp_err_t esp_eth_mac_w5500_sock_close(esp_eth_mac_t *mac, uint8_t sock);
+
+/**
+  @brief Read state, received and free sizes of a socket
+*/
+esp_err_t esp_eth_mac_w5500_sock_info(esp_eth_mac_t *mac, uint8_t sock, eth_w5500_sock_info_t *info);
+
+/**
+  @brief Read the peer of a socket (network byte order address, host order port)
+*/
+esp_err_t esp_eth_mac_w5500_sock_remote(esp_eth_mac_t *mac, uint8_t sock, uint32_t *ip, uint16_t *port);
+
+/**
+  @brief Queue TCP payload, as much as fits the socket's TX buffer
+
+  @param[out] sent: bytes taken, 0 when the TX buffer is full
+
+  @return
+       - ESP_OK: *sent bytes handed to the chip
+       - ESP_ERR_INVALID_STATE: not connected
+       - ESP_ERR_INVALID_ARG / ESP_FAIL / ESP_ERR_TIMEOUT
+*/
+esp_err_t esp_eth_mac_w5500_sock_send(esp_eth_mac_t *mac, uint8_t sock, const void *buffer, uint32_t length,
+                                      uint32_t *sent);
+
+/**
+  @brief Send one UDP datagram and wait until it left (or ARP for the destination failed)
+
+  @return
+       - ESP_OK: sent
+       - ESP_ERR_INVALID_SIZE: larger than the socket's TX buffer
+       - ESP_ERR_TIMEOUT: destination unreachable (ARP timeout) or TX buffer stayed full
+       - ESP_ERR_INVALID_ARG / ESP_FAIL
+*/
+esp_err_t esp_eth_mac_w5500_sock_sendto(esp_eth_mac_t *mac, uint8_t sock, const void *buffer, uint32_t length,
+                                        uint32_t ip, uint16_t port);
+
+/**
+  @brief Read up to length bytes of received TCP payload
+
+  @param[out] received: bytes read, 0 when nothing is waiting
+*/
+esp_err_t esp_eth_mac_w5500_sock_recv(esp_eth_mac_t *mac, uint8_t sock, void *buffer, uint32_t length,
+                                      uint32_t *received);
+
+/**
+  @brief Read the next UDP datagram, the part not fitting into buffer is dropped
+
+  @param[out] received: bytes stored, 0 when no datagram is waiting
+  @param[out] size: datagram size as received
+  @param[out] ip: sender address (network byte order)
+  @param[out] port: sender port
+*/
+esp_err_t esp_eth_mac_w5500_sock_recvfrom(esp_eth_mac_t *mac, uint8_t sock, void *buffer, uint32_t length,
+                                          uint32_t *received, uint32_t *size, uint32_t *ip, uint16_t *port);
+
+////////////////////////////////////////
+
+/**
+  @brief Create the glue between w5500 driver and esp-netif.
+         Same as esp_eth_new_netif_glue(), but returns receive buffers to the w5500 RX pool.
+         The glue drives its esp-netif from the Ethernet events of eth_hdl only, so several w5500 instances can run
+         side by side. Don't install the default Ethernet handlers (tcpip_adapter_set_default_eth_handlers()) too.
+
+  @param[in] eth_hdl: Ethernet driver handle
+  @param[in] mac: w5500 MAC instance installed in eth_hdl
+
+  @return
+       - glue handle, to be passed to esp_netif_attach()
+       - NULL: no mem
+*/
+esp_eth_w5500_netif_glue_handle_t esp_eth_w5500_new_netif_glue(esp_eth_handle_t eth_hdl, esp_eth_mac_t *mac);
+
+////////////////////////////////////////
+
+/**
+  @brief Delete the glue between w5500 driver and esp-netif.
+         The glue is freed once lwIP has released the last frame it received through it.
+
+  @param[in] glue: glue handle
+
+  @return
+       - ESP_OK: delete netif glue successfully
+*/
+esp_err_t esp_eth_w5500_del_netif_glue(esp_eth_w5500_netif_glue_handle_t glue);
+
+////////////////////////////////////////
+
 /**
   @brief Create a PHY instance of w5500
 
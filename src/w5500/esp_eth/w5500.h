@@ -64,7 +64,10 @@
 ////////////////////////////////////////
 
 #define W5500_REG_MR        W5500_MAKE_MAP(0x0000, W5500_BSB_COM_REG) // Mode
+#define W5500_REG_GAR       W5500_MAKE_MAP(0x0001, W5500_BSB_COM_REG) // Gateway IP Address, SUBR follows
+#define W5500_REG_SUBR      W5500_MAKE_MAP(0x0005, W5500_BSB_COM_REG) // Subnet Mask
 #define W5500_REG_MAC       W5500_MAKE_MAP(0x0009, W5500_BSB_COM_REG) // MAC Address
+#define W5500_REG_SIPR      W5500_MAKE_MAP(0x000F, W5500_BSB_COM_REG) // Source IP Address
 #define W5500_REG_INTLEVEL  W5500_MAKE_MAP(0x0013, W5500_BSB_COM_REG) // Interrupt Level Timeout
 #define W5500_REG_IR        W5500_MAKE_MAP(0x0015, W5500_BSB_COM_REG) // Interrupt
 #define W5500_REG_IMR       W5500_MAKE_MAP(0x0016, W5500_BSB_COM_REG) // Interrupt Mask
@@ -80,7 +83,10 @@
 #define W5500_REG_SOCK_MR(s)         W5500_MAKE_MAP(0x0000, W5500_BSB_SOCK_REG(s)) // Socket Mode
 #define W5500_REG_SOCK_CR(s)         W5500_MAKE_MAP(0x0001, W5500_BSB_SOCK_REG(s)) // Socket Command
 #define W5500_REG_SOCK_IR(s)         W5500_MAKE_MAP(0x0002, W5500_BSB_SOCK_REG(s)) // Socket Interrupt
-#define W5500_REG_SOCK_SR(s)         W5500_MAKE_MAP(0x0004, W5500_BSB_SOCK_REG(s)) // Socket Status
+#define W5500_REG_SOCK_SR(s)         W5500_MAKE_MAP(0x0003, W5500_BSB_SOCK_REG(s)) // Socket Status
+#define W5500_REG_SOCK_PORT(s)       W5500_MAKE_MAP(0x0004, W5500_BSB_SOCK_REG(s)) // Socket Source Port
+#define W5500_REG_SOCK_DIPR(s)       W5500_MAKE_MAP(0x000C, W5500_BSB_SOCK_REG(s)) // Socket Destination IP
+#define W5500_REG_SOCK_DPORT(s)      W5500_MAKE_MAP(0x0010, W5500_BSB_SOCK_REG(s)) // Socket Destination Port
 #define W5500_REG_SOCK_RXBUF_SIZE(s) W5500_MAKE_MAP(0x001E, W5500_BSB_SOCK_REG(s)) // Socket Receive Buffer Size
 #define W5500_REG_SOCK_TXBUF_SIZE(s) W5500_MAKE_MAP(0x001F, W5500_BSB_SOCK_REG(s)) // Socket Transmit Buffer Size
 #define W5500_REG_SOCK_TX_FSR(s)     W5500_MAKE_MAP(0x0020, W5500_BSB_SOCK_REG(s)) // Socket TX Free Size
@@ -107,20 +113,28 @@
 
 ////////////////////////////////////////
 
+#define W5500_SMR_TCP        (0x01) // TCP mode
+#define W5500_SMR_UDP        (0x02) // UDP mode
 #define W5500_SMR_MAC_RAW    (1<<2) // MAC RAW mode
 #define W5500_SMR_MAC_FILTER (1<<7) // MAC filter
 
 ////////////////////////////////////////
 
-#define W5500_SCR_OPEN  (0x01) // Open command
-#define W5500_SCR_CLOSE (0x10) // Close command
-#define W5500_SCR_SEND  (0x20) // Send command
-#define W5500_SCR_RECV  (0x40) // Recv command
+#define W5500_SCR_OPEN    (0x01) // Open command
+#define W5500_SCR_LISTEN  (0x02) // Listen command (TCP server)
+#define W5500_SCR_CONNECT (0x04) // Connect command (TCP client)
+#define W5500_SCR_DISCON  (0x08) // Disconnect command (TCP FIN)
+#define W5500_SCR_CLOSE   (0x10) // Close command
+#define W5500_SCR_SEND    (0x20) // Send command
+#define W5500_SCR_RECV    (0x40) // Recv command
 
 ////////////////////////////////////////
 
-#define W5500_SIR_RECV (1<<2)  // Receive done
-#define W5500_SIR_SEND (1<<4)  // Send done
+#define W5500_SIR_CON     (1<<0) // Connection established
+#define W5500_SIR_DISCON  (1<<1) // FIN or RST received
+#define W5500_SIR_RECV    (1<<2) // Receive done
+#define W5500_SIR_TIMEOUT (1<<3) // ARP or TCP retransmission timeout
+#define W5500_SIR_SEND    (1<<4) // Send done
 
 ////////////////////////////////////////
 